@@ -21,6 +21,7 @@
 #define IRMO_ALGO_ALGO_H 
 
 #include "arraylist.h"
+#include "binary-heap.h"
 #include "compare-pointer.h"
 #include "compare-string.h"
 #include "hash-pointer.h"
@@ -87,7 +87,7 @@ unsigned int irmo_struct_member_get_int(IrmoStructMember *member,
                         irmo_warning_message(
                                 "irmo_struct_member_get_int",
                                 "Structure member '%s' has unsupported "
-                                "size: '%i'", member->size);
+                                "size: '%lu'", member->name, member->size);
                         return 0;
         }
 }
@@ -116,7 +116,55 @@ void irmo_struct_member_set_int(IrmoStructMember *member, void *structure,
                         irmo_warning_message(
                                 "irmo_struct_member_set_int",
                                 "Structure member '%s' has unsupported "
-                                "size: '%i'", member->size);
+                                "size: '%lu'", member->name, member->size);
+                        break;
+        }
+}
+
+float irmo_struct_member_get_float(IrmoStructMember *member,
+                                   void *structure)
+{
+        void *member_value;
+
+        member_value = MEMBER_PTR(member, structure);
+
+        switch (member->size) {
+                case sizeof(float):
+                        return *((float *) member_value);
+
+                case sizeof(double):
+                        return (float) *((double *) member_value);
+
+                default:
+                        irmo_warning_message(
+                                "irmo_struct_member_get_float",
+                                "Structure member '%s' has unsupported "
+                                "size: '%lu'", member->name, member->size);
+                        return 0;
+        }
+}
+
+void irmo_struct_member_set_float(IrmoStructMember *member, void *structure,
+                                  float value)
+{
+        void *member_value;
+
+        member_value = MEMBER_PTR(member, structure);
+
+        switch (member->size) {
+                case sizeof(float):
+                        *((float *) member_value) = value;
+                        break;
+
+                case sizeof(double):
+                        *((double *) member_value) = value;
+                        break;
+
+                default:
+                        irmo_warning_message(
+                                "irmo_struct_member_set_float",
+                                "Structure member '%s' has unsupported "
+                                "size: '%lu'", member->name, member->size);
                         break;
         }
 }
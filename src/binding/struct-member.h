@@ -100,5 +100,29 @@ unsigned int irmo_struct_member_get_int(IrmoStructMember *member,
 void irmo_struct_member_set_int(IrmoStructMember *member, void *structure,
                                 unsigned int value);
 
+/*!
+ * Get the value of a structure member (floating point type).  The
+ * member may be a float or a double.
+ *
+ * @param member         The structure member.
+ * @param structure      Pointer to the structure.
+ * @return               The value.
+ */
+
+float irmo_struct_member_get_float(IrmoStructMember *member,
+                                   void *structure);
+
+/*!
+ * Set the value of a structure member (floating point type).  The
+ * member may be a float or a double.
+ *
+ * @param member         The structure member.
+ * @param structure      Pointer to the structure.
+ * @param value          The value to set.
+ */
+
+void irmo_struct_member_set_float(IrmoStructMember *member, void *structure,
+                                  float value);
+
 #endif /* #ifndef IRMO_BINDING_STRUCT_MEMBER_H */
 
@@ -164,6 +164,183 @@ int irmo_client_ping_time(IrmoClient *client);
 
 void irmo_client_set_max_sendwindow(IrmoClient *client, unsigned int max);
 
+/*!
+ * Set the congestion control algorithm used when sending to a client.
+ * The algorithm restarts from its initial state, as though the
+ * client had just connected.
+ *
+ * @param client   The client.
+ * @param cc       The congestion control algorithm.
+ */
+
+void irmo_client_set_congestion_control(IrmoClient *client,
+                                        IrmoCongestionControl cc);
+
+/*!
+ * Set the maximum time that acknowledgements of data received from a
+ * client are delayed for, waiting for data to send them with.  See
+ * @ref irmo_server_set_ack_delay.  This can also be used on an
+ * @ref IrmoConnection.
+ *
+ * @param client   The client.
+ * @param ms       Maximum delay, in milliseconds.  If zero,
+ *                 acknowledgements are never delayed.
+ */
+
+void irmo_client_set_ack_delay(IrmoClient *client, unsigned int ms);
+
+/*!
+ * Set the maximum size of the packets sent to and from a remote
+ * server.  This must be used on an @ref IrmoConnection before it is
+ * first run; the size is negotiated with the server when the
+ * connection is made.  See @ref irmo_server_set_mtu.
+ *
+ * @param client   The connection.
+ * @param mtu      Maximum packet size, in bytes.
+ */
+
+void irmo_client_set_mtu(IrmoClient *client, unsigned int mtu);
+
+/*!
+ * Set whether to use the compact wire format when talking to a remote
+ * server.  In the compact format, packet headers are smaller, and
+ * object IDs and integer values are sent as variable-length integers
+ * so that small values take fewer bytes.  This must be used on an
+ * @ref IrmoConnection before it is first run; the server switches to
+ * the same format for the connection if it supports it.
+ *
+ * @param client   The connection.
+ * @param compact  Non-zero to use the compact format.
+ */
+
+void irmo_client_set_compact(IrmoClient *client, int compact);
+
+/*!
+ * Set whether to probe for the largest packet size that reaches a
+ * client.  See @ref irmo_server_set_mtu_probing.  This can also be
+ * used on an @ref IrmoConnection.
+ *
+ * @param client   The client.
+ * @param probe    Non-zero to enable probing.
+ */
+
+void irmo_client_set_mtu_probing(IrmoClient *client, int probe);
+
+/*!
+ * Set whether to send forward error correction data to a client.
+ * See @ref irmo_server_set_fec.  This can also be used on an
+ * @ref IrmoConnection.
+ *
+ * @param client   The client.
+ * @param fec      Non-zero to enable forward error correction.
+ */
+
+void irmo_client_set_fec(IrmoClient *client, int fec);
+
+/*!
+ * Set the limit on the size of the table of strings sent to a client.
+ * See @ref irmo_server_set_string_table_size.  This can also be used
+ * on an @ref IrmoConnection.
+ *
+ * @param client   The client.
+ * @param bytes    Limit on the total size of the strings in the
+ *                 table, in bytes.  If zero, strings are always sent
+ *                 in full.
+ */
+
+void irmo_client_set_string_table_size(IrmoClient *client,
+                                       unsigned int bytes);
+
+/*!
+ * Get the maximum size of the packets currently being sent to a
+ * client.
+ *
+ * @param client   The client.
+ * @return         Maximum packet size, in bytes.
+ */
+
+unsigned int irmo_client_get_mtu(IrmoClient *client);
+
+/*!
+ * Set a callback function to weight the objects sent to a client.
+ *
+ * When the send window is too small to send every change as soon
+ * as it is made, changed objects must wait their turn.  Every time
+ * the client is run, each object with changes waiting accumulates
+ * the weight returned by the callback function, and the objects with
+ * the highest accumulated weight are sent first.  When an object
+ * is sent, its accumulated weight is reset to zero.  Important
+ * objects are therefore updated more frequently, while unimportant
+ * objects are still updated eventually.
+ *
+ * This only has an effect when the server is using the
+ * @ref IRMO_REPLICATION_DIRTY_MASK replication mode.  If no callback
+ * function is set, changed objects are sent in the order in which
+ * they were changed.
+ *
+ * @param client     The client.
+ * @param callback   The callback function, or NULL to send changed
+ *                   objects in order.
+ * @param user_data  Extra data to pass to the callback function.
+ */
+
+void irmo_client_set_priority_callback(IrmoClient *client,
+                                       IrmoPriorityCallback callback,
+                                       void *user_data);
+
+/*!
+ * Set a filter function to decide which objects are sent to a client.
+ *
+ * By default, every object in the world being served is sent to
+ * every client.  For large worlds, a client is often only interested
+ * in a small part of the world (for example, the objects close to
+ * the player).  If a filter function is set, only the objects for
+ * which it returns non-zero are sent to the client, and changes to
+ * other objects are ignored.
+ *
+ * When an object becomes relevant, it is created at the remote end
+ * along with its complete state.  When an object stops being
+ * relevant, it is destroyed at the remote end.  The filter is
+ * evaluated for an object whenever it is created or changed; if the
+ * relevance of objects changes for some other reason (for example,
+ * the player moves), call @ref irmo_client_update_relevance.
+ *
+ * The filter is applied to the initial world state sent to the
+ * client if it is set from the server's connect callback (see
+ * @ref irmo_server_watch_connect).
+ *
+ * The filter saves bandwidth, but not all of the server's work: it
+ * is called for every object changed since the last
+ * @ref irmo_server_run, once for each client that has a filter, so
+ * the cost of changes grows with the number of clients.  The filter
+ * should therefore be cheap; an object's relevance is only
+ * evaluated once per client in each run, however many times it
+ * changes.  The bench-relevance program in the tests directory
+ * measures the cost for large worlds.
+ *
+ * @param client     The client.
+ * @param callback   The filter function, or NULL to send all objects.
+ * @param user_data  Extra data to pass to the filter function.
+ */
+
+void irmo_client_set_relevance_filter(IrmoClient *client,
+                                      IrmoRelevanceCallback callback,
+                                      void *user_data);
+
+/*!
+ * Re-evaluate the relevance filter for every object in the world
+ * being served to a client.
+ *
+ * Objects that have become relevant are sent to the client, and
+ * objects that are no longer relevant are destroyed at the remote end.
+ * The filter is called for every object in the world, so this should
+ * not be called for every client on every run in large worlds.
+ *
+ * @param client     The client.
+ */
+
+void irmo_client_update_relevance(IrmoClient *client);
+
 /*!
  * Get the remote address of a client.
  *
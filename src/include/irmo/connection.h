@@ -116,6 +116,30 @@ void irmo_connection_run(IrmoConnection *conn);
 
 void irmo_connection_block(IrmoConnection *conn, int timeout);
 
+/*!
+ * Set whether a variable is received from a remote server.
+ *
+ * By default, changes to every variable of every object in the remote
+ * world are received.  If a client does not need some variables,
+ * it can unsubscribe from them, and the server will never send them.
+ * Unsubscribed variables keep their default values in the local copy
+ * of the remote world.
+ *
+ * Subscriptions are sent to the server when connecting, so this must
+ * be called before the connection is first run.  Subclasses have
+ * separate subscriptions to their parent classes.
+ *
+ * @param conn        The connection.
+ * @param class_name  Name of the class containing the variable.
+ * @param var_name    Name of the variable.
+ * @param subscribed  If non-zero, the variable is received; if zero,
+ *                    it is not.
+ */
+
+void irmo_connection_set_subscribed(IrmoConnection *conn,
+                                    char *class_name, char *var_name,
+                                    int subscribed);
+
 /*!
  * Get the world object for a remote server.
  *
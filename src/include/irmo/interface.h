@@ -274,6 +274,41 @@ IrmoClassVar *irmo_class_new_variable(IrmoClass *klass,
                                       char *var_name,
                                       IrmoValueType var_type);
 
+/*!
+ * Create a new quantized variable (@ref IRMO_TYPE_QUANTIZED) in the
+ * given class.  The range is divided into evenly spaced steps no
+ * further apart than the precision.  Values of the variable are
+ * rounded to the nearest step and clamped to the range, so that they
+ * can be sent in the smallest number of bits.
+ *
+ * @param klass         The @ref IrmoClass object representing the class.
+ * @param var_name      The name of the new variable.
+ * @param min           The minimum value.
+ * @param max           The maximum value.
+ * @param precision     The largest difference allowed between
+ *                      successive values.
+ *
+ * @return              A pointer to the new IrmoClassVar object, or
+ *                      NULL if the range is invalid.
+ */
+
+IrmoClassVar *irmo_class_new_quantized_variable(IrmoClass *klass,
+                                                char *var_name,
+                                                float min, float max,
+                                                float precision);
+
+/*!
+ * Set whether the variables of a class are unreliable.  This applies
+ * to the variables declared in the class, including those declared
+ * afterwards, but not to those inherited from a parent class.  See
+ * @ref irmo_class_var_set_unreliable.
+ *
+ * @param klass         The class.
+ * @param unreliable    Non-zero to make the variables unreliable.
+ */
+
+void irmo_class_set_unreliable(IrmoClass *klass, int unreliable);
+
 /*!
  * Add a reference to a @ref IrmoClass object.
  */
@@ -324,6 +359,48 @@ char *irmo_class_var_get_name(IrmoClassVar *var);
 
 IrmoValueType irmo_class_var_get_type(IrmoClassVar *var);
 
+/*!
+ * Get the range of values of a quantized class variable.  See
+ * @ref irmo_class_new_quantized_variable.
+ *
+ * @param var           The class variable.
+ * @return              The range, or NULL if the variable is not
+ *                      quantized.
+ */
+
+IrmoValueRange *irmo_class_var_get_range(IrmoClassVar *var);
+
+/*!
+ * Set whether a class variable is unreliable.
+ *
+ * Changes to normal variables are delivered reliably and in order.
+ * Changes to unreliable variables are sent once, outside of the
+ * reliable stream, and changes older than one already received are
+ * ignored.  If a change is lost, it is not retransmitted; only the
+ * latest value is sent again, if a newer change has not been sent
+ * already.  This suits values that change frequently, such as
+ * positions, where an old value is useless once a newer one exists.
+ *
+ * The initial value of an object's variables is always delivered
+ * reliably.  Both ends of a connection must agree on which variables
+ * are unreliable.
+ *
+ * @param var           The class variable.
+ * @param unreliable    Non-zero to make the variable unreliable.
+ */
+
+void irmo_class_var_set_unreliable(IrmoClassVar *var, int unreliable);
+
+/*!
+ * Find whether a class variable is unreliable.  See
+ * @ref irmo_class_var_set_unreliable.
+ *
+ * @param var           The class variable.
+ * @return              Non-zero if the variable is unreliable.
+ */
+
+int irmo_class_var_is_unreliable(IrmoClassVar *var);
+
 /*!
  * Add a reference to an @ref IrmoClassVar object.
  */
@@ -395,7 +472,8 @@ IrmoIterator *irmo_method_iterate_arguments(IrmoMethod *method);
  *
  * @param method        The method.
  * @param arg_name      The name of the new argument.
- * @param arg_type      The type of the new argument.
+ * @param arg_type      The type of the new argument.  Arguments
+ *                      cannot be quantized.
  *
  * @return              A new @ref IrmoMethodArg object.
  */
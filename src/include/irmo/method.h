@@ -81,6 +81,20 @@ char *irmo_method_arg_string(IrmoMethodData *data, char *argname);
 
 unsigned int irmo_method_arg_int(IrmoMethodData *data, char *argname);
 
+/*!
+ * Retrieve a method argument.
+ *
+ * Get the value of a floating point argument to a method from the
+ * method callback function.
+ *
+ * @param data    A @ref IrmoMethodData object containing information about
+ *                the method call.
+ * @param argname The name of the method argument.
+ * @return        The value of the method argument.
+ */
+
+float irmo_method_arg_float(IrmoMethodData *data, char *argname);
+
 /*!
  * Find the client which invoked a method.
  *
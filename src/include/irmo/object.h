@@ -145,6 +145,20 @@ void irmo_object_set_int(IrmoObject *object, char *variable,
 
 void irmo_object_set_string(IrmoObject *object, char *variable, char *value);
 
+/*!
+ * Set the value of an object's member variable (floating point type).
+ *
+ * This is for use on variables of float32 or quantized type.  Values
+ * of quantized variables are rounded to the precision of the variable
+ * and clamped to its range.
+ *
+ * @param object     The object to change.
+ * @param variable   The name of the variable to change.
+ * @param value      The new value for the variable.
+ */
+
+void irmo_object_set_float(IrmoObject *object, char *variable, float value);
+
 /*!
  * Get the value of an object's member variable (generic).
  *
@@ -191,6 +205,18 @@ unsigned int irmo_object_get_int(IrmoObject *object, char *variable);
 
 char *irmo_object_get_string(IrmoObject *object, char *variable);
 
+/*!
+ * Get the value of an object's member variable (floating point type).
+ *
+ * This function is for variables of float32 or quantized type.
+ *
+ * @param object     The object to query.
+ * @param variable   The name of the member variable.
+ * @return           The value of the member variable.
+ */
+
+float irmo_object_get_float(IrmoObject *object, char *variable);
+
 /*!
  * Get the @ref IrmoWorld world that an object belongs to.
  *
@@ -109,6 +109,65 @@ int irmo_packet_writei32(IrmoPacket *packet, unsigned int i);
 
 int irmo_packet_writestring(IrmoPacket *packet, char *s);
 
+/*!
+ * Write a block of raw data to the packet.
+ *
+ * @param packet     The packet to write to.
+ * @param data       Pointer to the data to write.
+ * @param data_len   Length of the data, in bytes.
+ * @return           Non-zero if successful.
+ */
+
+int irmo_packet_writebytes(IrmoPacket *packet, unsigned char *data,
+                           unsigned int data_len);
+
+/*!
+ * Write an unsigned integer to the packet in a variable-length
+ * encoding.  Seven bits are stored in each byte, low bits first, and
+ * the top bit of each byte is set if more bytes follow.  Values below
+ * 128 take a single byte; the largest 32-bit values take five.
+ *
+ * @param packet     The packet to write to.
+ * @param i          Value to write.
+ * @return           Non-zero if successful.
+ */
+
+int irmo_packet_writevarint(IrmoPacket *packet, unsigned int i);
+
+/*!
+ * Write a 16-bit integer to the packet.  If the packet is in the
+ * compact format (see @ref irmo_packet_set_compact), the value is
+ * written using @ref irmo_packet_writevarint; otherwise, it is
+ * written in the same way as @ref irmo_packet_writei16.
+ *
+ * @param packet     The packet to write to.
+ * @param i          Value to write.
+ * @return           Non-zero if successful.
+ */
+
+int irmo_packet_writei16v(IrmoPacket *packet, unsigned int i);
+
+/*!
+ * Write a field of up to 32 bits to the packet.  Fields written
+ * one after another are packed together without padding: the first
+ * field goes in the low bits of a byte, and the next field follows
+ * on from it.  Bits are buffered and written out a word at a time.
+ *
+ * Bit-level and byte-level access can be mixed.  A byte-level read
+ * or write first moves to the start of the next whole byte (see
+ * @ref irmo_packet_align_bits), as does getting or setting the
+ * position, length or buffer of the packet.
+ *
+ * @param packet     The packet to write to.
+ * @param value      Value to write.  Only the low num_bits bits are
+ *                   written.
+ * @param num_bits   Number of bits to write, from 0 to 32.
+ * @return           Non-zero if successful.
+ */
+
+int irmo_packet_write_bits(IrmoPacket *packet, unsigned int value,
+                           unsigned int num_bits);
+
 /*!
  * Read a single byte (8-bit integer) from the packet.
  *
@@ -139,6 +198,55 @@ int irmo_packet_readi16(IrmoPacket *packet, unsigned int *i);
 
 int irmo_packet_readi32(IrmoPacket *packet, unsigned int *i);
 
+/*!
+ * Read a field of up to 32 bits written by @ref irmo_packet_write_bits
+ * from the packet.
+ *
+ * @param packet     The packet to read from.
+ * @param value      Pointer to a variable to store the value read.
+ * @param num_bits   Number of bits to read, from 0 to 32.
+ * @return           Non-zero if successful, or zero if there are
+ *                   not enough bits left in the packet.
+ */
+
+int irmo_packet_read_bits(IrmoPacket *packet, unsigned int *value,
+                          unsigned int num_bits);
+
+/*!
+ * Finish reading or writing a sequence of fields with
+ * @ref irmo_packet_read_bits or @ref irmo_packet_write_bits.  When
+ * writing, any bits left over are written, padded out to a whole byte
+ * with zeros.  When reading, the rest of a partly read byte is skipped.
+ *
+ * @param packet     The packet.
+ */
+
+void irmo_packet_align_bits(IrmoPacket *packet);
+
+/*!
+ * Read an unsigned integer written by @ref irmo_packet_writevarint
+ * from the packet.
+ *
+ * @param packet     The packet to read from.
+ * @param i          Pointer to a variable to store the value read.
+ * @return           Non-zero if successful, or zero if the end of the
+ *                   packet was reached or the value does not fit in
+ *                   32 bits.
+ */
+
+int irmo_packet_readvarint(IrmoPacket *packet, unsigned int *i);
+
+/*!
+ * Read a 16-bit integer written by @ref irmo_packet_writei16v from
+ * the packet.
+ *
+ * @param packet     The packet to read from.
+ * @param i          Pointer to a variable to store the value read.
+ * @return           Non-zero if successful.
+ */
+
+int irmo_packet_readi16v(IrmoPacket *packet, unsigned int *i);
+
 /*!
  * Read a NUL-terminated from the packet.
  * The pointer returned points within the packet buffer; it is therefore
@@ -189,6 +297,105 @@ int irmo_packet_read_value(IrmoPacket *packet, IrmoValue *value,
 void irmo_packet_write_value(IrmoPacket *packet, IrmoValue *value, 
 			     IrmoValueType type);
 
+/*!
+ * Round a value to one that can be sent as a quantized value: the
+ * nearest of the steps that the range is divided into, clamped to
+ * the range.
+ *
+ * @param range      The range of the value.
+ * @param value      The value.
+ * @return           The rounded value.
+ */
+
+float irmo_packet_quantize(IrmoValueRange *range, float value);
+
+/*!
+ * Get the number of bits used to write a quantized value: enough to
+ * hold the number of steps that the range is divided into.
+ *
+ * @param range      The range of the value.
+ * @return           Number of bits, from 0 to 32.
+ */
+
+unsigned int irmo_packet_quantized_bits(IrmoValueRange *range);
+
+/*!
+ * Write a quantized value (@ref IRMO_TYPE_QUANTIZED) to a packet.
+ * The value is rounded (see @ref irmo_packet_quantize) and written
+ * as the number of steps above the minimum, using
+ * @ref irmo_packet_write_bits, so that consecutive quantized values
+ * are packed together.  Quantized values are not written by
+ * @ref irmo_packet_write_value, as the encoding depends on the range.
+ *
+ * @param packet     The packet to write into.
+ * @param value      The value to write.
+ * @param range      The range of the value.
+ */
+
+void irmo_packet_write_quantized(IrmoPacket *packet, float value,
+                                 IrmoValueRange *range);
+
+/*!
+ * Read a quantized value written by @ref irmo_packet_write_quantized.
+ *
+ * @param packet     The packet to read from.
+ * @param value      Pointer to a variable to store the value read,
+ *                   or NULL to only check that a valid value can be
+ *                   read.
+ * @param range      The range of the value.
+ * @return           Non-zero for success, or zero for failure.
+ */
+
+int irmo_packet_read_quantized(IrmoPacket *packet, float *value,
+                               IrmoValueRange *range);
+
+/*!
+ * Get the number of bytes that @ref irmo_packet_writevarint uses to
+ * write a value.
+ *
+ * @param i          The value.
+ * @return           Length of the encoded value, in bytes.
+ */
+
+unsigned int irmo_packet_varint_length(unsigned int i);
+
+/*!
+ * Get the number of bytes that @ref irmo_packet_write_value uses to
+ * write a value.
+ *
+ * @param value      Pointer to the value.
+ * @param type       Type of the value.
+ * @param compact    Non-zero to get the length in the compact format.
+ * @return           Length of the encoded value, in bytes.
+ */
+
+unsigned int irmo_packet_value_length(IrmoValue *value, IrmoValueType type,
+                                      int compact);
+
+/*!
+ * Set whether a packet uses the compact format.  In the compact
+ * format, 16 and 32-bit values are written by
+ * @ref irmo_packet_write_value as zigzag encoded variable-length
+ * integers (see @ref irmo_packet_writevarint), so that values close
+ * to zero take fewer bytes.  Packets use the fixed-width format by
+ * default.
+ *
+ * @param packet     The packet.
+ * @param compact    Non-zero to use the compact format.
+ */
+
+void irmo_packet_set_compact(IrmoPacket *packet, int compact);
+
+/*!
+ * Check whether a packet uses the compact format.  See
+ * @ref irmo_packet_set_compact.
+ *
+ * @param packet     The packet.
+ * @return           Non-zero if the packet uses the compact format.
+ */
+
+int irmo_packet_is_compact(IrmoPacket *packet);
+
 /*!
  * Get the packet buffer used by a packet.
  *
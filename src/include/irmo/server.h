@@ -87,6 +87,307 @@ IrmoCallback *irmo_server_watch_connect(IrmoServer *server,
 
 IrmoIterator *irmo_server_iterate_clients(IrmoServer *server);
 
+/*!
+ * Statistics that can be retrieved from a server using
+ * @ref irmo_server_get_stat.
+ */
+
+typedef enum {
+
+        /*!
+         * Number of changes written to packets using data copied
+         * from the payload cache, rather than encoded again.
+         */
+
+        IRMO_SERVER_STAT_CACHE_HITS,
+
+        /*!
+         * Number of changes that were not found in the payload
+         * cache and had to be encoded.
+         */
+
+        IRMO_SERVER_STAT_CACHE_MISSES,
+
+        /*!
+         * Number of times that a client has been run.  Clients are
+         * only run when they have data to send or receive, or
+         * when a retransmission or connection attempt is due.
+         */
+
+        IRMO_SERVER_STAT_CLIENT_RUNS,
+
+        /*!
+         * Number of atoms that have been retransmitted to clients
+         * because they were not acknowledged in time.
+         */
+
+        IRMO_SERVER_STAT_ATOMS_RESENT,
+
+        /*!
+         * Number of atoms that have been retransmitted without waiting
+         * for a timeout, because acknowledgements of later packets
+         * showed that they had been lost.  These are also counted in
+         * @ref IRMO_SERVER_STAT_ATOMS_RESENT.
+         */
+
+        IRMO_SERVER_STAT_FAST_RETRANSMITS,
+
+        /*!
+         * Number of acknowledgements that were not sent in a packet
+         * of their own.  Acknowledgements are delayed briefly, so
+         * that they can be sent along with data or merged with the
+         * acknowledgement of the next packet received.  See
+         * @ref irmo_server_set_ack_delay.
+         */
+
+        IRMO_SERVER_STAT_ACKS_AVOIDED,
+
+        /*!
+         * Number of updates to unreliable variables sent to clients.
+         * Each update carries the latest values of the unreliable
+         * variables of one object that have changed.  See
+         * @ref irmo_class_var_set_unreliable.
+         */
+
+        IRMO_SERVER_STAT_UNRELIABLE_UPDATES,
+
+        /*!
+         * Number of updates to unreliable variables that were lost.
+         * These are not retransmitted; instead, the latest values
+         * are sent in a new update, if one is not already on its way.
+         */
+
+        IRMO_SERVER_STAT_UNRELIABLE_LOST,
+
+        /*!
+         * Number of parity packets sent to clients.  See
+         * @ref irmo_server_set_fec.
+         */
+
+        IRMO_SERVER_STAT_FEC_PACKETS,
+
+        /*!
+         * Number of lost packets from clients that were rebuilt
+         * from parity packets, rather than waiting for the data in
+         * them to be retransmitted.
+         */
+
+        IRMO_SERVER_STAT_FEC_RECOVERED,
+
+        /*!
+         * Number of times that changes to the world being served
+         * have been queued for a client.  This only happens for
+         * clients that have not yet seen the changes made since
+         * they were last brought up to date, so it does not grow
+         * while the world is not changing.
+         */
+
+        IRMO_SERVER_STAT_JOURNAL_UPDATES,
+
+        IRMO_SERVER_NUM_STATS
+} IrmoServerStat;
+
+/*!
+ * Get the value of a statistic counter for a server.
+ *
+ * @param server      The server.
+ * @param stat        The statistic to retrieve.
+ * @return            The value of the counter.
+ */
+
+unsigned int irmo_server_get_stat(IrmoServer *server, IrmoServerStat stat);
+
+/*!
+ * Methods that a server can use to send changes to the world it is
+ * serving to its clients.  See @ref irmo_server_set_replication_mode.
+ */
+
+typedef enum {
+
+        /*!
+         * Each change is queued for transmission as soon as it is
+         * made.  This is the default.
+         */
+
+        IRMO_REPLICATION_QUEUED,
+
+        /*!
+         * Each client only records which variables of each object
+         * have changed.  Changes are sent when there is space in
+         * the send window, carrying the latest values.  This uses
+         * less memory for slow clients in worlds where the same
+         * objects change frequently.
+         */
+
+        IRMO_REPLICATION_DIRTY_MASK,
+} IrmoReplicationMode;
+
+/*!
+ * Set the method that a server uses to send changes to its clients.
+ * The mode for a client is fixed when it connects, so this only
+ * affects clients that connect after it is called.
+ *
+ * @param server      The server.
+ * @param mode        The replication mode.
+ */
+
+void irmo_server_set_replication_mode(IrmoServer *server,
+                                      IrmoReplicationMode mode);
+
+/*!
+ * Set the congestion control algorithm that a server uses when
+ * sending to its clients.  This only affects clients that connect
+ * after it is called; see @ref irmo_client_set_congestion_control
+ * to change the algorithm for an existing client.
+ *
+ * @param server      The server.
+ * @param cc          The congestion control algorithm.
+ */
+
+void irmo_server_set_congestion_control(IrmoServer *server,
+                                        IrmoCongestionControl cc);
+
+/*!
+ * Set the maximum time that a server delays acknowledgements of data
+ * received from its clients.  While an acknowledgement is delayed, it
+ * can be sent along with data, instead of in a packet of its own.
+ * Acknowledgements are still sent straight away if data is missing,
+ * or if several packets have been received.  This only affects
+ * clients that connect after it is called; see
+ * @ref irmo_client_set_ack_delay.
+ *
+ * @param server      The server.
+ * @param ms          Maximum delay, in milliseconds.  If zero,
+ *                    acknowledgements are never delayed.
+ */
+
+void irmo_server_set_ack_delay(IrmoServer *server, unsigned int ms);
+
+/*!
+ * Set the maximum size of the packets that a server sends to its
+ * clients.  When a client connects, the smaller of this value and the
+ * size requested by the client is used in both directions.  This only
+ * affects clients that connect after it is called.
+ *
+ * @param server      The server.
+ * @param mtu         Maximum packet size, in bytes.  The default is
+ *                    1024 bytes; the value must be between 256 and
+ *                    16384 bytes.
+ */
+
+void irmo_server_set_mtu(IrmoServer *server, unsigned int mtu);
+
+/*!
+ * Set whether a server probes for the largest packet size that reaches
+ * each of its clients.  If enabled, packets of the default size are
+ * sent at first, and the size is raised towards the size negotiated
+ * when the client connected (see @ref irmo_server_set_mtu) as padded
+ * probe packets are found to get through.  Probes that are lost are
+ * not treated as a sign of congestion.  This only affects clients
+ * that connect after it is called.
+ *
+ * @param server      The server.
+ * @param probe       Non-zero to enable probing.
+ */
+
+void irmo_server_set_mtu_probing(IrmoServer *server, int probe);
+
+/*!
+ * Set whether a server sends forward error correction data to its
+ * clients.  If enabled, a parity packet is sent after each group of
+ * packets containing data, so that if one packet in the group is
+ * lost, the client can rebuild it without waiting for the data to
+ * be retransmitted.  This is useful when the round trip time is
+ * long.  Groups are made smaller as more packets are lost, so the
+ * overhead adapts to the loss rate.  This only affects clients that
+ * connect after it is called.
+ *
+ * @param server      The server.
+ * @param fec         Non-zero to enable forward error correction.
+ */
+
+void irmo_server_set_fec(IrmoServer *server, int fec);
+
+/*!
+ * Set the limit on the size of the table of strings kept for each of
+ * a server's clients.  The first time a string value or method
+ * argument is sent to a client, it is added to the table, and once
+ * the client has received it, it is sent as a short index into the
+ * table rather than in full.  The least recently used strings are
+ * removed when the table is full.  The default limit is 4096 bytes.
+ * This only affects clients that connect after it is called.
+ *
+ * @param server      The server.
+ * @param bytes       Limit on the total size of the strings in each
+ *                    table, in bytes.  If zero, strings are always
+ *                    sent in full.
+ */
+
+void irmo_server_set_string_table_size(IrmoServer *server,
+                                       unsigned int bytes);
+
+/*!
+ * Types of data sent by a server, for setting priorities with
+ * @ref irmo_server_set_priority.
+ */
+
+typedef enum {
+
+        /*! Creation of a new object. */
+
+        IRMO_PRIORITY_NEW_OBJECT,
+
+        /*! Changes to the variables of an object. */
+
+        IRMO_PRIORITY_CHANGE,
+
+        /*! Destruction of an object. */
+
+        IRMO_PRIORITY_DESTROY,
+
+        /*! Method calls. */
+
+        IRMO_PRIORITY_METHOD,
+
+        IRMO_PRIORITY_NUM_TYPES
+} IrmoPriorityType;
+
+/*!
+ * Set the priority of a type of data sent by a server.
+ *
+ * Data waiting to be sent to a client is sent in the order in which
+ * it was queued, except that data with a higher priority may be sent
+ * ahead of other data.  The priority is the number of previously
+ * queued items that data may be sent ahead of.  This limit ensures
+ * that data with a low priority is still sent eventually.
+ *
+ * Changes to an object are always sent in order, regardless of
+ * priority.  By default, all types have a priority of zero, except
+ * for object destruction and method calls, which have a priority
+ * of 64.
+ *
+ * @param server      The server.
+ * @param type        The type of data.
+ * @param priority    The new priority.
+ */
+
+void irmo_server_set_priority(IrmoServer *server, IrmoPriorityType type,
+                              unsigned int priority);
+
+/*!
+ * Set the priority of objects of a particular class.  This is
+ * added to the priority for creating and changing objects of the
+ * class (see @ref irmo_server_set_priority).
+ *
+ * @param server      The server.
+ * @param klass       A class from the interface of the world being
+ *                    served.
+ * @param priority    The priority for the class.
+ */
+
+void irmo_server_set_class_priority(IrmoServer *server, IrmoClass *klass,
+                                    unsigned int priority);
+
 /*!
  * Add a reference to a server object. When a server is created its 
  * reference count is set to 1. References can be added with 
@@ -131,10 +432,29 @@ void irmo_server_shutdown(IrmoServer *server);
 
 void irmo_server_run(IrmoServer *server);
 
+/*!
+ * Get the time until a server next needs to be run to send data.
+ *
+ * Data sent to clients is paced out over time, and lost data is
+ * resent after a timeout.  This returns the time until
+ * @ref irmo_server_run next needs to be called, so that the caller
+ * can sleep until then.  New packets received may also need the
+ * server to be run sooner.
+ *
+ * @param server        The server.
+ * @return              Time in milliseconds until the server next
+ *                      needs to be run, zero if it needs to be run
+ *                      now, or -1 if nothing is waiting to be sent.
+ */
+
+int irmo_server_next_send_time(IrmoServer *server);
+
 /*!
  * Block until new packets are received by a server.
  *
- * This function sleeps until @ref irmo_server_run can be run again.
+ * This function sleeps until @ref irmo_server_run can be run again:
+ * either a packet is received, or data is due to be sent (see
+ * @ref irmo_server_next_send_time).
  *
  * @param server        The server.
  * @param timeout       Maximum time to sleep for, in ms.
@@ -101,9 +101,34 @@ typedef enum {
 	IRMO_TYPE_INT16,
 	IRMO_TYPE_INT32,
 	IRMO_TYPE_STRING,
+
+	//! 32 bit floating point value.
+
+	IRMO_TYPE_FLOAT32,
+
+	/*!
+	 * Floating point value limited to a range and precision
+	 * (see @ref IrmoValueRange), sent in only as many bits as are
+	 * needed.  Only class variables can be quantized.
+	 */
+
+	IRMO_TYPE_QUANTIZED,
+
 	IRMO_NUM_TYPES,
 } IrmoValueType;
 
+/*!
+ * The range of values of a quantized variable.  The range is divided
+ * into evenly spaced steps no further apart than the precision;
+ * values are rounded to the nearest step and clamped to the range.
+ */
+
+typedef struct {
+	float min;
+	float max;
+	float precision;
+} IrmoValueRange;
+
 typedef void (*IrmoClassCallback)(IrmoClass *klass, void *user_data);
 typedef void (*IrmoClassVarCallback)(IrmoClassVar *var, void *user_data);
 typedef void (*IrmoMethodCallback)(IrmoMethod *method, void *user_data);
@@ -211,12 +236,14 @@ typedef void (*IrmoInvokeCallback)(IrmoMethodData *data,
  */
 
 /*!
- * A union structure that can hold an integer or a string pointer.
+ * A union structure that can hold an integer, a string pointer or a
+ * floating point value.
  */
 
 typedef union {
 	unsigned int i;
 	char *s;
+	float f;
 } IrmoValue;
 
 //! An Irmo Object
@@ -283,6 +310,35 @@ typedef enum {
         IRMO_CLIENT_NUM_STATES
 } IrmoClientState;
 
+/*!
+ * Congestion control algorithms, which control how fast data is
+ * sent to clients.  See @ref irmo_server_set_congestion_control
+ * and @ref irmo_client_set_congestion_control.
+ */
+
+typedef enum {
+
+        /*!
+         * Loss-based congestion control, similar to TCP Reno.  The
+         * sending rate is increased until packets are lost.  This is
+         * the default.
+         */
+
+        IRMO_CONGESTION_RENO,
+
+        /*!
+         * Delay-based congestion control, similar to TCP Vegas.  The
+         * sending rate is reduced when round trip times increase,
+         * which keeps queues along the path short.  This gives lower
+         * latency, but may get less bandwidth when competing with
+         * loss-based senders.
+         */
+
+        IRMO_CONGESTION_VEGAS,
+
+        IRMO_CONGESTION_NUM_CONTROLS,
+} IrmoCongestionControl;
+
 /*!
  * A numerical client identifier.
  *
@@ -301,6 +357,30 @@ typedef unsigned int IrmoClientID;
 
 typedef void (*IrmoClientCallback) (IrmoClient *client, void *user_data);
 
+/*!
+ * Callback function used to weight the objects sent to a client.
+ *
+ * Functions of this type are used to calculate how important it is
+ * to keep an object up to date on a particular client.  See
+ * @ref irmo_client_set_priority_callback.
+ */
+
+typedef unsigned int (*IrmoPriorityCallback) (IrmoClient *client,
+                                              IrmoObject *object,
+                                              void *user_data);
+
+/*!
+ * Callback function used to decide which objects are sent to a client.
+ *
+ * Functions of this type return non-zero if an object is relevant
+ * to a client and should be sent to it.  See
+ * @ref irmo_client_set_relevance_filter.
+ */
+
+typedef int (*IrmoRelevanceCallback) (IrmoClient *client,
+                                      IrmoObject *object,
+                                      void *user_data);
+
 //! \}
 
 //---------------------------------------------------------------------
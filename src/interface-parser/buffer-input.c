@@ -50,6 +50,7 @@ static int from_buffer_input(void *buf, unsigned int buf_len, void *handle)
         }
 
         memcpy(buf, buffer->data + buffer->offset, (size_t) result);
+        buffer->offset += (unsigned int) result;
 
         return result;
 }
@@ -21,6 +21,7 @@
 #include "base/alloc.h"
 #include "base/assert.h"
 #include "base/error.h"
+#include "base/util.h"
 
 #include "interface.h"
 
@@ -28,17 +29,12 @@
 // IrmoClassVar
 //
 
-IrmoClassVar *irmo_class_new_variable(IrmoClass *klass,
-                                      char *var_name,
-                                      IrmoValueType var_type)
+static IrmoClassVar *new_variable(IrmoClass *klass,
+                                  char *var_name,
+                                  IrmoValueType var_type)
 {
         IrmoClassVar *class_var;
 
-        irmo_return_val_if_fail(klass != NULL, NULL);
-        irmo_return_val_if_fail(var_name != NULL, NULL);
-        irmo_return_val_if_fail(var_type != IRMO_TYPE_UNKNOWN
-                             && var_type != IRMO_NUM_TYPES, NULL);
-
         if (klass->nvariables >= MAX_VARIABLES) {
                 irmo_error_report("irmo_class_new_variable", 
                                   "Maximum of %i variables per class",
@@ -62,6 +58,7 @@ IrmoClassVar *irmo_class_new_variable(IrmoClass *klass,
         class_var->type = var_type;
         class_var->index = klass->nvariables;
         class_var->klass = klass;
+        class_var->unreliable = klass->unreliable;
 
         // Add to the class.
 
@@ -77,6 +74,51 @@ IrmoClassVar *irmo_class_new_variable(IrmoClass *klass,
         return class_var;
 }
 
+IrmoClassVar *irmo_class_new_variable(IrmoClass *klass,
+                                      char *var_name,
+                                      IrmoValueType var_type)
+{
+        irmo_return_val_if_fail(klass != NULL, NULL);
+        irmo_return_val_if_fail(var_name != NULL, NULL);
+        irmo_return_val_if_fail(var_type != IRMO_TYPE_UNKNOWN
+                             && var_type != IRMO_TYPE_QUANTIZED
+                             && var_type < IRMO_NUM_TYPES, NULL);
+
+        return new_variable(klass, var_name, var_type);
+}
+
+IrmoClassVar *irmo_class_new_quantized_variable(IrmoClass *klass,
+                                                char *var_name,
+                                                float min, float max,
+                                                float precision)
+{
+        IrmoClassVar *class_var;
+
+        irmo_return_val_if_fail(klass != NULL, NULL);
+        irmo_return_val_if_fail(var_name != NULL, NULL);
+
+        // The number of steps in the range must fit in 32 bits.
+
+        if (!(precision > 0) || !(max > min)
+         || ((double) max - min) / precision >= 4294967295.0) {
+                irmo_error_report("irmo_class_new_quantized_variable",
+                                  "Invalid range for variable '%s' in "
+                                  "class '%s'",
+                                  var_name, klass->name);
+                return NULL;
+        }
+
+        class_var = new_variable(klass, var_name, IRMO_TYPE_QUANTIZED);
+
+        if (class_var != NULL) {
+                class_var->range.min = min;
+                class_var->range.max = max;
+                class_var->range.precision = precision;
+        }
+
+        return class_var;
+}
+
 char *irmo_class_var_get_name(IrmoClassVar *var)
 {
 	irmo_return_val_if_fail(var != NULL, NULL);
@@ -91,6 +133,31 @@ IrmoValueType irmo_class_var_get_type(IrmoClassVar *var)
 	return var->type;
 }
 
+IrmoValueRange *irmo_class_var_get_range(IrmoClassVar *var)
+{
+	irmo_return_val_if_fail(var != NULL, NULL);
+
+        if (var->type != IRMO_TYPE_QUANTIZED) {
+                return NULL;
+        }
+
+	return &var->range;
+}
+
+void irmo_class_var_set_unreliable(IrmoClassVar *var, int unreliable)
+{
+	irmo_return_if_fail(var != NULL);
+
+        var->unreliable = unreliable != 0;
+}
+
+int irmo_class_var_is_unreliable(IrmoClassVar *var)
+{
+	irmo_return_val_if_fail(var != NULL, 0);
+
+        return var->unreliable;
+}
+
 void irmo_class_var_bind(IrmoClassVar *var, char *member_name)
 {
         IrmoStructMember *member;
@@ -122,10 +189,35 @@ void irmo_class_var_unref(IrmoClassVar *var)
 	irmo_interface_unref(var->klass->iface);
 }
 
+// Hash the bits of a floating point value.
+
+static uint32_t float_hash(float f)
+{
+        uint32_t i;
+
+        memcpy(&i, &f, sizeof(i));
+
+        return i;
+}
+
 uint32_t irmo_class_var_hash(IrmoClassVar *class_var)
 {
-        return class_var->type
-             ^ irmo_string_hash(class_var->name);
+        uint32_t result;
+
+        result = class_var->type
+               ^ ((uint32_t) class_var->unreliable << 8)
+               ^ irmo_string_hash(class_var->name);
+
+        if (class_var->type == IRMO_TYPE_QUANTIZED) {
+                result = irmo_rotate_int(result)
+                       ^ float_hash(class_var->range.min);
+                result = irmo_rotate_int(result)
+                       ^ float_hash(class_var->range.max);
+                result = irmo_rotate_int(result)
+                       ^ float_hash(class_var->range.precision);
+        }
+
+        return result;
 }
 
 void _irmo_class_var_free(IrmoClassVar *var)
@@ -47,10 +47,20 @@ struct _IrmoClassVar {
 
 	IrmoValueType type;
 
+        // Range of values, if this is a quantized variable.
+
+        IrmoValueRange range;
+
         // Structure member that this variable is bound to, or 
         // NULL if it is not bound to any structure member.
 
         IrmoStructMember *member;
+
+        // If non-zero, changes to this variable are sent unreliably:
+        // each change is sent once, and only the latest value
+        // matters, so lost changes are not retransmitted.
+
+        int unreliable;
 };
 
 /*!
@@ -164,6 +164,24 @@ IrmoIterator *irmo_class_iterate_variables(IrmoClass *klass,
         return iter;
 }
 
+void irmo_class_set_unreliable(IrmoClass *klass, int unreliable)
+{
+        unsigned int i;
+
+	irmo_return_if_fail(klass != NULL);
+
+        klass->unreliable = unreliable != 0;
+
+        // Variables inherited from the parent class are shared with
+        // it, so only this class's own variables are changed.
+
+        for (i=0; i<klass->nvariables; ++i) {
+                if (klass->variables[i]->klass == klass) {
+                        klass->variables[i]->unreliable = klass->unreliable;
+                }
+        }
+}
+
 IrmoClass *irmo_class_parent_class(IrmoClass *klass)
 {
 	irmo_return_val_if_fail(klass != NULL, NULL);
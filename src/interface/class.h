@@ -61,6 +61,11 @@ struct _IrmoClass {
         // Type of C structure that objects of this structure are bound to.
 
         IrmoStruct *structure;
+
+        // If non-zero, variables declared in this class are
+        // unreliable (see IrmoClassVar).
+
+        int unreliable;
 };
 
 /*!
@@ -37,7 +37,8 @@ IrmoMethodArg *irmo_method_new_argument(IrmoMethod *method,
         irmo_return_val_if_fail(method != NULL, NULL);
         irmo_return_val_if_fail(arg_name != NULL, NULL);
         irmo_return_val_if_fail(arg_type != IRMO_TYPE_UNKNOWN
-                             && arg_type != IRMO_NUM_TYPES, NULL);
+                             && arg_type != IRMO_TYPE_QUANTIZED
+                             && arg_type < IRMO_NUM_TYPES, NULL);
 
         if (method->narguments >= MAX_VARIABLES) {
                 irmo_error_report("irmo_method_new_argument", 
@@ -31,7 +31,19 @@
 #include "interface.h"
 
 #define HEADER_SIGNATURE "Irmo Interface Blob"
-#define BLOB_VERSION 1
+
+// Newest blob version.  Blobs are written with the lowest version that
+// can describe the interface, so that older readers can load them.
+
+#define BLOB_VERSION 3
+
+// Flag set in the type of an unreliable class variable.  Blobs older
+// than version 2 do not have unreliable variables.
+
+#define CLASS_VAR_UNRELIABLE 0x80U
+
+// The range of a quantized variable follows its type.  Blobs older
+// than version 3 do not have floating point or quantized variables.
 
 //#define DEBUG 1
 
@@ -45,14 +57,94 @@
 // Blob header
 //
 
+// Get the blob version needed to describe a variable or argument type.
+
+static unsigned int type_version(IrmoValueType type)
+{
+        if (type == IRMO_TYPE_FLOAT32 || type == IRMO_TYPE_QUANTIZED) {
+                return 3;
+        } else {
+                return 1;
+        }
+}
+
+// Get the blob version needed to describe a class variable.
+
+static unsigned int class_var_version(IrmoClassVar *var)
+{
+        unsigned int version;
+
+        version = type_version(irmo_class_var_get_type(var));
+
+        if (irmo_class_var_is_unreliable(var) && version < 2) {
+                version = 2;
+        }
+
+        return version;
+}
+
+// Work out the lowest blob version that can describe an interface.
+
+static unsigned int blob_version(IrmoInterface *iface)
+{
+        IrmoIterator *iter, *inner_iter;
+        IrmoClass *klass;
+        IrmoMethod *method;
+        unsigned int version, needed;
+
+        version = 1;
+
+        iter = irmo_interface_iterate_classes(iface);
+
+        while (irmo_iterator_has_more(iter)) {
+                klass = irmo_iterator_next(iter);
+                inner_iter = irmo_class_iterate_variables(klass, 0);
+
+                while (irmo_iterator_has_more(inner_iter)) {
+                        needed = class_var_version(
+                                        irmo_iterator_next(inner_iter));
+
+                        if (needed > version) {
+                                version = needed;
+                        }
+                }
+
+                irmo_iterator_free(inner_iter);
+        }
+
+        irmo_iterator_free(iter);
+
+        iter = irmo_interface_iterate_methods(iface);
+
+        while (irmo_iterator_has_more(iter)) {
+                method = irmo_iterator_next(iter);
+                inner_iter = irmo_method_iterate_arguments(method);
+
+                while (irmo_iterator_has_more(inner_iter)) {
+                        needed = type_version(irmo_method_arg_get_type(
+                                        irmo_iterator_next(inner_iter)));
+
+                        if (needed > version) {
+                                version = needed;
+                        }
+                }
+
+                irmo_iterator_free(inner_iter);
+        }
+
+        irmo_iterator_free(iter);
+
+        return version;
+}
+
 // Write the header into the packet
 
-static void write_header(IrmoPacket *packet)
+static void write_header(IrmoInterface *iface, IrmoPacket *packet)
 {
         DEBUGMSG(("Write header\n"));
 
         irmo_packet_writestring(packet, HEADER_SIGNATURE);
-        irmo_packet_writei32(packet, BLOB_VERSION);
+        irmo_packet_writei32(packet, blob_version(iface));
 }
 
 // Read and verify the header
@@ -79,7 +171,7 @@ static int read_header(IrmoPacket *packet)
                 return 0;
         }
 
-        if (ver != BLOB_VERSION) {
+        if (ver < 1 || ver > BLOB_VERSION) {
                 irmo_error_report("irmo_interface_load",
                                   "Wrong interface version");
                 return 0;
@@ -94,18 +186,64 @@ static int read_header(IrmoPacket *packet)
 // IrmoClassVar
 //
 
+// Floating point values are stored as the bits of their IEEE 754
+// representation.
+
+static void write_float(IrmoPacket *packet, float f)
+{
+        uint32_t i;
+
+        memcpy(&i, &f, sizeof(i));
+
+        irmo_packet_writei32(packet, i);
+}
+
+static int read_float(IrmoPacket *packet, float *f)
+{
+        unsigned int i;
+        uint32_t bits;
+
+        if (!irmo_packet_readi32(packet, &i)) {
+                return 0;
+        }
+
+        bits = i;
+        memcpy(f, &bits, sizeof(*f));
+
+        return 1;
+}
+
 static void write_class_var(IrmoClassVar *var, IrmoPacket *packet)
 {
+        IrmoValueRange *range;
+        unsigned int type;
+
         DEBUGMSG(("\t\tWrite class var: '%s'\n", irmo_class_var_get_name(var)));
 
+        type = irmo_class_var_get_type(var);
+
+        if (irmo_class_var_is_unreliable(var)) {
+                type |= CLASS_VAR_UNRELIABLE;
+        }
+
         irmo_packet_writestring(packet, irmo_class_var_get_name(var));
-        irmo_packet_writei8(packet, irmo_class_var_get_type(var));
+        irmo_packet_writei8(packet, type);
+
+        if (irmo_class_var_get_type(var) == IRMO_TYPE_QUANTIZED) {
+                range = irmo_class_var_get_range(var);
+
+                write_float(packet, range->min);
+                write_float(packet, range->max);
+                write_float(packet, range->precision);
+        }
 }
 
 static int read_class_var(IrmoPacket *packet, IrmoClass *klass)
 {
+        IrmoClassVar *var;
         char *name;
         unsigned int type;
+        float min, max, precision;
 
         DEBUGMSG(("\t\tRead class var\n"));
 
@@ -119,10 +257,27 @@ static int read_class_var(IrmoPacket *packet, IrmoClass *klass)
                 return 0;
         }
 
-        if (irmo_class_new_variable(klass, name, type) == NULL) {
+        if ((type & ~CLASS_VAR_UNRELIABLE) == IRMO_TYPE_QUANTIZED) {
+                if (!read_float(packet, &min)
+                 || !read_float(packet, &max)
+                 || !read_float(packet, &precision)) {
+                        return 0;
+                }
+
+                var = irmo_class_new_quantized_variable(klass, name,
+                                                        min, max,
+                                                        precision);
+        } else {
+                var = irmo_class_new_variable(klass, name,
+                                              type & ~CLASS_VAR_UNRELIABLE);
+        }
+
+        if (var == NULL) {
                 return 0;
         }
 
+        irmo_class_var_set_unreliable(var, (type & CLASS_VAR_UNRELIABLE) != 0);
+
         DEBUGMSG(("\t\tClass var '%s' read successfully\n", name));
 
         return 1;
@@ -482,7 +637,7 @@ void irmo_interface_dump(IrmoInterface *iface,
         irmo_return_if_fail(data_len != NULL);
 
         packet = irmo_packet_new();
-        write_header(packet);
+        write_header(iface, packet);
         write_classes(iface, packet);
         write_methods(iface, packet);
         write_checksum(iface, packet);
@@ -35,6 +35,13 @@
 #define CLIENT_CONNECT_ATTEMPTS 6
 #define CLIENT_SYN_INTERVAL 1000
 
+// Invoked when the client's timer expires.
+
+static void client_timer_expired(IrmoTimer *timer, void *user_data)
+{
+        irmo_client_wake(user_data);
+}
+
 // create a new client (used internally)
 
 IrmoClient *irmo_client_new(IrmoServer *server, IrmoNetAddress *addr)
@@ -55,19 +62,15 @@ IrmoClient *irmo_client_new(IrmoServer *server, IrmoNetAddress *addr)
 
 	// send queue
 
-	client->sendq = irmo_queue_new();
-        irmo_alloc_assert(client->sendq != NULL);
-
-        client->sendq_hashtable = irmo_hash_table_new(irmo_pointer_hash,
-                                                      irmo_pointer_equal);
+	client->sendq = irmo_client_sendq_new();
 
-        irmo_alloc_assert(client->sendq_hashtable != NULL);
+        client->replication_mode = server->replication_mode;
+        client->ack_delay = server->ack_delay;
 
-	// receive window
+	// Send and receive windows are allocated when first used.
 
-	client->recvwindow_start = 0;
-	client->recvwindow_size = 64;
-	client->recvwindow = irmo_new0(IrmoSendAtom *, client->recvwindow_size);
+	client->sendwindow = NULL;
+	client->recvwindow = NULL;
 
 	// start at one ref, from the server this is part of 
 
@@ -78,16 +81,37 @@ IrmoClient *irmo_client_new(IrmoServer *server, IrmoNetAddress *addr)
 	client->rtt = 1000;
 	client->rtt_deviation = 200;
 
+	// packet numbers start from one; zero means "none"
+
+	client->send_packet_num = 1;
+	client->largest_acked_packet = 0;
+	client->recv_packet_num = 0;
+	client->ack_packet_num = 0;
+
 	// backoff
 
 	client->backoff = 1;
 
+        // Packet size.  This is reduced if the remote end asks for
+        // smaller packets during the SYN handshake.
+
+        client->mtu = server->mtu;
+        client->mtu_max = server->mtu;
+        client->mtu_probing = server->mtu_probing;
+        client->mtu_probe_fail = server->mtu + 1;
+
+        client->fec = server->fec;
+
+        irmo_string_table_init(client, server->string_table_size);
+
 	// congestion/sendwindow size stuff
 
-	// start cwnd with one packet, ssthresh as large
+        client->last_rtt = 0;
+        client->cc = irmo_congestion_controls[server->congestion_control];
+        client->cc->init(client);
 
-	client->cwnd = IRMO_PROTOCOL_MTU;
-	client->ssthresh = 65535;
+        client->pacing_tokens = (float) (IRMO_PACING_BURST * client->mtu);
+        client->pacing_time = irmo_get_time();
 
         // assign a new ID for this client:
 
@@ -113,6 +137,11 @@ IrmoClient *irmo_client_new(IrmoServer *server, IrmoNetAddress *addr)
 
         client->local_synced = client->world == NULL;
 
+        // Run the client straight away to start the connection.
+
+        irmo_timer_init(&client->timer, client_timer_expired, client);
+        irmo_client_wake(client);
+
 	return client;
 }
 
@@ -128,6 +157,55 @@ void irmo_client_ref(IrmoClient *client)
 	++client->refcount;
 }
 
+uint8_t **irmo_client_subscriptions_new(IrmoInterface *iface)
+{
+        uint8_t **result;
+        size_t len;
+        unsigned int i;
+
+        result = irmo_new0(uint8_t *, iface->nclasses);
+
+        for (i=0; i<iface->nclasses; ++i) {
+                len = (iface->classes[i]->nvariables + 7) / 8;
+                result[i] = irmo_new0(uint8_t, len);
+                memset(result[i], 0xff, len);
+        }
+
+        return result;
+}
+
+static void free_subscriptions(uint8_t **subscriptions, unsigned int n)
+{
+        unsigned int i;
+
+        if (subscriptions == NULL) {
+                return;
+        }
+
+        for (i=0; i<n; ++i) {
+                free(subscriptions[i]);
+        }
+
+        free(subscriptions);
+}
+
+int irmo_client_is_subscribed(IrmoClient *client, IrmoClass *klass,
+                              IrmoClassVar *var)
+{
+        uint8_t *bitmap;
+
+        if (client->subscriptions == NULL) {
+                return 1;
+        }
+
+        // Subclasses share their parent's variables, so the object's
+        // class must be used rather than the variable's class.
+
+        bitmap = client->subscriptions[klass->index];
+
+        return (bitmap[var->index / 8] & (1 << (var->index % 8))) != 0;
+}
+
 static void irmo_client_destroy(IrmoClient *client)
 {
 	unsigned int i;
@@ -140,29 +218,59 @@ static void irmo_client_destroy(IrmoClient *client)
 
 	// clear send queue
 
-	while (!irmo_queue_is_empty(client->sendq)) {
+	while (irmo_binary_heap_num_entries(client->sendq) > 0) {
 		IrmoSendAtom *atom;
 
-		atom = (IrmoSendAtom *) irmo_queue_pop_head(client->sendq);
+		atom = (IrmoSendAtom *) irmo_binary_heap_pop(client->sendq);
 
 		irmo_sendatom_free(atom);
 	}
 
-	irmo_queue_free(client->sendq);
-
-	irmo_hash_table_free(client->sendq_hashtable);
+	irmo_binary_heap_free(client->sendq);
 
 	// destroy sendwindow and all data in it
 
 	for (i=0; i<client->sendwindow_size; ++i) {
-		irmo_sendatom_free(client->sendwindow[i]);
+		irmo_sendatom_free(IRMO_CLIENT_SENDWINDOW(client, i));
         }
 
-	//free(client->sendwindow);
+        // The atoms have now all been removed from the object table.
+
+        for (i=0; i<client->objects_size; ++i) {
+                free(client->objects[i].dirty);
+                free(client->objects[i].unreliable_changed);
+                free(client->objects[i].unreliable_unacked);
+        }
+
+        free(client->objects);
+        free(client->dirty_list);
+        free(client->unreliable_list);
+        free(client->unreliable_scratch);
+        free(client->unreliable_recv);
+        free(client->priority_sort);
+        free(client->scope_pending);
+        free(client->fec_parity);
+        free(client->sent_packets);
+
+        irmo_string_table_free(client);
+
+        if (client->recv_packets != NULL) {
+                for (i=0; i<IRMO_CLIENT_RECV_PACKETS; ++i) {
+                        free(client->recv_packets[i].data);
+                }
+
+                free(client->recv_packets);
+        }
+
+        free_subscriptions(client->subscriptions, client->nsubscriptions);
+        free_subscriptions(client->requested_subscriptions,
+                           client->nrequested_subscriptions);
+
+	free(client->sendwindow);
 
 	// destroy receive window and all data in it
 	
-	for (i=0; i<client->recvwindow_size; ++i) {
+	for (i=0; i<client->recvwindow_alloced; ++i) {
 		if (client->recvwindow[i] != NULL) {
 			irmo_sendatom_free(client->recvwindow[i]);
                 }
@@ -200,6 +308,291 @@ void irmo_client_unref(IrmoClient *client)
 	irmo_server_unref(client->server);	
 }
 
+// Copy the contents of a window ring buffer into a new buffer of the
+// specified size, so that the start of the window is at index zero.
+
+static IrmoSendAtom **window_resize(IrmoSendAtom **window,
+                                    unsigned int head,
+                                    unsigned int alloced,
+                                    unsigned int new_alloced)
+{
+        IrmoSendAtom **result;
+        unsigned int i;
+
+        result = irmo_new0(IrmoSendAtom *, new_alloced);
+
+        for (i=0; i<alloced; ++i) {
+                result[i] = window[(head + i) & (alloced - 1)];
+        }
+
+        free(window);
+
+        return result;
+}
+
+// Get the ring buffer size needed to hold the specified number of
+// atoms: the windows grow geometrically, in powers of two.
+
+static unsigned int window_new_size(unsigned int alloced, unsigned int size)
+{
+        unsigned int result;
+
+        if (alloced == 0) {
+                result = IRMO_CLIENT_WINDOW_INITIAL;
+        } else {
+                result = alloced;
+        }
+
+        while (result < size) {
+                result *= 2;
+        }
+
+        return result;
+}
+
+void irmo_client_sendwindow_push(IrmoClient *client, IrmoSendAtom *atom)
+{
+        unsigned int new_alloced;
+
+        if (client->sendwindow_size >= client->sendwindow_alloced) {
+                new_alloced = window_new_size(client->sendwindow_alloced,
+                                              client->sendwindow_size + 1);
+
+                client->sendwindow = window_resize(client->sendwindow,
+                                                   client->sendwindow_head,
+                                                   client->sendwindow_alloced,
+                                                   new_alloced);
+                client->sendwindow_head = 0;
+                client->sendwindow_alloced = new_alloced;
+        }
+
+        atom->seqnum = client->sendwindow_start + client->sendwindow_size;
+        atom->sendtime = IRMO_ATOM_UNSENT;
+
+        client->sendwindow_bytes += atom->len;
+        ++client->sendwindow_unsent;
+
+        IRMO_CLIENT_SENDWINDOW(client, client->sendwindow_size) = atom;
+        ++client->sendwindow_size;
+}
+
+void irmo_client_sendwindow_advance(IrmoClient *client, unsigned int length)
+{
+        if (length == 0) {
+                return;
+        }
+
+        client->sendwindow_head = (client->sendwindow_head + length)
+                                & (client->sendwindow_alloced - 1);
+        client->sendwindow_start += length;
+        client->sendwindow_size -= length;
+}
+
+// Remove an atom in the send window from the count or list for its
+// current state, before the state changes.
+
+static void sendwindow_unlink(IrmoClient *client, IrmoSendAtom *atom)
+{
+        if (atom->sacked) {
+                return;
+        } else if (atom->sendtime == IRMO_ATOM_UNSENT) {
+                --client->sendwindow_unsent;
+                return;
+        } else if (atom->lost) {
+                --client->sendwindow_lost;
+                return;
+        }
+
+        if (atom->inflight_prev != NULL) {
+                atom->inflight_prev->inflight_next = atom->inflight_next;
+        } else {
+                client->inflight_head = atom->inflight_next;
+        }
+
+        if (atom->inflight_next != NULL) {
+                atom->inflight_next->inflight_prev = atom->inflight_prev;
+        } else {
+                client->inflight_tail = atom->inflight_prev;
+        }
+
+        atom->inflight_prev = NULL;
+        atom->inflight_next = NULL;
+}
+
+void irmo_client_sendwindow_sent(IrmoClient *client, IrmoSendAtom *atom,
+                                 unsigned int nowtime)
+{
+        sendwindow_unlink(client, atom);
+
+        atom->sendtime = nowtime;
+        atom->packet_num = client->send_packet_num;
+        atom->lost = 0;
+
+        // Null atoms next to the data in a packet are sent again even
+        // if they have been received, but are not waited for.
+
+        if (atom->sacked) {
+                return;
+        }
+
+        atom->inflight_prev = client->inflight_tail;
+
+        if (client->inflight_tail != NULL) {
+                client->inflight_tail->inflight_next = atom;
+        } else {
+                client->inflight_head = atom;
+        }
+
+        client->inflight_tail = atom;
+}
+
+void irmo_client_sendwindow_lost(IrmoClient *client, IrmoSendAtom *atom)
+{
+        sendwindow_unlink(client, atom);
+
+        atom->lost = 1;
+        ++client->sendwindow_lost;
+}
+
+void irmo_client_sendwindow_sacked(IrmoClient *client, IrmoSendAtom *atom)
+{
+        sendwindow_unlink(client, atom);
+
+        atom->sacked = 1;
+}
+
+void irmo_client_sendwindow_acked(IrmoClient *client, IrmoSendAtom *atom)
+{
+        sendwindow_unlink(client, atom);
+
+        client->sendwindow_bytes -= atom->len;
+}
+
+// Resize the buffer of sent packets, moving each record to its slot
+// in the new buffer.
+
+static void sent_packets_resize(IrmoClient *client, unsigned int new_alloced)
+{
+        IrmoSentPacket *result;
+        IrmoSentPacket *sent;
+        unsigned int i;
+
+        result = irmo_new0(IrmoSentPacket, new_alloced);
+
+        for (i=0; i<client->sent_packets_alloced; ++i) {
+                sent = &client->sent_packets[i];
+
+                if (sent->packet_num != 0) {
+                        result[sent->packet_num & (new_alloced - 1)] = *sent;
+                }
+        }
+
+        free(client->sent_packets);
+
+        client->sent_packets = result;
+        client->sent_packets_alloced = new_alloced;
+}
+
+IrmoSentPacket *irmo_client_sent_packet_new(IrmoClient *client,
+                                            unsigned int packet_num)
+{
+        unsigned int needed;
+
+        // Records are needed for the packets that have not yet been
+        // acknowledged, and the 32 before the largest acknowledged
+        // packet, which acknowledgements may also cover.
+
+        needed = packet_num - client->largest_acked_packet + 32;
+
+        if (needed > IRMO_CLIENT_SENT_PACKETS) {
+                needed = IRMO_CLIENT_SENT_PACKETS;
+        }
+
+        if (needed > client->sent_packets_alloced) {
+                sent_packets_resize(client,
+                                    window_new_size(
+                                        client->sent_packets_alloced,
+                                        needed));
+        }
+
+        return &client->sent_packets[packet_num
+                                     & (client->sent_packets_alloced - 1)];
+}
+
+IrmoSentPacket *irmo_client_sent_packet(IrmoClient *client,
+                                        unsigned int packet_num)
+{
+        IrmoSentPacket *sent;
+
+        if (client->sent_packets == NULL) {
+                return NULL;
+        }
+
+        sent = &client->sent_packets[packet_num
+                                     & (client->sent_packets_alloced - 1)];
+
+        if (sent->packet_num != packet_num) {
+                return NULL;
+        }
+
+        return sent;
+}
+
+void irmo_client_recvwindow_reserve(IrmoClient *client, unsigned int size)
+{
+        unsigned int new_alloced;
+
+        if (size <= client->recvwindow_alloced) {
+                return;
+        }
+
+        new_alloced = window_new_size(client->recvwindow_alloced, size);
+
+        client->recvwindow = window_resize(client->recvwindow,
+                                           client->recvwindow_head,
+                                           client->recvwindow_alloced,
+                                           new_alloced);
+        client->recvwindow_head = 0;
+        client->recvwindow_alloced = new_alloced;
+}
+
+// Returns true if it is time to send another SYN packet.  The first
+// packet is sent straight away; after that, retries are spaced out
+// by CLIENT_SYN_INTERVAL.
+
+static int client_should_send_syn(IrmoClient *client, unsigned int nowtime)
+{
+        return client->connect_attempts == CLIENT_CONNECT_ATTEMPTS
+            || nowtime >= client->connect_time + CLIENT_SYN_INTERVAL;
+}
+
+// Write the variables we want to receive from the remote server as
+// an option in the SYN packet.
+
+static void client_write_subscriptions(IrmoClient *client,
+                                       IrmoPacket *packet)
+{
+        IrmoInterface *iface = client->server->client_interface;
+        unsigned int len;
+        unsigned int i;
+
+        len = 0;
+
+        for (i=0; i<iface->nclasses; ++i) {
+                len += (iface->classes[i]->nvariables + 7) / 8;
+        }
+
+        irmo_packet_writei8(packet, SYN_OPTION_SUBSCRIPTIONS);
+        irmo_packet_writei16(packet, len);
+
+        for (i=0; i<iface->nclasses; ++i) {
+                irmo_packet_writebytes(packet,
+                                       client->requested_subscriptions[i],
+                                       (iface->classes[i]->nvariables + 7)
+                                         / 8);
+        }
+}
+
 // run when in the connecting state
 
 static void client_run_connecting(IrmoClient *client)
@@ -209,7 +602,7 @@ static void client_run_connecting(IrmoClient *client)
 
         nowtime = irmo_get_time();
 
-	if (nowtime >= client->connect_time + CLIENT_SYN_INTERVAL) {
+	if (client_should_send_syn(client, nowtime)) {
 
 		// run out of connection attempts?
 
@@ -246,10 +639,31 @@ static void client_run_connecting(IrmoClient *client)
 
 
 			irmo_packet_writei16(packet, PACKET_FLAG_SYN);
-			irmo_packet_writei16(packet, IRMO_PROTOCOL_VERSION);
+
+                        // The protocol version also says which packet
+                        // format to use.
+
+			if (client->compact) {
+				irmo_packet_writei16(packet,
+				             IRMO_PROTOCOL_VERSION_COMPACT);
+			} else {
+				irmo_packet_writei16(packet,
+				             IRMO_PROTOCOL_VERSION);
+			}
+
 			irmo_packet_writei32(packet, local_hash);
 			irmo_packet_writei32(packet, remote_hash);
 
+                        if (client->requested_subscriptions != NULL) {
+                                client_write_subscriptions(client, packet);
+                        }
+
+                        // Largest packet size we want to use.
+
+                        irmo_packet_writei8(packet, SYN_OPTION_MTU);
+                        irmo_packet_writei16(packet, 2);
+                        irmo_packet_writei16(packet, client->mtu_max);
+
 			// no hostname yet, fixme
 		} else {
 			// we are the server, sending syn ack replies
@@ -280,7 +694,7 @@ static void client_run_disconnecting(IrmoClient *client)
 
         nowtime = irmo_get_time();
 
-	if (nowtime >= client->connect_time + CLIENT_SYN_INTERVAL) {
+	if (client_should_send_syn(client, nowtime)) {
 
 		// after several attempts, give up and just set them
 		// as disconnected
@@ -309,6 +723,102 @@ static void client_run_disconnecting(IrmoClient *client)
 	}
 }
 
+void irmo_client_wake(IrmoClient *client)
+{
+        IrmoServer *server = client->server;
+
+        if (client->active || client->running || client->detached) {
+                return;
+        }
+
+        if (server->num_active_clients >= server->active_clients_alloced) {
+                server->active_clients_alloced
+                        = server->active_clients_alloced * 2 + 16;
+                server->active_clients
+                        = irmo_renew(IrmoClient *, server->active_clients,
+                                     server->active_clients_alloced);
+        }
+
+        server->active_clients[server->num_active_clients] = client;
+        ++server->num_active_clients;
+
+        client->active = 1;
+}
+
+// Work out whether a client needs to be run again, and when.  Returns
+// zero if the client does not need to be run until something happens.
+
+static int client_next_run(IrmoClient *client, unsigned int nowtime,
+                            unsigned int *when)
+{
+	switch (client->state) {
+	case IRMO_CLIENT_CONNECTING:
+	case IRMO_CLIENT_DISCONNECTING:
+                if (client_should_send_syn(client, nowtime)) {
+                        *when = nowtime;
+                } else {
+                        *when = client->connect_time + CLIENT_SYN_INTERVAL;
+                }
+                return 1;
+	case IRMO_CLIENT_CONNECTED:
+        case IRMO_CLIENT_SYNCHRONIZED:
+                return irmo_proto_next_run(client, nowtime, when);
+	case IRMO_CLIENT_DISCONNECTED:
+
+                // The client must be run again to be removed from
+                // the server.
+
+                if (client->disconnect_wait) {
+                        *when = client->connect_time
+                              + IRMO_CLIENT_DISCONNECT_WAIT;
+                } else {
+                        *when = nowtime;
+                }
+                return 1;
+        default:
+                irmo_bug();
+                return 0;
+	}
+}
+
+void irmo_client_schedule(IrmoClient *client, unsigned int nowtime)
+{
+        IrmoTimerWheel *timers = &client->server->timers;
+        unsigned int when;
+
+        if (!client_next_run(client, nowtime, &when)) {
+                irmo_timer_wheel_remove(timers, &client->timer);
+        } else if ((int) (when - nowtime) <= 0) {
+                irmo_timer_wheel_remove(timers, &client->timer);
+                irmo_client_wake(client);
+        } else {
+                irmo_timer_wheel_add(timers, &client->timer, when);
+        }
+}
+
+void irmo_client_detach(IrmoClient *client)
+{
+        IrmoServer *server = client->server;
+        unsigned int i;
+
+        irmo_timer_wheel_remove(&server->timers, &client->timer);
+
+        if (client->active) {
+                for (i=0; i<server->num_active_clients; ++i) {
+                        if (server->active_clients[i] == client) {
+                                server->active_clients[i]
+                                  = server->active_clients
+                                        [server->num_active_clients - 1];
+                                --server->num_active_clients;
+                                break;
+                        }
+                }
+        }
+
+        client->active = 0;
+        client->detached = 1;
+}
+
 void irmo_client_run(IrmoClient *client)
 {
 	switch (client->state) {
@@ -366,9 +876,87 @@ IrmoCallback *irmo_client_watch_state(IrmoClient *client,
 	return irmo_callback_list_add(list, func, user_data);
 }
 
+unsigned int irmo_client_pacing_rate(IrmoClient *client)
+{
+        if (client->rtt < IRMO_PACING_MIN_RTT) {
+                return 0;
+        }
+
+        return client->cc->pacing_rate(client);
+}
+
+void irmo_client_negotiate_mtu(IrmoClient *client, unsigned int remote_mtu)
+{
+        if (remote_mtu < IRMO_PROTOCOL_MIN_MTU) {
+                remote_mtu = IRMO_PROTOCOL_MIN_MTU;
+        }
+
+        if (remote_mtu < client->mtu_max) {
+                client->mtu_max = remote_mtu;
+        }
+
+        client->mtu = client->mtu_max;
+        client->mtu_probe_fail = client->mtu_max + 1;
+        client->mtu_probe_size = 0;
+
+        // When probing, start with packets of the default size, which
+        // are likely to get through, and work up from there.
+
+        if (client->mtu_probing && client->mtu > IRMO_PROTOCOL_MTU) {
+                client->mtu = IRMO_PROTOCOL_MTU;
+        }
+
+        // The initial congestion window is based on the packet size.
+
+        client->cc->init(client);
+        client->pacing_tokens = (float) (IRMO_PACING_BURST * client->mtu);
+}
+
+unsigned int *irmo_client_unreliable_recv(IrmoClient *client,
+                                          IrmoObjectID id)
+{
+        unsigned int new_size;
+
+        if (id >= client->unreliable_recv_size) {
+                new_size = client->unreliable_recv_size * 2 + 64;
+
+                while (new_size <= id) {
+                        new_size *= 2;
+                }
+
+                client->unreliable_recv = irmo_renew(unsigned int,
+                                                     client->unreliable_recv,
+                                                     new_size);
+
+                memset(client->unreliable_recv + client->unreliable_recv_size,
+                       0, sizeof(unsigned int)
+                            * (new_size - client->unreliable_recv_size));
+
+                client->unreliable_recv_size = new_size;
+        }
+
+        return &client->unreliable_recv[id];
+}
+
 unsigned int irmo_client_timeout_time(IrmoClient *client)
 {
-	return (unsigned int) (client->rtt + client->rtt_deviation * 2 + 1);
+        unsigned int result;
+        unsigned int rate;
+
+	result = (unsigned int) (client->rtt + client->rtt_deviation * 2 + 1);
+
+        // When data is paced, the packets that follow an atom are sent
+        // at intervals.  Allow time for enough of them to arrive that a
+        // loss can be detected from their acknowledgements, rather
+        // than timing out first.
+
+        rate = irmo_client_pacing_rate(client);
+
+        if (rate != 0) {
+                result += LOSS_PACKET_THRESHOLD * client->mtu * 1000 / rate;
+        }
+
+        return result;
 }
 
 int irmo_client_ping_time(IrmoClient *client)
@@ -389,6 +977,112 @@ void irmo_client_set_max_sendwindow(IrmoClient *client, unsigned int max)
 	irmo_client_sendq_add_sendwindow(client, max);
 }
 
+void irmo_client_set_congestion_control(IrmoClient *client,
+                                        IrmoCongestionControl cc)
+{
+	irmo_return_if_fail(client != NULL);
+        irmo_return_if_fail(cc >= 0 && cc < IRMO_CONGESTION_NUM_CONTROLS);
+
+        // The new controller starts again from its initial state.
+
+        client->cc = irmo_congestion_controls[cc];
+        client->cc->init(client);
+}
+
+void irmo_client_set_ack_delay(IrmoClient *client, unsigned int ms)
+{
+	irmo_return_if_fail(client != NULL);
+
+        client->ack_delay = ms;
+}
+
+void irmo_client_set_mtu(IrmoClient *client, unsigned int mtu)
+{
+	irmo_return_if_fail(client != NULL);
+        irmo_return_if_fail(client->state == IRMO_CLIENT_CONNECTING);
+        irmo_return_if_fail(mtu >= IRMO_PROTOCOL_MIN_MTU
+                         && mtu <= IRMO_PROTOCOL_MAX_MTU);
+
+        client->mtu = mtu;
+        client->mtu_max = mtu;
+        client->mtu_probe_fail = mtu + 1;
+}
+
+void irmo_client_set_compact(IrmoClient *client, int compact)
+{
+	irmo_return_if_fail(client != NULL);
+        irmo_return_if_fail(client->state == IRMO_CLIENT_CONNECTING);
+
+        client->compact = compact;
+}
+
+void irmo_client_set_mtu_probing(IrmoClient *client, int probe)
+{
+	irmo_return_if_fail(client != NULL);
+
+        client->mtu_probing = probe;
+}
+
+void irmo_client_set_fec(IrmoClient *client, int fec)
+{
+	irmo_return_if_fail(client != NULL);
+
+        client->fec = fec;
+}
+
+void irmo_client_set_string_table_size(IrmoClient *client,
+                                       unsigned int bytes)
+{
+	irmo_return_if_fail(client != NULL);
+
+        irmo_string_table_set_size(client, bytes);
+}
+
+unsigned int irmo_client_get_mtu(IrmoClient *client)
+{
+	irmo_return_val_if_fail(client != NULL, 0);
+
+        return client->mtu;
+}
+
+void irmo_client_set_priority_callback(IrmoClient *client,
+                                       IrmoPriorityCallback callback,
+                                       void *user_data)
+{
+        irmo_return_if_fail(client != NULL);
+
+        client->priority_callback = callback;
+        client->priority_user_data = user_data;
+}
+
+void irmo_client_set_relevance_filter(IrmoClient *client,
+                                      IrmoRelevanceCallback callback,
+                                      void *user_data)
+{
+        irmo_return_if_fail(client != NULL);
+
+        client->relevance_callback = callback;
+        client->relevance_user_data = user_data;
+
+        irmo_client_update_relevance(client);
+}
+
+void irmo_client_update_relevance(IrmoClient *client)
+{
+        irmo_return_if_fail(client != NULL);
+
+        // Until the client is connected, the filter is applied when
+        // the initial world state is sent.
+
+        if (client->server->world == NULL
+         || (client->state != IRMO_CLIENT_CONNECTED
+          && client->state != IRMO_CLIENT_SYNCHRONIZED)) {
+                return;
+        }
+
+        irmo_client_sendq_update_relevance(client);
+}
+
 void irmo_client_get_address(IrmoClient *client, char *buffer,
                              unsigned int buffer_len)
 {
@@ -429,6 +1123,8 @@ void irmo_client_set_state(IrmoClient *client, IrmoClientState state)
                 callback_list = &client->state_change_callbacks[state];
 
                 irmo_client_callback_raise(callback_list, client);
+
+                irmo_client_wake(client);
         }
 }
 
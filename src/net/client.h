@@ -25,17 +25,211 @@
 #include "netbase/net-address.h"
 #include "world/world.h"
 
+#include "congestion.h"
 #include "sendatom.h"
 #include "server.h"
+#include "string-table.h"
+#include "timer-wheel.h"
 
-// maximum sendwindow size
+// maximum sendwindow size.  Only the low 16 bits of sequence numbers
+// are sent, so the window must stay well within half of that range
+// for acknowledgements to be unambiguous.
 
-#define MAX_SENDWINDOW 1024
+#define MAX_SENDWINDOW 0x4000
 
-// maximum packet size: when a packet exceeds this,
-// no more atoms are added to it
+// initial size of the send and receive window ring buffers
+
+#define IRMO_CLIENT_WINDOW_INITIAL 16
+
+// Largest number of recently sent packets for which send times are
+// remembered, for estimating the round trip time.  The buffer grows
+// with the number of packets in flight, up to this size.  Must be a
+// power of two.
+
+#define IRMO_CLIENT_SENT_PACKETS 256
+
+// Number of recently received packets kept for rebuilding lost
+// packets from parity packets.  Must be a power of two.
+
+#define IRMO_CLIENT_RECV_PACKETS 64
+
+// Default maximum packet size: when a packet exceeds this,
+// no more atoms are added to it.  The size used for a client is
+// negotiated when it connects, and must be within the limits below.
 
 #define IRMO_PROTOCOL_MTU 1024
+#define IRMO_PROTOCOL_MIN_MTU 256
+#define IRMO_PROTOCOL_MAX_MTU 16384
+
+// When probing for the largest packet size that reaches a client,
+// probing stops once the largest size known to get through is within
+// this many bytes of the smallest size known not to.
+
+#define IRMO_MTU_PROBE_PRECISION 16
+
+// Number of times a probe of a particular size is sent before it is
+// concluded that packets of that size do not get through.
+
+#define IRMO_MTU_PROBE_ATTEMPTS 3
+
+// Number of full-size packets that may be sent in a burst when data
+// is paced.
+
+#define IRMO_PACING_BURST 2
+
+// An acknowledgement is sent straight away once this many data
+// packets have been received without being acknowledged.
+
+#define IRMO_ACK_PACKETS 2
+
+// Default maximum time, in milliseconds, that acknowledgements are
+// delayed for, waiting for data to send them with.  By default they
+// are sent straight away.
+
+#define IRMO_DEFAULT_ACK_DELAY 0
+
+// Data is not paced for clients with round trip times shorter than
+// this, in milliseconds.  Times are only measured to the nearest
+// millisecond, so there is too little time to spread packets out.
+
+#define IRMO_PACING_MIN_RTT 4
+
+// Time to wait after a client disconnects remotely before destroying
+// it, in milliseconds.
+
+#define IRMO_CLIENT_DISCONNECT_WAIT (10 * 1000)
+
+// Access the atom at the specified position in a client's send or
+// receive window, relative to the start of the window.
+
+#define IRMO_CLIENT_SENDWINDOW(client, i)                                 \
+        ((client)->sendwindow[((client)->sendwindow_head + (i))           \
+                              & ((client)->sendwindow_alloced - 1)])
+
+#define IRMO_CLIENT_RECVWINDOW(client, i)                                 \
+        ((client)->recvwindow[((client)->recvwindow_head + (i))           \
+                              & ((client)->recvwindow_alloced - 1)])
+
+typedef struct _IrmoClientObject IrmoClientObject;
+typedef struct _IrmoClientPriority IrmoClientPriority;
+typedef struct _IrmoSentPacket IrmoSentPacket;
+typedef struct _IrmoReceivedPacket IrmoReceivedPacket;
+
+// Per-client state for an object in the world being served to
+// the client.
+
+struct _IrmoClientObject {
+
+        // Change atom for this object waiting in the send queue, if
+        // any.  New changes to the object are added to this atom.
+
+        IrmoChangeAtom *sendq_atom;
+
+        // New object atom for this object waiting in the send queue,
+        // if any.
+
+        IrmoNewObjectAtom *sendq_new;
+
+        // New object atom for this object in the send window, if
+        // it has not yet been acknowledged.
+
+        IrmoNewObjectAtom *window_new;
+
+        // Send queue key of the last atom pushed for this object.
+        // Atoms for the same object are always sent in order.
+
+        unsigned int sendq_key;
+
+        // List of change atoms for this object in the send window.
+
+        IrmoChangeAtom *window_atoms;
+
+        // In IRMO_REPLICATION_DIRTY_MASK mode, a bitmap of the
+        // variables in the object that have changed and are waiting
+        // to be sent, and the number of bits that are set.
+
+        IrmoObject *dirty_object;
+        uint8_t *dirty;
+        unsigned int ndirty;
+
+        // Accumulated priority of the changes waiting to be sent, if a
+        // priority callback is set, and the last pass in which the
+        // object was accumulated.
+
+        unsigned int priority;
+        unsigned int priority_pass;
+
+        // Non-zero if the object exists at the remote end (or the
+        // atom creating it is waiting to be sent).
+
+        int in_scope;
+
+        // Destroy atom for this object ID that has not yet been
+        // acknowledged.  A new object with this ID cannot be sent
+        // until the remote end has run the destroy atom, so the
+        // object is added to the client's scope_pending list instead.
+
+        IrmoDestroyAtom *destroy_atom;
+        int scope_pending;
+
+        // Cached result of the client's relevance filter, and the
+        // pass in which it was evaluated.
+
+        int relevant;
+        unsigned int relevance_pass;
+
+        // Bitmaps of the unreliable variables in the object that have
+        // changed since they were last sent, and of those sent in
+        // packet unreliable_packet that have not yet been
+        // acknowledged.  unreliable_listed is non-zero if the object
+        // is in the client's unreliable list.
+
+        uint8_t *unreliable_changed;
+        uint8_t *unreliable_unacked;
+        unsigned int unreliable_packet;
+        int unreliable_listed;
+};
+
+// Entry used when sorting the dirty list by accumulated priority.
+
+struct _IrmoClientPriority {
+        IrmoObjectID id;
+        unsigned int priority;
+        unsigned int order;
+};
+
+// Record of a packet containing data that was sent to a client.
+
+struct _IrmoSentPacket {
+
+        // Packet number of the packet.
+
+        unsigned int packet_num;
+
+        // Time that the packet was sent.
+
+        unsigned int sendtime;
+
+        // Non-zero once the packet is known to have been received.
+
+        int acked;
+};
+
+// A packet received from a client, kept for forward error correction.
+
+struct _IrmoReceivedPacket {
+
+        // Packet number of the packet.
+
+        unsigned int packet_num;
+
+        // Contents of the packet, and its length.  The buffer is
+        // reused for later packets, and grows as needed.
+
+        uint8_t *data;
+        unsigned int len;
+        unsigned int alloced;
+};
 
 // client
 
@@ -80,19 +274,84 @@ struct _IrmoClient {
 
 	int disconnect_wait;
 
-	// Send queue.  This is a queue of atoms waiting to be
-        // added to the send window, for transmission to the
+	// Send queue.  This is a priority queue of atoms waiting to
+        // be added to the send window, for transmission to the
         // client.
 
-	IrmoQueue *sendq;
+	IrmoBinaryHeap *sendq;
+
+        // Sequence number to assign to the next atom pushed to the
+        // send queue, and the highest key of any atom pushed so far.
+
+        unsigned int sendq_next_seq;
+        unsigned int sendq_max_key;
+
+        // Table of per-object state, indexed by object ID.  This is
+        // used to find the change atoms for an object in the send
+        // queue and send window, so that new changes can be added to
+        // an existing atom in the send queue, and out of date changes
+        // in the send window can be cleared.  The table is grown as
+        // necessary to cover the highest object ID seen.
+
+        IrmoClientObject *objects;
+        unsigned int objects_size;
+
+        // Replication mode used for this client.
+
+        IrmoReplicationMode replication_mode;
+
+        // In IRMO_REPLICATION_DIRTY_MASK mode, list of the IDs of the
+        // objects that have changes waiting to be sent.  Entries
+        // before dirty_head have already been sent, and entries for
+        // objects without any dirty variables are ignored.
+
+        IrmoObjectID *dirty_list;
+        unsigned int dirty_list_len;
+        unsigned int dirty_list_alloced;
+        unsigned int dirty_head;
+
+        // Callback used to weight changed objects in
+        // IRMO_REPLICATION_DIRTY_MASK mode, and scratch space used
+        // when sorting the dirty list by accumulated priority.
+
+        IrmoPriorityCallback priority_callback;
+        void *priority_user_data;
+        unsigned int priority_pass;
+        IrmoClientPriority *priority_sort;
+        unsigned int priority_sort_alloced;
+
+        // Filter used to decide which objects are sent to the client.
+        // The filter is evaluated at most once per object in each
+        // pass; relevance_pass is incremented to start a new pass.
 
-        // Send queue lookup table.
-	// Change atoms in the send queue are stored in this
-        // table, hashed by object ID, so that new changes can be
-        // added to atoms if a change is made to an object for
-        // which an entry is already in the queue.
+        IrmoRelevanceCallback relevance_callback;
+        void *relevance_user_data;
+        unsigned int relevance_pass;
 
-	IrmoHashTable *sendq_hashtable;
+        // IDs of objects waiting to be sent once the destroy atom for
+        // a previous object with the same ID has been acknowledged.
+
+        IrmoObjectID *scope_pending;
+        unsigned int scope_pending_len;
+        unsigned int scope_pending_alloced;
+
+        // IDs of objects with changes to unreliable variables waiting
+        // to be sent or acknowledged.
+
+        IrmoObjectID *unreliable_list;
+        unsigned int unreliable_list_len;
+        unsigned int unreliable_list_alloced;
+
+        // Flags for the variables sent in an unreliable update, reused
+        // for each object.  This is large enough for the class with
+        // the most variables, and is allocated when first used.
+
+        int *unreliable_scratch;
+
+        // Position in the server's change journal up to which changes
+        // have been added to the send queue.
+
+        unsigned int journal_pos;
 
 	// Sequence number of the first atom in the send window.
 
@@ -102,9 +361,32 @@ struct _IrmoClient {
         // to the client, and are awaiting acknowldegement from
         // the client.
 
-	IrmoSendAtom *sendwindow[MAX_SENDWINDOW];
+        // This is a ring buffer: the first atom in the window is at
+        // index sendwindow_head.  The buffer size is always a power of
+        // two, and it is allocated when the first atom is added.
+
+	IrmoSendAtom **sendwindow;
+	unsigned int sendwindow_head;
+	unsigned int sendwindow_alloced;
 	unsigned int sendwindow_size;
 
+	// Atoms in the send window that have been sent and are waiting
+	// to be acknowledged, in the order that they were last sent,
+	// which is also the order of their packet numbers.  Atoms that
+	// have been selectively acknowledged or detected as lost are
+	// not in the list.
+
+	IrmoSendAtom *inflight_head;
+	IrmoSendAtom *inflight_tail;
+
+	// Total size of the atoms in the send window, in bytes, and
+	// the numbers of atoms in it that have not been sent yet and
+	// that have been detected as lost (but not since received).
+
+	size_t sendwindow_bytes;
+	unsigned int sendwindow_unsent;
+	unsigned int sendwindow_lost;
+
 	// Sequence number of the first atom in the receive window.
 
 	unsigned int recvwindow_start;
@@ -112,15 +394,42 @@ struct _IrmoClient {
         // The receive window.  These are atoms that have been
         // received from the remote client, but not yet executed
         // (generally because of a lost packet earlier in sequence)
+        // This is a ring buffer in the same way as the send window;
+        // empty slots are NULL.
 
 	IrmoSendAtom **recvwindow;
-	unsigned int recvwindow_size;
+	unsigned int recvwindow_head;
+	unsigned int recvwindow_alloced;
 
 	// If true, we need to send an ack to the client to acknowledge
 	// something it has sent us.
 
 	int need_ack;
 
+        // If non-zero, the pending acknowledgement must be sent
+        // straight away, rather than waiting for data to send it with.
+
+        int ack_now;
+
+        // Number of data packets received since an acknowledgement
+        // was last sent.
+
+        unsigned int ack_packets;
+
+        // Time by which the pending acknowledgement must be sent.
+
+        unsigned int ack_deadline;
+
+        // Non-zero if a run of the client finished without sending
+        // the pending acknowledgement.
+
+        int ack_delayed;
+
+        // Maximum time, in milliseconds, that an acknowledgement is
+        // delayed for, waiting for data to send it with.
+
+        unsigned int ack_delay;
+
 	// Callbacks invoked when the client state changes,
         // a separate list for each state.
 
@@ -132,6 +441,98 @@ struct _IrmoClient {
 	float rtt;
 	float rtt_deviation;
 
+	// Packet number to use for the next packet sent.  Every packet
+	// has a new number, so that when a packet is acknowledged it
+	// is known exactly which transmission arrived.
+
+	unsigned int send_packet_num;
+
+	// Packet numbers and send times of recently sent data packets,
+	// indexed by the low bits of the packet number.  The buffer
+	// size is a power of two, and it is allocated when the first
+	// data packet is sent.
+
+	IrmoSentPacket *sent_packets;
+	unsigned int sent_packets_alloced;
+
+	// Largest packet number acknowledged by the remote client, or
+	// zero if nothing has been acknowledged yet.
+
+	unsigned int largest_acked_packet;
+
+	// Losses detected in packets with numbers lower than this are
+	// part of the same loss event as an earlier loss, and do not
+	// reduce the congestion window again.
+
+	unsigned int recovery_packet;
+
+	// Largest packet number received from the remote client, used
+	// to expand the low 16 bits sent in each packet.
+
+	unsigned int recv_packet_num;
+
+	// Largest packet number containing data received from the
+	// remote client, or zero if nothing has been received yet.
+	// This is sent back in acks.
+
+	unsigned int ack_packet_num;
+
+	// Time at which ack_packet_num was received, so that the time
+	// that its acknowledgement was held back for can be sent.
+
+	unsigned int ack_packet_time;
+
+	// Bitmap of the packets before ack_packet_num that have been
+	// received: bit n is set if packet ack_packet_num - 1 - n
+	// arrived.  This is sent back in acks once an unreliable update
+	// has been received (recv_unreliable is non-zero), so that the
+	// sender knows which updates were lost.
+
+	uint32_t recv_packet_mask;
+	int recv_unreliable;
+
+	// Forward error correction when sending to the client: whether
+	// it is enabled, the loss rate measured from acknowledgements,
+	// and the next packet number to be counted in that measurement.
+
+	int fec;
+	float fec_loss;
+	unsigned int fec_loss_packet;
+
+	// The group of packets currently being protected: the number
+	// of the first packet, the time it was sent, a bitmap of the
+	// packets in the group, the number of packets in the group and
+	// the number to send a parity packet after.
+
+	unsigned int fec_first;
+	unsigned int fec_time;
+	uint32_t fec_mask;
+	unsigned int fec_count;
+	unsigned int fec_group_size;
+
+	// Parity of the packets in the group so far: the lengths and
+	// contents of the packets, XORed together.
+
+	unsigned int fec_length;
+	uint8_t *fec_parity;
+	unsigned int fec_parity_len;
+	unsigned int fec_parity_alloced;
+
+	// Non-zero once a parity packet has been received from the
+	// client.  Packets received are then kept, so that a lost
+	// packet can be rebuilt.  The buffer of IRMO_CLIENT_RECV_PACKETS
+	// packets is only allocated when the first parity packet
+	// arrives.
+
+	int recv_fec;
+	IrmoReceivedPacket *recv_packets;
+
+	// Packet number of the newest unreliable update applied to each
+	// object, indexed by object ID.  Older updates are ignored.
+
+	unsigned int *unreliable_recv;
+	unsigned int unreliable_recv_size;
+
 	// Resend backoff factor.  Each time a packet is resent, the
         // time before the next resend is doubled.
         // TODO: Don't do this?
@@ -149,6 +550,61 @@ struct _IrmoClient {
 
 	unsigned int ssthresh;
 
+        // Congestion controller used to set cwnd for this client.
+
+        IrmoCongestionControlClass *cc;
+
+        // Token bucket used to pace the data sent to the client: the
+        // number of bytes that may be sent now, and the time at which
+        // it was last filled.  This may be negative if a packet larger
+        // than the number of tokens has been sent.
+
+        float pacing_tokens;
+        unsigned int pacing_time;
+
+        // Maximum packet size used when sending to the client, and the
+        // largest size that the client will accept, as negotiated in
+        // the SYN handshake.  If probing is enabled, mtu starts at a
+        // size that is likely to get through, and is raised towards
+        // mtu_max as larger probe packets are acknowledged.
+
+        unsigned int mtu;
+        unsigned int mtu_max;
+
+        // If true, packets after the SYN handshake are sent in the
+        // compact format, with variable-length integers.  Requested by
+        // the connecting side in the protocol version of its SYN.
+
+        int compact;
+
+        // Table of strings sent to and received from the client.
+
+        IrmoStringTable strings;
+
+        // Path MTU probing state: whether probing is enabled, the
+        // smallest packet size known not to get through, and the size,
+        // send time and number of attempts of the probe in flight.  If
+        // mtu_probe_size is zero, no probe is in flight.
+
+        int mtu_probing;
+        unsigned int mtu_probe_fail;
+        unsigned int mtu_probe_size;
+        unsigned int mtu_probe_time;
+        unsigned int mtu_probe_attempts;
+
+        // Most recent round trip time measurement, in milliseconds.
+
+        unsigned int last_rtt;
+
+        // Delay-based congestion control state: the smallest round
+        // trip time seen over the whole connection and during the
+        // current round, and the packet number that, once
+        // acknowledged, ends the current round.
+
+        unsigned int cc_base_rtt;
+        unsigned int cc_round_rtt;
+        unsigned int cc_round_end;
+
         // If true, the remote world (that the client is sharing to us)
         // has been synced to us. (ie. we have received the sync point
         // atom)
@@ -172,6 +628,34 @@ struct _IrmoClient {
         // server failed.
 
 	char *connection_error;
+
+        // Variables that the remote end has subscribed to, received in
+        // the initial SYN.  There is one bitmap for each class in the
+        // world being served, indexed by class number.  If NULL, all
+        // variables are sent.
+
+        uint8_t **subscriptions;
+        unsigned int nsubscriptions;
+
+        // For connections, the variables to request from the remote
+        // server, in the same form.  If NULL, all variables are
+        // requested.
+
+        uint8_t **requested_subscriptions;
+        unsigned int nrequested_subscriptions;
+
+        // Timer used to run the client when a retransmission or
+        // connection attempt is due.
+
+        IrmoTimer timer;
+
+        // Non-zero if the client is in the server's list of clients
+        // to be run, if it is being run now, or if it has been removed
+        // from its server and must not be run again.
+
+        int active;
+        int running;
+        int detached;
 };
 
 /*!
@@ -201,6 +685,41 @@ void irmo_client_internal_unref(IrmoClient *client);
 
 void irmo_client_run(IrmoClient *client);
 
+/*!
+ * Get the packet number of the newest unreliable update applied to
+ * an object received from a client, growing the table of packet
+ * numbers if necessary.
+ *
+ * @param client         The client.
+ * @param id             The object ID.
+ * @return               Pointer to the packet number for the object.
+ */
+
+unsigned int *irmo_client_unreliable_recv(IrmoClient *client,
+                                          IrmoObjectID id);
+
+/*!
+ * Get the rate at which data should be sent to a client.
+ *
+ * @param client         The client.
+ * @return               Rate in bytes per second, or zero if data sent
+ *                       to the client is not paced.
+ */
+
+unsigned int irmo_client_pacing_rate(IrmoClient *client);
+
+/*!
+ * Set the maximum packet size for a client, once the largest size
+ * accepted by the remote end is known from the SYN handshake.  The
+ * congestion controller is restarted, as its initial window is
+ * based on the packet size.
+ *
+ * @param client         The client.
+ * @param remote_mtu     Largest packet size accepted by the remote end.
+ */
+
+void irmo_client_negotiate_mtu(IrmoClient *client, unsigned int remote_mtu);
+
 /*!
  * Calculate the timeout time for the specified client, ie. the number of
  * milliseconds after which a sent atom is judged to have timed out.
@@ -219,9 +738,110 @@ unsigned int irmo_client_timeout_time(IrmoClient *client);
 
 void irmo_client_run_recvwindow(IrmoClient *client);
 
+/*!
+ * Add an atom to the end of a client's send window, growing the window
+ * if necessary.  The atom is assigned the next sequence number, and
+ * is marked as not yet sent.
+ *
+ * @param client         The client.
+ * @param atom           The atom to add.
+ */
+
+void irmo_client_sendwindow_push(IrmoClient *client, IrmoSendAtom *atom);
+
+/*!
+ * Remove atoms from the start of a client's send window, once they
+ * have been acknowledged.  The atoms themselves are not freed.
+ *
+ * @param client         The client.
+ * @param length         Number of atoms to remove.
+ */
+
+void irmo_client_sendwindow_advance(IrmoClient *client, unsigned int length);
+
+/*!
+ * Record that an atom in a client's send window is being sent in the
+ * next packet, numbered client->send_packet_num.  The atom is moved
+ * to the end of the list of atoms in flight.
+ *
+ * @param client         The client.
+ * @param atom           The atom.
+ * @param nowtime        The current time.
+ */
+
+void irmo_client_sendwindow_sent(IrmoClient *client, IrmoSendAtom *atom,
+                                 unsigned int nowtime);
+
+/*!
+ * Flag an atom in flight as lost, so that it is resent straight away.
+ *
+ * @param client         The client.
+ * @param atom           The atom.
+ */
+
+void irmo_client_sendwindow_lost(IrmoClient *client, IrmoSendAtom *atom);
+
+/*!
+ * Flag an atom in a client's send window as selectively acknowledged,
+ * so that it is not resent.
+ *
+ * @param client         The client.
+ * @param atom           The atom.
+ */
+
+void irmo_client_sendwindow_sacked(IrmoClient *client, IrmoSendAtom *atom);
+
+/*!
+ * Remove an atom that has been acknowledged from the list of atoms in
+ * flight and the totals for the send window, before it is freed.
+ *
+ * @param client         The client.
+ * @param atom           The atom.
+ */
+
+void irmo_client_sendwindow_acked(IrmoClient *client, IrmoSendAtom *atom);
+
+/*!
+ * Get the record of a data packet sent to a client, growing the buffer
+ * of sent packets if necessary so that packets that may still be
+ * acknowledged are not overwritten.  The record is not filled in.
+ *
+ * @param client         The client.
+ * @param packet_num     The packet number.
+ * @return               Pointer to the record for the packet.
+ */
+
+IrmoSentPacket *irmo_client_sent_packet_new(IrmoClient *client,
+                                            unsigned int packet_num);
+
+/*!
+ * Look up the record of a data packet sent to a client.
+ *
+ * @param client         The client.
+ * @param packet_num     The packet number.
+ * @return               Pointer to the record for the packet, or NULL
+ *                       if there is no record (it did not contain
+ *                       data, or was sent too long ago).
+ */
+
+IrmoSentPacket *irmo_client_sent_packet(IrmoClient *client,
+                                        unsigned int packet_num);
+
+/*!
+ * Grow a client's receive window so that it has space for at least
+ * the specified number of atoms.
+ *
+ * @param client         The client.
+ * @param size           Number of atoms required.
+ */
+
+void irmo_client_recvwindow_reserve(IrmoClient *client, unsigned int size);
+
 /*!
  * Run through send atoms waiting in a client's receive window, executing
- * them before they can be "officially" run, if possible.
+ * them before they can be "officially" run, if possible.  New object
+ * and change atoms are run ahead of earlier atoms for other objects,
+ * so that a lost packet does not delay unrelated objects.
  *
  * @param client         The client.
  * @param start          Start of the range of atoms to execute.
@@ -231,6 +851,58 @@ void irmo_client_run_recvwindow(IrmoClient *client);
 void irmo_client_run_preexec(IrmoClient *client, unsigned int start,
                              unsigned int end);
 
+/*!
+ * Allocate a set of variable subscription bitmaps for an interface,
+ * with all variables subscribed.
+ *
+ * @param iface          The interface.
+ * @return               Array of bitmaps, one for each class.
+ */
+
+uint8_t **irmo_client_subscriptions_new(IrmoInterface *iface);
+
+/*!
+ * Check if the remote end of a client has subscribed to a variable.
+ *
+ * @param client         The client.
+ * @param klass          Class of the object.
+ * @param var            The variable.
+ * @return               Non-zero if changes to the variable should
+ *                       be sent to the client.
+ */
+
+int irmo_client_is_subscribed(IrmoClient *client, IrmoClass *klass,
+                              IrmoClassVar *var);
+
+/*!
+ * Mark a client as needing to be run on the next call to
+ * @ref irmo_server_run, because it has new data to send or has
+ * received a packet.
+ *
+ * @param client         The client.
+ */
+
+void irmo_client_wake(IrmoClient *client);
+
+/*!
+ * After a client has been run, work out when it next needs to be run,
+ * either waking it or setting its timer.
+ *
+ * @param client         The client.
+ * @param nowtime        The current time.
+ */
+
+void irmo_client_schedule(IrmoClient *client, unsigned int nowtime);
+
+/*!
+ * Remove a client from its server's timers and list of clients to be
+ * run.  This is called when the client is removed from the server.
+ *
+ * @param client         The client.
+ */
+
+void irmo_client_detach(IrmoClient *client);
+
 /*!
  * Set the connection state of a client.
  *
@@ -29,13 +29,58 @@
 #include "client.h"
 #include "sendatom.h"
 
-// preexec receive window, run change atoms where possible,
-// asyncronously
+// The atoms in the receive window are in a single sequence, but each
+// object forms an independent stream: a lost packet should only delay
+// the atoms for the objects it affects.  New object and change atoms
+// are therefore run as soon as they arrive where it is safe to do so
+// (preexec), rather than waiting for all earlier atoms to arrive.
+// Other atoms (destroys, method calls, sync points) are only run in
+// sequence by irmo_client_run_recvwindow, but later atoms do not wait
+// for them.
+
+// Try to run an atom ahead of the atoms before it.  Returns true if
+// a new object was created.
+
+static int preexec_atom(IrmoClient *client, IrmoSendAtom *atom)
+{
+	IrmoNewObjectAtom *newobj;
+
+	if (atom->klass == &irmo_change_atom) {
+
+		// Change atoms are ignored if the object does not exist
+		// yet; newer changes to the same variable are checked
+		// by the atom itself.
+
+		irmo_change_atom.run(atom);
+
+	} else if (atom->klass == &irmo_newobject_atom) {
+
+		// The ID of a new object is not reused by the sender until
+		// the destroy atom for the previous object has been
+		// acknowledged, so if no object has this ID, nothing
+		// earlier in the stream is still to be run.  Running the
+		// atom again later is harmless.
+
+		newobj = (IrmoNewObjectAtom *) atom;
+
+		if (irmo_world_get_object_for_id(client->world,
+		                                 newobj->id) == NULL) {
+			irmo_newobject_atom.run(atom);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// preexec receive window, run new object and change atoms where
+// possible, asyncronously
 
 void irmo_client_run_preexec(IrmoClient *client, unsigned int start,
                              unsigned int end)
 {
 	unsigned int i;
+	int created;
 
 	if (start < client->recvwindow_start) {
 		start = client->recvwindow_start;
@@ -43,12 +88,32 @@ void irmo_client_run_preexec(IrmoClient *client, unsigned int start,
 
 	//printf("preexec %i->%i\n", start, end);
 
+	created = 0;
+
 	for (i=start; i<end; ++i) {
 		IrmoSendAtom *atom;
 
-                atom = client->recvwindow[i - client->recvwindow_start];
+                atom = IRMO_CLIENT_RECVWINDOW(client,
+                                              i - client->recvwindow_start);
 
-		// only run change atoms
+		if (atom != NULL) {
+			created = preexec_atom(client, atom) || created;
+                }
+	}
+
+	// Changes received earlier for a newly created object may be
+	// waiting later in the window.
+
+	if (!created) {
+		return;
+	}
+
+	for (i=end; i<client->recvwindow_start + client->recvwindow_alloced;
+	     ++i) {
+		IrmoSendAtom *atom;
+
+                atom = IRMO_CLIENT_RECVWINDOW(client,
+                                              i - client->recvwindow_start);
 
 		if (atom != NULL && atom->klass == &irmo_change_atom) {
 			irmo_change_atom.run(atom);
@@ -60,38 +125,35 @@ void irmo_client_run_preexec(IrmoClient *client, unsigned int start,
 
 void irmo_client_run_recvwindow(IrmoClient *client)
 {
-	unsigned int i, n;
+	unsigned int i;
 
 	// nothing to run?
 	
-	if (client->recvwindow[0] == NULL) {
+	if (client->recvwindow_alloced == 0
+	 || IRMO_CLIENT_RECVWINDOW(client, 0) == NULL) {
 		return;
         }
 	
-	// run as many from the start as possible
+	// run as many from the start as possible, clearing each
+	// slot as we go so that it can be reused
 	
 	for (i=0;
-	     i<client->recvwindow_size && client->recvwindow[i] != NULL;
+	     i<client->recvwindow_alloced
+	      && IRMO_CLIENT_RECVWINDOW(client, i) != NULL;
 	     ++i) {
-		IrmoSendAtom *atom = client->recvwindow[i];
+		IrmoSendAtom *atom = IRMO_CLIENT_RECVWINDOW(client, i);
 
 		atom->klass->run(atom);
 
 		irmo_sendatom_free(atom);
+
+		IRMO_CLIENT_RECVWINDOW(client, i) = NULL;
 	}
 	
 	// move recvwindow along
 
 	client->recvwindow_start += i;
-	
-	memcpy(client->recvwindow,
-	       client->recvwindow + i,
-	       sizeof(*client->recvwindow) * (client->recvwindow_size-i));
-
-	// clear the end
-	
-	for (n=client->recvwindow_size-i; n<client->recvwindow_size; ++n) {
-		client->recvwindow[n] = NULL;
-        }
+	client->recvwindow_head = (client->recvwindow_head + i)
+	                        & (client->recvwindow_alloced - 1);
 }
 
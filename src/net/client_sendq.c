@@ -26,6 +26,499 @@
 #include <irmo/iterator.h>
 
 #include "sendatom.h"
+#include "server-journal.h"
+
+// Get the entry in the object table for the specified object ID,
+// growing the table if necessary.
+
+static IrmoClientObject *client_object(IrmoClient *client, IrmoObjectID id)
+{
+        unsigned int new_size;
+
+        if (id >= client->objects_size) {
+
+                // Grow exponentially.
+
+                new_size = client->objects_size;
+
+                if (new_size == 0) {
+                        new_size = 64;
+                }
+
+                while (new_size <= id) {
+                        new_size *= 2;
+                }
+
+                client->objects = irmo_renew(IrmoClientObject,
+                                             client->objects, new_size);
+
+                memset(client->objects + client->objects_size, 0,
+                       sizeof(IrmoClientObject)
+                         * (new_size - client->objects_size));
+
+                client->objects_size = new_size;
+        }
+
+        return &client->objects[id];
+}
+
+// Add a change atom to the list of atoms in the send window for
+// its object.
+
+static void window_link_change(IrmoClient *client, IrmoChangeAtom *atom)
+{
+        IrmoClientObject *entry;
+
+        entry = client_object(client, atom->id);
+
+        atom->window_prev = NULL;
+        atom->window_next = entry->window_atoms;
+
+        if (entry->window_atoms != NULL) {
+                entry->window_atoms->window_prev = atom;
+        }
+
+        entry->window_atoms = atom;
+}
+
+void irmo_client_sendq_unlink_change(IrmoChangeAtom *atom)
+{
+        IrmoClient *client = atom->sendatom.client;
+        IrmoClientObject *entry;
+
+        // Only atoms being sent are stored in the object table.
+
+        if (atom->object == NULL || client == NULL
+         || atom->id >= client->objects_size) {
+                return;
+        }
+
+        entry = &client->objects[atom->id];
+
+        if (entry->sendq_atom == atom) {
+                entry->sendq_atom = NULL;
+                return;
+        }
+
+        if (atom->window_prev != NULL) {
+                atom->window_prev->window_next = atom->window_next;
+        } else if (entry->window_atoms == atom) {
+                entry->window_atoms = atom->window_next;
+        } else {
+                // Not in the list.
+
+                return;
+        }
+
+        if (atom->window_next != NULL) {
+                atom->window_next->window_prev = atom->window_prev;
+        }
+
+        atom->window_prev = NULL;
+        atom->window_next = NULL;
+}
+
+void irmo_client_sendq_unlink_destroy(IrmoDestroyAtom *atom)
+{
+        IrmoClient *client = atom->sendatom.client;
+        IrmoClientObject *entry;
+
+        // Only atoms being sent are stored in the object table.
+
+        if (client == NULL || atom->id >= client->objects_size) {
+                return;
+        }
+
+        entry = &client->objects[atom->id];
+
+        if (entry->destroy_atom == atom) {
+                entry->destroy_atom = NULL;
+        }
+}
+
+void irmo_client_sendq_unlink_new(IrmoNewObjectAtom *atom)
+{
+        IrmoClient *client = atom->sendatom.client;
+        IrmoClientObject *entry;
+
+        if (client == NULL || atom->id >= client->objects_size) {
+                return;
+        }
+
+        entry = &client->objects[atom->id];
+
+        if (entry->sendq_new == atom) {
+                entry->sendq_new = NULL;
+        }
+
+        if (entry->window_new == atom) {
+                entry->window_new = NULL;
+        }
+}
+
+// Create a new change atom for the specified object.
+
+static IrmoChangeAtom *new_change_atom(IrmoObject *object)
+{
+	IrmoChangeAtom *atom;
+
+	atom = irmo_new0(IrmoChangeAtom, 1);
+	IRMO_SENDATOM(atom)->klass = &irmo_change_atom;
+
+	atom->id = object->id;
+	atom->object = object;
+	atom->changed = irmo_new0(int, object->objclass->nvariables);
+	atom->nchanged = 0;
+
+        return atom;
+}
+
+// In IRMO_REPLICATION_DIRTY_MASK mode, mark a variable in an object as
+// changed.
+
+static void mark_dirty(IrmoClient *client, IrmoObject *object,
+                       IrmoClassVar *var)
+{
+        IrmoClientObject *entry;
+        uint8_t bit;
+
+        entry = client_object(client, object->id);
+
+        if (entry->dirty == NULL) {
+                entry->dirty = irmo_new0(uint8_t,
+                                         (object->objclass->nvariables + 7)
+                                           / 8);
+        }
+
+        bit = (uint8_t) (1 << (var->index % 8));
+
+        if ((entry->dirty[var->index / 8] & bit) != 0) {
+                return;
+        }
+
+        entry->dirty[var->index / 8] |= bit;
+        entry->dirty_object = object;
+        ++entry->ndirty;
+
+        // If this is the first change, add to the dirty list.
+
+        if (entry->ndirty == 1) {
+                if (client->dirty_list_len >= client->dirty_list_alloced) {
+                        client->dirty_list_alloced
+                                = client->dirty_list_alloced * 2 + 16;
+                        client->dirty_list
+                                = irmo_renew(IrmoObjectID,
+                                             client->dirty_list,
+                                             client->dirty_list_alloced);
+                }
+
+                client->dirty_list[client->dirty_list_len] = object->id;
+                ++client->dirty_list_len;
+
+                irmo_client_wake(client);
+        }
+}
+
+// Clear all changes for an object marked in IRMO_REPLICATION_DIRTY_MASK
+// mode.  The object's ID is left in the dirty list, but will be ignored.
+
+static void clear_dirty(IrmoClientObject *entry)
+{
+        free(entry->dirty);
+        entry->dirty = NULL;
+        entry->dirty_object = NULL;
+        entry->ndirty = 0;
+        entry->priority = 0;
+}
+
+// Record a change to an unreliable variable in an object.  Changes to
+// unreliable variables are not sent through the send window; the
+// latest values are sent once the client is next run.
+
+static void mark_unreliable(IrmoClient *client, IrmoObject *object,
+                            IrmoClassVar *var)
+{
+        IrmoClientObject *entry;
+        unsigned int bitmap_size;
+
+        entry = client_object(client, object->id);
+
+        if (entry->unreliable_changed == NULL) {
+                bitmap_size = (object->objclass->nvariables + 7) / 8;
+                entry->unreliable_changed = irmo_new0(uint8_t, bitmap_size);
+                entry->unreliable_unacked = irmo_new0(uint8_t, bitmap_size);
+        }
+
+        entry->unreliable_changed[var->index / 8]
+                |= (uint8_t) (1 << (var->index % 8));
+
+        // Add to the unreliable list, if not there already.
+
+        if (!entry->unreliable_listed) {
+                if (client->unreliable_list_len
+                 >= client->unreliable_list_alloced) {
+                        client->unreliable_list_alloced
+                                = client->unreliable_list_alloced * 2 + 16;
+                        client->unreliable_list
+                                = irmo_renew(IrmoObjectID,
+                                             client->unreliable_list,
+                                             client->unreliable_list_alloced);
+                }
+
+                client->unreliable_list[client->unreliable_list_len]
+                        = object->id;
+                ++client->unreliable_list_len;
+                entry->unreliable_listed = 1;
+        }
+
+        irmo_client_wake(client);
+}
+
+// Forget the unreliable changes for an object.  The object's ID is
+// left in the unreliable list, but will be ignored.
+
+static void clear_unreliable(IrmoClientObject *entry)
+{
+        free(entry->unreliable_changed);
+        free(entry->unreliable_unacked);
+        entry->unreliable_changed = NULL;
+        entry->unreliable_unacked = NULL;
+}
+
+// Check if a change atom for an object changes any of its unreliable
+// variables.
+
+static int atom_changes_unreliable(IrmoChangeAtom *atom, IrmoClass *klass)
+{
+        unsigned int i;
+
+        for (i=0; i<klass->nvariables; ++i) {
+                if (atom->changed[i] && klass->variables[i]->unreliable) {
+                        return 1;
+                }
+        }
+
+        return 0;
+}
+
+int irmo_client_sendq_unreliable_held(IrmoClient *client,
+                                      IrmoObject *object)
+{
+        IrmoClientObject *entry;
+        IrmoChangeAtom *atom;
+        unsigned int i;
+
+        entry = client_object(client, object->id);
+
+        // The object must exist at the remote end.
+
+        if (entry->sendq_new != NULL || entry->window_new != NULL) {
+                return 1;
+        }
+
+        // Values sent through the send window are applied in order,
+        // and might overwrite a newer value sent unreliably.
+
+        if (entry->sendq_atom != NULL
+         && atom_changes_unreliable(entry->sendq_atom, object->objclass)) {
+                return 1;
+        }
+
+        for (atom = entry->window_atoms; atom != NULL;
+             atom = atom->window_next) {
+                if (atom_changes_unreliable(atom, object->objclass)) {
+                        return 1;
+                }
+        }
+
+        // Likewise for changes recorded in dirty mask mode before the
+        // world state was synchronized.
+
+        if (entry->ndirty > 0) {
+                for (i=0; i<object->objclass->nvariables; ++i) {
+                        if ((entry->dirty[i / 8] & (1 << (i % 8))) != 0
+                         && object->objclass->variables[i]->unreliable) {
+                                return 1;
+                        }
+                }
+        }
+
+        return 0;
+}
+
+// In IRMO_REPLICATION_DIRTY_MASK mode, build a change atom for the next
+// object in the dirty list.  Returns NULL if there are no objects
+// with changes waiting to be sent.
+
+static IrmoChangeAtom *pop_dirty(IrmoClient *client)
+{
+        IrmoClientObject *entry;
+        IrmoChangeAtom *atom;
+        IrmoObject *object;
+        IrmoObjectID id;
+        unsigned int i;
+
+        while (client->dirty_head < client->dirty_list_len) {
+
+                id = client->dirty_list[client->dirty_head];
+                ++client->dirty_head;
+
+                entry = &client->objects[id];
+
+                if (entry->ndirty == 0) {
+                        continue;
+                }
+
+                // Build an atom from the bitmap, then clear the bitmap.
+                // The bitmap itself is kept, as the object is likely
+                // to change again.
+
+                object = entry->dirty_object;
+                atom = new_change_atom(object);
+
+                for (i=0; i<object->objclass->nvariables; ++i) {
+                        if (entry->dirty[i / 8] & (1 << (i % 8))) {
+                                atom->changed[i] = 1;
+                        }
+                }
+
+                atom->nchanged = (int) entry->ndirty;
+
+                memset(entry->dirty, 0,
+                       (object->objclass->nvariables + 7) / 8);
+                entry->ndirty = 0;
+                entry->priority = 0;
+
+                return atom;
+        }
+
+        // The list is empty; start again from the beginning.
+
+        client->dirty_head = 0;
+        client->dirty_list_len = 0;
+
+        return NULL;
+}
+
+// Comparison function for sorting the dirty list: highest accumulated
+// priority first, otherwise in the order the objects were changed.
+
+static int priority_compare(const void *value1, const void *value2)
+{
+        const IrmoClientPriority *entry1 = value1;
+        const IrmoClientPriority *entry2 = value2;
+
+        if (entry1->priority != entry2->priority) {
+                return entry1->priority > entry2->priority ? -1 : 1;
+        }
+
+        return entry1->order < entry2->order ? -1 : 1;
+}
+
+void irmo_client_sendq_accumulate(IrmoClient *client)
+{
+        IrmoClientObject *entry;
+        IrmoClientPriority *sort_entry;
+        IrmoObjectID id;
+        unsigned int num_entries;
+        unsigned int i;
+
+        if (client->priority_callback == NULL
+         || client->dirty_head >= client->dirty_list_len) {
+                return;
+        }
+
+        if (client->priority_sort_alloced < client->dirty_list_alloced) {
+                client->priority_sort_alloced = client->dirty_list_alloced;
+                client->priority_sort
+                        = irmo_renew(IrmoClientPriority,
+                                     client->priority_sort,
+                                     client->priority_sort_alloced);
+        }
+
+        // Each object with changes waiting accumulates its weight.
+        // Objects that are no longer dirty are dropped from the list;
+        // an object can appear twice if it was destroyed and its ID
+        // reused, so only count each object once per pass.
+
+        ++client->priority_pass;
+        num_entries = 0;
+
+        for (i=client->dirty_head; i<client->dirty_list_len; ++i) {
+                id = client->dirty_list[i];
+                entry = &client->objects[id];
+
+                if (entry->ndirty == 0
+                 || entry->priority_pass == client->priority_pass) {
+                        continue;
+                }
+
+                entry->priority_pass = client->priority_pass;
+                entry->priority += client->priority_callback(
+                                        client, entry->dirty_object,
+                                        client->priority_user_data);
+
+                sort_entry = &client->priority_sort[num_entries];
+                sort_entry->id = id;
+                sort_entry->priority = entry->priority;
+                sort_entry->order = num_entries;
+                ++num_entries;
+        }
+
+        qsort(client->priority_sort, num_entries,
+              sizeof(IrmoClientPriority), priority_compare);
+
+        // Rebuild the dirty list in priority order.
+
+        for (i=0; i<num_entries; ++i) {
+                client->dirty_list[i] = client->priority_sort[i].id;
+        }
+
+        client->dirty_head = 0;
+        client->dirty_list_len = num_entries;
+}
+
+// Compare send queue keys, allowing for wraparound.
+
+static int compare_keys(unsigned int key1, unsigned int key2)
+{
+        return (int) (key1 - key2);
+}
+
+// Comparison function for ordering atoms in the send queue.
+
+static int sendq_compare(IrmoBinaryHeapValue value1,
+                         IrmoBinaryHeapValue value2)
+{
+        IrmoSendAtom *atom1 = value1;
+        IrmoSendAtom *atom2 = value2;
+        int result;
+
+        result = compare_keys(atom1->sendq_key, atom2->sendq_key);
+
+        if (result == 0) {
+                result = compare_keys(atom1->sendq_seq, atom2->sendq_seq);
+        }
+
+        return result;
+}
+
+IrmoBinaryHeap *irmo_client_sendq_new(void)
+{
+        IrmoBinaryHeap *result;
+
+        result = irmo_binary_heap_new(IRMO_BINARY_HEAP_TYPE_MIN,
+                                      sendq_compare);
+        irmo_alloc_assert(result != NULL);
+
+        return result;
+}
+
+int irmo_client_sendq_is_empty(IrmoClient *client)
+{
+        return irmo_binary_heap_num_entries(client->sendq) == 0
+            && client->dirty_head >= client->dirty_list_len;
+}
 
 IrmoSendAtom *irmo_client_sendq_pop(IrmoClient *client)
 {
@@ -33,10 +526,21 @@ IrmoSendAtom *irmo_client_sendq_pop(IrmoClient *client)
 
 	while (1) {
 	
-		atom = (IrmoSendAtom *) irmo_queue_pop_head(client->sendq);
+		atom = (IrmoSendAtom *) irmo_binary_heap_pop(client->sendq);
 		
+		// Once the queue is empty, build change atoms for
+                // objects in the dirty list.
+
 		if (atom == NULL) {
-			return NULL;
+                        atom = IRMO_SENDATOM(pop_dirty(client));
+
+                        if (atom == NULL) {
+                                return NULL;
+                        }
+
+                        atom->client = client;
+                        atom->len = atom->klass->length(atom);
+                        break;
                 }
 
 		// automatically ignore and delete NULL atoms that
@@ -49,54 +553,233 @@ IrmoSendAtom *irmo_client_sendq_pop(IrmoClient *client)
 		irmo_sendatom_free(atom);
 	} 
 
-	// if a change, remove from the change hash
+	// if a change, the atom is moving from the send queue to
+        // the send window.
 
 	if (atom->klass == &irmo_change_atom) {
 		IrmoChangeAtom *catom = (IrmoChangeAtom *) atom;
+                IrmoClientObject *entry;
 
-		irmo_hash_table_remove(client->sendq_hashtable,
-				       IRMO_POINTER_KEY(catom->object->id));
-	}
+                entry = client_object(client, catom->id);
+
+                if (entry->sendq_atom == catom) {
+                        entry->sendq_atom = NULL;
+                }
+
+                window_link_change(client, catom);
+	} else if (atom->klass == &irmo_newobject_atom) {
+                IrmoNewObjectAtom *natom = (IrmoNewObjectAtom *) atom;
+                IrmoClientObject *entry;
+
+                entry = client_object(client, natom->id);
+                entry->sendq_new = NULL;
+                entry->window_new = natom;
+
+                // The initial values are copied into the atom, so that
+                // retransmissions send the same values as the first
+                // transmission; later changes are sent in change atoms.
+
+                irmo_newobject_atom_set_state(natom);
+        }
 
 	return atom;
 }
 
+// Get the priority of an atom to be pushed to the send queue, from
+// the priorities set on the server for the atom type and the class of
+// the object it affects.
+
+static unsigned int atom_priority(IrmoClient *client, IrmoSendAtom *atom)
+{
+        IrmoServer *server = client->server;
+        unsigned int classnum;
+
+        switch (atom->klass->type) {
+        case ATOM_NEW:
+                classnum = ((IrmoNewObjectAtom *) atom)->classnum;
+                return server->priorities[IRMO_PRIORITY_NEW_OBJECT]
+                     + server->class_priorities[classnum];
+        case ATOM_CHANGE:
+                classnum = ((IrmoChangeAtom *) atom)->object->objclass->index;
+                return server->priorities[IRMO_PRIORITY_CHANGE]
+                     + server->class_priorities[classnum];
+        case ATOM_DESTROY:
+                return server->priorities[IRMO_PRIORITY_DESTROY];
+        case ATOM_METHOD:
+                return server->priorities[IRMO_PRIORITY_METHOD];
+        default:
+                return 0;
+        }
+}
+
+// Get the entry in the object table for the object affected by an atom,
+// or NULL if the atom does not affect an object.
+
+static IrmoClientObject *atom_object(IrmoClient *client, IrmoSendAtom *atom)
+{
+        switch (atom->klass->type) {
+        case ATOM_NEW:
+                return client_object(client,
+                                     ((IrmoNewObjectAtom *) atom)->id);
+        case ATOM_CHANGE:
+                return client_object(client,
+                                     ((IrmoChangeAtom *) atom)->id);
+        case ATOM_DESTROY:
+                return client_object(client,
+                                     ((IrmoDestroyAtom *) atom)->id);
+        default:
+                return NULL;
+        }
+}
+
 void irmo_client_sendq_push(IrmoClient *client, IrmoSendAtom *atom)
 {
+        IrmoClientObject *entry;
+        unsigned int key;
+
+        // Atoms are sent in the order they are pushed, but each atom
+        // may jump ahead of as many previously-pushed atoms as its
+        // priority.  This means that low priority atoms are still
+        // sent eventually.
+
+        atom->sendq_seq = client->sendq_next_seq;
+        ++client->sendq_next_seq;
+
+        key = atom->sendq_seq - atom_priority(client, atom);
+
+        // Atoms affecting the same object must be sent in order.
+
+        entry = atom_object(client, atom);
+
+        if (entry != NULL) {
+                if (compare_keys(key, entry->sendq_key) < 0) {
+                        key = entry->sendq_key;
+                }
+
+                entry->sendq_key = key;
+        }
+
+        // The sync point must follow all atoms that came before it.
+
+        if (atom->klass == &irmo_sync_point_atom
+         && compare_keys(key, client->sendq_max_key) < 0) {
+                key = client->sendq_max_key;
+        }
+
+        if (compare_keys(key, client->sendq_max_key) > 0) {
+                client->sendq_max_key = key;
+        }
+
+        atom->sendq_key = key;
+
 	if (atom->klass == &irmo_change_atom) {
 		IrmoChangeAtom *catom = (IrmoChangeAtom *) atom;
-                void *key = IRMO_POINTER_KEY(catom->object->id);
 
-                irmo_alloc_assert(irmo_hash_table_insert(client->sendq_hashtable,
-                                                         key,
-                                                         atom));
-	}
+                entry->sendq_atom = catom;
+	} else if (atom->klass == &irmo_newobject_atom) {
+                IrmoNewObjectAtom *natom = (IrmoNewObjectAtom *) atom;
+
+                entry->sendq_new = natom;
+        }
 
 	atom->client = client;
 	atom->len = atom->klass->length(atom);
 
-	irmo_alloc_assert(irmo_queue_push_tail(client->sendq, atom));
+	irmo_alloc_assert(irmo_binary_heap_insert(client->sendq, atom));
+
+        irmo_client_wake(client);
 }
 
-void irmo_client_sendq_add_new(IrmoClient *client, IrmoObject *object)
+// Check if an object is relevant to a client.  The filter is only
+// evaluated once per object in each pass.
+
+static int object_relevant(IrmoClient *client, IrmoClientObject *entry,
+                           IrmoObject *object)
+{
+        if (client->relevance_callback == NULL) {
+                return 1;
+        }
+
+        if (entry->relevance_pass != client->relevance_pass) {
+                entry->relevant = client->relevance_callback(
+                                        client, object,
+                                        client->relevance_user_data) != 0;
+                entry->relevance_pass = client->relevance_pass;
+        }
+
+        return entry->relevant;
+}
+
+// Add an object to the client's scope, queueing an atom to create it
+// at the remote end, along with its current state.  If the destroy
+// atom for a previous object with the same ID has not been
+// acknowledged yet, the object is added to the pending list instead.
+
+static void enter_scope(IrmoClient *client, IrmoClientObject *entry,
+                       IrmoObject *object)
 {
 	IrmoNewObjectAtom *atom;
 
+        if (entry->destroy_atom != NULL) {
+                if (!entry->scope_pending) {
+                        if (client->scope_pending_len
+                         >= client->scope_pending_alloced) {
+                                client->scope_pending_alloced
+                                   = client->scope_pending_alloced * 2 + 16;
+                                client->scope_pending
+                                   = irmo_renew(IrmoObjectID,
+                                                client->scope_pending,
+                                                client->scope_pending_alloced);
+                        }
+
+                        client->scope_pending[client->scope_pending_len]
+                                = object->id;
+                        ++client->scope_pending_len;
+                        entry->scope_pending = 1;
+                }
+
+                return;
+        }
+
 	atom = irmo_new0(IrmoNewObjectAtom, 1);
 
 	atom->sendatom.klass = &irmo_newobject_atom;
 	atom->id = object->id;
 	atom->classnum = object->objclass->index;
+	atom->objclass = object->objclass;
+	atom->object = object;
+
+        entry->in_scope = 1;
 
 	irmo_client_sendq_push(client, IRMO_SENDATOM(atom));
 }
 
+void irmo_client_sendq_add_new(IrmoClient *client, IrmoObject *object)
+{
+        IrmoClientObject *entry;
+
+        entry = client_object(client, object->id);
+
+        if (!entry->in_scope && object_relevant(client, entry, object)) {
+                enter_scope(client, entry, object);
+        }
+}
+
 static void clear_existing_change(IrmoClient *client,
                                   IrmoObject *obj,
                                   IrmoClassVar *var)
 {
+        IrmoClientObject *entry;
 	IrmoChangeAtom *atom;
-	unsigned int i;
+
+        entry = client_object(client, obj->id);
+
+        // The initial value sent when the object was created is also
+        // out of date.
+
+        if (entry->window_new != NULL) {
+                entry->window_new->changed[var->index] = 0;
+        }
 
 	// Search the send window for a change atom affecting this
         // object.  If the atom changes this variable, that change
@@ -106,18 +789,11 @@ static void clear_existing_change(IrmoClient *client,
         // Once a change atom has no variables left to change, it
         // is nullified (converted to a null atom).
 
-	for (i=0; i<client->sendwindow_size; ++i) {
+        atom = entry->window_atoms;
 
-		// is this a change atom for this variable in
-		// this object?
+	for (; atom != NULL; atom = atom->window_next) {
 
-		if (client->sendwindow[i]->klass != &irmo_change_atom) {
-			continue;
-                }
-
-		atom = (IrmoChangeAtom *) client->sendwindow[i];
-
-		if (atom->object == obj && atom->changed[var->index]) {
+		if (atom->changed[var->index]) {
 
 			// Unset the change in the atom and update
 			// change count
@@ -140,38 +816,28 @@ static void clear_existing_change(IrmoClient *client,
 	}
 }
 
-void irmo_client_sendq_add_change(IrmoClient *client,
-				  IrmoObject *object,
-                                  IrmoClassVar *var)
+// Add a change to the change atom for the object in the send queue,
+// creating a new atom if there is not one already.
+
+static void queue_change(IrmoClient *client, IrmoObject *object,
+                         IrmoClassVar *var)
 {
 	IrmoChangeAtom *atom;
 
-        // Clear out an existing change for this variable, if one
-        // is already in the send window - that change is now out
-        // of date.
-        // Don't nullify atoms until the world state has been
-        // synchronized, as the client needs to have the complete
-        // world state when it reaches the synchronization point.
+        // Variables that the client has not subscribed to are
+        // never sent.
 
-        if (client->remote_synced) {
-                clear_existing_change(client, object, var);
+        if (!irmo_client_is_subscribed(client, object->objclass, var)) {
+                return;
         }
 
 	// Check if there is an existing atom for this object in
 	// the send queue, and reuse it if possible.
 
-	atom = irmo_hash_table_lookup(client->sendq_hashtable,
-				      IRMO_POINTER_KEY(object->id));
+	atom = client_object(client, object->id)->sendq_atom;
 
 	if (atom == NULL) {
-		atom = irmo_new0(IrmoChangeAtom, 1);
-		IRMO_SENDATOM(atom)->klass = &irmo_change_atom;
-
-		atom->id = object->id;
-		atom->object = object;
-		atom->changed = irmo_new0(int, object->objclass->nvariables);
-		atom->nchanged = 0;
-
+		atom = new_change_atom(object);
 		irmo_client_sendq_push(client, IRMO_SENDATOM(atom));
 	}
 
@@ -187,40 +853,138 @@ void irmo_client_sendq_add_change(IrmoClient *client,
 	atom->sendatom.len = irmo_change_atom.length(IRMO_SENDATOM(atom));
 }
 
-void irmo_client_sendq_add_destroy(IrmoClient *client, IrmoObject *object)
+static void leave_scope(IrmoClient *client, IrmoObject *object);
+
+void irmo_client_sendq_add_change(IrmoClient *client,
+				  IrmoObject *object,
+                                  IrmoClassVar *var)
+{
+        IrmoClientObject *entry;
+
+        entry = client_object(client, object->id);
+
+        // Changes to objects outside the client's scope are ignored,
+        // unless the change brings the object into scope.  Likewise,
+        // the change may take the object out of scope.
+
+        if (!entry->in_scope) {
+                if (object_relevant(client, entry, object)) {
+                        enter_scope(client, entry, object);
+                }
+
+                return;
+        }
+
+        if (!object_relevant(client, entry, object)) {
+                leave_scope(client, object);
+                return;
+        }
+
+        // Until the atom creating the object leaves the send queue,
+        // it carries the current values of all of the variables.
+
+        if (entry->sendq_new != NULL) {
+                entry->sendq_new->sendatom.len = irmo_newobject_atom.length(
+                                        IRMO_SENDATOM(entry->sendq_new));
+                return;
+        }
+
+        if (!irmo_client_is_subscribed(client, object->objclass, var)) {
+                return;
+        }
+
+        // Changes to unreliable variables bypass the send window once
+        // the world state has been synchronized.  Until the object's
+        // state has been sent, changes are added to it instead.
+
+        if (var->unreliable && client->remote_synced
+         && (entry->sendq_atom == NULL
+          || !entry->sendq_atom->changed[var->index])) {
+                mark_unreliable(client, object, var);
+                return;
+        }
+
+        // Clear out an existing change for this variable, if one
+        // is already in the send window - that change is now out
+        // of date.
+        // Don't nullify atoms until the world state has been
+        // synchronized, as the client needs to have the complete
+        // world state when it reaches the synchronization point.
+
+        if (client->remote_synced) {
+                clear_existing_change(client, object, var);
+        }
+
+        // In dirty mask mode, just record that the variable has
+        // changed; the atom is built when there is space for it in
+        // the send window.  If there is already an atom for the
+        // object in the send queue (part of the initial world
+        // state), add to it instead.
+
+        if (client->replication_mode == IRMO_REPLICATION_DIRTY_MASK
+         && client_object(client, object->id)->sendq_atom == NULL) {
+                mark_dirty(client, object, var);
+        } else {
+                queue_change(client, object, var);
+        }
+}
+
+// Remove an object from the client's scope, destroying it at the
+// remote end.
+
+static void leave_scope(IrmoClient *client, IrmoObject *object)
 {
+        IrmoClientObject *entry;
 	IrmoDestroyAtom *atom;
-	unsigned int i;
 	
-	// Check for any change atoms referring to this object
+        entry = client_object(client, object->id);
+        entry->in_scope = 0;
 
-	atom = irmo_hash_table_lookup(client->sendq_hashtable,
-				      IRMO_POINTER_KEY(object->id));
+        // Unreliable changes are not needed once the object is gone.
 
-	// Convert to a ATOM_NULL atom
+        clear_unreliable(entry);
 
-	if (atom != NULL) {
-		irmo_sendatom_nullify(IRMO_SENDATOM(atom));
-		irmo_hash_table_remove(client->sendq_hashtable,
-				       IRMO_POINTER_KEY(object->id));
-	}
-
-	// Nullify atoms in send window too
+        // If the object has not been created at the remote end yet,
+        // there is no need to send anything at all.
 
-	for (i=0; i<client->sendwindow_size; ++i) {
-		IrmoChangeAtom *catom;
+        if (entry->sendq_new != NULL) {
+                irmo_sendatom_nullify(IRMO_SENDATOM(entry->sendq_new));
+                entry->sendq_new = NULL;
 
-		if (client->sendwindow[i]->klass != &irmo_change_atom) {
-			continue;
+                if (entry->sendq_atom != NULL) {
+                        irmo_sendatom_nullify(IRMO_SENDATOM(entry->sendq_atom));
                 }
 
-		catom = (IrmoChangeAtom *) client->sendwindow[i];
+                clear_dirty(entry);
 
-		if (object == catom->object) {
-			irmo_sendatom_nullify(client->sendwindow[i]);
-		}
+                return;
+        }
+
+        // If the atom creating the object has not been acknowledged,
+        // it may still be resent, but the object's state is gone.
+
+        if (entry->window_new != NULL) {
+                irmo_newobject_atom_clear_state(entry->window_new);
+        }
+
+	// Check for any change atoms referring to this object
+	// Convert to a ATOM_NULL atom.  This also removes the atom from
+        // the object table.
+
+	if (entry->sendq_atom != NULL) {
+		irmo_sendatom_nullify(IRMO_SENDATOM(entry->sendq_atom));
+	}
+
+	// Nullify atoms in send window too
+
+	while (entry->window_atoms != NULL) {
+		irmo_sendatom_nullify(IRMO_SENDATOM(entry->window_atoms));
 	}
 
+        // Forget any changes not yet sent in dirty mask mode.
+
+        clear_dirty(entry);
+
 	// create a destroy atom
 
 	atom = irmo_new0(IrmoDestroyAtom, 1);
@@ -229,6 +993,25 @@ void irmo_client_sendq_add_destroy(IrmoClient *client, IrmoObject *object)
 	atom->id = object->id;
 
 	irmo_client_sendq_push(client, IRMO_SENDATOM(atom));
+
+        // The ID cannot be reused until the destroy is acknowledged.
+
+        client_object(client, object->id)->destroy_atom = atom;
+}
+
+void irmo_client_sendq_add_destroy(IrmoClient *client, IrmoObject *object)
+{
+        IrmoClientObject *entry;
+
+        entry = client_object(client, object->id);
+
+        // Forget the cached relevance, as the ID may be reused.
+
+        entry->relevance_pass = 0;
+
+        if (entry->in_scope) {
+                leave_scope(client, object);
+        }
 }
 
 void irmo_client_sendq_add_method(IrmoClient *client, IrmoMethodData *data)
@@ -297,45 +1080,100 @@ void irmo_client_sendq_add_sync_point(IrmoClient *client)
 
 }
 
-// queue up the entire current world state in the client send queue
-// this is used for when new clients connect to retrieve the entire
-// current world state
+void irmo_client_sendq_update_scope(IrmoClient *client)
+{
+        IrmoClientObject *entry;
+        IrmoObject *object;
+        IrmoObjectID id;
+        unsigned int i, n;
 
-void irmo_client_sendq_add_state(IrmoClient *client)
+        ++client->relevance_pass;
+
+        // Send any objects whose IDs are now free at the remote end.
+
+        n = 0;
+
+        for (i=0; i<client->scope_pending_len; ++i) {
+                id = client->scope_pending[i];
+                entry = &client->objects[id];
+
+                if (entry->destroy_atom != NULL) {
+                        client->scope_pending[n] = id;
+                        ++n;
+                        continue;
+                }
+
+                entry->scope_pending = 0;
+
+                object = irmo_world_get_object_for_id(client->server->world,
+                                                      id);
+
+                if (object != NULL && !entry->in_scope
+                 && object_relevant(client, entry, object)) {
+                        enter_scope(client, entry, object);
+                }
+        }
+
+        client->scope_pending_len = n;
+}
+
+void irmo_client_sendq_update_relevance(IrmoClient *client)
 {
+        IrmoClientObject *entry;
         IrmoIterator *iter;
-        IrmoClassVar *var;
         IrmoObject *object;
-        unsigned int i;
 
-	// create all the objects first
-	// this is done all together and separately from sending the
-	// variable state, as the rle encoding in the packets will
-	// better compress the atoms this way
+        // Bring the send queue up to date first, so that objects
+        // created since the client was last run are not sent twice.
+        // Then start a new pass of the filter.
+
+        irmo_client_journal_consume(client);
+        irmo_client_sendq_update_scope(client);
 
         iter = irmo_world_iterate_objects(client->server->world, NULL);
 
         while (irmo_iterator_has_more(iter)) {
                 object = irmo_iterator_next(iter);
-
-                irmo_client_sendq_add_new(client, object);
+                entry = client_object(client, object->id);
+
+                if (object_relevant(client, entry, object)) {
+                        if (!entry->in_scope) {
+                                enter_scope(client, entry, object);
+                        }
+                } else if (entry->in_scope) {
+                        leave_scope(client, object);
+                }
         }
 
         irmo_iterator_free(iter);
+}
 
-        // Now set the variable states
+// queue up the entire current world state in the client send queue
+// this is used for when new clients connect to retrieve the entire
+// current world state
+
+void irmo_client_sendq_add_state(IrmoClient *client)
+{
+        IrmoIterator *iter;
+        IrmoObject *object;
+
+        // Any changes already in the server's change journal are
+        // covered by the state being sent here.
+
+        irmo_client_journal_skip(client);
+        irmo_client_sendq_update_scope(client);
+
+        // Create all the objects.  The atoms carry the current values
+        // of the objects' variables.  They are always queued as atoms,
+        // even in dirty mask mode, so that they are sent before the
+        // sync point.
 
         iter = irmo_world_iterate_objects(client->server->world, NULL);
 
         while (irmo_iterator_has_more(iter)) {
                 object = irmo_iterator_next(iter);
 
-                // Add change for all variables in this object.
-
-                for (i=0; i<object->objclass->nvariables; ++i) {
-                        var = object->objclass->variables[i];
-                        irmo_client_sendq_add_change(client, object, var);
-                }
+                irmo_client_sendq_add_new(client, object);
         }
 
         irmo_iterator_free(iter);
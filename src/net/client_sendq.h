@@ -20,6 +20,14 @@
 #ifndef IRMO_NET_CLIENT_SENDQ_H
 #define IRMO_NET_CLIENT_SENDQ_H
 
+/*!
+ * Create a new, empty send queue.
+ *
+ * @return                    The new send queue.
+ */
+
+IrmoBinaryHeap *irmo_client_sendq_new(void);
+
 /*!
  * Add an atom to the specified client's send queue to signal that
  * a new object has been created.
@@ -82,6 +90,88 @@ void irmo_client_sendq_add_sendwindow(IrmoClient *client, unsigned int max);
 
 IrmoSendAtom *irmo_client_sendq_pop(IrmoClient *client);
 
+/*!
+ * In IRMO_REPLICATION_DIRTY_MASK mode, add the weight of each object
+ * with changes waiting to be sent to its accumulated priority, and
+ * reorder the objects so that the highest priority objects are sent
+ * first.  This does nothing if no priority callback is set for the
+ * client.
+ *
+ * @param client              The client.
+ */
+
+void irmo_client_sendq_accumulate(IrmoClient *client);
+
+/*!
+ * Check if there are no atoms waiting to be sent to a client.
+ *
+ * @param client              The client.
+ * @return                    Non-zero if there are no atoms waiting.
+ */
+
+int irmo_client_sendq_is_empty(IrmoClient *client);
+
+/*!
+ * Remove a change atom from the client's table of per-object state.
+ * This is called when the atom is destroyed or nullified.
+ *
+ * @param atom                The change atom.
+ */
+
+void irmo_client_sendq_unlink_change(IrmoChangeAtom *atom);
+
+/*!
+ * Remove a destroy atom from the client's table of per-object state.
+ * This is called when the atom is destroyed.
+ *
+ * @param atom                The destroy atom.
+ */
+
+void irmo_client_sendq_unlink_destroy(IrmoDestroyAtom *atom);
+
+/*!
+ * Remove a new object atom from the client's table of per-object
+ * state.  This is called when the atom is destroyed.
+ *
+ * @param atom                The new object atom.
+ */
+
+void irmo_client_sendq_unlink_new(IrmoNewObjectAtom *atom);
+
+/*!
+ * Check if changes to the unreliable variables of an object must not
+ * be sent yet, because the remote end has not acknowledged the
+ * creation of the object, or because values for those variables are still waiting to be
+ * sent or acknowledged in the send queue or send window.
+ *
+ * @param client              The client.
+ * @param object              The object.
+ * @return                    Non-zero if unreliable changes must wait.
+ */
+
+int irmo_client_sendq_unreliable_held(IrmoClient *client,
+                                      IrmoObject *object);
+
+/*!
+ * Start a new pass of the client's relevance filter, and send any
+ * objects that were waiting for a destroy atom for a previous object
+ * with the same ID to be acknowledged.
+ *
+ * @param client              The client.
+ */
+
+void irmo_client_sendq_update_scope(IrmoClient *client);
+
+/*!
+ * Re-evaluate the relevance filter for every object in the world,
+ * adding objects that have entered the client's scope and
+ * destroying objects that have left it.
+ *
+ * @param client              The client.
+ */
+
+void irmo_client_sendq_update_relevance(IrmoClient *client);
+
 /*!
  * Queue up the entire state of the world being served for transmission
  * to the remote client.
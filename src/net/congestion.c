@@ -0,0 +1,65 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+#include "arch/sysheaders.h"
+
+#include "congestion.h"
+
+IrmoCongestionControlClass *irmo_congestion_controls[] = {
+        &irmo_congestion_reno,
+        &irmo_congestion_vegas,
+};
+
+unsigned int irmo_congestion_window_rate(IrmoClient *client)
+{
+        unsigned int rtt;
+        float rate;
+
+        // Until the round trip time has been measured, the estimate
+        // is just a guess, and there is no way to work out a rate.
+
+        if (client->largest_acked_packet == 0) {
+                return 0;
+        }
+
+        // The whole window can be sent once per round trip.  Round
+        // trip times are in milliseconds; avoid dividing by zero on
+        // very fast links.
+
+        rtt = (unsigned int) client->rtt;
+
+        if (rtt < 1) {
+                rtt = 1;
+        }
+
+        rate = client->cwnd * 1000 / (float) rtt;
+
+        // Send slightly faster than this so that the window is not
+        // held back by the pacing.  During slow start, the window
+        // doubles every round trip, so the rate must keep up.
+
+        if (client->cwnd < client->ssthresh) {
+                rate *= IRMO_PACING_GAIN_SLOW_START;
+        } else {
+                rate *= IRMO_PACING_GAIN;
+        }
+
+        return (unsigned int) rate;
+}
+
@@ -0,0 +1,95 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+#ifndef IRMO_NET_CONGESTION_H
+#define IRMO_NET_CONGESTION_H
+
+typedef struct _IrmoCongestionControlClass IrmoCongestionControlClass;
+
+#include <irmo/server.h>
+
+#include "client.h"
+
+// Factors by which the sending rate exceeds the congestion window
+// divided by the round trip time, during and after slow start.
+
+#define IRMO_PACING_GAIN_SLOW_START 2.0f
+#define IRMO_PACING_GAIN 1.25f
+
+typedef void (*IrmoCongestionInitFunc)(IrmoClient *client);
+typedef void (*IrmoCongestionAckFunc)(IrmoClient *client,
+                                      unsigned int acked_bytes,
+                                      int new_rtt);
+typedef void (*IrmoCongestionLossFunc)(IrmoClient *client, int timeout);
+typedef unsigned int (*IrmoCongestionPacingRateFunc)(IrmoClient *client);
+
+//
+// A congestion controller decides how much data may be in flight to a
+// client at once, by setting the client's cwnd value.  Each controller
+// is a class of functions invoked as acknowledgements and losses are
+// seen.
+//
+
+struct _IrmoCongestionControlClass {
+
+        // Initialize the congestion control state for a client.
+
+        IrmoCongestionInitFunc init;
+
+        // Invoked when the send window is advanced by an
+        // acknowledgement.  If 'new_rtt' is non-zero, the packet
+        // carrying the acknowledgement gave a new round trip time
+        // sample, which is in client->last_rtt.
+
+        IrmoCongestionAckFunc on_ack;
+
+        // Invoked when data is lost.  If 'timeout' is non-zero, the
+        // loss was detected because the retransmission timer expired;
+        // otherwise, acknowledgements of later data showed that it
+        // was lost.  This is invoked once per loss event.
+
+        IrmoCongestionLossFunc on_loss;
+
+        // Get the rate, in bytes per second, at which data should be
+        // sent to the client, or zero if data should not be paced.
+
+        IrmoCongestionPacingRateFunc pacing_rate;
+};
+
+// Congestion controllers, indexed by IrmoCongestionControl value.
+
+extern IrmoCongestionControlClass *irmo_congestion_controls[];
+
+extern IrmoCongestionControlClass irmo_congestion_reno;
+extern IrmoCongestionControlClass irmo_congestion_vegas;
+
+/*!
+ * Get the rate at which data should be sent, based on the congestion
+ * window and the round trip time.  Used by controllers that do not
+ * have a better estimate.
+ *
+ * @param client       The client.
+ * @return             Rate in bytes per second, or zero if the round
+ *                     trip time has not yet been measured.
+ */
+
+unsigned int irmo_congestion_window_rate(IrmoClient *client);
+
+#endif /* #ifndef IRMO_NET_CONGESTION_H */
+
@@ -0,0 +1,85 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+//
+// Loss-based congestion control, similar to TCP Reno.
+//
+// The window grows by one packet for every acknowledgement during slow
+// start, and by one packet per window afterwards.  A loss detected from
+// acknowledgements halves the window; a timeout drops it back to one
+// packet and restarts slow start.
+//
+
+#include "arch/sysheaders.h"
+
+#include "congestion.h"
+
+static void reno_init(IrmoClient *client)
+{
+        // start cwnd with one packet, ssthresh as large
+
+        client->cwnd = (float) client->mtu;
+        client->ssthresh = 65535;
+}
+
+static void reno_on_ack(IrmoClient *client, unsigned int acked_bytes,
+                        int new_rtt)
+{
+        // We got a valid ack. open up the send window a bit more.
+        // If we are above the slow start congestion threshold, open
+        // slower.
+
+        if (client->cwnd < client->ssthresh) {
+                client->cwnd += (float) client->mtu;
+        } else {
+                client->cwnd +=
+                        (float) (client->mtu * client->mtu) / client->cwnd;
+        }
+}
+
+static void reno_on_loss(IrmoClient *client, int timeout)
+{
+        client->ssthresh = (unsigned int) (client->cwnd / 2);
+
+        if (timeout) {
+
+                // Possibly we're experiencing heavy congestion.
+                // Reset the send window size back to one packet.
+
+                client->cwnd = (float) client->mtu;
+        } else {
+
+                // Data is still getting through, so there is no
+                // need to go back to slow start.
+
+                if (client->ssthresh < client->mtu) {
+                        client->ssthresh = client->mtu;
+                }
+
+                client->cwnd = (float) client->ssthresh;
+        }
+}
+
+IrmoCongestionControlClass irmo_congestion_reno = {
+        reno_init,
+        reno_on_ack,
+        reno_on_loss,
+        irmo_congestion_window_rate,
+};
+
@@ -0,0 +1,208 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+//
+// Delay-based congestion control, similar to TCP Vegas.
+//
+// The smallest round trip time seen is taken to be the time with no
+// queueing along the path.  Once per round trip, the smallest round
+// trip time seen during that round is compared against it to estimate
+// how much of the window is sitting in queues.  The window is adjusted
+// to keep a small, fixed amount of data queued, so that the queues
+// stay short rather than being filled until packets are dropped.
+//
+
+#include "arch/sysheaders.h"
+
+#include "congestion.h"
+
+// Thresholds, in packets, for the amount of data estimated to be
+// queued.  Below alpha, the window is increased; above beta, it is
+// decreased.  During slow start, exceeding gamma ends slow start.
+
+#define VEGAS_ALPHA 2
+#define VEGAS_BETA 4
+#define VEGAS_GAMMA 1
+
+// The window never shrinks below this many packets due to delay.
+
+#define VEGAS_MIN_CWND 2
+
+static void vegas_init(IrmoClient *client)
+{
+        client->cwnd = (float) client->mtu;
+        client->ssthresh = 65535;
+
+        client->cc_base_rtt = 0;
+        client->cc_round_rtt = 0;
+        client->cc_round_end = client->send_packet_num;
+}
+
+// Estimate of the amount of data, in packets, that is queued along
+// the path.  This is the difference between the window and the amount
+// of data that could be in flight if there was no queueing.
+
+static unsigned int vegas_queued(IrmoClient *client)
+{
+        float queued;
+
+        queued = client->cwnd
+               * (float) (client->cc_round_rtt - client->cc_base_rtt)
+               / (float) client->cc_round_rtt;
+
+        return (unsigned int) (queued / (float) client->mtu);
+}
+
+// Invoked once per round trip to adjust the window.
+
+static void vegas_end_round(IrmoClient *client)
+{
+        unsigned int queued;
+
+        queued = vegas_queued(client);
+
+        if (client->cwnd < client->ssthresh) {
+
+                // Leave slow start as soon as queues start to build.
+
+                if (queued > VEGAS_GAMMA) {
+                        client->ssthresh = (unsigned int) client->cwnd;
+                }
+        } else if (queued < VEGAS_ALPHA) {
+                client->cwnd += (float) client->mtu;
+        } else if (queued > VEGAS_BETA) {
+                client->cwnd -= (float) client->mtu;
+
+                if (client->cwnd < (float) (VEGAS_MIN_CWND * client->mtu)) {
+                        client->cwnd = (float) (VEGAS_MIN_CWND * client->mtu);
+                }
+        }
+}
+
+// Add a round trip time sample to the minimum for the connection and
+// for the current round.
+
+static void vegas_sample_rtt(IrmoClient *client)
+{
+        unsigned int rtt;
+
+        // Round trip times of zero are possible on fast links; treat
+        // them as one millisecond so that the estimates are sensible.
+
+        rtt = client->last_rtt;
+
+        if (rtt < 1) {
+                rtt = 1;
+        }
+
+        if (client->cc_base_rtt == 0 || rtt < client->cc_base_rtt) {
+                client->cc_base_rtt = rtt;
+        }
+
+        if (client->cc_round_rtt == 0 || rtt < client->cc_round_rtt) {
+                client->cc_round_rtt = rtt;
+        }
+}
+
+static void vegas_on_ack(IrmoClient *client, unsigned int acked_bytes,
+                         int new_rtt)
+{
+        // Only fresh samples are used: client->last_rtt may be left
+        // over from a previous round.
+
+        if (new_rtt) {
+                vegas_sample_rtt(client);
+        }
+
+        // Grow exponentially during slow start.  The decision to stop
+        // is made at the end of each round.
+
+        if (client->cwnd < client->ssthresh) {
+                client->cwnd += (float) client->mtu;
+        }
+
+        // A round ends when a packet sent after the start of the
+        // round has been acknowledged.  The round continues until
+        // there is a round trip time sample to compare.
+
+        if (client->largest_acked_packet >= client->cc_round_end
+         && client->cc_round_rtt != 0) {
+                vegas_end_round(client);
+
+                client->cc_round_rtt = 0;
+                client->cc_round_end = client->send_packet_num;
+        }
+}
+
+static void vegas_on_loss(IrmoClient *client, int timeout)
+{
+        if (timeout) {
+
+                // Heavy congestion; start again from one packet.
+
+                client->ssthresh = (unsigned int) (client->cwnd / 2);
+                client->cwnd = (float) client->mtu;
+        } else {
+
+                // Losses are not the main congestion signal, so the
+                // window is reduced by less than for Reno.
+
+                client->cwnd = client->cwnd * 3 / 4;
+
+                if (client->cwnd < (float) (VEGAS_MIN_CWND * client->mtu)) {
+                        client->cwnd = (float) (VEGAS_MIN_CWND * client->mtu);
+                }
+
+                client->ssthresh = (unsigned int) client->cwnd;
+        }
+
+        // The queue estimate for the current round is no longer
+        // meaningful.
+
+        client->cc_round_rtt = 0;
+        client->cc_round_end = client->send_packet_num;
+}
+
+// Vegas knows the round trip time with no queueing, so data can be
+// paced to fill the path without building queues.
+
+static unsigned int vegas_pacing_rate(IrmoClient *client)
+{
+        float rate;
+
+        if (client->cc_base_rtt == 0) {
+                return irmo_congestion_window_rate(client);
+        }
+
+        rate = client->cwnd * 1000 / (float) client->cc_base_rtt;
+
+        if (client->cwnd < client->ssthresh) {
+                rate *= IRMO_PACING_GAIN_SLOW_START;
+        }
+
+        return (unsigned int) rate;
+}
+
+IrmoCongestionControlClass irmo_congestion_vegas = {
+        vegas_init,
+        vegas_on_ack,
+        vegas_on_loss,
+        vegas_pacing_rate,
+};
+
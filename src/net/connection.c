@@ -96,6 +96,53 @@ void irmo_connection_run(IrmoConnection *conn)
 	irmo_server_run(conn->server);
 }
 
+void irmo_connection_set_subscribed(IrmoConnection *conn,
+                                    char *class_name, char *var_name,
+                                    int subscribed)
+{
+        IrmoInterface *iface;
+        IrmoClass *klass;
+        IrmoClassVar *var;
+        uint8_t *bitmap;
+
+	irmo_return_if_fail(conn != NULL);
+	irmo_return_if_fail(conn->state == IRMO_CLIENT_CONNECTING);
+	irmo_return_if_fail(conn->server->client_interface != NULL);
+
+        iface = conn->server->client_interface;
+
+        klass = irmo_interface_get_class(iface, class_name);
+
+        if (klass == NULL) {
+                irmo_error_report("irmo_connection_set_subscribed",
+                                  "unknown class '%s'", class_name);
+                return;
+        }
+
+        var = irmo_class_get_variable(klass, var_name);
+
+        if (var == NULL) {
+                irmo_error_report("irmo_connection_set_subscribed",
+                                  "unknown variable '%s' in class '%s'",
+                                  var_name, class_name);
+                return;
+        }
+
+        if (conn->requested_subscriptions == NULL) {
+                conn->requested_subscriptions
+                        = irmo_client_subscriptions_new(iface);
+                conn->nrequested_subscriptions = iface->nclasses;
+        }
+
+        bitmap = conn->requested_subscriptions[klass->index];
+
+        if (subscribed) {
+                bitmap[var->index / 8] |= (uint8_t) (1 << (var->index % 8));
+        } else {
+                bitmap[var->index / 8] &= (uint8_t) ~(1 << (var->index % 8));
+        }
+}
+
 IrmoWorld *irmo_connection_get_world(IrmoConnection *conn)
 {
 	irmo_return_val_if_fail(conn != NULL, NULL);
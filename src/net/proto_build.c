@@ -18,6 +18,7 @@
 //
 
 #include "arch/sysheaders.h"
+#include "base/alloc.h"
 
 #include <irmo/packet.h>
 
@@ -25,6 +26,42 @@
 #include "client_sendq.h"
 #include "protocol.h"
 #include "sendatom.h"
+#include "server-journal.h"
+#include "world/object.h"
+
+void irmo_proto_write_flags(IrmoClient *client, IrmoPacket *packet,
+                            unsigned int flags)
+{
+        unsigned int header;
+
+        if (!client->compact) {
+                irmo_packet_writei16(packet, flags);
+                return;
+        }
+
+        irmo_packet_set_compact(packet, 1);
+
+        header = PACKET_COMPACT_HEADER | (flags & PACKET_COMPACT_LOW_FLAGS);
+
+        if (flags > PACKET_COMPACT_LOW_FLAGS) {
+                irmo_packet_writei8(packet, header | PACKET_COMPACT_HIGH_FLAGS);
+                irmo_packet_writei8(packet, flags >> 6);
+        } else {
+                irmo_packet_writei8(packet, header);
+        }
+}
+
+// Largest possible size of the fields before the atoms in a data
+// packet to a client.
+
+static size_t client_max_header_len(IrmoClient *client)
+{
+        if (client->compact) {
+                return PACKET_MAX_HEADER_LEN_COMPACT;
+        } else {
+                return PACKET_MAX_HEADER_LEN;
+        }
+}
 
 // Get maximum send window size for the specified client
 
@@ -59,13 +96,21 @@ static unsigned int client_sendwindow_max(IrmoClient *client)
 static void client_pump(IrmoClient *client)
 {
         IrmoSendAtom *atom;
-	size_t current_size = 0;
-	unsigned int i;
+	size_t current_size;
 	unsigned int sendwindow_max;
+
+        // Queue up any changes to the world made since we were
+        // last run.
+
+        irmo_client_journal_consume(client);
+
+        // Update the priorities of objects waiting to be sent.
+
+        irmo_client_sendq_accumulate(client);
 	
 	// if queue is already empty, this is a nonissue
 	
-	if (irmo_queue_is_empty(client->sendq)) {
+	if (irmo_client_sendq_is_empty(client)) {
 		return;
         }
 
@@ -75,26 +120,22 @@ static void client_pump(IrmoClient *client)
 
         // Get the current sendwindow size.
 
-	for (i=0; i<client->sendwindow_size; ++i) {
-		current_size += client->sendwindow[i]->len;
-        }
+        current_size = client->sendwindow_bytes;
 
 	// adding things in until we run out of space or atoms to add
 	
 	while (current_size < sendwindow_max
-	    && !irmo_queue_is_empty(client->sendq)
 	    && client->sendwindow_size < MAX_SENDWINDOW) {
 
 		// pop another from the sendq and add to the sendwindow
 
 		atom = irmo_client_sendq_pop(client);		
-		atom->sendtime = IRMO_ATOM_UNSENT;
-		
-		client->sendwindow[client->sendwindow_size] = atom;
-		atom->seqnum = client->sendwindow_start
-			     + client->sendwindow_size;
-		
-		++client->sendwindow_size;
+
+                if (atom == NULL) {
+                        break;
+                }
+
+		irmo_client_sendwindow_push(client, atom);
 		
 		// keep track of size
 		
@@ -107,29 +148,37 @@ static void client_pump(IrmoClient *client)
 static void client_flag_resends(IrmoClient *client,
                                 unsigned int start, unsigned int end)
 {
+        IrmoSendAtom *atom;
         unsigned int i;
 
 	// Set the resent flag on all atoms that were previously sent.
         
         for (i=start; i <= end; ++i) {
-                if (client->sendwindow[i]->sendtime != IRMO_ATOM_UNSENT) {
-                        client->sendwindow[i]->resent = 1;
+                atom = IRMO_CLIENT_SENDWINDOW(client, i);
+
+                if (atom->sendtime != IRMO_ATOM_UNSENT) {
+                        atom->resent = 1;
+                        ++client->server->atoms_resent;
+
+                        if (atom->lost) {
+                                ++client->server->fast_retransmits;
+                        }
                 }
         }
 
-	// If we are resending the first atom, use exponential backoff and
-        // double the resend time every time we resend
+	// If we are resending the first atom because it timed out, use
+        // exponential backoff and double the resend time every time we
+        // resend.  Atoms detected as lost have not timed out.
 	
-	if (start == 0 && client->sendwindow[0]->resent) {
+        atom = IRMO_CLIENT_SENDWINDOW(client, 0);
+
+	if (start == 0 && atom->resent && !atom->lost) {
 
 		// If this is the first time we have missed a packet, it's
 		// possible we're experiencing congestion.
-		// Reset the send window size back to one packet and save the 
-		// slow-start threshold.
 		
 		if (client->backoff == 1) {
-			client->ssthresh = (unsigned int) (client->cwnd / 2);
-			client->cwnd = IRMO_PROTOCOL_MTU;
+			client->cc->on_loss(client, 1);
 		}
 		
 		client->backoff *= 2;
@@ -140,9 +189,11 @@ static void client_flag_resends(IrmoClient *client,
 // Expand a list of atoms to send
 
 static void client_expand_packet(IrmoClient *client, 
-                                 unsigned int *start, unsigned int *end)
+                                 unsigned int *start, unsigned int *end,
+                                 size_t room)
 {
         unsigned int backstart;
+        unsigned int max_nulls;
 
 	// move the start back to cover all null atoms that prefix this
 	// data segment. in running games we typically repeatedly change 
@@ -151,12 +202,16 @@ static void client_expand_packet(IrmoClient *client,
 	// have lots of NULL atoms before the start of our new data.
 	// as NULL atoms compress very well and take up very little room,
 	// include these as it may reduce the need for retransmissions.
+	// Each group of 32 null atoms takes one byte, so the number
+	// added is limited by the room left in the packet.
 	
         backstart = *start;
+        max_nulls = (unsigned int) room * 32;
 
-        while (backstart > 0 
-            && client->sendwindow[backstart-1] != NULL
-            && client->sendwindow[backstart-1]->klass == &irmo_null_atom) {
+        while (backstart > 0 && *start - backstart < max_nulls
+            && IRMO_CLIENT_SENDWINDOW(client, backstart-1) != NULL
+            && IRMO_CLIENT_SENDWINDOW(client, backstart-1)->klass
+                 == &irmo_null_atom) {
                 --backstart;
         }
 
@@ -169,20 +224,291 @@ static void client_set_send_times(IrmoClient *client,
                                   unsigned int start, unsigned int end,
                                   unsigned int nowtime)
 {
+        IrmoSendAtom *atom;
         unsigned int i;
 
-        // Set the send time for all atoms.
+        // Set the send time for all atoms, and the number of the
+        // packet they are about to be sent in.
         
         for (i=start; i <= end; ++i) {
-                client->sendwindow[i]->sendtime = nowtime;
+                atom = IRMO_CLIENT_SENDWINDOW(client, i);
+
+                irmo_client_sendwindow_sent(client, atom, nowtime);
+        }
+}
+
+// Find the ranges of atoms in the receive window that have been received
+// out of order, beyond the start of the window.  The ranges are stored
+// as pairs of (offset, length) values.  Returns the number of ranges.
+
+static unsigned int client_sack_ranges(IrmoClient *client,
+                                       unsigned int *ranges)
+{
+        unsigned int num_ranges;
+        unsigned int i, start;
+
+        num_ranges = 0;
+        i = 0;
+
+        while (i < client->recvwindow_alloced
+            && num_ranges < PACKET_MAX_SACK_RANGES) {
+
+                // Skip over atoms not yet received.
+
+                if (IRMO_CLIENT_RECVWINDOW(client, i) == NULL) {
+                        ++i;
+                        continue;
+                }
+
+                // Find the end of this range.
+
+                start = i;
+
+                while (i < client->recvwindow_alloced
+                    && IRMO_CLIENT_RECVWINDOW(client, i) != NULL) {
+                        ++i;
+                }
+
+                ranges[num_ranges * 2] = start;
+                ranges[num_ranges * 2 + 1] = i - start;
+                ++num_ranges;
+        }
+
+        return num_ranges;
+}
+
+// Write a packet header containing an acknowledgement of the data
+// received so far.  Selective acknowledgements are included if
+// anything has been received out of order.  Returns the packet number
+// assigned to the packet.
+
+static unsigned int client_write_ack(IrmoClient *client, IrmoPacket *packet,
+                                     unsigned int flags)
+{
+        unsigned int packet_num;
+        unsigned int ranges[PACKET_MAX_SACK_RANGES * 2];
+        unsigned int num_ranges;
+        unsigned int ack_delay;
+        unsigned int i;
+
+        num_ranges = client_sack_ranges(client, ranges);
+
+        if (num_ranges > 0) {
+                flags |= PACKET_FLAG_SAK;
+        }
+
+        // Once unreliable updates or parity packets have been
+        // received, the sender needs to know which packets were lost.
+
+        if (client->recv_unreliable || client->recv_fec) {
+                flags |= PACKET_FLAG_PAK;
+        }
+
+        // Tell the sender how long the acknowledgement was held back
+        // for, so that it can measure the round trip time correctly.
+
+        ack_delay = irmo_get_time() - client->ack_packet_time;
+
+        if (client->ack_packet_num != 0 && ack_delay > 0) {
+                flags |= PACKET_FLAG_ADL;
+
+                if (ack_delay > 0xffff) {
+                        ack_delay = 0xffff;
+                }
+        }
+
+	irmo_proto_write_flags(client, packet, flags | PACKET_FLAG_ACK);
+
+        packet_num = client->send_packet_num;
+        ++client->send_packet_num;
+
+        irmo_packet_writei16(packet, packet_num & 0xffff);
+
+	// In sending stream positions we only send the low 16
+	// bits. the higher bits can be implied by their current
+	// position.
+
+	irmo_packet_writei16(packet, client->recvwindow_start & 0xffff);
+	irmo_packet_writei16(packet, client->ack_packet_num & 0xffff);
+
+        if ((flags & PACKET_FLAG_ADL) != 0) {
+                irmo_packet_writei16v(packet, ack_delay);
+        }
+
+        if ((flags & PACKET_FLAG_PAK) != 0) {
+                irmo_packet_writei32(packet, client->recv_packet_mask);
+        }
+
+        if (num_ranges > 0) {
+                irmo_packet_writei8(packet, num_ranges);
+
+                for (i=0; i<num_ranges * 2; ++i) {
+                        irmo_packet_writei16v(packet, ranges[i]);
+                }
+        }
+
+        // A delayed acknowledgement sent along with data did not need
+        // a packet of its own.
+
+        if (client->ack_delayed
+         && (flags & (PACKET_FLAG_DTA | PACKET_FLAG_UNR)) != 0) {
+                ++client->server->acks_avoided;
+        }
+
+	client->need_ack = 0;
+        client->ack_now = 0;
+        client->ack_packets = 0;
+        client->ack_delayed = 0;
+
+        return packet_num;
+}
+
+// Record the send time of a packet containing data, so that the round
+// trip time can be measured when it is acknowledged.
+
+static void client_record_sent(IrmoClient *client, unsigned int packet_num,
+                               unsigned int nowtime)
+{
+        IrmoSentPacket *sent;
+
+        sent = irmo_client_sent_packet_new(client, packet_num);
+        sent->packet_num = packet_num;
+        sent->sendtime = nowtime;
+        sent->acked = 0;
+}
+
+// Work out the number of packets to send a parity packet after, from
+// the loss rate measured so far.
+
+static unsigned int client_fec_group_size(IrmoClient *client)
+{
+        float size;
+
+        if (client->fec_loss <= 0) {
+                return FEC_MAX_GROUP;
+        }
+
+        size = FEC_GROUP_LOSSES / client->fec_loss - 1;
+
+        if (size < FEC_MIN_GROUP) {
+                return FEC_MIN_GROUP;
+        } else if (size > FEC_MAX_GROUP) {
+                return FEC_MAX_GROUP;
+        } else {
+                return (unsigned int) size;
+        }
+}
+
+// Send a parity packet for the packets in the current group, and start
+// a new group.
+
+static void client_fec_send(IrmoClient *client)
+{
+        IrmoPacket *packet;
+
+        packet = irmo_packet_new();
+
+        irmo_proto_write_flags(client, packet, PACKET_FLAG_FEC);
+        irmo_packet_writei16(packet, client->fec_first & 0xffff);
+        irmo_packet_writei32(packet, client->fec_mask);
+        irmo_packet_writei16(packet, client->fec_length);
+        irmo_packet_writebytes(packet, client->fec_parity,
+                               client->fec_parity_len);
+
+        irmo_net_socket_send_packet(client->server->socket,
+                                    client->address,
+                                    packet);
+
+        // Parity packets are paced along with the data.
+
+        if (irmo_client_pacing_rate(client) != 0) {
+                client->pacing_tokens
+                        -= (float) irmo_packet_get_length(packet);
         }
+
+        irmo_packet_free(packet);
+
+        ++client->server->fec_packets;
+
+        client->fec_count = 0;
+}
+
+// Add a packet containing data to the current parity group.  Once
+// there are enough packets in the group, a parity packet is sent.
+
+static void client_fec_add(IrmoClient *client, IrmoPacket *packet,
+                           unsigned int packet_num, unsigned int nowtime)
+{
+        uint8_t *data;
+        unsigned int len;
+        unsigned int i;
+
+        if (!client->fec) {
+                return;
+        }
+
+        // The packets in a group must be close together.
+
+        if (client->fec_count > 0
+         && packet_num - client->fec_first >= FEC_MAX_SPAN) {
+                client_fec_send(client);
+        }
+
+        if (client->fec_count == 0) {
+                client->fec_first = packet_num;
+                client->fec_time = nowtime;
+                client->fec_mask = 0;
+                client->fec_length = 0;
+                client->fec_parity_len = 0;
+                client->fec_group_size = client_fec_group_size(client);
+        }
+
+        data = irmo_packet_get_buffer(packet);
+        len = irmo_packet_get_length(packet);
+
+        // Shorter packets are padded with zeros.
+
+        if (len > client->fec_parity_alloced) {
+                client->fec_parity_alloced = len;
+                client->fec_parity = irmo_renew(uint8_t, client->fec_parity,
+                                                len);
+        }
+
+        if (len > client->fec_parity_len) {
+                memset(client->fec_parity + client->fec_parity_len, 0,
+                       len - client->fec_parity_len);
+                client->fec_parity_len = len;
+        }
+
+        for (i=0; i<len; ++i) {
+                client->fec_parity[i] ^= data[i];
+        }
+
+        client->fec_length ^= len;
+        client->fec_mask |= 1U << (packet_num - client->fec_first);
+        ++client->fec_count;
+
+        if (client->fec_count >= client->fec_group_size) {
+                client_fec_send(client);
+        }
+}
+
+// Time at which a parity packet is sent for a group that is not yet
+// full, so that the packets in it are still protected if no more data
+// is sent for a while.
+
+static unsigned int client_fec_deadline(IrmoClient *client)
+{
+        return client->fec_time + (unsigned int) (client->rtt / 2);
 }
 
 // Build a packet to send to the specified client containing the
 // atoms from the sendwindow in the range start...end
 
 static IrmoPacket *client_build_packet(IrmoClient *client,
-                                       unsigned int start, unsigned int end)
+                                       unsigned int start, unsigned int end,
+                                       unsigned int nowtime,
+                                       unsigned int *packet_num)
 {
 	IrmoPacket *packet;
 	unsigned int i, n;
@@ -191,18 +517,12 @@ static IrmoPacket *client_build_packet(IrmoClient *client,
 	
 	packet = irmo_packet_new();
 
-	// Packet header.
-	
-	irmo_packet_writei16(packet, PACKET_FLAG_ACK|PACKET_FLAG_DTA);
-	
-	// In sending stream positions we only send the low 16
-	// bits. the higher bits can be implied by their current
-	// position.
-	
-        // Add the last acked point in the stream.
+	// Packet header, with the last acked point in the stream.
 
-	irmo_packet_writei16(packet, client->recvwindow_start & 0xffff);
-	client->need_ack = 0;
+        n = client_write_ack(client, packet, PACKET_FLAG_DTA);
+
+        client_record_sent(client, n, nowtime);
+        *packet_num = n;
 
 	// Start position in stream
 	
@@ -218,30 +538,32 @@ static IrmoPacket *client_build_packet(IrmoClient *client,
 	while (i <= end) {
 		IrmoSendAtomClass *klass;
 
-		klass = client->sendwindow[i]->klass;
+		klass = IRMO_CLIENT_SENDWINDOW(client, i)->klass;
 
 		// Group up to 32 sendatoms of the same type together
 		// we send the number of EXTRA sendatoms after
 		// the starting one: the first one is implied. after that
 		// we can specify up to 31 of the same type that follow
 		
-		for (n=1; i+n<=end && n<32; ++n) {
-			if (klass != client->sendwindow[i+n]->klass) {
+		for (n=1; i+n<=end && n<ATOM_GROUP_MAX; ++n) {
+			if (klass != IRMO_CLIENT_SENDWINDOW(client, i+n)->klass) {
 				break;
                         }
                 }
 
 		//printf("-- build_packet: group length %i, type %i\n",
-		//n, client->sendwindow[i]->type);
+		//n, IRMO_CLIENT_SENDWINDOW(client, i)->type);
 
 		// store extra count in the low bits, type in the high bits
 
-		irmo_packet_writei8(packet, (klass->type << 5) | (n-1));
+		irmo_packet_write_bits(packet, n - 1, ATOM_GROUP_COUNT_BITS);
+		irmo_packet_write_bits(packet, klass->type,
+		                       ATOM_GROUP_TYPE_BITS);
 
 		// add atoms
 
 		for (; n>0; --n, ++i) {
-			klass->write(client->sendwindow[i], packet);
+			klass->write(IRMO_CLIENT_SENDWINDOW(client, i), packet);
 		}
 	}
 
@@ -265,6 +587,18 @@ static int atom_timed_out(IrmoSendAtom *atom, unsigned int nowtime,
 static int atom_needs_send(IrmoSendAtom *atom, unsigned int nowtime,
                            unsigned int timeout_length)
 {
+        // Already received by the remote client?
+
+        if (atom->sacked) {
+                return 0;
+        }
+
+        // Known to have been lost?
+
+        if (atom->lost) {
+                return 1;
+        }
+
         // Not sent yet? It needs to be sent now.
 
         if (atom->sendtime == IRMO_ATOM_UNSENT) {
@@ -276,6 +610,66 @@ static int atom_needs_send(IrmoSendAtom *atom, unsigned int nowtime,
         return atom_timed_out(atom, nowtime, timeout_length);
 }
 
+// Fill the token bucket used to pace the data sent to a client, with
+// the data that could have been sent since it was last filled.
+// Returns zero if data sent to the client is not paced.
+
+static int client_pacing_fill(IrmoClient *client, unsigned int nowtime)
+{
+        unsigned int rate;
+        float depth;
+
+        rate = irmo_client_pacing_rate(client);
+
+        // The bucket holds a small burst of packets, plus as much as
+        // can be sent in a millisecond, as times are only measured to
+        // the nearest millisecond.
+
+        depth = (float) (IRMO_PACING_BURST * client->mtu + rate / 1000);
+
+        if (rate == 0) {
+                client->pacing_tokens = depth;
+        } else {
+                client->pacing_tokens += (float) rate / 1000
+                                       * (float) (nowtime
+                                                  - client->pacing_time);
+
+                if (client->pacing_tokens > depth) {
+                        client->pacing_tokens = depth;
+                }
+        }
+
+        client->pacing_time = nowtime;
+
+        return rate != 0;
+}
+
+// Get the time at which the pacing of a client will next allow a
+// packet to be sent.
+
+static unsigned int client_pacing_next_send(IrmoClient *client,
+                                            unsigned int nowtime)
+{
+        unsigned int rate;
+        float tokens;
+
+        rate = irmo_client_pacing_rate(client);
+
+        if (rate == 0) {
+                return nowtime;
+        }
+
+        tokens = client->pacing_tokens
+               + (float) rate / 1000
+                 * (float) (nowtime - client->pacing_time);
+
+        if (tokens > 0) {
+                return nowtime;
+        }
+
+        return nowtime + 1 + (unsigned int) (-tokens * 1000 / (float) rate);
+}
+
 // Check a client's send queue for packets that need to be [re]transmitted.
 
 static void client_send_data(IrmoClient *client,
@@ -283,25 +677,53 @@ static void client_send_data(IrmoClient *client,
 {
         IrmoPacket *packet;
         size_t len;
+        size_t budget, atom_len;
         unsigned int start, end;
+        unsigned int packet_num;
         unsigned int i;
         unsigned int nowtime;
+        int paced;
 
         // All atoms where nowtime >= atom->sendtime + timeout_length
         // need to be resent.
      
         nowtime = irmo_get_time();
 
+        // Nothing to send?  Avoid searching the send window if no
+        // atoms are waiting to be sent or have been lost, and the
+        // first atom in flight has not timed out.
+
+        if (client->sendwindow_unsent == 0 && client->sendwindow_lost == 0
+         && (client->inflight_head == NULL
+          || !atom_timed_out(client->inflight_head, nowtime,
+                             timeout_length))) {
+                return;
+        }
+
+        paced = client_pacing_fill(client, nowtime);
+
+        // Space for atoms in each packet.
+
+        budget = client->mtu - client_max_header_len(client);
+
         i = 0;
 
         while (i < client->sendwindow_size) {
 
+                // Packets are paced out, rather than being sent in a
+                // burst that might overflow buffers along the path.
+                // Anything left is sent on a later run.
+
+                if (paced && client->pacing_tokens <= 0) {
+                        break;
+                }
+
 		// Search forward until we find the start of a block
                 // of atoms to send.
 
                 for (; i<client->sendwindow_size; ++i) {
 
-                        if (atom_needs_send(client->sendwindow[i],
+                        if (atom_needs_send(IRMO_CLIENT_SENDWINDOW(client, i),
                                             nowtime, timeout_length)) {
 
                                 // This is the first of a block of atoms
@@ -328,7 +750,7 @@ static void client_send_data(IrmoClient *client,
 		
                 for (; i < client->sendwindow_size; ++i) {
 
-                        if (!atom_needs_send(client->sendwindow[i],
+                        if (!atom_needs_send(IRMO_CLIENT_SENDWINDOW(client, i),
                                              nowtime, timeout_length)) {
 
                                 // This packet does not need to be sent.
@@ -338,19 +760,20 @@ static void client_send_data(IrmoClient *client,
                                 break;
                         }
 
-                        if (len >= IRMO_PROTOCOL_MTU) {
+                        // Each atom may need a byte for its type, as
+                        // well as its own data.  The packet is full
+                        // if the atom will not fit, but an atom that
+                        // is too large for any packet is sent alone.
 
-                                // We have exceeded the maximum size of 
-                                // a packet.  No more atoms can be added
-                                // to this packet.
-                            
+                        atom_len = IRMO_CLIENT_SENDWINDOW(client, i)->len + 1;
+
+                        if (len > 0 && len + atom_len > budget) {
                                 break;
                         }
                         
                         // add this atom
 
-			//printf("atom %i out of date\n", i);
-			len += client->sendwindow[i]->len;
+			len += atom_len;
 		}
 
                 end = i - 1;
@@ -366,7 +789,8 @@ static void client_send_data(IrmoClient *client,
 
                 // Expand packet list to include neighbouring null atoms.
 
-                client_expand_packet(client, &start, &end);
+                client_expand_packet(client, &start, &end,
+                                     len < budget ? budget - len : 0);
 
                 // Update the send times for the atoms to be transmitted.
 
@@ -374,16 +798,581 @@ static void client_send_data(IrmoClient *client,
 
                 // Build and transmit a packet containing the atoms.
 
-		packet = client_build_packet(client, start, end);
+		packet = client_build_packet(client, start, end, nowtime,
+		                             &packet_num);
 
 		irmo_net_socket_send_packet(client->server->socket,
 				            client->address,
 				            packet);
 
+                if (paced) {
+                        client->pacing_tokens
+                                -= (float) irmo_packet_get_length(packet);
+                }
+
+                client_fec_add(client, packet, packet_num, nowtime);
+
 		irmo_packet_free(packet);
 	}
 }
 
+// Work out when data next needs to be sent to a client.
+
+static int client_next_send(IrmoClient *client, unsigned int nowtime,
+                            unsigned int *when)
+{
+        IrmoSendAtom *atom;
+        unsigned int timeout_length;
+        unsigned int next_send;
+
+        // Data is sent as soon as pacing allows.
+
+        next_send = client_pacing_next_send(client, nowtime);
+
+        // If there is data waiting and space in the send window,
+        // it can be sent straight away.
+
+        if (!irmo_client_sendq_is_empty(client)
+         && client->sendwindow_size < MAX_SENDWINDOW
+         && client->sendwindow_bytes < client_sendwindow_max(client)) {
+                *when = next_send;
+                return 1;
+        }
+
+        // Atoms in the send window that have not been sent, or that
+        // have been lost, are also sent straight away.
+
+        if (client->sendwindow_unsent > 0 || client->sendwindow_lost > 0) {
+                *when = next_send;
+                return 1;
+        }
+
+        // Otherwise, the client needs to be run when the first atom
+        // in flight times out.  Atoms in flight are in the order they
+        // were sent, so this is the first in the list.
+
+        atom = client->inflight_head;
+
+        if (atom == NULL) {
+                return 0;
+        }
+
+        timeout_length = irmo_client_timeout_time(client) * client->backoff;
+        *when = atom->sendtime + timeout_length;
+
+        if ((int) (*when - next_send) < 0) {
+                *when = next_send;
+        }
+
+        return 1;
+}
+
+// Check if a bitmap of unreliable variables is empty.
+
+static int unreliable_bitmap_empty(uint8_t *bitmap, unsigned int size)
+{
+        unsigned int i;
+
+        for (i=0; i<size; ++i) {
+                if (bitmap[i] != 0) {
+                        return 0;
+                }
+        }
+
+        return 1;
+}
+
+// Check whether the last unreliable update sent for an object has
+// arrived.  If it has been lost, it is not resent; instead, the
+// variables are marked as changed again, so that their latest values
+// are sent.
+
+static void client_check_unreliable(IrmoClient *client,
+                                    IrmoClientObject *entry,
+                                    unsigned int bitmap_size,
+                                    unsigned int nowtime)
+{
+        IrmoSentPacket *sent;
+        unsigned int packet_num;
+        unsigned int i;
+
+        if (unreliable_bitmap_empty(entry->unreliable_unacked, bitmap_size)) {
+                return;
+        }
+
+        packet_num = entry->unreliable_packet;
+        sent = irmo_client_sent_packet(client, packet_num);
+
+        // If the packet is too old to have a record, it is assumed
+        // lost.  Otherwise it is lost if later packets have been
+        // acknowledged, or if it has timed out.
+
+        if (sent != NULL) {
+                if (sent->acked) {
+                        memset(entry->unreliable_unacked, 0, bitmap_size);
+                        return;
+                }
+
+                if (packet_num + LOSS_PACKET_THRESHOLD
+                      > client->largest_acked_packet
+                 && nowtime - sent->sendtime
+                      < irmo_client_timeout_time(client)) {
+                        return;
+                }
+        }
+
+        for (i=0; i<bitmap_size; ++i) {
+                entry->unreliable_changed[i] |= entry->unreliable_unacked[i];
+                entry->unreliable_unacked[i] = 0;
+        }
+
+        ++client->server->unreliable_lost;
+}
+
+// Check if there is an unreliable update waiting to be sent for an
+// object.
+
+static int client_unreliable_ready(IrmoClient *client,
+                                   IrmoClientObject *entry,
+                                   IrmoObject *object)
+{
+        return !unreliable_bitmap_empty(entry->unreliable_changed,
+                                        (object->objclass->nvariables + 7)
+                                          / 8)
+            && !irmo_client_sendq_unreliable_held(client, object);
+}
+
+// Start a packet of unreliable updates.  The number of updates is
+// filled in once the packet is complete.
+
+static IrmoPacket *client_unreliable_packet(IrmoClient *client,
+                                            unsigned int nowtime,
+                                            unsigned int *packet_num)
+{
+        IrmoPacket *packet;
+
+        packet = irmo_packet_new();
+
+        *packet_num = client_write_ack(client, packet, PACKET_FLAG_UNR);
+
+        client_record_sent(client, *packet_num, nowtime);
+
+        irmo_packet_writei8(packet, 0);
+
+        return packet;
+}
+
+// Fill in the number of updates in a packet of unreliable updates, and
+// send it.
+
+static void client_unreliable_send(IrmoClient *client, IrmoPacket *packet,
+                                   unsigned int packet_num,
+                                   unsigned int count_pos,
+                                   unsigned int count, int paced,
+                                   unsigned int nowtime)
+{
+        unsigned int len;
+
+        len = irmo_packet_get_length(packet);
+
+        irmo_packet_set_position(packet, count_pos);
+        irmo_packet_writei8(packet, count);
+        irmo_packet_set_position(packet, len);
+
+        irmo_net_socket_send_packet(client->server->socket,
+                                    client->address,
+                                    packet);
+
+        if (paced) {
+                client->pacing_tokens -= (float) len;
+        }
+
+        client_fec_add(client, packet, packet_num, nowtime);
+
+        irmo_packet_free(packet);
+}
+
+// Send the latest values of unreliable variables that have changed.
+// Each update is written in the same way as a change atom.
+
+// Allocate the flags used to build unreliable updates, large enough
+// for any class in the world being served.
+
+static void client_unreliable_alloc_scratch(IrmoClient *client)
+{
+        IrmoInterface *iface = client->server->world->iface;
+        unsigned int nvariables;
+        unsigned int i;
+
+        nvariables = 1;
+
+        for (i=0; i<iface->nclasses; ++i) {
+                if (iface->classes[i]->nvariables > nvariables) {
+                        nvariables = iface->classes[i]->nvariables;
+                }
+        }
+
+        client->unreliable_scratch = irmo_new0(int, nvariables);
+}
+
+static void client_send_unreliable(IrmoClient *client)
+{
+        IrmoClientObject *entry;
+        IrmoChangeAtom atom;
+        IrmoPacket *packet;
+        IrmoObject *object;
+        IrmoObjectID id;
+        unsigned int nowtime;
+        unsigned int bitmap_size;
+        unsigned int count, count_pos;
+        unsigned int packet_num;
+        size_t budget, len, atom_len;
+        unsigned int i, j, n;
+        int paced;
+
+        if (client->unreliable_list_len == 0) {
+                return;
+        }
+
+        if (client->unreliable_scratch == NULL) {
+                client_unreliable_alloc_scratch(client);
+        }
+
+        nowtime = irmo_get_time();
+        paced = client_pacing_fill(client, nowtime);
+        budget = client->mtu - client_max_header_len(client);
+
+        memset(&atom, 0, sizeof(atom));
+        atom.sendatom.klass = &irmo_change_atom;
+        atom.sendatom.client = client;
+        atom.unreliable = 1;
+
+        packet = NULL;
+        packet_num = 0;
+        count = 0;
+        count_pos = 0;
+        len = 0;
+        n = 0;
+
+        for (i=0; i<client->unreliable_list_len; ++i) {
+                id = client->unreliable_list[i];
+                entry = &client->objects[id];
+
+                // Changes cleared when the object left the client's
+                // scope?
+
+                if (entry->unreliable_changed == NULL) {
+                        entry->unreliable_listed = 0;
+                        continue;
+                }
+
+                object = irmo_world_get_object_for_id(client->server->world,
+                                                      id);
+                bitmap_size = (object->objclass->nvariables + 7) / 8;
+
+                client_check_unreliable(client, entry, bitmap_size, nowtime);
+
+                if (client_unreliable_ready(client, entry, object)
+                 && (packet != NULL || !paced || client->pacing_tokens > 0)) {
+
+                        // Send the latest values of all variables not
+                        // yet known to have arrived.
+
+                        atom.object = object;
+                        atom.changed = client->unreliable_scratch;
+                        memset(atom.changed, 0,
+                               sizeof(int) * object->objclass->nvariables);
+
+                        for (j=0; j<object->objclass->nvariables; ++j) {
+                                if (((entry->unreliable_changed[j / 8]
+                                      | entry->unreliable_unacked[j / 8])
+                                     & (1 << (j % 8))) != 0) {
+                                        atom.changed[j] = 1;
+                                }
+                        }
+
+                        atom_len = irmo_change_atom.length(
+                                        IRMO_SENDATOM(&atom));
+
+                        // Start a new packet if this one is full.
+
+                        if (packet != NULL
+                         && (count >= PACKET_MAX_UNRELIABLE
+                          || len + atom_len > budget)) {
+                                client_unreliable_send(client, packet,
+                                                       packet_num,
+                                                       count_pos, count,
+                                                       paced, nowtime);
+                                packet = NULL;
+                        }
+
+                        if (packet == NULL
+                         && (!paced || client->pacing_tokens > 0)) {
+                                packet = client_unreliable_packet(
+                                                client, nowtime, &packet_num);
+                                count_pos = irmo_packet_get_length(packet)
+                                          - 1;
+                                count = 0;
+                                len = 0;
+                        }
+
+                        if (packet != NULL) {
+                                irmo_change_atom.write(IRMO_SENDATOM(&atom),
+                                                       packet);
+                                ++count;
+                                len += atom_len;
+
+                                for (j=0; j<bitmap_size; ++j) {
+                                        entry->unreliable_unacked[j]
+                                            |= entry->unreliable_changed[j];
+                                        entry->unreliable_changed[j] = 0;
+                                }
+
+                                entry->unreliable_packet = packet_num;
+                                ++client->server->unreliable_updates;
+                        }
+                }
+
+                // Objects stay in the list until everything sent for
+                // them has been acknowledged.
+
+                if (unreliable_bitmap_empty(entry->unreliable_changed,
+                                            bitmap_size)
+                 && unreliable_bitmap_empty(entry->unreliable_unacked,
+                                            bitmap_size)) {
+                        entry->unreliable_listed = 0;
+                } else {
+                        client->unreliable_list[n] = id;
+                        ++n;
+                }
+        }
+
+        client->unreliable_list_len = n;
+
+        if (packet != NULL) {
+                client_unreliable_send(client, packet, packet_num,
+                                       count_pos, count, paced, nowtime);
+        }
+}
+
+// Work out when a client next needs to be run to send unreliable
+// updates, or to check whether those sent have been lost.
+
+static int client_next_unreliable(IrmoClient *client, unsigned int nowtime,
+                                  unsigned int *when)
+{
+        IrmoClientObject *entry;
+        IrmoSentPacket *sent;
+        IrmoObject *object;
+        IrmoObjectID id;
+        unsigned int deadline;
+        unsigned int i;
+        int result;
+
+        result = 0;
+
+        for (i=0; i<client->unreliable_list_len; ++i) {
+                id = client->unreliable_list[i];
+                entry = &client->objects[id];
+
+                if (entry->unreliable_changed == NULL) {
+                        continue;
+                }
+
+                object = irmo_world_get_object_for_id(client->server->world,
+                                                      id);
+
+                if (client_unreliable_ready(client, entry, object)) {
+                        *when = client_pacing_next_send(client, nowtime);
+                        return 1;
+                }
+
+                // Unacknowledged updates are assumed lost once they
+                // time out.
+
+                if (unreliable_bitmap_empty(entry->unreliable_unacked,
+                                            (object->objclass->nvariables
+                                             + 7) / 8)) {
+                        continue;
+                }
+
+                sent = irmo_client_sent_packet(client,
+                                               entry->unreliable_packet);
+
+                if (sent != NULL) {
+                        deadline = sent->sendtime
+                                 + irmo_client_timeout_time(client);
+                } else {
+                        deadline = nowtime;
+                }
+
+                if (!result || (int) (deadline - *when) < 0) {
+                        *when = deadline;
+                        result = 1;
+                }
+        }
+
+        return result;
+}
+
+// Work out the size of the next probe to send to a client, or zero if
+// the largest packet size that gets through has been found.
+
+static unsigned int client_probe_size(IrmoClient *client)
+{
+        if (!client->mtu_probing
+         || client->mtu_probe_fail - client->mtu <= IRMO_MTU_PROBE_PRECISION) {
+                return 0;
+        }
+
+        // Try the largest size first, as often the whole path can
+        // carry it.  After that, search between the largest size known
+        // to get through and the smallest size known not to.
+
+        if (client->mtu_probe_fail > client->mtu_max) {
+                return client->mtu_max;
+        } else {
+                return (client->mtu + client->mtu_probe_fail) / 2;
+        }
+}
+
+// Time at which the probe in flight to a client times out.
+
+static unsigned int client_probe_deadline(IrmoClient *client)
+{
+        return client->mtu_probe_time + irmo_client_timeout_time(client);
+}
+
+// Send a probe packet of the specified size, padded out to that size.
+
+static void client_send_probe(IrmoClient *client, unsigned int size)
+{
+        IrmoPacket *packet;
+
+        packet = irmo_packet_new();
+
+        irmo_proto_write_flags(client, packet, PACKET_FLAG_PRB);
+        irmo_packet_writei8(packet, PROBE_REQUEST);
+        irmo_packet_writei16(packet, size);
+
+        while (irmo_packet_get_length(packet) < size) {
+                irmo_packet_writei8(packet, 0);
+        }
+
+        irmo_net_socket_send_packet(client->server->socket,
+                                    client->address,
+                                    packet);
+
+        irmo_packet_free(packet);
+}
+
+// Probe for the largest packet size that gets through to a client.
+// One probe is in flight at a time; when a reply is received, the
+// packet size is raised and the next probe can be sent.
+
+static void client_run_probe(IrmoClient *client, unsigned int nowtime)
+{
+        // Has the probe in flight timed out?  If it has been sent
+        // several times without a reply, packets of that size do
+        // not get through.
+
+        if (client->mtu_probe_size != 0) {
+                if ((int) (nowtime - client_probe_deadline(client)) < 0) {
+                        return;
+                }
+
+                if (client->mtu_probe_attempts >= IRMO_MTU_PROBE_ATTEMPTS) {
+                        client->mtu_probe_fail = client->mtu_probe_size;
+                        client->mtu_probe_size = 0;
+                }
+        }
+
+        if (client->mtu_probe_size == 0) {
+                client->mtu_probe_size = client_probe_size(client);
+                client->mtu_probe_attempts = 0;
+
+                if (client->mtu_probe_size == 0) {
+                        return;
+                }
+        }
+
+        client_send_probe(client, client->mtu_probe_size);
+
+        client->mtu_probe_time = nowtime;
+        ++client->mtu_probe_attempts;
+}
+
+// Work out when a probe next needs to be sent to a client.  A probe is
+// sent as soon as the last one has been answered, or resent when it
+// times out.
+
+static int client_next_probe(IrmoClient *client, unsigned int nowtime,
+                             unsigned int *when)
+{
+        if (!client->mtu_probing) {
+                return 0;
+        }
+
+        if (client->mtu_probe_size != 0) {
+                *when = client_probe_deadline(client);
+                return 1;
+        } else if (client_probe_size(client) != 0) {
+                *when = nowtime;
+                return 1;
+        } else {
+                return 0;
+        }
+}
+
+int irmo_proto_next_run(IrmoClient *client, unsigned int nowtime,
+                        unsigned int *when)
+{
+        unsigned int deadline;
+        int result;
+
+        result = client_next_send(client, nowtime, when);
+
+        if (client_next_unreliable(client, nowtime, &deadline)
+         && (!result || (int) (deadline - *when) < 0)) {
+                *when = deadline;
+                result = 1;
+        }
+
+        if (client_next_probe(client, nowtime, &deadline)
+         && (!result || (int) (deadline - *when) < 0)) {
+                *when = deadline;
+                result = 1;
+        }
+
+        // A parity packet is due for the packets sent so far.
+
+        if (client->fec_count > 0) {
+                deadline = client_fec_deadline(client);
+
+                if (!result || (int) (deadline - *when) < 0) {
+                        *when = deadline;
+                        result = 1;
+                }
+        }
+
+        // Acknowledgements that cannot be delayed are sent straight
+        // away; others are sent when the delay expires, if there is
+        // no data to send them with before then.
+
+        if (client->need_ack) {
+                if (client->ack_now) {
+                        *when = nowtime;
+                } else if (!result
+                        || (int) (client->ack_deadline - *when) < 0) {
+                        *when = client->ack_deadline;
+                }
+
+                result = 1;
+        }
+
+        return result;
+}
+
 static void client_send_ack(IrmoClient *client)
 {
         IrmoPacket *packet;
@@ -392,8 +1381,7 @@ static void client_send_ack(IrmoClient *client)
 
         // only ack flag is sent, not dta as there is no data
         
-        irmo_packet_writei16(packet, PACKET_FLAG_ACK);
-        irmo_packet_writei16(packet, client->recvwindow_start & 0xffff);
+        client_write_ack(client, packet, 0);
 
         // send packet
 
@@ -434,13 +1422,36 @@ void irmo_proto_run_client(IrmoClient *client)
 
         client_send_data(client, timeout_length);
 
+        // Send the latest values of unreliable variables.
+
+        client_send_unreliable(client);
+
+        // Protect the packets sent recently, if no more have been
+        // sent to fill up the parity group.
+
+        if (client->fec_count > 0
+         && (int) (irmo_get_time() - client_fec_deadline(client)) >= 0) {
+                client_fec_send(client);
+        }
+
+        // Look for a larger packet size that gets through.
+
+        if (client->mtu_probing) {
+                client_run_probe(client, irmo_get_time());
+        }
+
 	// Possibly we need to send an ack for something we have received.
 	// If we have nothing in our send window to send, we still need
-	// to send an acknowledgement back.
+	// to send an acknowledgement back, but it may be delayed for a
+	// while in case there is data to send it with.
 
 	if (client->need_ack) {
-                client_send_ack(client);
-                client->need_ack = 0;
+                if (client->ack_now
+                 || (int) (irmo_get_time() - client->ack_deadline) >= 0) {
+                        client_send_ack(client);
+                } else {
+                        client->ack_delayed = 1;
+                }
 	}
 }
 
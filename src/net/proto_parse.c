@@ -29,14 +29,52 @@
 
 #include <irmo/packet.h>
 
+#include "world/object.h"
+
 #include "protocol.h"
 #include "sendatom.h"
+#include "string-table.h"
 
 // alpha value used for estimating round trip time
 
 #define RTT_ALPHA 0.9f
 
 int irmo_proto_use_preexec = 1;
+int irmo_proto_use_fast_retransmit = 1;
+
+int irmo_proto_read_flags(IrmoPacket *packet, unsigned int *flags)
+{
+	unsigned int pos;
+	unsigned int header, high;
+
+	pos = irmo_packet_get_position(packet);
+
+	if (!irmo_packet_readi8(packet, &header)) {
+		return 0;
+	}
+
+	// The int16 flags never have the top bit set.
+
+	if ((header & PACKET_COMPACT_HEADER) == 0) {
+		irmo_packet_set_position(packet, pos);
+
+		return irmo_packet_readi16(packet, flags);
+	}
+
+	irmo_packet_set_compact(packet, 1);
+
+	*flags = header & PACKET_COMPACT_LOW_FLAGS;
+
+	if ((header & PACKET_COMPACT_HIGH_FLAGS) != 0) {
+		if (!irmo_packet_readi8(packet, &high)) {
+			return 0;
+		}
+
+		*flags |= high << 6;
+	}
+
+	return 1;
+}
 
 // only the low 16 bits of the stream position is sent
 // therefore we must expand positions we get based on the
@@ -64,35 +102,26 @@ static void proto_parse_insert_atom(IrmoClient *client,
 				    unsigned int seq)
 {
 	unsigned int index = seq - client->recvwindow_start;
-	unsigned int i;
 
 	// increase the receive window size if neccesary
 	
-	if (index >= client->recvwindow_size) {
-		unsigned int newsize = index + 1;
-
-		client->recvwindow = irmo_renew(IrmoSendAtom *,
-                                                client->recvwindow,
-                                                newsize);
-
-		for (i=client->recvwindow_size; i<newsize; ++i) {
-			client->recvwindow[i] = NULL;
-                }
-
-		client->recvwindow_size = newsize;
-	}
+	irmo_client_recvwindow_reserve(client, index + 1);
 
 	// delete old sendatoms in the same position (assume
 	// new retransmitted atoms are more up to date)
 	
-	if (client->recvwindow[index] != NULL) {
-		irmo_sendatom_free(client->recvwindow[index]);
+	if (IRMO_CLIENT_RECVWINDOW(client, index) != NULL) {
+		irmo_sendatom_free(IRMO_CLIENT_RECVWINDOW(client, index));
         }
 
-	client->recvwindow[index] = atom;
+	IRMO_CLIENT_RECVWINDOW(client, index) = atom;
 }
 
-static void proto_parse_packet_data(IrmoClient *client, IrmoPacket *packet)
+// Parse the data in a packet, returning the sequence number following
+// the last atom.
+
+static unsigned int proto_parse_packet_data(IrmoClient *client,
+                                            IrmoPacket *packet)
 {
 	unsigned int i;
 	unsigned int seq;
@@ -110,19 +139,19 @@ static void proto_parse_packet_data(IrmoClient *client, IrmoPacket *packet)
 
 	for (;;) {
 		IrmoSendAtomClass *klass;
-		IrmoSendAtomType atomtype;
+		unsigned int atomtype;
 		unsigned int natoms;
-		unsigned int byte;
 
 		// read type/count byte
 		// if none, end of packet
 		
-		if (!irmo_packet_readi8(packet, &byte)) {
+		if (!irmo_packet_read_bits(packet, &natoms,
+		                           ATOM_GROUP_COUNT_BITS)) {
 			break;
                 }
 
-		atomtype = (byte >> 5) & 0x07;
-		natoms = (byte & 0x1f) + 1;
+		irmo_packet_read_bits(packet, &atomtype, ATOM_GROUP_TYPE_BITS);
+		natoms += 1;
 
 		klass = irmo_sendatom_types[atomtype];
 
@@ -131,22 +160,11 @@ static void proto_parse_packet_data(IrmoClient *client, IrmoPacket *packet)
 		for (i=0; i<natoms; ++i, ++seq) {
 			IrmoSendAtom *atom;
 
+			client->strings.read_seq = seq;
 			atom = klass->read(packet, client);
 			atom->client = client;
 			atom->seqnum = seq;
 
-			// set the need_ack flag if this is at the start
-			// or before the start of the recvwindow. We only
-			// send an ack when the atom is at the start of
-			// the recvwindow (seq == client->recvwindow_start)
-			// as this allows us to advance the window
-			// or if it is too old (as this could be resend
-			// because our previous ack was lost
-
-			if (seq <= client->recvwindow_start) {
-				client->need_ack = 1;
-                        }
-			
 			// too old?
 			
 			if (seq < client->recvwindow_start) {
@@ -165,6 +183,129 @@ static void proto_parse_packet_data(IrmoClient *client, IrmoPacket *packet)
 	if (irmo_proto_use_preexec) {
 		irmo_client_run_preexec(client, start, seq);
         }
+
+        return seq;
+}
+
+// Apply the unreliable updates in a packet.  Updates are ignored if
+// a later update to the same object has already been applied, or if
+// the object does not exist.
+
+static void proto_parse_unreliable(IrmoClient *client, IrmoPacket *packet,
+                                   unsigned int packet_num)
+{
+	IrmoChangeAtom *atom;
+	IrmoObject *obj;
+	IrmoClass *objclass;
+	unsigned int *newest;
+	unsigned int count;
+	unsigned int i, j;
+
+	irmo_packet_readi8(packet, &count);
+
+	for (i=0; i<count; ++i) {
+		atom = (IrmoChangeAtom *) irmo_change_atom.read(packet, client);
+		atom->sendatom.client = client;
+
+		obj = irmo_world_get_object_for_id(client->world, atom->id);
+		newest = irmo_client_unreliable_recv(client, atom->id);
+
+		if (obj != NULL && obj->objclass == atom->objclass
+		 && packet_num > *newest) {
+			objclass = obj->objclass;
+
+			for (j=0; j<objclass->nvariables; ++j) {
+				if (atom->changed[j]
+				 && objclass->variables[j]->unreliable) {
+					irmo_object_internal_set(
+						obj, objclass->variables[j],
+						&atom->newvalues[j], 1);
+				}
+			}
+
+			*newest = packet_num;
+		}
+
+		irmo_sendatom_free(IRMO_SENDATOM(atom));
+	}
+}
+
+// Record the number of a packet containing data that has been
+// received, so that it is acknowledged.
+
+static void proto_record_received(IrmoClient *client,
+                                  unsigned int packet_num)
+{
+	unsigned int shift;
+
+	if (packet_num > client->ack_packet_num) {
+
+		// Shift the bitmap of earlier packets along, and add the
+		// previous largest packet to it.
+
+		shift = packet_num - client->ack_packet_num;
+
+		if (client->ack_packet_num == 0 || shift > 32) {
+			client->recv_packet_mask = 0;
+		} else {
+			if (shift < 32) {
+				client->recv_packet_mask <<= shift;
+			} else {
+				client->recv_packet_mask = 0;
+			}
+
+			client->recv_packet_mask |= 1U << (shift - 1);
+		}
+
+		client->ack_packet_num = packet_num;
+		client->ack_packet_time = irmo_get_time();
+	} else if (packet_num < client->ack_packet_num) {
+		shift = client->ack_packet_num - packet_num;
+
+		if (shift <= 32) {
+			client->recv_packet_mask |= 1U << (shift - 1);
+		}
+	}
+}
+
+// Schedule an acknowledgement of a data packet that has been received.
+// 'start' is the start of the receive window before the packet was
+// received, and 'end' is the sequence number following the last atom
+// in the packet.  'flags' are the packet's header flags.
+
+static void proto_schedule_ack(IrmoClient *client, unsigned int start,
+                               unsigned int end, unsigned int flags)
+{
+        // An acknowledgement that was being delayed is merged into
+        // the acknowledgement of this packet.
+
+        if (client->ack_delayed) {
+                ++client->server->acks_avoided;
+                client->ack_delayed = 0;
+        }
+
+        if (!client->need_ack) {
+                client->need_ack = 1;
+                client->ack_deadline = irmo_get_time() + client->ack_delay;
+        }
+
+        ++client->ack_packets;
+
+        // The acknowledgement can be delayed until there is data to
+        // send it with, unless:
+        //  * No new atoms were received.  Our previous ack may have
+        //    been lost, causing the data to be resent.
+        //  * An earlier packet has been lost.  The selective ack tells
+        //    the sender which atoms it does not need to resend.
+        //  * Several packets have been received.  The sender's window
+        //    only opens as data is acknowledged.
+
+        if (client->ack_delay == 0
+         || ((flags & PACKET_FLAG_DTA) != 0 && end <= start)
+         || client->recvwindow_start < end
+         || client->ack_packets >= IRMO_ACK_PACKETS) {
+                client->ack_now = 1;
+        }
 }
 
 // Perform a low pass filter of RTT values
@@ -180,93 +321,190 @@ static float rtt_low_pass_filter(float last_value,
         return result;
 }
 
-// Update the congestion control values for the given client, after 
-// receiving a successful acknowledgement.
+// Update the round trip time estimate for the given client, after
+// receiving an acknowledgement of the specified packet.  'ack_delay'
+// is the time that the remote client held the acknowledgement back
+// for.  Returns non-zero if a new measurement was taken.
 
-static void proto_update_cc_values(IrmoClient *client)
+static int proto_update_rtt(IrmoClient *client, unsigned int packet_num,
+                            unsigned int ack_delay)
 {
-        unsigned int nowtime, rtt;
+        IrmoSentPacket *sent;
+        unsigned int rtt;
         unsigned int deviation;
 
-	// We got a valid ack. open up the send window a bit more.
-	// If we are above the slow start congestion threshold, open
-	// slower.
+        // Only the largest packet number acknowledged so far is
+        // sent back; if this is not new, it has already been used.
 
-	if (client->cwnd < client->ssthresh) {
-		client->cwnd += IRMO_PROTOCOL_MTU;
-	} else {
-		client->cwnd +=
-			(IRMO_PROTOCOL_MTU * IRMO_PROTOCOL_MTU) / client->cwnd;
+        if (packet_num <= client->largest_acked_packet
+         || packet_num >= client->send_packet_num) {
+                return 0;
         }
 
-        //
-	// We are acking something valid and advancing the window
-	// Assume this is because the first atom in the window has
-	// been cleared. Therefore we can estimate the round-trip time
-	// by subtracting the current time from the send time of the
-	// first atom in the send window.
-        //
-	// If the atom was resent, this cannot be used.
-        //
+        sent = irmo_client_sent_packet(client, packet_num);
 
-	if (!client->sendwindow[0]->resent) {
-                nowtime = irmo_get_time();
+        // No record of this packet?  It might have been an ack that
+        // did not contain data, or too long ago.
 
-                // Round-trip time
+        if (sent == NULL) {
+                client->largest_acked_packet = packet_num;
+                return 0;
+        }
+
+        rtt = irmo_get_time() - sent->sendtime;
+
+        // Time spent waiting to send the acknowledgement is not part
+        // of the round trip.  The clocks only count milliseconds, so
+        // the delay can appear to be longer than the round trip.
+
+        if (ack_delay < rtt) {
+                rtt -= ack_delay;
+        } else {
+                rtt = 0;
+        }
+
+        client->last_rtt = rtt;
 
-                rtt = nowtime - client->sendwindow[0]->sendtime;
+        // The first measurement replaces the initial guess, which
+        // is very conservative.
 
+        if (client->largest_acked_packet == 0) {
+                client->rtt = (float) rtt;
+                client->rtt_deviation = (float) rtt / 2;
+        } else {
 		deviation = (unsigned int) abs((int) rtt - (int) client->rtt);
 
-                client->rtt
-                        = rtt_low_pass_filter(client->rtt, rtt);
+                client->rtt = rtt_low_pass_filter(client->rtt, rtt);
                 client->rtt_deviation
                         = rtt_low_pass_filter(client->rtt_deviation,
                                               deviation);
+        }
+
+        client->largest_acked_packet = packet_num;
 
-		// Reset exponential backoff now that we have a valid packet
+        // Reset exponential backoff now that a packet has got through.
 
-		client->backoff = 1;
+        client->backoff = 1;
+
+        return 1;
+}
+
+// Mark packets as received by the remote client: the largest packet
+// number received, and the packets before it set in the bitmap.
+
+static void proto_mark_received(IrmoClient *client, unsigned int packet_num,
+                                unsigned int mask)
+{
+	IrmoSentPacket *sent;
+	unsigned int n;
+	unsigned int i;
+
+	if (packet_num >= client->send_packet_num) {
+		return;
+	}
+
+	for (i=0; i<=32; ++i) {
+		if (i > 0 && (mask & (1U << (i - 1))) == 0) {
+			continue;
+		}
+
+		n = packet_num - i;
+		sent = irmo_client_sent_packet(client, n);
+
+		if (sent != NULL) {
+			sent->acked = 1;
+		}
 	}
 }
 
-static void advance_send_window(IrmoClient *client, unsigned int length)
+// Update the loss rate measured for forward error correction, after
+// an acknowledgement that shows which packets were received.  As with
+// atoms, a packet is counted as lost once a packet sent a few packets
+// after it has been acknowledged.
+
+static void proto_measure_loss(IrmoClient *client)
+{
+	IrmoSentPacket *sent;
+	unsigned int n;
+
+	if (!client->fec
+	 || client->largest_acked_packet < LOSS_PACKET_THRESHOLD) {
+		return;
+	}
+
+	// Only packets covered by the bitmap of received packets
+	// can be counted.
+
+	n = client->fec_loss_packet;
+
+	if (n + 32 < client->largest_acked_packet) {
+		n = client->largest_acked_packet - 32;
+	}
+
+	for (; n + LOSS_PACKET_THRESHOLD <= client->largest_acked_packet;
+	     ++n) {
+		sent = irmo_client_sent_packet(client, n);
+
+		// Only packets containing data are recorded.
+
+		if (sent == NULL) {
+			continue;
+		}
+
+		client->fec_loss *= 1 - FEC_LOSS_ALPHA;
+
+		if (!sent->acked) {
+			client->fec_loss += FEC_LOSS_ALPHA;
+		}
+	}
+
+	client->fec_loss_packet = n;
+}
+
+// Advance the send window after an acknowledgement, returning the
+// number of bytes of data acknowledged.
+
+static unsigned int advance_send_window(IrmoClient *client,
+                                        unsigned int length)
 {
         IrmoSendAtom *atom;
+        unsigned int acked_bytes;
         unsigned int i;
 
+        acked_bytes = 0;
+
 	// destroy all atoms in the area acked
 
 	for (i=0; i<length; ++i) {
 
-                atom = client->sendwindow[i];
+                atom = IRMO_CLIENT_SENDWINDOW(client, i);
+                acked_bytes += (unsigned int) atom->len;
 
                 // Signal the atom that it has been acknowledged.
 
+                irmo_string_table_acked(atom);
+
                 if (atom->klass->acked != NULL) {
                         atom->klass->acked(atom);
                 }
 
+                irmo_client_sendwindow_acked(client, atom);
 		irmo_sendatom_free(atom);
         }
 
         // advance the send window forward
 
-	memcpy(client->sendwindow,
-	       client->sendwindow + length,
-	       sizeof(*client->sendwindow)
-	         * (client->sendwindow_size - length));
-
-        // update counters
+        irmo_client_sendwindow_advance(client, length);
 
-	client->sendwindow_start += length;
-	client->sendwindow_size -= length;
+        return acked_bytes;
 }
 
-static void proto_parse_ack(IrmoClient *client, unsigned int ack)
+static void proto_parse_ack(IrmoClient *client, unsigned int ack,
+                            int new_rtt)
 {
 	unsigned int seq;
 	unsigned int relative;
+	unsigned int acked_bytes;
 
 	//printf("got an ack: %i\n", ack);
 
@@ -295,16 +533,265 @@ static void proto_parse_ack(IrmoClient *client, unsigned int ack)
 		return;
 	}
 
+        acked_bytes = advance_send_window(client, relative);
+
         // Update congestion control values
 
-        proto_update_cc_values(client);
-        advance_send_window(client, relative);
+        client->cc->on_ack(client, acked_bytes, new_rtt);
+}
+
+// Parse a list of selective acknowledgement ranges following an ack,
+// and flag the atoms in those ranges so that they are not resent.
+
+static void proto_parse_sack(IrmoClient *client, IrmoPacket *packet,
+                             unsigned int ack)
+{
+	unsigned int seq;
+	unsigned int num_ranges;
+	unsigned int offset, length;
+	unsigned int i, j;
+
+	seq = get_stream_position(client->sendwindow_start, ack);
+
+	irmo_packet_readi8(packet, &num_ranges);
+
+	for (i=0; i<num_ranges; ++i) {
+		irmo_packet_readi16v(packet, &offset);
+		irmo_packet_readi16v(packet, &length);
+
+		for (j=seq+offset; j<seq+offset+length; ++j) {
+
+			// Ignore anything outside the send window.
+
+			if (j < client->sendwindow_start
+			 || j - client->sendwindow_start
+			      >= client->sendwindow_size) {
+				continue;
+			}
+
+			irmo_client_sendwindow_sacked(client,
+			    IRMO_CLIENT_SENDWINDOW(client,
+			                           j - client->sendwindow_start));
+		}
+	}
+}
+
+// Look for atoms that have been lost: atoms that have not been
+// acknowledged, although packets sent after them have.  These are
+// flagged to be retransmitted straight away.
+
+static void proto_detect_losses(IrmoClient *client)
+{
+	IrmoSendAtom *atom;
+	int new_loss;
+
+	if (!irmo_proto_use_fast_retransmit
+	 || client->largest_acked_packet < LOSS_PACKET_THRESHOLD) {
+		return;
+	}
+
+	new_loss = 0;
+
+	// Atoms in flight are in packet number order, so only the
+	// start of the list needs to be checked.  Lost atoms are
+	// removed from the list.
+
+	while (client->inflight_head != NULL) {
+		atom = client->inflight_head;
+
+		if (atom->packet_num + LOSS_PACKET_THRESHOLD
+		      > client->largest_acked_packet) {
+			break;
+		}
+
+		irmo_client_sendwindow_lost(client, atom);
+
+		if (atom->packet_num >= client->recovery_packet) {
+			new_loss = 1;
+		}
+	}
+
+	// Only the first loss in each loss event reduces the
+	// congestion window.
+
+	if (new_loss) {
+		client->cc->on_loss(client, 0);
+		client->recovery_packet = client->send_packet_num;
+	}
+}
+
+// Handle a path MTU probe packet.
+
+static void proto_parse_probe(IrmoClient *client, IrmoPacket *packet)
+{
+	IrmoPacket *reply;
+	unsigned int type, size;
+
+	irmo_packet_readi8(packet, &type);
+	irmo_packet_readi16(packet, &size);
+
+	if (type == PROBE_REQUEST) {
+
+		// Tell the sender that packets of this size get through.
+
+		reply = irmo_packet_new();
+
+		irmo_proto_write_flags(client, reply, PACKET_FLAG_PRB);
+		irmo_packet_writei8(reply, PROBE_REPLY);
+		irmo_packet_writei16(reply, size);
+
+		irmo_net_socket_send_packet(client->server->socket,
+		                            client->address,
+		                            reply);
+
+		irmo_packet_free(reply);
+
+		return;
+	}
+
+	// One of our probes got through, so packets of that size can
+	// be used.  Replies may arrive after the probe has been resent,
+	// so a reply to any probe larger than the current size is
+	// accepted.
+
+	if (size > client->mtu && size < client->mtu_probe_fail) {
+		client->mtu = size;
+	}
+
+	if (size == client->mtu_probe_size) {
+		client->mtu_probe_size = 0;
+	}
+}
+
+// Keep a copy of a packet containing data, so that it can be used
+// to rebuild another packet in its parity group if that is lost.
+
+static void proto_keep_packet(IrmoClient *client, IrmoPacket *packet,
+                              unsigned int packet_num)
+{
+	IrmoReceivedPacket *received;
+	unsigned int len;
+
+	received = &client->recv_packets[packet_num
+	                                 & (IRMO_CLIENT_RECV_PACKETS - 1)];
+	len = irmo_packet_get_length(packet);
+
+	if (len > received->alloced) {
+		received->alloced = len;
+		received->data = irmo_renew(uint8_t, received->data, len);
+	}
+
+	memcpy(received->data, irmo_packet_get_buffer(packet), len);
+	received->len = len;
+	received->packet_num = packet_num;
+}
+
+// Handle a parity packet.  If exactly one packet in its group has not
+// been received, it is rebuilt and parsed as if it had arrived.
+
+static void proto_parse_parity(IrmoClient *client, IrmoPacket *packet)
+{
+	IrmoReceivedPacket *received;
+	IrmoPacket *rebuilt;
+	uint8_t *data;
+	unsigned int first, mask, len;
+	unsigned int pos, parity_len;
+	unsigned int missing;
+	unsigned int flags;
+	unsigned int i, j, n;
+
+	irmo_packet_readi16(packet, &first);
+	irmo_packet_readi32(packet, &mask);
+	irmo_packet_readi16(packet, &len);
+
+	first = get_stream_position(client->recv_packet_num, first);
+
+	// From now on, packets are kept so that they can be rebuilt.
+
+	if (!client->recv_fec) {
+		client->recv_packets = irmo_new0(IrmoReceivedPacket,
+		                                 IRMO_CLIENT_RECV_PACKETS);
+		client->recv_fec = 1;
+	}
+
+	missing = 0;
+	n = 0;
+
+	for (i=0; i<32; ++i) {
+		if ((mask & (1U << i)) == 0) {
+			continue;
+		}
+
+		received = &client->recv_packets[(first + i)
+		                           & (IRMO_CLIENT_RECV_PACKETS - 1)];
+
+		if (received->packet_num != first + i) {
+			++missing;
+			n = first + i;
+		}
+	}
+
+	// XOR the other packets out of the parity data, leaving the
+	// missing packet.
+
+	pos = irmo_packet_get_position(packet);
+	parity_len = irmo_packet_get_length(packet) - pos;
+
+	if (missing != 1 || parity_len == 0) {
+		return;
+	}
+
+	data = irmo_new0(uint8_t, parity_len);
+	memcpy(data, irmo_packet_get_buffer(packet) + pos, parity_len);
+
+	for (i=0; i<32; ++i) {
+		if ((mask & (1U << i)) == 0 || first + i == n) {
+			continue;
+		}
+
+		received = &client->recv_packets[(first + i)
+		                           & (IRMO_CLIENT_RECV_PACKETS - 1)];
+
+		if (received->len > parity_len) {
+			free(data);
+			return;
+		}
+
+		for (j=0; j<received->len; ++j) {
+			data[j] ^= received->data[j];
+		}
+
+		len ^= received->len;
+	}
+
+	if (len > parity_len) {
+		free(data);
+		return;
+	}
+
+	// The rebuilt packet is parsed like any other.  It must not be
+	// another parity packet.
+
+	rebuilt = irmo_packet_new_from(data, len);
+
+	if (irmo_proto_read_flags(rebuilt, &flags)
+	 && (flags & (PACKET_FLAG_DTA | PACKET_FLAG_UNR)) != 0
+	 && (flags & (PACKET_FLAG_SYN | PACKET_FLAG_PRB
+	              | PACKET_FLAG_FEC)) == 0) {
+		++client->server->fec_recovered;
+		irmo_proto_parse_packet(rebuilt, client, flags);
+	}
+
+	irmo_packet_free(rebuilt);
+	free(data);
 }
 
 void irmo_proto_parse_packet(IrmoPacket *packet,
                              IrmoClient *client,
                              unsigned int flags)
 {
+	unsigned int packet_num;
+
 	// verify packet before parsing for security
 	
 	if (!irmo_proto_verify_packet(packet, client, flags)) {
@@ -315,20 +802,102 @@ void irmo_proto_parse_packet(IrmoPacket *packet,
 		return;
 	}
 
+	if ((flags & PACKET_FLAG_PRB) != 0) {
+		proto_parse_probe(client, packet);
+		return;
+	}
+
+	if ((flags & PACKET_FLAG_FEC) != 0) {
+		proto_parse_parity(client, packet);
+		return;
+	}
+
+	// read the packet number
+
+	irmo_packet_readi16(packet, &packet_num);
+
+	packet_num = get_stream_position(client->recv_packet_num, packet_num);
+
 	// read ack field if there is one
 
+	if (packet_num > client->recv_packet_num) {
+		client->recv_packet_num = packet_num;
+	}
+
 	if ((flags & PACKET_FLAG_ACK) != 0) {
-		unsigned int i;
+		unsigned int ack, ack_packet;
+		unsigned int ack_delay;
+		unsigned int mask;
+		int new_rtt;
+
+		irmo_packet_readi16(packet, &ack);
+
+		// largest data packet received by the remote client,
+		// and possibly those received before it
+
+		irmo_packet_readi16(packet, &ack_packet);
+
+		ack_packet = get_stream_position(client->send_packet_num,
+		                                 ack_packet);
+
+		if ((flags & PACKET_FLAG_ADL) != 0) {
+			irmo_packet_readi16v(packet, &ack_delay);
+		} else {
+			ack_delay = 0;
+		}
+
+		if ((flags & PACKET_FLAG_PAK) != 0) {
+			irmo_packet_readi32(packet, &mask);
+		} else {
+			mask = 0;
+		}
+
+		proto_mark_received(client, ack_packet, mask);
+
+		// Update the round trip time first, so that the
+		// congestion controller sees the new measurement.
 
-		irmo_packet_readi16(packet, &i);
+		new_rtt = proto_update_rtt(client, ack_packet, ack_delay);
 
-		proto_parse_ack(client, i);
+		if ((flags & PACKET_FLAG_PAK) != 0) {
+			proto_measure_loss(client);
+		}
+
+		proto_parse_ack(client, ack, new_rtt);
+
+		if ((flags & PACKET_FLAG_SAK) != 0) {
+			proto_parse_sack(client, packet, ack);
+		}
+
+		proto_detect_losses(client);
 	}
 
-	if ((flags & PACKET_FLAG_DTA) != 0) {
-		proto_parse_packet_data(client, packet);
+	if ((flags & (PACKET_FLAG_DTA | PACKET_FLAG_UNR)) != 0) {
+		unsigned int start, end;
+
+		// Remember the packet number so that it is acknowledged.
+
+		proto_record_received(client, packet_num);
+
+		if (client->recv_fec) {
+			proto_keep_packet(client, packet, packet_num);
+		}
+
+		start = client->recvwindow_start;
+		end = start;
+
+		if ((flags & PACKET_FLAG_UNR) != 0) {
+			client->recv_unreliable = 1;
+			proto_parse_unreliable(client, packet, packet_num);
+		}
+
+		if ((flags & PACKET_FLAG_DTA) != 0) {
+			end = proto_parse_packet_data(client, packet);
+
+			irmo_client_run_recvwindow(client);
+		}
 
-		irmo_client_run_recvwindow(client);
+		proto_schedule_ack(client, start, end, flags);
 	}
 }
 
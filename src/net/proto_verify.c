@@ -43,12 +43,13 @@ static int proto_verify_packet_cluster(IrmoPacket *packet, IrmoClient *client)
 		unsigned int atomtype;
 		unsigned int natoms;
 		
-		if (!irmo_packet_readi8(packet, &i)) {
+		if (!irmo_packet_read_bits(packet, &natoms,
+		                           ATOM_GROUP_COUNT_BITS)) {
 			break;
                 }
 
-		atomtype = (i >> 5) & 0x07;
-		natoms = (i & 0x1f) + 1;
+		irmo_packet_read_bits(packet, &atomtype, ATOM_GROUP_TYPE_BITS);
+		natoms += 1;
 
 		if (atomtype >= NUM_SENDATOM_TYPES) {
 			//printf("invalid atom type (%i)\n", atomtype);
@@ -70,24 +71,159 @@ static int proto_verify_packet_cluster(IrmoPacket *packet, IrmoClient *client)
 	return 1;
 }
 
+static int proto_verify_sack(IrmoPacket *packet)
+{
+	unsigned int num_ranges;
+	unsigned int offset, length;
+	unsigned int i;
+
+	if (!irmo_packet_readi8(packet, &num_ranges)
+	 || num_ranges > PACKET_MAX_SACK_RANGES) {
+		return 0;
+	}
+
+	for (i=0; i<num_ranges; ++i) {
+		if (!irmo_packet_readi16v(packet, &offset)
+		 || !irmo_packet_readi16v(packet, &length)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int proto_verify_unreliable(IrmoPacket *packet, IrmoClient *client)
+{
+	unsigned int count;
+	unsigned int i;
+
+	if (!irmo_packet_readi8(packet, &count)) {
+		return 0;
+	}
+
+	for (i=0; i<count; ++i) {
+		if (!irmo_change_atom.verify(packet, client)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// Probe packets carry nothing else.  A request must be padded out to
+// the probe size.
+
+static int proto_verify_probe(IrmoPacket *packet, unsigned int flags)
+{
+	unsigned int type, size;
+
+	if (flags != PACKET_FLAG_PRB
+	 || !irmo_packet_readi8(packet, &type)
+	 || !irmo_packet_readi16(packet, &size)) {
+		return 0;
+	}
+
+	if (type == PROBE_REQUEST) {
+		return size == irmo_packet_get_length(packet);
+	} else {
+		return type == PROBE_REPLY;
+	}
+}
+
+// Parity packets also carry nothing else, and must cover at least one
+// packet.
+
+static int proto_verify_parity(IrmoPacket *packet, unsigned int flags)
+{
+	unsigned int first, mask, len;
+
+	if (flags != PACKET_FLAG_FEC
+	 || !irmo_packet_readi16(packet, &first)
+	 || !irmo_packet_readi32(packet, &mask)
+	 || !irmo_packet_readi16(packet, &len)) {
+		return 0;
+	}
+
+	return mask != 0;
+}
+
 int irmo_proto_verify_packet(IrmoPacket *packet, IrmoClient *client, 
                              unsigned int flags)
 {
 	int result = 1;
 	unsigned int origpos;
+	unsigned int packet_num;
 
         origpos = irmo_packet_get_position(packet);
+
+	if ((flags & PACKET_FLAG_PRB) != 0) {
+		result = proto_verify_probe(packet, flags);
+		irmo_packet_set_position(packet, origpos);
+
+		return result;
+	}
+
+	if ((flags & PACKET_FLAG_FEC) != 0) {
+		result = proto_verify_parity(packet, flags);
+		irmo_packet_set_position(packet, origpos);
+
+		return result;
+	}
 	
-	// read ack
+	// packet number
+
+	if (!irmo_packet_readi16(packet, &packet_num)) {
+		result = 0;
+	}
+
+	// read ack and largest packet number received
 	
-	if (flags & PACKET_FLAG_ACK) {
-		unsigned int ack;
+	if (result && (flags & PACKET_FLAG_ACK) != 0) {
+		unsigned int ack, ack_packet;
 
-		if (!irmo_packet_readi16(packet, &ack)) {
+		if (!irmo_packet_readi16(packet, &ack)
+		 || !irmo_packet_readi16(packet, &ack_packet)) {
 			result = 0;
                 }
 	}
 
+	// time the ack was delayed
+
+	if (result && (flags & PACKET_FLAG_ADL) != 0) {
+		unsigned int ack_delay;
+
+		if ((flags & PACKET_FLAG_ACK) == 0
+		 || !irmo_packet_readi16v(packet, &ack_delay)) {
+			result = 0;
+		}
+	}
+
+	// bitmap of packets received before the largest
+
+	if (result && (flags & PACKET_FLAG_PAK) != 0) {
+		unsigned int mask;
+
+		if ((flags & PACKET_FLAG_ACK) == 0
+		 || !irmo_packet_readi32(packet, &mask)) {
+			result = 0;
+		}
+	}
+
+	// selective ack ranges
+
+	if (result && (flags & PACKET_FLAG_SAK) != 0) {
+		if ((flags & PACKET_FLAG_ACK) == 0
+		 || !proto_verify_sack(packet)) {
+			result = 0;
+		}
+	}
+
+	if (result && (flags & PACKET_FLAG_UNR) != 0) {
+		if (!proto_verify_unreliable(packet, client)) {
+			result = 0;
+		}
+	}
+
 	if (result && (flags & PACKET_FLAG_DTA) != 0) {
 		if (!proto_verify_packet_cluster(packet, client)) {
 			result = 0;
@@ -26,7 +26,12 @@
 
 // protocol version number, bumped every time the protocol changes
 
-#define IRMO_PROTOCOL_VERSION 5
+#define IRMO_PROTOCOL_VERSION 12
+
+// Protocol version sent in the SYN by clients that want to use the
+// compact format (see below).  Servers accept both versions.
+
+#define IRMO_PROTOCOL_VERSION_COMPACT 13
 
 // Packet header flags
 
@@ -34,6 +39,257 @@
 #define PACKET_FLAG_ACK 0x02
 #define PACKET_FLAG_FIN 0x04
 #define PACKET_FLAG_DTA 0x08
+#define PACKET_FLAG_SAK 0x10
+#define PACKET_FLAG_PRB 0x20
+#define PACKET_FLAG_UNR 0x40
+#define PACKET_FLAG_PAK 0x80
+#define PACKET_FLAG_FEC 0x100
+#define PACKET_FLAG_ADL 0x200
+
+// Packets other than SYN packets have the following format:
+//
+//   <int16>         header flags
+//   <int16>         packet number
+//   <int16>         acknowledged atom sequence number (PACKET_FLAG_ACK)
+//   <int16>         largest packet number received (PACKET_FLAG_ACK)
+//   <int16v>        time the ack was delayed, in ms (PACKET_FLAG_ADL)
+//   <int32>         packets received before it (PACKET_FLAG_PAK)
+//   ...             selective ack ranges (PACKET_FLAG_SAK)
+//   ...             unreliable updates (PACKET_FLAG_UNR)
+//   ...             atoms (PACKET_FLAG_DTA)
+//
+// Only the low 16 bits of sequence and packet numbers are sent.  Every
+// packet sent has a new packet number, so that the round trip time can
+// be measured from the acknowledgement of a packet even if the atoms
+// in it were retransmissions.
+//
+// If the acknowledgement was held back after the largest packet was
+// received, PACKET_FLAG_ADL is set and the time that it was held for
+// is sent.  The sender subtracts this from the round trip time that
+// it measures, so that delayed acknowledgements do not make the path
+// look slower than it is.
+
+// Compact format.  If the client asked for IRMO_PROTOCOL_VERSION_COMPACT
+// in its SYN, packets other than SYN packets are sent with a compressed
+// header in place of the int16 header flags:
+//
+//   <int8>          0x80, plus the low six flags, plus 0x40 if the
+//                   high flags follow
+//   <int8>          the high flags, shifted down six bits (optional)
+//
+// The top bit is never set in the first byte of the int16 flags, so
+// the two forms can be told apart.  In compact packets, object IDs,
+// selective ack ranges and the send window size (fields shown as
+// <int16v> in the atom formats) are written as variable-length
+// integers (see irmo_packet_writei16v), as are 16 and 32-bit variable
+// values and method arguments.  Sequence and packet
+// numbers are still sent as int16 fields, as they are spread over
+// the full 16-bit range.
+
+#define PACKET_COMPACT_HEADER 0x80
+#define PACKET_COMPACT_HIGH_FLAGS 0x40
+#define PACKET_COMPACT_LOW_FLAGS 0x3f
+
+// Selective acknowledgements.  If PACKET_FLAG_SAK is set, the ack
+// field is followed by a list of the ranges of atoms that have been
+// received beyond the acknowledged position:
+//
+//   <int8>          number of ranges
+//
+// followed by, for each range:
+//
+//   <int16v>        offset of the first atom in the range from the
+//                   acknowledged position
+//   <int16v>        number of atoms in the range
+//
+// The sender does not need to retransmit the atoms in these ranges.
+
+#define PACKET_MAX_SACK_RANGES 8
+
+// Atoms.  If PACKET_FLAG_DTA is set, the packet ends with the atoms
+// being sent:
+//
+//   <int16>         sequence number of the first atom
+//
+// followed by groups of consecutive atoms of the same type.  Each
+// group starts with a header byte, packed low bits first:
+//
+//   5 bits          number of atoms in the group, minus one
+//   3 bits          atom type
+
+#define ATOM_GROUP_COUNT_BITS 5
+#define ATOM_GROUP_TYPE_BITS 3
+#define ATOM_GROUP_MAX (1 << ATOM_GROUP_COUNT_BITS)
+
+// Unreliable updates.  Changes to unreliable variables are not sent
+// as atoms; if PACKET_FLAG_UNR is set, the packet carries updates
+// containing the latest values of the variables:
+//
+//   <int8>          number of updates
+//
+// followed by the updates, each in the same format as a change atom.
+// An update is ignored if an update to the same object from a later
+// packet has already been received.  Lost updates are not resent;
+// the latest values are sent instead.
+//
+// To find out which updates were lost, the receiver of an unreliable
+// update sets PACKET_FLAG_PAK in its acks, and follows the largest
+// packet number received with a bitmap of the 32 packets before it:
+// bit n is set if packet (largest - 1 - n) was received.  The same is
+// done once a parity packet has been received (see below), so that
+// the sender can measure the loss rate.
+
+// Largest possible size of the fields before the atoms in a data
+// packet, including the start position of the atoms or the number of
+// unreliable updates.  Atoms and updates are only added to a packet
+// while it stays within the maximum packet size once this is allowed
+// for.
+
+#define PACKET_MAX_HEADER_LEN (2 + 2 + 2 + 2 + 2 + 4 + 1 \
+                               + 4 * PACKET_MAX_SACK_RANGES + 2)
+
+// The same for compact packets, where the ack delay and each field of
+// a selective ack range can take up to three bytes.
+
+#define PACKET_MAX_HEADER_LEN_COMPACT (2 + 2 + 2 + 2 + 3 + 4 + 1 \
+                                       + 6 * PACKET_MAX_SACK_RANGES + 2)
+
+// Maximum number of unreliable updates in a packet.
+
+#define PACKET_MAX_UNRELIABLE 255
+
+// Strings.  STRING variable values and method arguments in atoms are
+// sent through a table of strings kept for each connection:
+//
+//   <varint>        tag
+//   <string>        NUL-terminated text (unless a reference)
+//
+// A tag of zero is followed by a string that is not in the table.
+// Otherwise, the top bits of the tag are an index into the table,
+// from one up to STRING_TABLE_MAX_ENTRIES - 1.  If the low bit is
+// zero, the string that follows is stored at that index; if it is
+// one, the tag refers to the string already stored there, and no
+// text follows.
+//
+// A string is only sent as a reference once an atom containing its
+// definition has been acknowledged, and an index is only reused for
+// a different string once every atom using it has been acknowledged.
+// Definitions from atoms older than the one that last defined an
+// index are ignored, so that delayed duplicate packets do no harm.
+// Unreliable updates always send strings in full.
+
+#define STRING_TABLE_MAX_ENTRIES 1024
+
+// Path MTU probes.  Packets with PACKET_FLAG_PRB set do not have a
+// packet number and carry no other data:
+//
+//   <int16>         header flags (PACKET_FLAG_PRB only)
+//   <int8>          probe type (PROBE_REQUEST or PROBE_REPLY)
+//   <int16>         probe size
+//   ...             padding (PROBE_REQUEST)
+//
+// A request is padded to the probe size.  When one is received, a
+// reply is sent back with the same size value, showing that packets
+// of that size get through.  Probes are not retransmitted like atoms
+// are, and lost probes are not a sign of congestion.
+
+#define PROBE_REQUEST 0
+#define PROBE_REPLY 1
+
+// Forward error correction.  If enabled, a parity packet is sent after
+// every group of packets containing data.  Like probes, parity packets
+// do not have a packet number, and are never retransmitted:
+//
+//   <int16>         header flags (PACKET_FLAG_FEC only)
+//   <int16>         packet number of the first packet in the group
+//   <int32>         bitmap of the packets in the group: bit n is set
+//                   if packet (first + n) is in the group
+//   <int16>         lengths of the packets, XORed together
+//   ...             contents of the packets, each padded with zeros
+//                   to the length of the longest, XORed together
+//
+// If exactly one packet in a group is lost, the receiver rebuilds it
+// from the parity packet and the other packets, without waiting for
+// the data in it to be retransmitted.
+//
+// The number of packets in a group depends on the loss rate that the
+// sender has measured: the group is smaller when more packets are
+// lost, so that it is unlikely that more than one packet in a group
+// is lost.
+
+#define FEC_MIN_GROUP 2
+#define FEC_MAX_GROUP 16
+
+// Groups are sized so that this many packets are expected to be
+// lost in each group, including its parity packet.
+
+#define FEC_GROUP_LOSSES 0.5f
+
+// Packets in a group are within this many packet numbers of the
+// first packet in the group.
+
+#define FEC_MAX_SPAN 32
+
+// Weight given to each new sample when measuring the loss rate.
+
+#define FEC_LOSS_ALPHA (1.0f / 32)
+
+// An atom is considered lost if a packet sent this many packets after
+// it has been acknowledged, but the atom itself has not.  This allows
+// for a small amount of reordering.
+
+#define LOSS_PACKET_THRESHOLD 3
+
+// Options that may follow the interface hashes in the initial SYN
+// packet.  Each option is encoded as:
+//
+//   <int8>          option type
+//   <int16>         length of option data, in bytes
+//   <data>
+//
+// Unknown options are ignored.
+
+// Variables that the client wants to receive: a bitmap of the variables
+// in each class of the world being served, in class order.
+
+#define SYN_OPTION_SUBSCRIPTIONS 1
+
+// Largest packet size that the client wants to use, as an int16.  The
+// server replies with the smaller of this and its own limit, after
+// the client ID in the SYN-ACK.  If not present, the default
+// IRMO_PROTOCOL_MTU is assumed.
+
+#define SYN_OPTION_MTU 2
+
+// If non-zero, atoms are retransmitted as soon as acknowledgements show
+// that they have been lost, rather than waiting for them to time out.
+
+extern int irmo_proto_use_fast_retransmit;
+
+/*!
+ * Write the header flags at the start of a packet to a client.  If
+ * the client is using the compact format, the packet is set to the
+ * compact format and the compressed header is written.
+ *
+ * @param client        The client that the packet is being sent to.
+ * @param packet        The packet.
+ * @param flags         Header flags.
+ */
+
+void irmo_proto_write_flags(IrmoClient *client, IrmoPacket *packet,
+                            unsigned int flags);
+
+/*!
+ * Read the header flags from the start of a received packet.  If the
+ * packet has a compressed header, the packet is set to the compact
+ * format, so that the rest of it is read correctly.
+ *
+ * @param packet        The packet.
+ * @param flags         Pointer to a variable to store the flags.
+ * @return              Non-zero if the header was read successfully.
+ */
+
+int irmo_proto_read_flags(IrmoPacket *packet, unsigned int *flags);
 
 /*!
  * Verify that the specified packet is valid and can be parsed.
@@ -69,5 +325,20 @@ void irmo_proto_parse_packet(IrmoPacket *packet,
 
 void irmo_proto_run_client(IrmoClient *client);
 
+/*!
+ * Work out when a connected client next needs to be run.
+ *
+ * @param client        The client.
+ * @param nowtime       The current time.
+ * @param when          Pointer to a variable to store the time at which
+ *                      the client should be run.
+ * @return              Non-zero if the client needs to be run, or zero
+ *                      if there is nothing to do until a packet is
+ *                      received or new data is queued.
+ */
+
+int irmo_proto_next_run(IrmoClient *client, unsigned int nowtime,
+                        unsigned int *when);
+
 #endif /* #ifndef IRMO_NET_PROTO_H */
 
@@ -37,15 +37,145 @@ void irmo_sendatom_free(IrmoSendAtom *atom)
 		atom->klass->destructor(atom);
         }
 
+        free(atom->string_defs);
 	free(atom);
 }
 
+size_t irmo_sendatom_i16v_length(IrmoClient *client, unsigned int i)
+{
+        if (client->compact) {
+                return irmo_packet_varint_length(i);
+        } else {
+                return 2;
+        }
+}
+
 void irmo_sendatom_nullify(IrmoSendAtom *atom)
 {
 	if (atom->klass->destructor != NULL) {
 		atom->klass->destructor(atom);
         }
 
+        // A null atom defines no strings.
+
+        free(atom->string_defs);
+        atom->string_defs = NULL;
+        atom->num_string_defs = 0;
+
 	atom->klass = &irmo_null_atom;
 }
 
+int irmo_sendatom_verify_value(IrmoClient *client, IrmoPacket *packet,
+                               IrmoValueType type, IrmoValueRange *range)
+{
+        if (type == IRMO_TYPE_STRING) {
+                return irmo_string_table_verify(client, packet);
+        } else if (type == IRMO_TYPE_QUANTIZED) {
+                return irmo_packet_read_quantized(packet, NULL, range);
+        } else {
+                return irmo_packet_verify_value(packet, type);
+        }
+}
+
+void irmo_sendatom_read_value(IrmoClient *client, IrmoPacket *packet,
+                              IrmoValue *value, IrmoValueType type,
+                              IrmoValueRange *range)
+{
+        if (type == IRMO_TYPE_STRING) {
+                value->s = irmo_string_table_read(client, packet);
+        } else if (type == IRMO_TYPE_QUANTIZED) {
+                irmo_packet_read_quantized(packet, &value->f, range);
+        } else {
+                irmo_packet_read_value(packet, value, type);
+        }
+}
+
+void irmo_sendatom_write_value(IrmoClient *client, IrmoSendAtom *atom,
+                               IrmoPacket *packet, IrmoValue *value,
+                               IrmoValueType type, IrmoValueRange *range)
+{
+        if (type == IRMO_TYPE_STRING) {
+                irmo_string_table_write(client, atom, packet, value->s);
+        } else if (type == IRMO_TYPE_QUANTIZED) {
+                irmo_packet_write_quantized(packet, value->f, range);
+        } else {
+                irmo_packet_write_value(packet, value, type);
+        }
+}
+
+size_t irmo_sendatom_value_length(IrmoClient *client, IrmoValue *value,
+                                  IrmoValueType type, IrmoValueRange *range)
+{
+        if (type == IRMO_TYPE_STRING) {
+                return irmo_string_table_length(value->s);
+        } else if (type == IRMO_TYPE_QUANTIZED) {
+
+                // Consecutive quantized values are packed together,
+                // so this may overestimate.
+
+                return (irmo_packet_quantized_bits(range) + 7) / 8;
+        } else {
+                return irmo_packet_value_length(value, type,
+                                                client->compact);
+        }
+}
+
+int irmo_sendatom_read_bitmap(IrmoPacket *packet, int *flags,
+                              unsigned int n)
+{
+	unsigned int word;
+	unsigned int i, j, bits;
+
+	// Read a word at a time.
+
+	for (i=0; i<n; i += bits) {
+		bits = n - i;
+
+		if (bits > 32) {
+			bits = 32;
+		}
+
+		if (!irmo_packet_read_bits(packet, &word, bits)) {
+			return 0;
+		}
+
+		for (j=0; j<bits; ++j) {
+			if (word & (1U << j)) {
+				flags[i + j] = 1;
+			}
+		}
+	}
+
+	irmo_packet_align_bits(packet);
+
+	return 1;
+}
+
+void irmo_sendatom_write_bitmap(IrmoPacket *packet, int *flags,
+                                unsigned int n)
+{
+	unsigned int word;
+	unsigned int i, j, bits;
+
+	// Build and write a word at a time.
+
+	for (i=0; i<n; i += bits) {
+		bits = n - i;
+
+		if (bits > 32) {
+			bits = 32;
+		}
+
+		word = 0;
+
+		for (j=0; j<bits; ++j) {
+			if (flags[i + j]) {
+				word |= 1U << j;
+			}
+		}
+
+		irmo_packet_write_bits(packet, word, bits);
+	}
+
+	irmo_packet_align_bits(packet);
+}
@@ -129,6 +129,29 @@ struct _IrmoSendAtom {
 
 	int resent;
 
+	// Packet number of the packet this atom was last sent in.
+
+	unsigned int packet_num;
+
+	// true if this atom has been detected as lost, because later
+	// packets have been acknowledged.  It is resent straight away
+	// rather than waiting for it to time out.
+
+	int lost;
+
+	// true if the remote client has selectively acknowledged that
+	// it has received this atom (see PACKET_FLAG_SAK).  The atom
+	// stays in the send window until the window is advanced past
+	// it, but does not need to be resent.
+
+	int sacked;
+
+	// Links in the client's list of atoms in flight (see
+	// IrmoClient).
+
+	IrmoSendAtom *inflight_prev;
+	IrmoSendAtom *inflight_next;
+
 	// length of atom in bytes
 
 	size_t len;
@@ -136,11 +159,27 @@ struct _IrmoSendAtom {
 	// number of this atom in the sequence
 	
 	unsigned int seqnum;
+
+	// Indexes of the entries in the client's string table that
+	// this atom defines, which are confirmed when it is acknowledged,
+	// and whether it has been written before (see string-table.h).
+
+	unsigned int *string_defs;
+	unsigned int num_string_defs;
+	int string_written;
+
+	// Ordering in the send queue.  Atoms are popped from the queue
+	// in order of key, then in the order they were pushed
+	// (see irmo_client_sendq_push).
+
+	unsigned int sendq_key;
+	unsigned int sendq_seq;
 };
 
 //
 // A "new object" atom is sent when a new object is created in the world
-// being served.
+// being served.  It also carries the initial values of the object's
+// variables.
 //
 
 struct _IrmoNewObjectAtom {
@@ -156,6 +195,27 @@ struct _IrmoNewObjectAtom {
         // Class of the new object.
 
 	unsigned int classnum;
+	IrmoClass *objclass;
+
+	// Object being created.  This is only used for the send queue
+	// and send window, and is set to NULL if the object leaves the
+	// client's scope before the atom is acknowledged.
+
+	IrmoObject *object;
+
+	// Array of flags indicating which variables have their initial
+	// values sent.  While the atom is in the send queue, this is
+	// NULL, and the current values of all variables not holding
+	// their default values are sent.
+
+	int *changed;
+
+	// Array of the initial values.  In the receive window, these
+	// are the values read from the packet; in the send window, they
+	// are copied from the object when the atom leaves the send
+	// queue, so that retransmissions send the same values.
+
+	IrmoValue *newvalues;
 };
 
 //
@@ -192,6 +252,12 @@ struct _IrmoChangeAtom {
 	
 	int *changed;
 
+	// Links to the previous and next change atoms for the same
+	// object in the send window (see IrmoClientObject).
+
+	IrmoChangeAtom *window_prev;
+	IrmoChangeAtom *window_next;
+
 	// Class of the object being changed. this is only
 	// used for the receive window.
 
@@ -201,6 +267,12 @@ struct _IrmoChangeAtom {
 	// receive window. For the send window this is NULL.
 			
 	IrmoValue *newvalues;
+
+	// If non-zero, this atom is being sent as an unreliable update
+	// rather than from the send window, and strings are always sent
+	// in full.
+
+	int unreliable;
 };
 
 // 
@@ -268,6 +340,127 @@ void irmo_sendatom_free(IrmoSendAtom *atom);
 
 void irmo_sendatom_nullify(IrmoSendAtom *atom);
 
+/*!
+ * Get the number of bytes used to send a 16-bit field, such as an
+ * object ID, in an atom to a client.  The field is written with
+ * @ref irmo_packet_writei16v, so it is shorter if the client is using
+ * the compact format.
+ *
+ * @param client        The client.
+ * @param i             Value of the field.
+ * @return              Length of the field, in bytes.
+ */
+
+size_t irmo_sendatom_i16v_length(IrmoClient *client, unsigned int i);
+
+/*!
+ * Check that a variable value or method argument in an atom can be
+ * read from a packet.  Strings are sent through the client's string
+ * table (see string-table.h), and quantized values with
+ * @ref irmo_packet_write_quantized; other values are read with
+ * @ref irmo_packet_verify_value.
+ *
+ * @param client        The client the packet was received from.
+ * @param packet        The packet.
+ * @param type          Type of the value.
+ * @param range         Range of the value, if it is quantized.
+ * @return              Non-zero if the value can be read.
+ */
+
+int irmo_sendatom_verify_value(IrmoClient *client, IrmoPacket *packet,
+                               IrmoValueType type, IrmoValueRange *range);
+
+/*!
+ * Read a variable value or method argument in an atom from a packet.
+ *
+ * @param client        The client the packet was received from.
+ * @param packet        The packet.
+ * @param value         Pointer to the value to store the result in.
+ * @param type          Type of the value.
+ * @param range         Range of the value, if it is quantized.
+ */
+
+void irmo_sendatom_read_value(IrmoClient *client, IrmoPacket *packet,
+                              IrmoValue *value, IrmoValueType type,
+                              IrmoValueRange *range);
+
+/*!
+ * Write a variable value or method argument in an atom to a packet.
+ *
+ * @param client        The client the packet is being sent to.
+ * @param atom          The atom being written, if strings may be sent
+ *                      as references to the string table, or NULL
+ *                      to always send strings in full.
+ * @param packet        The packet.
+ * @param value         The value.
+ * @param type          Type of the value.
+ * @param range         Range of the value, if it is quantized.
+ */
+
+void irmo_sendatom_write_value(IrmoClient *client, IrmoSendAtom *atom,
+                               IrmoPacket *packet, IrmoValue *value,
+                               IrmoValueType type, IrmoValueRange *range);
+
+/*!
+ * Get the largest number of bytes that
+ * @ref irmo_sendatom_write_value uses to write a value.
+ *
+ * @param client        The client the value is being sent to.
+ * @param value         The value.
+ * @param type          Type of the value.
+ * @param range         Range of the value, if it is quantized.
+ * @return              Length in bytes.
+ */
+
+size_t irmo_sendatom_value_length(IrmoClient *client, IrmoValue *value,
+                                  IrmoValueType type, IrmoValueRange *range);
+
+/*!
+ * Read a bitmap of flags, one bit for each variable in a class, into
+ * an array.  Flags for bits that are set are set to 1; others are
+ * left unchanged.  Bits are read low bits first, and the bitmap is
+ * padded to a whole number of bytes.
+ *
+ * @param packet        The packet.
+ * @param flags         Array of flags.
+ * @param n             Number of flags.
+ * @return              Non-zero if the bitmap was read successfully.
+ */
+
+int irmo_sendatom_read_bitmap(IrmoPacket *packet, int *flags,
+                              unsigned int n);
+
+/*!
+ * Write a bitmap of flags in the form read by
+ * @ref irmo_sendatom_read_bitmap.
+ *
+ * @param packet        The packet.
+ * @param flags         Array of flags.
+ * @param n             Number of flags.
+ */
+
+void irmo_sendatom_write_bitmap(IrmoPacket *packet, int *flags,
+                                unsigned int n);
+
+/*!
+ * Fix the set of variables whose initial values are sent in a new
+ * object atom, as it moves from the send queue to the send window.
+ * Later changes to the object are sent in change atoms.
+ *
+ * @param atom          The atom.
+ */
+
+void irmo_newobject_atom_set_state(IrmoNewObjectAtom *atom);
+
+/*!
+ * Stop sending the initial values of the variables in a new object
+ * atom, because the object has left the client's scope.
+ *
+ * @param atom          The atom.
+ */
+
+void irmo_newobject_atom_clear_state(IrmoNewObjectAtom *atom);
+
 // atom classes
 
 extern IrmoSendAtomClass irmo_null_atom;
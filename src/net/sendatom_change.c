@@ -26,6 +26,9 @@
 #include "world/object.h"
 
 #include "sendatom.h"
+#include "string-table.h"
+#include "client_sendq.h"
+#include "server.h"
 
 //
 // IrmoChangeAtom
@@ -35,7 +38,7 @@
 // format:
 // 
 // <int8>	object class number
-// <int16> 	object id
+// <int16v> 	object id
 // <int8>[]	bitmap; one bit for each class variable,
 // 		each bit is 1 if an update to that variable
 //		follows. low bits to high bits. enough
@@ -48,7 +51,6 @@ static int irmo_change_atom_verify(IrmoPacket *packet, IrmoClient *client)
 {
 	IrmoClass *objclass;
 	unsigned int i;
-        unsigned int n, b;
 	int result;
 	int *changed;
 	
@@ -70,30 +72,16 @@ static int irmo_change_atom_verify(IrmoPacket *packet, IrmoClient *client)
 	
 	// object id
 
-	if (!irmo_packet_readi16(packet, &i)) {
+	if (!irmo_packet_readi16v(packet, &i)) {
 		return 0;
         }
 
 	// read object changed bitmap
 	
-	result = 1;
-
 	changed = irmo_new0(int, objclass->nvariables);
 
-	for (i=0, n=0; result && i<(objclass->nvariables+7) / 8; ++i) {
-		unsigned int byte;
-
-		if (!irmo_packet_readi8(packet, &byte)) {
-			result = 0;
-			break;
-		}
-
-		for (b=0; b<8 && n<objclass->nvariables; ++b, ++n) {
-			if (byte & (1 << b)) {
-				changed[n] = 1;
-                        }
-                }
-	}
+	result = irmo_sendatom_read_bitmap(packet, changed,
+	                                   objclass->nvariables);
 
 	// check new variable values
 
@@ -103,13 +91,16 @@ static int irmo_change_atom_verify(IrmoPacket *packet, IrmoClient *client)
 				continue;
                         }
 			
-			if (!irmo_packet_verify_value
-				(packet, objclass->variables[i]->type)) {
+			if (!irmo_sendatom_verify_value
+				(client, packet, objclass->variables[i]->type,
+				 &objclass->variables[i]->range)) {
 				result = 0;
 				break;
 			}
 		}
 	}
+
+	irmo_packet_align_bits(packet);
 	
 	free(changed);
 
@@ -124,7 +115,6 @@ static IrmoSendAtom *irmo_change_atom_read(IrmoPacket *packet,
 	int *changed;
 	IrmoValue *newvalues;
 	unsigned int i;
-        unsigned int b, n;
 
 	atom = irmo_new0(IrmoChangeAtom, 1);
 	atom->sendatom.klass = &irmo_change_atom;
@@ -138,27 +128,14 @@ static IrmoSendAtom *irmo_change_atom_read(IrmoPacket *packet,
 
 	// read object id
 	
-	irmo_packet_readi16(packet, &atom->id);
+	irmo_packet_readi16v(packet, &atom->id);
 	
 	// read the changed object bitmap
 
 	changed = irmo_new0(int, objclass->nvariables);
 	atom->changed = changed;
-	
-	for (i=0, n=0; i<(objclass->nvariables+7) / 8; ++i) {
-		unsigned int byte;
 
-		// read the bits out of this byte in the bitmap into the
-		// changed array
-		
-		irmo_packet_readi8(packet, &byte);
-
-		for (b=0; b<8 && n<objclass->nvariables; ++b,++n) {
-			if (byte & (1 << b)) {
-				changed[n] = 1;
-                        }
-                }
-	}
+	irmo_sendatom_read_bitmap(packet, changed, objclass->nvariables);
 
 	// read the new values
 
@@ -170,18 +147,69 @@ static IrmoSendAtom *irmo_change_atom_read(IrmoPacket *packet,
 			continue;
                 }
 
-		irmo_packet_read_value(packet, &newvalues[i],
-				       objclass->variables[i]->type);
+		irmo_sendatom_read_value(client, packet, &newvalues[i],
+				         objclass->variables[i]->type,
+				         &objclass->variables[i]->range);
 	}
 
+	irmo_packet_align_bits(packet);
+
 	return IRMO_SENDATOM(atom);
 }
 
+// Returns true if a change atom includes changes to string variables.
+
+static int changes_strings(IrmoChangeAtom *atom)
+{
+	IrmoClass *objclass = atom->object->objclass;
+	unsigned int i;
+
+	for (i=0; i<objclass->nvariables; ++i) {
+		if (atom->changed[i]
+		 && objclass->variables[i]->type == IRMO_TYPE_STRING) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// Write the values of the changed variables.  If string_atom is NULL,
+// strings are sent in full rather than through the string table.
+
+static void write_values(IrmoChangeAtom *atom, IrmoPacket *packet,
+                         IrmoSendAtom *string_atom)
+{
+	IrmoObject *obj = atom->object;
+	unsigned int i;
+
+	for (i=0; i<obj->objclass->nvariables; ++i) {
+
+		// check we are sending this variable
+
+		if (atom->changed[i]) {
+			irmo_sendatom_write_value
+				(atom->sendatom.client, string_atom, packet,
+				 &obj->variables[i],
+				 obj->objclass->variables[i]->type,
+				 &obj->objclass->variables[i]->range);
+                }
+	}
+
+	// Quantized values are packed into bits; pad the atom out to a
+	// whole number of bytes.
+
+	irmo_packet_align_bits(packet);
+}
+
 static void irmo_change_atom_write(IrmoChangeAtom *atom, IrmoPacket *packet)
 {
+	IrmoClient *client = atom->sendatom.client;
+	IrmoServer *server = client->server;
 	IrmoObject *obj = atom->object;
-	unsigned int bitmap_size;
-	unsigned int i, j;
+	unsigned int header_start, header_len;
+
+	header_start = irmo_packet_get_position(packet);
 
 	// include the object class number
 	// this is neccesary otherwise the packet can be ambiguous to
@@ -192,46 +220,47 @@ static void irmo_change_atom_write(IrmoChangeAtom *atom, IrmoPacket *packet)
 	
 	// send object id
 	
-	irmo_packet_writei16(packet, obj->id);
-
-	// build and send bitmap
+	irmo_packet_writei16v(packet, obj->id);
 
-	bitmap_size = (obj->objclass->nvariables + 7) / 8;
+	// send bitmap
 
-	for (i=0; i<bitmap_size; ++i) {
-		uint8_t b;
+	irmo_sendatom_write_bitmap(packet, atom->changed,
+	                           obj->objclass->nvariables);
 
-		// build a byte at a time
+	// Strings sent through the client's string table are encoded
+	// differently for each client, so the values cannot be cached.
 
-		b = 0;
+	if (!atom->unreliable && irmo_string_table_enabled(client)
+	 && changes_strings(atom)) {
+		irmo_string_table_begin_atom(&atom->sendatom);
+		write_values(atom, packet, &atom->sendatom);
+		irmo_string_table_end_atom(&atom->sendatom);
+		return;
+	}
 
-		for (j=0; j<8 && i*8+j<obj->objclass->nvariables; ++j) {
-			if (atom->changed[i*8 + j]) {
-				b |= (uint8_t) (1 << j);
-			}
-		}
+	// The same change is often sent to many clients.  If it has
+	// already been encoded for another client, copy the values from
+	// the cache.
 
-		irmo_packet_writei8(packet, b);
+	if (irmo_server_cache_write(server, obj, packet, header_start)) {
+		return;
 	}
 
-	// send variables
+	header_len = irmo_packet_get_position(packet) - header_start;
 
-	for (i=0; i<obj->objclass->nvariables; ++i) {
+	// send variables
 
-		// check we are sending this variable
+	write_values(atom, packet, NULL);
 
-		if (atom->changed[i]) {
-			irmo_packet_write_value
-				(packet, &obj->variables[i], 
-				 obj->objclass->variables[i]->type);
-                }
-	}
+	irmo_server_cache_add(server, obj, packet, header_start, header_len);
 }
 
 static void irmo_change_atom_destroy(IrmoChangeAtom *atom)
 {
         unsigned int i;
 
+        irmo_client_sendq_unlink_change(atom);
+
         if (atom->newvalues) {
                 IrmoClass *objclass = atom->objclass;
 
@@ -338,7 +367,7 @@ static size_t irmo_change_atom_length(IrmoChangeAtom *atom)
          
         // object id
  
-        len += 2;
+        len += irmo_sendatom_i16v_length(atom->sendatom.client, obj->id);
          
         // leading bitmap
          
@@ -354,22 +383,10 @@ static size_t irmo_change_atom_length(IrmoChangeAtom *atom)
                         continue;
                 }
                  
-                switch (klass->variables[i]->type) {
-                case IRMO_TYPE_INT8:
-                        len += 1;
-                        break;
-                case IRMO_TYPE_INT16:
-                        len += 2;
-                        break;
-                case IRMO_TYPE_INT32:
-                        len += 4;
-                        break;
-                case IRMO_TYPE_STRING:
-                        len += strlen(obj->variables[i].s) + 1;
-                        break;
-                default:
-                        irmo_bug();
-                }
+                len += irmo_sendatom_value_length(atom->sendatom.client,
+                                                  &obj->variables[i],
+                                                  klass->variables[i]->type,
+                                                  &klass->variables[i]->range);
         }
  
         return len;
@@ -26,6 +26,7 @@
 #include "world/object.h"
 
 #include "sendatom.h"
+#include "client_sendq.h"
 
 
 //
@@ -35,7 +36,7 @@
 //
 // format:
 //
-// <int16>	object id of object to destroy
+// <int16v>	object id of object to destroy
 //
 
 static int irmo_destroy_atom_verify(IrmoPacket *packet, IrmoClient *client)
@@ -48,7 +49,7 @@ static int irmo_destroy_atom_verify(IrmoPacket *packet, IrmoClient *client)
 
 	// object id
 
-	if (!irmo_packet_readi16(packet, &i)) {
+	if (!irmo_packet_readi16v(packet, &i)) {
 		return 0;
         }
 		
@@ -65,14 +66,14 @@ static IrmoSendAtom *irmo_destroy_atom_read(IrmoPacket *packet,
 
 	// object id to destroy
 
-	irmo_packet_readi16(packet, &atom->id);
+	irmo_packet_readi16v(packet, &atom->id);
 
 	return IRMO_SENDATOM(atom);
 }
 
 static void irmo_destroy_atom_write(IrmoDestroyAtom *atom, IrmoPacket *packet)
 {
-	irmo_packet_writei16(packet, atom->id);
+	irmo_packet_writei16v(packet, atom->id);
 }
 
 static void irmo_destroy_atom_run(IrmoDestroyAtom *atom)
@@ -98,9 +99,14 @@ static void irmo_destroy_atom_run(IrmoDestroyAtom *atom)
 	irmo_object_internal_destroy(obj, 1, 1);
 }
 
-static size_t irmo_destroy_atom_length(IrmoSendAtom *atom)
+static size_t irmo_destroy_atom_length(IrmoDestroyAtom *atom)
 {
-	return 2;
+	return irmo_sendatom_i16v_length(atom->sendatom.client, atom->id);
+}
+
+static void irmo_destroy_atom_destroy(IrmoDestroyAtom *atom)
+{
+        irmo_client_sendq_unlink_destroy(atom);
 }
 
 IrmoSendAtomClass irmo_destroy_atom = {
@@ -110,7 +116,7 @@ IrmoSendAtomClass irmo_destroy_atom = {
 	(IrmoSendAtomWriteFunc) irmo_destroy_atom_write,
 	(IrmoSendAtomRunFunc) irmo_destroy_atom_run,
 	(IrmoSendAtomLengthFunc) irmo_destroy_atom_length,
-        NULL,
+        (IrmoSendAtomDestroyFunc) irmo_destroy_atom_destroy,
 	NULL,
 };
 
@@ -25,6 +25,7 @@
 #include "world/object.h"
 
 #include "sendatom.h"
+#include "string-table.h"
 
 //
 // IrmoMethodAtom
@@ -67,8 +68,8 @@ static int irmo_method_atom_verify(IrmoPacket *packet, IrmoClient *client)
 	// read arguments
 
 	for (i=0; i<method->narguments; ++i) {
-		if (!irmo_packet_verify_value
-			(packet, method->arguments[i]->type)) {
+		if (!irmo_sendatom_verify_value
+			(client, packet, method->arguments[i]->type, NULL)) {
 			return 0;
                 }
 	}
@@ -97,8 +98,9 @@ static IrmoSendAtom *irmo_method_atom_read(IrmoPacket *packet,
 	atom->method_data.args = irmo_new0(IrmoValue, method->narguments);
 
 	for (i=0; i<method->narguments; ++i) {
-		irmo_packet_read_value(packet, &atom->method_data.args[i],
-				       method->arguments[i]->type);
+		irmo_sendatom_read_value(client, packet,
+		                         &atom->method_data.args[i],
+		                         method->arguments[i]->type, NULL);
 	}
 
 	return IRMO_SENDATOM(atom);
@@ -116,10 +118,15 @@ static void irmo_method_atom_write(IrmoMethodAtom *atom, IrmoPacket *packet)
 
 	// send arguments
 
+	irmo_string_table_begin_atom(&atom->sendatom);
+
 	for (i=0; i<method->narguments; ++i) {
-		irmo_packet_write_value(packet, &args[i],
-					method->arguments[i]->type);
+		irmo_sendatom_write_value(atom->sendatom.client,
+		                          &atom->sendatom, packet, &args[i],
+		                          method->arguments[i]->type, NULL);
         }
+
+	irmo_string_table_end_atom(&atom->sendatom);
 }
 
 static void irmo_method_atom_run(IrmoMethodAtom *atom)
@@ -160,25 +167,12 @@ static size_t irmo_method_atom_length(IrmoMethodAtom *atom)
         len += 1;
  
         // find length of arguments
-        // copy strings while we are here
          
         for (i=0; i<method->narguments; ++i) {
-                switch (method->arguments[i]->type) {
-                case IRMO_TYPE_INT8:
-                        len += 1;
-                        break;
-                case IRMO_TYPE_INT16:
-                        len += 2;
-                        break;
-                case IRMO_TYPE_INT32:
-                        len += 4;
-                        break;
-                case IRMO_TYPE_STRING:
-                        len += strlen(atom->method_data.args[i].s) + 1;
-                        break;
-                default:
-                        irmo_bug();
-                }
+                len += irmo_sendatom_value_length(atom->sendatom.client,
+                                                  &atom->method_data.args[i],
+                                                  method->arguments[i]->type,
+                                                  NULL);
         }
 
 	return len;
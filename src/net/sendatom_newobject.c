@@ -26,21 +26,82 @@
 #include "world/object.h"
 
 #include "sendatom.h"
+#include "client_sendq.h"
+#include "string-table.h"
 
 //
 // IrmoNewObjectAtom
 //
-// Announce the creation of a new object.
+// Announce the creation of a new object, along with its initial state.
 //
 // format:
 // 
-// <int16>	object id
+// <int16v>	object id
 // <int8>	object class number
+// <int8>[]	bitmap; one bit for each class variable, in the same
+//		form as for a change atom.  each bit is 1 if the
+//		initial value of that variable follows.  variables
+//		holding their default values (zero, or the empty
+//		string, or for quantized variables, the nearest
+//		value to zero) are not sent.
+// <field>[]	a field for each variable in the bitmap.
+//		data depends on the variable type.
 // 
 
+// Returns true if a value is the default value that variables hold
+// when a new object is created.
+
+static int value_is_default(IrmoValue *value, IrmoClassVar *var)
+{
+	if (var->type == IRMO_TYPE_STRING) {
+		return value->s[0] == '\0';
+	} else if (var->type == IRMO_TYPE_QUANTIZED) {
+		return value->f == irmo_packet_quantize(&var->range, 0);
+	} else {
+		return value->i == 0;
+	}
+}
+
+// Returns true if the initial value of a variable is sent.
+
+static int sends_variable(IrmoNewObjectAtom *atom, unsigned int i)
+{
+	IrmoObject *obj = atom->object;
+	IrmoClassVar *var;
+
+	if (atom->changed != NULL) {
+		return atom->changed[i];
+	}
+
+	if (obj == NULL) {
+		return 0;
+	}
+
+	var = obj->objclass->variables[i];
+
+	return irmo_client_is_subscribed(atom->sendatom.client,
+	                                 obj->objclass, var)
+	    && !value_is_default(&obj->variables[i], var);
+}
+
+// Get the value of a variable to be sent.  Once the atom has left the
+// send queue, this is the copy made when its state was fixed.
+
+static IrmoValue *sent_value(IrmoNewObjectAtom *atom, unsigned int i)
+{
+	if (atom->newvalues != NULL) {
+		return &atom->newvalues[i];
+	} else {
+		return &atom->object->variables[i];
+	}
+}
+
 static int irmo_newobject_atom_verify(IrmoPacket *packet, IrmoClient *client)
 {
+	IrmoClass *objclass;
 	unsigned int i;
+	int *changed;
+	int result;
 
 	if (client->world == NULL) {
 		return 0;
@@ -48,7 +109,7 @@ static int irmo_newobject_atom_verify(IrmoPacket *packet, IrmoClient *client)
 
 	// object id
 
-	if (!irmo_packet_readi16(packet, &i)) {
+	if (!irmo_packet_readi16v(packet, &i)) {
 		return 0;
         }
 
@@ -64,40 +125,111 @@ static int irmo_newobject_atom_verify(IrmoPacket *packet, IrmoClient *client)
 		return 0;
         }
 
-	return 1;
+	objclass = client->world->iface->classes[i];
+
+	// initial values
+
+	changed = irmo_new0(int, objclass->nvariables);
+
+	result = irmo_sendatom_read_bitmap(packet, changed,
+	                                   objclass->nvariables);
+
+	for (i=0; result && i<objclass->nvariables; ++i) {
+		if (changed[i]
+		 && !irmo_sendatom_verify_value(client, packet,
+		                                objclass->variables[i]->type,
+		                                &objclass->variables[i]->range)) {
+			result = 0;
+		}
+	}
+
+	irmo_packet_align_bits(packet);
+
+	free(changed);
+
+	return result;
 }
 
 static IrmoSendAtom *irmo_newobject_atom_read(IrmoPacket *packet, 
                                               IrmoClient *client)
 {
 	IrmoNewObjectAtom *atom;
+	IrmoClass *objclass;
+	unsigned int i;
 
 	atom = irmo_new0(IrmoNewObjectAtom, 1);
 	atom->sendatom.klass = &irmo_newobject_atom;
 
 	// object id of new object
 		
-	irmo_packet_readi16(packet, &atom->id);
+	irmo_packet_readi16v(packet, &atom->id);
 
 	// class of new object
 
 	irmo_packet_readi8(packet, &atom->classnum);
 
+	objclass = client->world->iface->classes[atom->classnum];
+	atom->objclass = objclass;
+
+	// initial values
+
+	atom->changed = irmo_new0(int, objclass->nvariables);
+	atom->newvalues = irmo_new0(IrmoValue, objclass->nvariables);
+
+	irmo_sendatom_read_bitmap(packet, atom->changed, objclass->nvariables);
+
+	for (i=0; i<objclass->nvariables; ++i) {
+		if (atom->changed[i]) {
+			irmo_sendatom_read_value(client, packet,
+			                         &atom->newvalues[i],
+			                         objclass->variables[i]->type,
+			                         &objclass->variables[i]->range);
+		}
+	}
+
+	irmo_packet_align_bits(packet);
+
 	return IRMO_SENDATOM(atom);
 }
 
 static void irmo_newobject_atom_write(IrmoNewObjectAtom *atom,
 				      IrmoPacket *packet)
 {
-	irmo_packet_writei16(packet, atom->id);
+	IrmoClass *objclass = atom->objclass;
+	unsigned int i;
+
+	irmo_packet_writei16v(packet, atom->id);
 	irmo_packet_writei8(packet, atom->classnum);
+
+	// initial values
+
+	irmo_sendatom_write_bitmap(packet, atom->changed, objclass->nvariables);
+
+	irmo_string_table_begin_atom(&atom->sendatom);
+
+	for (i=0; i<objclass->nvariables; ++i) {
+		if (atom->changed[i]) {
+			irmo_sendatom_write_value(atom->sendatom.client,
+			                          &atom->sendatom, packet,
+			                          sent_value(atom, i),
+			                          objclass->variables[i]->type,
+			                          &objclass->variables[i]->range);
+		}
+	}
+
+	irmo_string_table_end_atom(&atom->sendatom);
+
+	// Pad quantized values out to a whole number of bytes.
+
+	irmo_packet_align_bits(packet);
 }
 
 static void irmo_newobject_atom_run(IrmoNewObjectAtom *atom)
 {
 	IrmoClient *client = atom->sendatom.client;
-	IrmoInterface *iface = client->world->iface;
-	IrmoClass *objclass = iface->classes[atom->classnum];
+	IrmoClass *objclass = atom->objclass;
+	IrmoObject *obj;
+	unsigned int i;
 	
 	// sanity check
 
@@ -113,14 +245,121 @@ static void irmo_newobject_atom_run(IrmoNewObjectAtom *atom)
 
 	// create new object
 							  
-	irmo_object_internal_new(client->world, objclass, atom->id);
+	obj = irmo_object_internal_new(client->world, objclass, atom->id);
+
+	// set initial values
+
+	for (i=0; i<objclass->nvariables; ++i) {
+		if (atom->changed[i]) {
+			irmo_object_internal_set(obj, objclass->variables[i],
+			                         &atom->newvalues[i], 1);
+			obj->variable_time[i] = atom->sendatom.seqnum;
+		}
+	}
+
+	// Unreliable updates sent before this point were for a previous
+	// object with the same ID.
+
+	*irmo_client_unreliable_recv(client, atom->id)
+		= client->recv_packet_num;
+}
+
+static size_t irmo_newobject_atom_length(IrmoNewObjectAtom *atom)
+{
+	IrmoClient *client = atom->sendatom.client;
+	IrmoClass *objclass = atom->objclass;
+	size_t len;
+	unsigned int i;
+
+	// object id, class number, bitmap
+
+	len = irmo_sendatom_i16v_length(client, atom->id) + 1
+	    + (objclass->nvariables + 7) / 8;
+
+	// initial values
+
+	for (i=0; i<objclass->nvariables; ++i) {
+		if (sends_variable(atom, i)) {
+			len += irmo_sendatom_value_length(
+			          client, sent_value(atom, i),
+			          objclass->variables[i]->type,
+			          &objclass->variables[i]->range);
+		}
+	}
+
+	return len;
+}
+
+// Free the strings in the copied values.
+
+static void free_values(IrmoNewObjectAtom *atom)
+{
+	IrmoClass *objclass = atom->objclass;
+	unsigned int i;
+
+	for (i=0; i<objclass->nvariables; ++i) {
+		if (atom->changed[i]
+		 && objclass->variables[i]->type == IRMO_TYPE_STRING) {
+			free(atom->newvalues[i].s);
+		}
+	}
 }
 
-static size_t irmo_newobject_atom_length(IrmoSendAtom *atom)
+void irmo_newobject_atom_set_state(IrmoNewObjectAtom *atom)
 {
-	// object id, class number
+	IrmoClass *objclass = atom->objclass;
+	IrmoValue *newvalues;
+	int *changed;
+	unsigned int i;
+
+	if (atom->changed != NULL) {
+		return;
+	}
+
+	changed = irmo_new0(int, objclass->nvariables);
+	newvalues = irmo_new0(IrmoValue, objclass->nvariables);
+
+	// Copy the values, so that if the atom is retransmitted, the
+	// same values are sent in the same length as before.
+
+	for (i=0; i<objclass->nvariables; ++i) {
+		changed[i] = sends_variable(atom, i);
+
+		if (!changed[i]) {
+			continue;
+		}
+
+		if (objclass->variables[i]->type == IRMO_TYPE_STRING) {
+			newvalues[i].s = strdup(atom->object->variables[i].s);
+		} else {
+			newvalues[i] = atom->object->variables[i];
+		}
+	}
+
+	atom->changed = changed;
+	atom->newvalues = newvalues;
+}
+
+void irmo_newobject_atom_clear_state(IrmoNewObjectAtom *atom)
+{
+	irmo_newobject_atom_set_state(atom);
+
+	free_values(atom);
+
+	memset(atom->changed, 0, sizeof(int) * atom->objclass->nvariables);
+	atom->object = NULL;
+}
+
+static void irmo_newobject_atom_destroy(IrmoNewObjectAtom *atom)
+{
+        irmo_client_sendq_unlink_new(atom);
+
+	if (atom->newvalues != NULL) {
+		free_values(atom);
+		free(atom->newvalues);
+	}
 
-	return 2 + 1;
+	free(atom->changed);
 }
 
 
@@ -132,6 +371,6 @@ IrmoSendAtomClass irmo_newobject_atom = {
 	(IrmoSendAtomRunFunc) irmo_newobject_atom_run,
 	(IrmoSendAtomLengthFunc) irmo_newobject_atom_length,
         NULL,
-	NULL,
+	(IrmoSendAtomDestroyFunc) irmo_newobject_atom_destroy,
 };
 
@@ -34,7 +34,7 @@
 //
 // format:
 //
-// <int16>	new send window size in bytes
+// <int16v>	new send window size in bytes
 //
 
 static int irmo_sendwindow_atom_verify(IrmoPacket *packet, IrmoClient *client)
@@ -43,7 +43,7 @@ static int irmo_sendwindow_atom_verify(IrmoPacket *packet, IrmoClient *client)
 
 	// set maximum sendwindow size
 
-	return irmo_packet_readi16(packet, &i);
+	return irmo_packet_readi16v(packet, &i);
 }
 
 static IrmoSendAtom *irmo_sendwindow_atom_read(IrmoPacket *packet,
@@ -56,7 +56,7 @@ static IrmoSendAtom *irmo_sendwindow_atom_read(IrmoPacket *packet,
 	
 	// read window advertisement
 
-	irmo_packet_readi16(packet, &atom->max);
+	irmo_packet_readi16v(packet, &atom->max);
 
 	return IRMO_SENDATOM(atom);
 }
@@ -64,7 +64,7 @@ static IrmoSendAtom *irmo_sendwindow_atom_read(IrmoPacket *packet,
 static void irmo_sendwindow_atom_write(IrmoSendWindowAtom *atom,
 				       IrmoPacket *packet)
 {
-	irmo_packet_writei16(packet, atom->max);
+	irmo_packet_writei16v(packet, atom->max);
 }
 
 static void irmo_sendwindow_atom_run(IrmoSendWindowAtom *atom)
@@ -74,9 +74,9 @@ static void irmo_sendwindow_atom_run(IrmoSendWindowAtom *atom)
 	client->remote_sendwindow_max = atom->max;
 }
 
-static size_t irmo_sendwindow_atom_length(IrmoSendAtom *atom)
+static size_t irmo_sendwindow_atom_length(IrmoSendWindowAtom *atom)
 {
-	return 2;
+	return irmo_sendatom_i16v_length(atom->sendatom.client, atom->max);
 }
 
 IrmoSendAtomClass irmo_sendwindow_atom = {
@@ -0,0 +1,163 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+//
+// Payload cache for change atoms.
+//
+// When an object changes, the same change is usually sent to every
+// connected client.  Rather than encoding the new values separately
+// for each client, the encoded atom is saved the first time it is
+// written and copied into the packets for the other clients.
+//
+
+#include "arch/sysheaders.h"
+#include "base/alloc.h"
+
+#include "algo/algo.h"
+
+#include "server.h"
+#include "server-cache.h"
+
+static void free_entry_list(IrmoHashTableValue value)
+{
+        IrmoPayloadCacheEntry *entry = value;
+        IrmoPayloadCacheEntry *next;
+
+        while (entry != NULL) {
+                next = entry->next;
+                free(entry->data);
+                free(entry);
+                entry = next;
+        }
+}
+
+static IrmoHashTable *new_objects_table(void)
+{
+        IrmoHashTable *result;
+
+        result = irmo_hash_table_new(irmo_pointer_hash, irmo_pointer_equal);
+        irmo_alloc_assert(result != NULL);
+
+        irmo_hash_table_register_free_functions(result, NULL,
+                                                free_entry_list);
+
+        return result;
+}
+
+void irmo_server_cache_init(IrmoServer *server)
+{
+        IrmoPayloadCache *cache = &server->cache;
+
+        cache->objects = new_objects_table();
+        cache->hits = 0;
+        cache->misses = 0;
+}
+
+void irmo_server_cache_free(IrmoServer *server)
+{
+        irmo_hash_table_free(server->cache.objects);
+}
+
+void irmo_server_cache_clear(IrmoServer *server)
+{
+        IrmoPayloadCache *cache = &server->cache;
+
+        if (irmo_hash_table_num_entries(cache->objects) > 0) {
+                irmo_hash_table_free(cache->objects);
+                cache->objects = new_objects_table();
+        }
+}
+
+void irmo_server_cache_invalidate(IrmoServer *server, IrmoObject *object)
+{
+        irmo_hash_table_remove(server->cache.objects, object);
+}
+
+int irmo_server_cache_write(IrmoServer *server, IrmoObject *object,
+                            IrmoPacket *packet, unsigned int header_start)
+{
+        IrmoPayloadCache *cache = &server->cache;
+        IrmoPayloadCacheEntry *entry;
+        unsigned char *header;
+        unsigned int header_len;
+
+        header = irmo_packet_get_buffer(packet) + header_start;
+        header_len = irmo_packet_get_position(packet) - header_start;
+
+        // Search the entries for this object for one with a
+        // matching header.
+
+        entry = irmo_hash_table_lookup(cache->objects, object);
+
+        while (entry != NULL) {
+                if (entry->compact == irmo_packet_is_compact(packet)
+                 && entry->header_len == header_len
+                 && memcmp(entry->data, header, header_len) == 0) {
+                        break;
+                }
+
+                entry = entry->next;
+        }
+
+        if (entry == NULL) {
+                ++cache->misses;
+                return 0;
+        }
+
+        ++cache->hits;
+
+        // The header is already in the packet; copy the rest.
+
+        irmo_packet_writebytes(packet, entry->data + header_len,
+                               entry->len - header_len);
+
+        return 1;
+}
+
+void irmo_server_cache_add(IrmoServer *server, IrmoObject *object,
+                           IrmoPacket *packet, unsigned int header_start,
+                           unsigned int header_len)
+{
+        IrmoPayloadCache *cache = &server->cache;
+        IrmoPayloadCacheEntry *entry;
+        IrmoPayloadCacheEntry *head;
+
+        entry = irmo_new0(IrmoPayloadCacheEntry, 1);
+        entry->len = irmo_packet_get_position(packet) - header_start;
+        entry->header_len = header_len;
+        entry->compact = irmo_packet_is_compact(packet);
+        entry->data = irmo_malloc0(entry->len);
+        memcpy(entry->data, irmo_packet_get_buffer(packet) + header_start,
+               entry->len);
+
+        // Add to the list for this object.  If there is already a
+        // list, the new entry goes after the first entry, so that the
+        // hash table does not need to be updated.
+
+        head = irmo_hash_table_lookup(cache->objects, object);
+
+        if (head != NULL) {
+                entry->next = head->next;
+                head->next = entry;
+        } else {
+                irmo_alloc_assert(irmo_hash_table_insert(cache->objects,
+                                                         object, entry));
+        }
+}
+
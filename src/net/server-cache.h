@@ -0,0 +1,145 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+#ifndef IRMO_NET_SERVER_CACHE_H
+#define IRMO_NET_SERVER_CACHE_H
+
+#include <irmo/types.h>
+#include <irmo/packet.h>
+
+#include "algo/hash-table.h"
+
+typedef struct _IrmoPayloadCache IrmoPayloadCache;
+typedef struct _IrmoPayloadCacheEntry IrmoPayloadCacheEntry;
+
+//
+// Cached encoding of a change atom.
+//
+
+struct _IrmoPayloadCacheEntry {
+
+        // Encoded atom data: the object class and ID, the changed
+        // bitmap, and the values of the changed variables.
+
+        unsigned char *data;
+        unsigned int len;
+
+        // Length of the header (class, ID and bitmap) at the start
+        // of the data.  Two atoms for the same object with the same
+        // header encode to the same data.
+
+        unsigned int header_len;
+
+        // If true, the atom was encoded in the compact format.  The
+        // entry is only used for packets in the same format.
+
+        int compact;
+
+        // Next entry for the same object.
+
+        IrmoPayloadCacheEntry *next;
+};
+
+//
+// Payload cache.  When a change to an object is sent to many clients,
+// the change atoms for each client encode the same data.  The first
+// time a change is written, the encoded data is saved in the cache,
+// so that it can be copied straight into the packets for the other
+// clients.  The cache is cleared every time the server is run.
+//
+
+struct _IrmoPayloadCache {
+
+        // Lists of IrmoPayloadCacheEntry structures, keyed by object.
+
+        IrmoHashTable *objects;
+
+        // Statistics.
+
+        unsigned int hits;
+        unsigned int misses;
+};
+
+/*!
+ * Initialise the payload cache for a server.
+ *
+ * @param server         The server.
+ */
+
+void irmo_server_cache_init(IrmoServer *server);
+
+/*!
+ * Free the payload cache for a server.
+ *
+ * @param server         The server.
+ */
+
+void irmo_server_cache_free(IrmoServer *server);
+
+/*!
+ * Remove all entries from a server's payload cache.
+ *
+ * @param server         The server.
+ */
+
+void irmo_server_cache_clear(IrmoServer *server);
+
+/*!
+ * Remove all cache entries for an object, because it has been changed
+ * or destroyed.
+ *
+ * @param server         The server.
+ * @param object         The object.
+ */
+
+void irmo_server_cache_invalidate(IrmoServer *server, IrmoObject *object);
+
+/*!
+ * Look up a change atom in the payload cache.  The header of the atom
+ * must already have been written to the packet; if a matching entry
+ * is found, the remainder of the atom is written after it.
+ *
+ * @param server         The server.
+ * @param object         The object being changed.
+ * @param packet         The packet being written.
+ * @param header_start   Position in the packet of the start of the
+ *                       atom header.
+ * @return               Non-zero if the atom was found in the cache
+ *                       and written to the packet.
+ */
+
+int irmo_server_cache_write(IrmoServer *server, IrmoObject *object,
+                            IrmoPacket *packet, unsigned int header_start);
+
+/*!
+ * Save an encoded change atom in the payload cache.
+ *
+ * @param server         The server.
+ * @param object         The object being changed.
+ * @param packet         The packet containing the encoded atom.
+ * @param header_start   Position in the packet of the start of the atom.
+ * @param header_len     Length of the atom header.
+ */
+
+void irmo_server_cache_add(IrmoServer *server, IrmoObject *object,
+                           IrmoPacket *packet, unsigned int header_start,
+                           unsigned int header_len);
+
+#endif /* #ifndef IRMO_NET_SERVER_CACHE_H */
+
@@ -0,0 +1,216 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+//
+// Server change journal.
+//
+// Changes to the world being served are recorded once per server,
+// and converted into send atoms lazily, per client, when each client
+// is run.  This makes the cost of changing a variable independent of
+// the number of connected clients.
+//
+
+#include "arch/sysheaders.h"
+#include "base/alloc.h"
+
+#include "world/object.h"
+
+#include "client.h"
+#include "client_sendq.h"
+#include "server.h"
+#include "server-journal.h"
+
+void irmo_server_journal_init(IrmoServer *server)
+{
+        IrmoJournal *journal = &server->journal;
+
+        journal->alloced = 64;
+        journal->entries = irmo_new0(IrmoJournalEntry, journal->alloced);
+        journal->num_entries = 0;
+        journal->start = 0;
+}
+
+void irmo_server_journal_free(IrmoServer *server)
+{
+        irmo_server_journal_clear(server);
+        free(server->journal.entries);
+}
+
+void irmo_server_journal_add(IrmoServer *server,
+                             IrmoJournalEntryType type,
+                             IrmoObject *object,
+                             IrmoClassVar *var)
+{
+        IrmoJournal *journal = &server->journal;
+        IrmoJournalEntry *entry;
+
+        // Repeatedly setting the same variable only needs to be
+        // recorded once.
+
+        if (journal->num_entries > 0) {
+                entry = &journal->entries[journal->num_entries - 1];
+
+                if (type == IRMO_JOURNAL_CHANGE && entry->type == type
+                 && entry->object == object && entry->var == var) {
+                        return;
+                }
+        }
+
+        // Grow the array if necessary.
+
+        if (journal->num_entries >= journal->alloced) {
+                journal->alloced *= 2;
+                journal->entries = irmo_renew(IrmoJournalEntry,
+                                              journal->entries,
+                                              journal->alloced);
+        }
+
+        // The object is about to be freed; hold on to it until the
+        // clients have seen that it was destroyed.
+
+        if (type == IRMO_JOURNAL_DESTROY) {
+                irmo_object_internal_hold(object);
+        }
+
+        entry = &journal->entries[journal->num_entries];
+        entry->type = type;
+        entry->object = object;
+        entry->var = var;
+
+        ++journal->num_entries;
+}
+
+void irmo_server_journal_clear(IrmoServer *server)
+{
+        IrmoJournal *journal = &server->journal;
+        unsigned int i;
+
+        for (i=0; i<journal->num_entries; ++i) {
+                if (journal->entries[i].type == IRMO_JOURNAL_DESTROY) {
+                        irmo_object_internal_release(
+                                journal->entries[i].object);
+                }
+        }
+
+        journal->start += journal->num_entries;
+        journal->num_entries = 0;
+}
+
+// Returns true if the given client should receive changes to the
+// world being served.
+
+static int client_receives_changes(IrmoClient *client)
+{
+        return client->state == IRMO_CLIENT_CONNECTED
+            || client->state == IRMO_CLIENT_SYNCHRONIZED;
+}
+
+void irmo_client_journal_consume(IrmoClient *client)
+{
+        IrmoJournal *journal = &client->server->journal;
+        IrmoJournalEntry *entry;
+        unsigned int end;
+        unsigned int i;
+
+        end = journal->start + journal->num_entries;
+
+        // Entries that were cleared before we got to see them were
+        // already covered by the world state sent on connect.
+
+        if ((int) (client->journal_pos - journal->start) < 0) {
+                client->journal_pos = journal->start;
+        }
+
+        // Don't queue up changes for clients that are not
+        // connected yet.
+
+        if (!client_receives_changes(client)) {
+                client->journal_pos = end;
+                return;
+        }
+
+        // Nothing to do if there is nothing new in the journal and no
+        // objects waiting to be brought into scope.
+
+        if (client->journal_pos == end && client->scope_pending_len == 0) {
+                return;
+        }
+
+        ++client->server->journal_updates;
+
+        irmo_client_sendq_update_scope(client);
+
+        for (i=client->journal_pos - journal->start;
+             i<journal->num_entries; ++i) {
+
+                entry = &journal->entries[i];
+
+                // Objects that have since been destroyed are only
+                // removed; there is no point creating or changing
+                // them first.
+
+                if (entry->type != IRMO_JOURNAL_DESTROY
+                 && entry->object->journal_refs > 0) {
+                        continue;
+                }
+
+                switch (entry->type) {
+                case IRMO_JOURNAL_NEW:
+                        irmo_client_sendq_add_new(client, entry->object);
+                        break;
+                case IRMO_JOURNAL_CHANGE:
+                        irmo_client_sendq_add_change(client, entry->object,
+                                                     entry->var);
+                        break;
+                case IRMO_JOURNAL_DESTROY:
+                        irmo_client_sendq_add_destroy(client, entry->object);
+                        break;
+                }
+        }
+
+        client->journal_pos = end;
+}
+
+void irmo_client_journal_skip(IrmoClient *client)
+{
+        IrmoJournal *journal = &client->server->journal;
+
+        client->journal_pos = journal->start + journal->num_entries;
+}
+
+void irmo_server_journal_flush(IrmoServer *server)
+{
+        IrmoHashTableIterator iter;
+        IrmoClient *client;
+
+        if (server->journal.num_entries == 0) {
+                return;
+        }
+
+        irmo_hash_table_iterate(server->clients, &iter);
+
+        while (irmo_hash_table_iter_has_more(&iter)) {
+                client = irmo_hash_table_iter_next(&iter);
+
+                irmo_client_journal_consume(client);
+        }
+
+        irmo_server_journal_clear(server);
+}
+
@@ -0,0 +1,149 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+#ifndef IRMO_NET_SERVER_JOURNAL_H
+#define IRMO_NET_SERVER_JOURNAL_H
+
+#include <irmo/types.h>
+
+typedef struct _IrmoJournal IrmoJournal;
+typedef struct _IrmoJournalEntry IrmoJournalEntry;
+
+typedef enum {
+        IRMO_JOURNAL_NEW,          // object created
+        IRMO_JOURNAL_CHANGE,       // object variable changed
+        IRMO_JOURNAL_DESTROY,      // object destroyed
+} IrmoJournalEntryType;
+
+//
+// A single change recorded in the journal.
+//
+
+struct _IrmoJournalEntry {
+
+        // Type of change.
+
+        IrmoJournalEntryType type;
+
+        // The object that was created, changed or destroyed.
+        // Destroyed objects are held until the journal is cleared
+        // (see irmo_server_journal_clear), so this is always valid.
+
+        IrmoObject *object;
+
+        // For change entries, the variable that was changed.
+
+        IrmoClassVar *var;
+};
+
+//
+// The change journal.  When the world being served by a server is
+// modified, the change is appended to the server's journal once,
+// rather than being queued separately for every connected client.
+// Each client keeps a cursor into the journal and converts the
+// entries it has not yet seen into send atoms when it is next run.
+//
+
+struct _IrmoJournal {
+
+        // Array of entries.
+
+        IrmoJournalEntry *entries;
+        unsigned int num_entries;
+        unsigned int alloced;
+
+        // Position of the first entry in the array.  Positions are
+        // absolute and keep increasing as the journal is cleared, so
+        // that client cursors remain valid.
+
+        unsigned int start;
+};
+
+/*!
+ * Initialise the change journal for a server.
+ *
+ * @param server         The server.
+ */
+
+void irmo_server_journal_init(IrmoServer *server);
+
+/*!
+ * Free the change journal for a server.
+ *
+ * @param server         The server.
+ */
+
+void irmo_server_journal_free(IrmoServer *server);
+
+/*!
+ * Append an entry to a server's change journal.
+ *
+ * @param server         The server.
+ * @param type           Type of the change.
+ * @param object         The object affected.
+ * @param var            For change entries, the variable that was
+ *                       changed; otherwise NULL.
+ */
+
+void irmo_server_journal_add(IrmoServer *server,
+                             IrmoJournalEntryType type,
+                             IrmoObject *object,
+                             IrmoClassVar *var);
+
+/*!
+ * Bring every connected client up to date with the change journal
+ * and then clear it.  Clients are woken if this queues anything for
+ * them to send.  Nothing is done if the journal is empty.
+ *
+ * @param server         The server.
+ */
+
+void irmo_server_journal_flush(IrmoServer *server);
+
+/*!
+ * Clear a server's change journal, releasing the objects destroyed
+ * since it was last cleared.  All connected clients must already have
+ * consumed the entries in the journal.
+ *
+ * @param server         The server.
+ */
+
+void irmo_server_journal_clear(IrmoServer *server);
+
+/*!
+ * Convert the journal entries that a client has not yet seen into
+ * atoms in its send queue.
+ *
+ * @param client         The client.
+ */
+
+void irmo_client_journal_consume(IrmoClient *client);
+
+/*!
+ * Move a client's journal cursor to the end of the journal, skipping
+ * any entries that are already in the journal.  This is used when the
+ * complete world state is sent to a client.
+ *
+ * @param client         The client.
+ */
+
+void irmo_client_journal_skip(IrmoClient *client);
+
+#endif /* #ifndef IRMO_NET_SERVER_JOURNAL_H */
+
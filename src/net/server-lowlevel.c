@@ -75,6 +75,10 @@ static void server_send_synack(IrmoServer *server, IrmoClient *client)
 
         irmo_packet_writei16(sendpacket, client->id);
 
+        // Send the largest packet size that may be used:
+
+        irmo_packet_writei16(sendpacket, client->mtu_max);
+
         irmo_net_socket_send_packet(server->socket, client->address,
                                     sendpacket);
 
@@ -94,6 +98,7 @@ static void server_run_syn(IrmoServer *server,
 
 		// remove from hash tables
 
+                irmo_client_detach(client);
 		irmo_hash_table_remove(client->server->clients,
                                        client->address);
 		irmo_hash_table_remove(client->server->clients_by_id,
@@ -135,6 +140,92 @@ static int server_check_hashes(IrmoServer *server,
             && server_hash == server_hash_expected;
 }
 
+// Read the variables that a client wants to receive from a
+// subscriptions option in its SYN packet.
+
+static void server_read_subscriptions(IrmoClient *client,
+                                      IrmoPacket *packet,
+                                      unsigned int len)
+{
+        IrmoInterface *iface;
+        unsigned int class_len;
+        unsigned int expected_len;
+        unsigned int i, j;
+        unsigned int b;
+
+        // Ignore subscriptions if we are not serving a world.
+
+        if (client->server->world == NULL) {
+                return;
+        }
+
+        iface = client->server->world->iface;
+
+        expected_len = 0;
+
+        for (i=0; i<iface->nclasses; ++i) {
+                expected_len += (iface->classes[i]->nvariables + 7) / 8;
+        }
+
+        if (len != expected_len) {
+                return;
+        }
+
+        client->subscriptions = irmo_client_subscriptions_new(iface);
+        client->nsubscriptions = iface->nclasses;
+
+        for (i=0; i<iface->nclasses; ++i) {
+                class_len = (iface->classes[i]->nvariables + 7) / 8;
+
+                for (j=0; j<class_len; ++j) {
+                        irmo_packet_readi8(packet, &b);
+                        client->subscriptions[i][j] = (uint8_t) b;
+                }
+        }
+}
+
+// Read the options that follow the interface hashes in a SYN packet.
+
+static void server_read_syn_options(IrmoClient *client, IrmoPacket *packet)
+{
+        unsigned int type, len;
+        unsigned int start;
+        unsigned int remote_mtu;
+
+        // Clients that do not ask for a packet size get the default.
+
+        remote_mtu = IRMO_PROTOCOL_MTU;
+
+        while (irmo_packet_readi8(packet, &type)
+            && irmo_packet_readi16(packet, &len)) {
+
+                start = irmo_packet_get_position(packet);
+
+                // Truncated option?
+
+                if (start + len > irmo_packet_get_length(packet)) {
+                        return;
+                }
+
+                switch (type) {
+                case SYN_OPTION_SUBSCRIPTIONS:
+                        server_read_subscriptions(client, packet, len);
+                        break;
+                case SYN_OPTION_MTU:
+                        if (len == 2) {
+                                irmo_packet_readi16(packet, &remote_mtu);
+                        }
+                        break;
+                default:
+                        break;
+                }
+
+                irmo_packet_set_position(packet, start + len);
+        }
+
+        irmo_client_negotiate_mtu(client, remote_mtu);
+}
+
 static void server_run_initial_syn(IrmoServer *server, 
                                    IrmoPacket *packet,
                                    IrmoNetAddress *addr)
@@ -149,7 +240,8 @@ static void server_run_initial_syn(IrmoServer *server,
 		return;
         }
 
-	if (protocol_version != IRMO_PROTOCOL_VERSION) {
+	if (protocol_version != IRMO_PROTOCOL_VERSION
+	 && protocol_version != IRMO_PROTOCOL_VERSION_COMPACT) {
 		server_send_refuse(server, addr,
 				   "client and server side protocol versions "
 				   "do not match");
@@ -177,6 +269,11 @@ static void server_run_initial_syn(IrmoServer *server,
 
         client = irmo_client_new(server, addr);
 
+        client->compact
+                = protocol_version == IRMO_PROTOCOL_VERSION_COMPACT;
+
+        server_read_syn_options(client, packet);
+
         // Send a response back to the new client.
  
         server_run_syn(server, client);
@@ -188,11 +285,13 @@ static void server_run_synack(IrmoServer *server, IrmoPacket *packet,
                               IrmoClient *client)
 {
         IrmoClientID remote_id;
+        unsigned int remote_mtu;
 
         // Read the remote-ID value, so we know our client ID at the
-        // remote server.
+        // remote server, and the negotiated packet size.
 
-	if (!irmo_packet_readi16(packet, &remote_id)) {
+	if (!irmo_packet_readi16(packet, &remote_id)
+         || !irmo_packet_readi16(packet, &remote_mtu)) {
 		return;
 	}
 
@@ -204,6 +303,8 @@ static void server_run_synack(IrmoServer *server, IrmoPacket *packet,
 
                 client->server->remote_client_id = remote_id;
 
+                irmo_client_negotiate_mtu(client, remote_mtu);
+
 		// create the remote world object
 
 		if (client->server->client_interface != NULL) {
@@ -320,7 +421,7 @@ static void server_run_packet(IrmoServer *server,
 
 	// read packet header
 
-	if (!irmo_packet_readi16(packet, &flags)) {
+	if (!irmo_proto_read_flags(packet, &flags)) {
 		// cant read header
 		// drop packet
 
@@ -353,6 +454,10 @@ static void server_run_packet(IrmoServer *server,
 		return;
 	}
 
+        // The client must be run to respond to the packet.
+
+        irmo_client_wake(client);
+
 	// check for syn ack connection acknowledgements
 
 	if (flags == (PACKET_FLAG_SYN|PACKET_FLAG_ACK)) {
@@ -382,24 +487,58 @@ static void server_run_packet(IrmoServer *server,
 
 static void server_run_clients(IrmoServer *server)
 {
-        IrmoHashTableIterator iter;
+        IrmoClient **clients;
         IrmoClient *client;
+        unsigned int num_clients;
+        unsigned int nowtime;
+        unsigned int i;
+
+        nowtime = irmo_get_time();
+
+        // Queue changes made to the world since the last run.  This
+        // wakes the clients that have something new to send.
+
+        irmo_server_journal_flush(server);
+
+        // Wake clients with a retransmission or connection attempt due.
+
+        irmo_timer_wheel_advance(&server->timers, nowtime);
+
+        // Take the list of clients to run.  Clients woken while we
+        // are running them are added to a new list, to be run next
+        // time.
 
-        // Iterate over all clients
+        clients = server->active_clients;
+        num_clients = server->num_active_clients;
 
-        irmo_hash_table_iterate(server->clients, &iter);
+        server->active_clients = server->running_clients;
+        server->num_active_clients = 0;
+        server->running_clients = clients;
 
-        while (irmo_hash_table_iter_has_more(&iter)) {
+        i = server->active_clients_alloced;
+        server->active_clients_alloced = server->running_clients_alloced;
+        server->running_clients_alloced = i;
 
-                client = irmo_hash_table_iter_next(&iter);
+        for (i=0; i<num_clients; ++i) {
+                clients[i]->active = 0;
+        }
+
+        for (i=0; i<num_clients; ++i) {
+
+                client = clients[i];
 
                 // Run the client
 
+                client->running = 1;
                 irmo_client_run(client);
+                client->running = 0;
+
+                ++server->client_runs;
 
                 // dont remove clients which aren't disconnected
 
                 if (client->state != IRMO_CLIENT_DISCONNECTED) {
+                        irmo_client_schedule(client, nowtime);
                         continue;
                 }
 
@@ -407,17 +546,29 @@ static void server_run_clients(IrmoServer *server)
                 // we wait a while before destroying the object
                 
                 if (client->disconnect_wait
-                    && irmo_get_time() - client->connect_time < 10 * 1000) {
+                    && nowtime - client->connect_time
+                         < IRMO_CLIENT_DISCONNECT_WAIT) {
+                        irmo_client_schedule(client, nowtime);
                         continue;
                 }
                 
-                // remove from socket list: return 1
-               
+                // remove from socket list
+
+                irmo_client_detach(client);
                 irmo_hash_table_remove(server->clients,
                                        client->address);
 
                 irmo_client_internal_unref(client);
         }
+
+        // Bring all clients up to date with the journal and clear it.
+        // Changes made while the clients were running (for example,
+        // from a callback function) are queued for the clients that
+        // have already been run, and they are woken up to send them.
+        // Cached data is only reused within a single run.
+
+        irmo_server_journal_flush(server);
+        irmo_server_cache_clear(server);
 }
 
 void irmo_server_run(IrmoServer *server)
@@ -21,58 +21,23 @@
 
 #include "sendatom.h"
 #include "client_sendq.h"
+#include "server.h"
+#include "server-journal.h"
 #include "server-world.h"
 
 // Called when the world being served creates a new object.
 
 void irmo_server_object_new(IrmoServer *server, IrmoObject *obj)
 {
-        IrmoHashTableIterator iter;
-        IrmoClient *client;
-
-        irmo_hash_table_iterate(server->clients, &iter);
-
-        while (irmo_hash_table_iter_has_more(&iter)) {
-                client = irmo_hash_table_iter_next(&iter);
-
-                // Don't queue up changes for clients that are not
-                // connected yet.
-
-                if (client->state != IRMO_CLIENT_CONNECTED
-                 && client->state != IRMO_CLIENT_SYNCHRONIZED) {
-                        continue;
-                }
-
-                // Add a new send atom for this object creation.
-
-                irmo_client_sendq_add_new(client, obj);
-        }
+        irmo_server_journal_add(server, IRMO_JOURNAL_NEW, obj, NULL);
 }
 
 // Called when the world being served destroys an object.
 
 void irmo_server_object_destroyed(IrmoServer *server, IrmoObject *obj)
 {
-        IrmoHashTableIterator iter;
-        IrmoClient *client;
-
-        irmo_hash_table_iterate(server->clients, &iter);
-
-        while (irmo_hash_table_iter_has_more(&iter)) {
-                client = irmo_hash_table_iter_next(&iter);
-
-                // Don't queue up changes for clients that are not
-                // connected yet.
-
-                if (client->state != IRMO_CLIENT_CONNECTED
-                 && client->state != IRMO_CLIENT_SYNCHRONIZED) {
-                        continue;
-                }
-
-                // Add a new send atom for this object destroy.
-
-                irmo_client_sendq_add_destroy(client, obj);
-        }
+        irmo_server_journal_add(server, IRMO_JOURNAL_DESTROY, obj, NULL);
+        irmo_server_cache_invalidate(server, obj);
 }
 
 // Called when the world being served changes an object.
@@ -80,26 +45,8 @@ void irmo_server_object_destroyed(IrmoServer *server, IrmoObject *obj)
 void irmo_server_object_changed(IrmoServer *server, IrmoObject *obj,
                                 IrmoClassVar *var)
 {
-        IrmoHashTableIterator iter;
-        IrmoClient *client;
-
-        irmo_hash_table_iterate(server->clients, &iter);
-
-        while (irmo_hash_table_iter_has_more(&iter)) {
-                client = irmo_hash_table_iter_next(&iter);
-
-                // Don't queue up changes for clients that are not
-                // connected yet.
-
-                if (client->state != IRMO_CLIENT_CONNECTED
-                 && client->state != IRMO_CLIENT_SYNCHRONIZED) {
-                        continue;
-                }
-
-                // Add a new sendatom for this change.
-
-                irmo_client_sendq_add_change(client, obj, var);
-        }
+        irmo_server_journal_add(server, IRMO_JOURNAL_CHANGE, obj, var);
+        irmo_server_cache_invalidate(server, obj);
 }
 
 void irmo_connection_method_call(IrmoConnection *conn, 
@@ -65,6 +65,25 @@ IrmoServer *irmo_server_new_from(IrmoNetSocket *sock,
         irmo_alloc_assert(server->clients != NULL);
         irmo_alloc_assert(server->clients_by_id != NULL);
 
+        irmo_server_journal_init(server);
+        irmo_server_cache_init(server);
+        irmo_timer_wheel_init(&server->timers, irmo_get_time());
+
+        // Default priorities: removing objects and method calls can
+        // jump ahead of changes.
+
+        server->priorities[IRMO_PRIORITY_DESTROY] = 64;
+        server->priorities[IRMO_PRIORITY_METHOD] = 64;
+
+        server->ack_delay = IRMO_DEFAULT_ACK_DELAY;
+        server->mtu = IRMO_PROTOCOL_MTU;
+        server->string_table_size = IRMO_STRING_TABLE_DEFAULT_SIZE;
+
+        if (world != NULL) {
+                server->class_priorities
+                        = irmo_new0(unsigned int, world->iface->nclasses);
+        }
+
 	return server;
 }
 
@@ -125,6 +144,7 @@ static void irmo_server_remove_all_clients(IrmoServer *server)
 
                 // Remove this client from the hash table and destroy it.
 
+                irmo_client_detach(client);
                 irmo_hash_table_remove(server->clients, client->address);
                 irmo_hash_table_remove(server->clients_by_id,
                                        IRMO_POINTER_KEY(client->id));
@@ -160,6 +180,10 @@ static void irmo_server_internal_shutdown(IrmoServer *server)
                 }
         }
 
+        // Release any destroyed objects still held by the journal.
+
+        irmo_server_journal_clear(server);
+
 	server->running = 0;
 }
 
@@ -174,6 +198,11 @@ void irmo_server_unref(IrmoServer *server)
 		irmo_server_internal_shutdown(server);
 		irmo_hash_table_free(server->clients);
 		irmo_hash_table_free(server->clients_by_id);
+		irmo_server_journal_free(server);
+		irmo_server_cache_free(server);
+		free(server->class_priorities);
+		free(server->active_clients);
+		free(server->running_clients);
 
 		// destroy callbacks
 
@@ -225,6 +254,115 @@ void irmo_server_raise_connect(IrmoServer *server, IrmoClient *client)
 	irmo_client_callback_raise(&server->connect_callbacks, client);
 }
 
+unsigned int irmo_server_get_stat(IrmoServer *server, IrmoServerStat stat)
+{
+	irmo_return_val_if_fail(server != NULL, 0);
+
+        switch (stat) {
+        case IRMO_SERVER_STAT_CACHE_HITS:
+                return server->cache.hits;
+        case IRMO_SERVER_STAT_CACHE_MISSES:
+                return server->cache.misses;
+        case IRMO_SERVER_STAT_CLIENT_RUNS:
+                return server->client_runs;
+        case IRMO_SERVER_STAT_ATOMS_RESENT:
+                return server->atoms_resent;
+        case IRMO_SERVER_STAT_FAST_RETRANSMITS:
+                return server->fast_retransmits;
+        case IRMO_SERVER_STAT_ACKS_AVOIDED:
+                return server->acks_avoided;
+        case IRMO_SERVER_STAT_UNRELIABLE_UPDATES:
+                return server->unreliable_updates;
+        case IRMO_SERVER_STAT_UNRELIABLE_LOST:
+                return server->unreliable_lost;
+        case IRMO_SERVER_STAT_FEC_PACKETS:
+                return server->fec_packets;
+        case IRMO_SERVER_STAT_FEC_RECOVERED:
+                return server->fec_recovered;
+        case IRMO_SERVER_STAT_JOURNAL_UPDATES:
+                return server->journal_updates;
+        default:
+                return 0;
+        }
+}
+
+void irmo_server_set_replication_mode(IrmoServer *server,
+                                      IrmoReplicationMode mode)
+{
+	irmo_return_if_fail(server != NULL);
+
+        server->replication_mode = mode;
+}
+
+void irmo_server_set_congestion_control(IrmoServer *server,
+                                        IrmoCongestionControl cc)
+{
+	irmo_return_if_fail(server != NULL);
+        irmo_return_if_fail(cc >= 0 && cc < IRMO_CONGESTION_NUM_CONTROLS);
+
+        server->congestion_control = cc;
+}
+
+void irmo_server_set_ack_delay(IrmoServer *server, unsigned int ms)
+{
+	irmo_return_if_fail(server != NULL);
+
+        server->ack_delay = ms;
+}
+
+void irmo_server_set_mtu(IrmoServer *server, unsigned int mtu)
+{
+	irmo_return_if_fail(server != NULL);
+        irmo_return_if_fail(mtu >= IRMO_PROTOCOL_MIN_MTU
+                         && mtu <= IRMO_PROTOCOL_MAX_MTU);
+
+        server->mtu = mtu;
+}
+
+void irmo_server_set_mtu_probing(IrmoServer *server, int probe)
+{
+	irmo_return_if_fail(server != NULL);
+
+        server->mtu_probing = probe;
+}
+
+void irmo_server_set_fec(IrmoServer *server, int fec)
+{
+	irmo_return_if_fail(server != NULL);
+
+        server->fec = fec;
+}
+
+void irmo_server_set_string_table_size(IrmoServer *server,
+                                       unsigned int bytes)
+{
+	irmo_return_if_fail(server != NULL);
+
+        server->string_table_size = bytes;
+}
+
+void irmo_server_set_priority(IrmoServer *server, IrmoPriorityType type,
+                              unsigned int priority)
+{
+	irmo_return_if_fail(server != NULL);
+	irmo_return_if_fail(type < IRMO_PRIORITY_NUM_TYPES);
+
+        server->priorities[type] = priority;
+}
+
+void irmo_server_set_class_priority(IrmoServer *server, IrmoClass *klass,
+                                    unsigned int priority)
+{
+	irmo_return_if_fail(server != NULL);
+	irmo_return_if_fail(klass != NULL);
+	irmo_return_if_fail(server->world != NULL);
+	irmo_return_if_fail(klass->index < server->world->iface->nclasses);
+	irmo_return_if_fail(server->world->iface->classes[klass->index]
+                              == klass);
+
+        server->class_priorities[klass->index] = priority;
+}
+
 IrmoIterator *irmo_server_iterate_clients(IrmoServer *server)
 {
 	irmo_return_val_if_fail(server != NULL, NULL);
@@ -265,8 +403,47 @@ void irmo_server_shutdown(IrmoServer *server)
 	irmo_server_internal_shutdown(server);
 }
 
+int irmo_server_next_send_time(IrmoServer *server)
+{
+        unsigned int nowtime;
+        unsigned int when;
+
+	irmo_return_val_if_fail(server != NULL, -1);
+
+        // Clients waiting to be run, or changes to send?
+
+        if (server->num_active_clients > 0
+         || server->journal.num_entries > 0) {
+                return 0;
+        }
+
+        // Otherwise, wait until the first client timer expires.
+
+        if (!irmo_timer_wheel_next_expiry(&server->timers, &when)) {
+                return -1;
+        }
+
+        nowtime = irmo_get_time();
+
+        if ((int) (when - nowtime) < 0) {
+                return 0;
+        }
+
+        return (int) (when - nowtime);
+}
+
 void irmo_server_block(IrmoServer *server, int ms)
 {
+        int next_send;
+
+        // Do not sleep past the time that data is due to be sent.
+
+        next_send = irmo_server_next_send_time(server);
+
+        if (next_send >= 0 && next_send < ms) {
+                ms = next_send;
+        }
+
         irmo_net_socket_block(server->socket, ms);
 }
 
@@ -28,6 +28,9 @@
 #include "netbase/net-socket.h"
 
 #include "client.h"
+#include "server-cache.h"
+#include "server-journal.h"
+#include "timer-wheel.h"
 
 struct _IrmoServer {
 
@@ -77,6 +80,101 @@ struct _IrmoServer {
         // unique client ID assigned to us by the remote server.
 
         IrmoClientID remote_client_id;
+
+        // Journal of changes made to the world being served that
+        // have not yet been queued for all clients.
+
+        IrmoJournal journal;
+
+        // Cache of encoded change atoms, shared between clients.
+
+        IrmoPayloadCache cache;
+
+        // Replication mode used for new clients.
+
+        IrmoReplicationMode replication_mode;
+
+        // Congestion controller used for new clients.
+
+        IrmoCongestionControl congestion_control;
+
+        // Maximum time that new clients delay acknowledgements for.
+
+        unsigned int ack_delay;
+
+        // Maximum packet size for new clients, and whether they probe
+        // for the largest packet size that gets through.
+
+        unsigned int mtu;
+        int mtu_probing;
+
+        // Whether parity packets are sent to new clients.
+
+        int fec;
+
+        // Limit on the size of the table of strings sent to each new
+        // client, in bytes.
+
+        unsigned int string_table_size;
+
+        // Send queue priorities, for each type of atom, and for
+        // each class in the interface of the world being served.
+
+        unsigned int priorities[IRMO_PRIORITY_NUM_TYPES];
+        unsigned int *class_priorities;
+
+        // Timers for retransmissions and connection attempts, for
+        // all clients.
+
+        IrmoTimerWheel timers;
+
+        // Clients to be run on the next call to irmo_server_run.
+        // Idle clients are not in the list, and are not run.  The
+        // second array is used while running the clients, so that
+        // clients can be woken at the same time.
+
+        IrmoClient **active_clients;
+        unsigned int num_active_clients;
+        unsigned int active_clients_alloced;
+
+        IrmoClient **running_clients;
+        unsigned int running_clients_alloced;
+
+        // Number of times a client has been run.
+
+        unsigned int client_runs;
+
+        // Number of atoms that have been retransmitted.
+
+        unsigned int atoms_resent;
+
+        // Number of atoms that were retransmitted because they were
+        // detected as lost, rather than timing out.
+
+        unsigned int fast_retransmits;
+
+        // Number of acknowledgements that were delayed and then sent
+        // with data or merged into a later acknowledgement, rather
+        // than being sent in a packet of their own.
+
+        unsigned int acks_avoided;
+
+        // Number of updates to unreliable variables sent, and the
+        // number that were lost.
+
+        unsigned int unreliable_updates;
+        unsigned int unreliable_lost;
+
+        // Number of parity packets sent, and the number of lost
+        // packets rebuilt from parity packets that were received.
+
+        unsigned int fec_packets;
+        unsigned int fec_recovered;
+
+        // Number of times that a client has been brought up to date
+        // with the change journal.
+
+        unsigned int journal_updates;
 };
 
 /*!
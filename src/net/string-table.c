@@ -0,0 +1,419 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+//
+// Per-client string table.
+//
+// The same strings (player names, item types and so on) are often
+// sent over and over again.  The first time a string is sent, it is
+// sent in full along with an index into a table kept at both ends of
+// the connection.  Once an atom containing the definition has been
+// acknowledged, later uses send only the index.
+//
+
+#include "arch/sysheaders.h"
+#include "base/alloc.h"
+#include "base/assert.h"
+
+#include "algo/algo.h"
+
+#include "client.h"
+#include "protocol.h"
+#include "string-table.h"
+
+// Strings shorter than this are always sent in full, as an index
+// would save little or nothing.
+
+#define STRING_TABLE_MIN_LENGTH 3
+
+void irmo_string_table_init(IrmoClient *client, unsigned int max_bytes)
+{
+        IrmoStringTable *table = &client->strings;
+
+        table->strings = irmo_hash_table_new(irmo_string_hash,
+                                             irmo_string_equal);
+        irmo_alloc_assert(table->strings != NULL);
+
+        table->entries = NULL;
+        table->num_entries = 0;
+        table->lru_head = NULL;
+        table->lru_tail = NULL;
+        table->bytes = 0;
+        table->max_bytes = max_bytes;
+
+        table->defs = NULL;
+        table->num_defs = 0;
+        table->defs_alloced = 0;
+
+        table->recv_strings = NULL;
+        table->recv_seqs = NULL;
+        table->read_seq = 0;
+}
+
+void irmo_string_table_free(IrmoClient *client)
+{
+        IrmoStringTable *table = &client->strings;
+        IrmoStringTableEntry *entry;
+        IrmoStringTableEntry *next;
+        unsigned int i;
+
+        entry = table->lru_head;
+
+        while (entry != NULL) {
+                next = entry->next;
+                free(entry->s);
+                free(entry);
+                entry = next;
+        }
+
+        irmo_hash_table_free(table->strings);
+        free(table->entries);
+        free(table->defs);
+
+        if (table->recv_strings != NULL) {
+                for (i=0; i<STRING_TABLE_MAX_ENTRIES; ++i) {
+                        free(table->recv_strings[i]);
+                }
+        }
+
+        free(table->recv_strings);
+        free(table->recv_seqs);
+}
+
+void irmo_string_table_set_size(IrmoClient *client, unsigned int max_bytes)
+{
+        client->strings.max_bytes = max_bytes;
+}
+
+int irmo_string_table_enabled(IrmoClient *client)
+{
+        return client->strings.max_bytes > 0;
+}
+
+// Unlink an entry from the list of entries.
+
+static void unlink_entry(IrmoStringTable *table, IrmoStringTableEntry *entry)
+{
+        if (entry->prev != NULL) {
+                entry->prev->next = entry->next;
+        } else {
+                table->lru_head = entry->next;
+        }
+
+        if (entry->next != NULL) {
+                entry->next->prev = entry->prev;
+        } else {
+                table->lru_tail = entry->prev;
+        }
+}
+
+// Move an entry to the head of the list of entries, as it has just
+// been used.
+
+static void touch_entry(IrmoStringTable *table, IrmoStringTableEntry *entry)
+{
+        unlink_entry(table, entry);
+
+        entry->prev = NULL;
+        entry->next = table->lru_head;
+
+        if (table->lru_head != NULL) {
+                table->lru_head->prev = entry;
+        } else {
+                table->lru_tail = entry;
+        }
+
+        table->lru_head = entry;
+}
+
+static void remove_entry(IrmoStringTable *table, IrmoStringTableEntry *entry)
+{
+        unlink_entry(table, entry);
+
+        irmo_hash_table_remove(table->strings, entry->s);
+        table->entries[entry->index] = NULL;
+        table->bytes -= (unsigned int) strlen(entry->s) + 1;
+        --table->num_entries;
+
+        free(entry->s);
+        free(entry);
+}
+
+// Add a new string to the table.  Entries are removed to make space,
+// least recently used first, but only if no atoms using them are
+// still waiting to be acknowledged.  Returns NULL if there is no
+// space for the string.
+
+static IrmoStringTableEntry *new_entry(IrmoClient *client, char *s,
+                                       unsigned int len)
+{
+        IrmoStringTable *table = &client->strings;
+        IrmoStringTableEntry *entry;
+        IrmoStringTableEntry *prev;
+        unsigned int i;
+
+        if (table->entries == NULL) {
+                table->entries = irmo_new0(IrmoStringTableEntry *,
+                                           STRING_TABLE_MAX_ENTRIES);
+        }
+
+        entry = table->lru_tail;
+
+        while (entry != NULL
+            && (table->bytes + len > table->max_bytes
+             || table->num_entries >= STRING_TABLE_MAX_ENTRIES - 1)) {
+                prev = entry->prev;
+
+                if (entry->last_use < client->sendwindow_start) {
+                        remove_entry(table, entry);
+                }
+
+                entry = prev;
+        }
+
+        if (table->bytes + len > table->max_bytes
+         || table->num_entries >= STRING_TABLE_MAX_ENTRIES - 1) {
+                return NULL;
+        }
+
+        // Find a free index.  Index zero is never used.
+
+        i = 1;
+
+        while (table->entries[i] != NULL) {
+                ++i;
+        }
+
+        entry = irmo_new0(IrmoStringTableEntry, 1);
+        entry->s = strdup(s);
+        entry->index = i;
+        entry->confirmed = 0;
+
+        irmo_alloc_assert(irmo_hash_table_insert(table->strings,
+                                                 entry->s, entry));
+        table->entries[i] = entry;
+        table->bytes += len;
+        ++table->num_entries;
+
+        // Add to the head of the list.
+
+        entry->next = table->lru_head;
+
+        if (table->lru_head != NULL) {
+                table->lru_head->prev = entry;
+        } else {
+                table->lru_tail = entry;
+        }
+
+        table->lru_head = entry;
+
+        return entry;
+}
+
+void irmo_string_table_begin_atom(IrmoSendAtom *atom)
+{
+        atom->client->strings.num_defs = 0;
+}
+
+void irmo_string_table_end_atom(IrmoSendAtom *atom)
+{
+        IrmoStringTable *table = &atom->client->strings;
+        unsigned int i, j, n;
+
+        if (!atom->string_written) {
+                atom->string_written = 1;
+
+                if (table->num_defs > 0) {
+                        atom->string_defs = irmo_new0(unsigned int,
+                                                      table->num_defs);
+                        memcpy(atom->string_defs, table->defs,
+                               sizeof(unsigned int) * table->num_defs);
+                        atom->num_string_defs = table->num_defs;
+                }
+
+                return;
+        }
+
+        // The atom has been written before, and the strings in it
+        // may have changed since.  Keep only the entries that it
+        // defined both times.
+
+        n = 0;
+
+        for (i=0; i<atom->num_string_defs; ++i) {
+                for (j=0; j<table->num_defs; ++j) {
+                        if (table->defs[j] == atom->string_defs[i]) {
+                                atom->string_defs[n] = atom->string_defs[i];
+                                ++n;
+                                break;
+                        }
+                }
+        }
+
+        atom->num_string_defs = n;
+}
+
+// Record that the atom being written defines an entry.
+
+static void add_def(IrmoStringTable *table, unsigned int index)
+{
+        if (table->num_defs >= table->defs_alloced) {
+                table->defs_alloced = table->defs_alloced * 2 + 4;
+                table->defs = irmo_renew(unsigned int, table->defs,
+                                         table->defs_alloced);
+        }
+
+        table->defs[table->num_defs] = index;
+        ++table->num_defs;
+}
+
+void irmo_string_table_write(IrmoClient *client, IrmoSendAtom *atom,
+                             IrmoPacket *packet, char *s)
+{
+        IrmoStringTable *table = &client->strings;
+        IrmoStringTableEntry *entry;
+        unsigned int len;
+
+        len = (unsigned int) strlen(s) + 1;
+        entry = NULL;
+
+        if (atom != NULL && len > STRING_TABLE_MIN_LENGTH
+         && len <= table->max_bytes) {
+                entry = irmo_hash_table_lookup(table->strings, s);
+
+                if (entry == NULL) {
+                        entry = new_entry(client, s, len);
+                } else {
+                        touch_entry(table, entry);
+                }
+        }
+
+        // Not in the table?  Send in full.
+
+        if (entry == NULL) {
+                irmo_packet_writevarint(packet, 0);
+                irmo_packet_writestring(packet, s);
+                return;
+        }
+
+        if (entry->last_use < atom->seqnum) {
+                entry->last_use = atom->seqnum;
+        }
+
+        if (entry->confirmed) {
+                irmo_packet_writevarint(packet, (entry->index << 1) | 1);
+        } else {
+                irmo_packet_writevarint(packet, entry->index << 1);
+                irmo_packet_writestring(packet, s);
+                add_def(table, entry->index);
+        }
+}
+
+size_t irmo_string_table_length(char *s)
+{
+        return irmo_packet_varint_length((STRING_TABLE_MAX_ENTRIES << 1) - 1)
+             + strlen(s) + 1;
+}
+
+int irmo_string_table_verify(IrmoClient *client, IrmoPacket *packet)
+{
+        IrmoStringTable *table = &client->strings;
+        unsigned int tag;
+        unsigned int index;
+
+        if (!irmo_packet_readvarint(packet, &tag)) {
+                return 0;
+        }
+
+        index = tag >> 1;
+
+        if (tag != 0 && (index == 0 || index >= STRING_TABLE_MAX_ENTRIES)) {
+                return 0;
+        }
+
+        // References must be to strings that have been received.
+
+        if ((tag & 1) != 0) {
+                return table->recv_strings != NULL
+                    && table->recv_strings[index] != NULL;
+        }
+
+        return irmo_packet_readstring(packet) != NULL;
+}
+
+// Store a string received in a definition.  Definitions from atoms
+// older than the current definition (delayed duplicate packets) are
+// ignored, as the entry may since have been reused.
+
+static void define_string(IrmoStringTable *table, unsigned int index,
+                          char *s)
+{
+        if (table->recv_strings == NULL) {
+                table->recv_strings = irmo_new0(char *,
+                                                STRING_TABLE_MAX_ENTRIES);
+                table->recv_seqs = irmo_new0(unsigned int,
+                                             STRING_TABLE_MAX_ENTRIES);
+        }
+
+        if (table->recv_strings[index] != NULL
+         && table->read_seq < table->recv_seqs[index]) {
+                return;
+        }
+
+        free(table->recv_strings[index]);
+        table->recv_strings[index] = strdup(s);
+        table->recv_seqs[index] = table->read_seq;
+}
+
+char *irmo_string_table_read(IrmoClient *client, IrmoPacket *packet)
+{
+        IrmoStringTable *table = &client->strings;
+        unsigned int tag;
+        char *s;
+
+        irmo_packet_readvarint(packet, &tag);
+
+        if ((tag & 1) != 0) {
+                return strdup(table->recv_strings[tag >> 1]);
+        }
+
+        s = irmo_packet_readstring(packet);
+
+        if (tag != 0) {
+                define_string(table, tag >> 1, s);
+        }
+
+        return strdup(s);
+}
+
+void irmo_string_table_acked(IrmoSendAtom *atom)
+{
+        IrmoStringTable *table = &atom->client->strings;
+        IrmoStringTableEntry *entry;
+        unsigned int i;
+
+        for (i=0; i<atom->num_string_defs; ++i) {
+                entry = table->entries[atom->string_defs[i]];
+
+                if (entry != NULL) {
+                        entry->confirmed = 1;
+                }
+        }
+}
+
@@ -0,0 +1,233 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+#ifndef IRMO_NET_STRING_TABLE_H
+#define IRMO_NET_STRING_TABLE_H
+
+#include <irmo/types.h>
+#include <irmo/packet.h>
+
+#include "algo/hash-table.h"
+
+// Default limit on the total size of the strings in the table of
+// strings sent to a client, in bytes.
+
+#define IRMO_STRING_TABLE_DEFAULT_SIZE 4096
+
+typedef struct _IrmoStringTable IrmoStringTable;
+typedef struct _IrmoStringTableEntry IrmoStringTableEntry;
+
+//
+// An entry in the table of strings sent to a client.
+//
+
+struct _IrmoStringTableEntry {
+
+        // The string, and its index in the table.
+
+        char *s;
+        unsigned int index;
+
+        // Non-zero once an atom defining the entry has been
+        // acknowledged.  Until then, the definition is sent every
+        // time the string is used.
+
+        int confirmed;
+
+        // Sequence number of the latest atom that used the entry.
+        // The entry cannot be reused for another string until this
+        // atom has been acknowledged.
+
+        unsigned int last_use;
+
+        // Links in the list of entries, most recently used first.
+
+        IrmoStringTableEntry *prev;
+        IrmoStringTableEntry *next;
+};
+
+//
+// String table.  Strings sent in atoms are added to a table kept for
+// each client, and once the client has received a string, it is sent
+// as an index into the table rather than in full.  The least recently
+// used strings are removed to keep the table within a size limit.
+// The strings received from the client are kept in a second table.
+//
+
+struct _IrmoStringTable {
+
+        // Entries for strings sent, by index and by string.  The
+        // array of entries is allocated when the first string is
+        // added.
+
+        IrmoStringTableEntry **entries;
+        IrmoHashTable *strings;
+        unsigned int num_entries;
+
+        // List of entries, most recently used first.
+
+        IrmoStringTableEntry *lru_head;
+        IrmoStringTableEntry *lru_tail;
+
+        // Total size of the strings in the table, and the limit on
+        // the size.  If the limit is zero, strings are always sent
+        // in full.
+
+        unsigned int bytes;
+        unsigned int max_bytes;
+
+        // Indexes of the entries defined by the atom currently being
+        // written.
+
+        unsigned int *defs;
+        unsigned int num_defs;
+        unsigned int defs_alloced;
+
+        // Strings received, by index, and the sequence number of the
+        // atom that defined each one.  Allocated when the first
+        // definition is received.
+
+        char **recv_strings;
+        unsigned int *recv_seqs;
+
+        // Sequence number of the atom currently being read.
+
+        unsigned int read_seq;
+};
+
+#include "sendatom.h"
+
+/*!
+ * Initialise the string table for a client.
+ *
+ * @param client         The client.
+ * @param max_bytes      Limit on the total size of the strings sent
+ *                       to the client.
+ */
+
+void irmo_string_table_init(IrmoClient *client, unsigned int max_bytes);
+
+/*!
+ * Free the string table for a client.
+ *
+ * @param client         The client.
+ */
+
+void irmo_string_table_free(IrmoClient *client);
+
+/*!
+ * Set the limit on the total size of the strings sent to a client.
+ * If the table is larger, strings are removed as space is needed.
+ *
+ * @param client         The client.
+ * @param max_bytes      The new limit.  If zero, strings are always
+ *                       sent in full.
+ */
+
+void irmo_string_table_set_size(IrmoClient *client, unsigned int max_bytes);
+
+/*!
+ * Returns true if strings written to a client may be sent as indexes
+ * into the string table, so that the encoding of an atom depends on
+ * the client that it is sent to.
+ *
+ * @param client         The client.
+ * @return               Non-zero if the string table is in use.
+ */
+
+int irmo_string_table_enabled(IrmoClient *client);
+
+/*!
+ * Start writing an atom containing strings.  The entries that the
+ * atom defines are recorded until @ref irmo_string_table_end_atom is
+ * called, so that they can be confirmed when the atom is acknowledged.
+ *
+ * @param atom           The atom.
+ */
+
+void irmo_string_table_begin_atom(IrmoSendAtom *atom);
+
+/*!
+ * Finish writing an atom containing strings.  If the atom has been
+ * written before, only the entries it defined every time it was
+ * written are confirmed when it is acknowledged, as it is not known
+ * which copy of the atom was received.
+ *
+ * @param atom           The atom.
+ */
+
+void irmo_string_table_end_atom(IrmoSendAtom *atom);
+
+/*!
+ * Write a string to a packet, adding it to the string table.
+ *
+ * @param client         The client the packet is being sent to.
+ * @param atom           The atom being written, which must have been
+ *                       passed to @ref irmo_string_table_begin_atom.
+ *                       If NULL, the string is always sent in full.
+ * @param packet         The packet.
+ * @param s              The string.
+ */
+
+void irmo_string_table_write(IrmoClient *client, IrmoSendAtom *atom,
+                             IrmoPacket *packet, char *s);
+
+/*!
+ * Get the largest number of bytes that @ref irmo_string_table_write
+ * can use to write a string.
+ *
+ * @param s              The string.
+ * @return               Length in bytes.
+ */
+
+size_t irmo_string_table_length(char *s);
+
+/*!
+ * Check that a string written by @ref irmo_string_table_write can be
+ * read from a packet.
+ *
+ * @param client         The client the packet was received from.
+ * @param packet         The packet.
+ * @return               Non-zero if the string can be read.
+ */
+
+int irmo_string_table_verify(IrmoClient *client, IrmoPacket *packet);
+
+/*!
+ * Read a string written by @ref irmo_string_table_write.  The string
+ * should have been checked with @ref irmo_string_table_verify.
+ *
+ * @param client         The client the packet was received from.
+ * @param packet         The packet.
+ * @return               A newly allocated copy of the string.
+ */
+
+char *irmo_string_table_read(IrmoClient *client, IrmoPacket *packet);
+
+/*!
+ * Confirm the entries defined by an atom, because it has been
+ * acknowledged.
+ *
+ * @param atom           The atom.
+ */
+
+void irmo_string_table_acked(IrmoSendAtom *atom);
+
+#endif /* #ifndef IRMO_NET_STRING_TABLE_H */
+
@@ -0,0 +1,307 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+
+//
+// Hierarchical timer wheel.
+//
+// Each level of the wheel is an array of slots, each holding a list
+// of timers.  A timer is placed in the lowest level in which it is
+// less than one revolution away.  Whenever the lowest level completes
+// a revolution, the timers in the next slot of the level above are
+// "cascaded" down into the lower levels.
+//
+
+#include "arch/sysheaders.h"
+
+#include "timer-wheel.h"
+
+#define SLOT_MASK (IRMO_TIMER_WHEEL_SLOTS - 1)
+
+// Compare times, allowing for wraparound.
+
+static int compare_times(unsigned int time1, unsigned int time2)
+{
+        return (int) (time1 - time2);
+}
+
+// Insert a timer into the appropriate slot of the wheel.
+
+static void insert_timer(IrmoTimerWheel *wheel, IrmoTimer *timer)
+{
+        IrmoTimer **slot;
+        unsigned int delta;
+        unsigned int distance;
+        unsigned int level;
+        unsigned int shift;
+
+        // Timers that have already expired go in the next slot
+        // to be processed.
+
+        if (compare_times(timer->expires, wheel->now) < 0) {
+                delta = 0;
+        } else {
+                delta = timer->expires - wheel->now;
+        }
+
+        // Find the lowest level in which the timer is less than one
+        // revolution away.  Timers too far away for the top level go
+        // in its furthest slot, and are cascaded down again later.
+
+        for (level=0; ; ++level) {
+                shift = level * IRMO_TIMER_WHEEL_BITS;
+                distance = ((wheel->now & ((1U << shift) - 1)) + delta)
+                           >> shift;
+
+                if (distance < IRMO_TIMER_WHEEL_SLOTS) {
+                        break;
+                }
+
+                if (level == IRMO_TIMER_WHEEL_LEVELS - 1) {
+                        distance = IRMO_TIMER_WHEEL_SLOTS - 1;
+                        break;
+                }
+        }
+
+        timer->pending = 1;
+        timer->level = level;
+        timer->slot = ((wheel->now >> shift) + distance) & SLOT_MASK;
+
+        slot = &wheel->slots[level][timer->slot];
+
+        timer->prev = NULL;
+        timer->next = *slot;
+
+        if (*slot != NULL) {
+                (*slot)->prev = timer;
+        }
+
+        *slot = timer;
+
+        ++wheel->counts[level];
+}
+
+// Remove a timer from the slot that it is in.
+
+static void unlink_timer(IrmoTimerWheel *wheel, IrmoTimer *timer)
+{
+        if (timer->prev != NULL) {
+                timer->prev->next = timer->next;
+        } else {
+                wheel->slots[timer->level][timer->slot] = timer->next;
+        }
+
+        if (timer->next != NULL) {
+                timer->next->prev = timer->prev;
+        }
+
+        timer->prev = NULL;
+        timer->next = NULL;
+        timer->pending = 0;
+        --wheel->counts[timer->level];
+}
+
+void irmo_timer_wheel_init(IrmoTimerWheel *wheel, unsigned int now)
+{
+        memset(wheel, 0, sizeof(IrmoTimerWheel));
+
+        wheel->now = now;
+}
+
+void irmo_timer_init(IrmoTimer *timer, IrmoTimerCallback callback,
+                     void *user_data)
+{
+        memset(timer, 0, sizeof(IrmoTimer));
+
+        timer->callback = callback;
+        timer->user_data = user_data;
+}
+
+void irmo_timer_wheel_remove(IrmoTimerWheel *wheel, IrmoTimer *timer)
+{
+        if (timer->pending) {
+                unlink_timer(wheel, timer);
+        }
+}
+
+void irmo_timer_wheel_add(IrmoTimerWheel *wheel, IrmoTimer *timer,
+                          unsigned int expires)
+{
+        irmo_timer_wheel_remove(wheel, timer);
+
+        timer->expires = expires;
+
+        insert_timer(wheel, timer);
+}
+
+// Move the timers in the current slot of each level above the lowest
+// level down into the lower levels.  This is done each time the
+// lowest level completes a revolution.
+
+static void cascade(IrmoTimerWheel *wheel)
+{
+        IrmoTimer *timer;
+        unsigned int level;
+        unsigned int slot;
+
+        for (level=1; level<IRMO_TIMER_WHEEL_LEVELS; ++level) {
+                slot = (wheel->now >> (level * IRMO_TIMER_WHEEL_BITS))
+                     & SLOT_MASK;
+
+                while (wheel->slots[level][slot] != NULL) {
+                        timer = wheel->slots[level][slot];
+                        unlink_timer(wheel, timer);
+                        insert_timer(wheel, timer);
+                }
+
+                // Only continue to the next level if this level has
+                // also completed a revolution.
+
+                if (slot != 0) {
+                        break;
+                }
+        }
+}
+
+// Invoke the timers in the current slot of the lowest level.
+
+static void run_slot(IrmoTimerWheel *wheel)
+{
+        IrmoTimer *timer;
+        unsigned int slot;
+
+        slot = wheel->now & SLOT_MASK;
+
+        while (wheel->slots[0][slot] != NULL) {
+                timer = wheel->slots[0][slot];
+                unlink_timer(wheel, timer);
+
+                // Timers too far away for the top level are placed
+                // early, and must be put back.
+
+                if (compare_times(timer->expires, wheel->now) > 0) {
+                        insert_timer(wheel, timer);
+                        continue;
+                }
+
+                timer->callback(timer, timer->user_data);
+        }
+}
+
+// Returns the total number of timers in a wheel.
+
+static unsigned int num_timers(IrmoTimerWheel *wheel)
+{
+        unsigned int result;
+        unsigned int level;
+
+        result = 0;
+
+        for (level=0; level<IRMO_TIMER_WHEEL_LEVELS; ++level) {
+                result += wheel->counts[level];
+        }
+
+        return result;
+}
+
+void irmo_timer_wheel_advance(IrmoTimerWheel *wheel, unsigned int now)
+{
+        unsigned int next;
+
+        while (compare_times(wheel->now, now) <= 0) {
+
+                // If the wheel is empty, there is nothing to do.
+
+                if (num_timers(wheel) == 0) {
+                        wheel->now = now + 1;
+                        break;
+                }
+
+                // If the lowest level is empty, skip straight to the end
+                // of its revolution.
+
+                if (wheel->counts[0] == 0 && (wheel->now & SLOT_MASK) != 0) {
+                        next = (wheel->now | SLOT_MASK) + 1;
+
+                        if (compare_times(next, now) > 0) {
+                                wheel->now = now + 1;
+                                break;
+                        }
+
+                        wheel->now = next;
+                        continue;
+                }
+
+                if ((wheel->now & SLOT_MASK) == 0) {
+                        cascade(wheel);
+                }
+
+                run_slot(wheel);
+
+                ++wheel->now;
+        }
+}
+
+int irmo_timer_wheel_next_expiry(IrmoTimerWheel *wheel, unsigned int *when)
+{
+        IrmoTimer *timer;
+        unsigned int level;
+        unsigned int start;
+        unsigned int slot;
+        unsigned int i;
+        int result;
+
+        result = 0;
+
+        // The slots in each level are in order of expiry time,
+        // starting from the current slot.  The first timer to expire
+        // in each level is in the first slot that is not empty;
+        // timers are not ordered within a slot in the upper levels,
+        // so the whole slot is checked.
+
+        for (level=0; level<IRMO_TIMER_WHEEL_LEVELS; ++level) {
+
+                if (wheel->counts[level] == 0) {
+                        continue;
+                }
+
+                start = wheel->now >> (level * IRMO_TIMER_WHEEL_BITS);
+
+                for (i=0; i<IRMO_TIMER_WHEEL_SLOTS; ++i) {
+                        slot = (start + i) & SLOT_MASK;
+
+                        if (wheel->slots[level][slot] != NULL) {
+                                break;
+                        }
+                }
+
+                for (timer = wheel->slots[level][slot];
+                     timer != NULL;
+                     timer = timer->next) {
+                        if (!result
+                         || compare_times(timer->expires, *when) < 0) {
+                                *when = timer->expires;
+                                result = 1;
+                        }
+                }
+        }
+
+        return result;
+}
+
@@ -0,0 +1,157 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+
+#ifndef IRMO_NET_TIMER_WHEEL_H
+#define IRMO_NET_TIMER_WHEEL_H
+
+typedef struct _IrmoTimer IrmoTimer;
+typedef struct _IrmoTimerWheel IrmoTimerWheel;
+
+typedef void (*IrmoTimerCallback)(IrmoTimer *timer, void *user_data);
+
+// Each level of the wheel has 2^IRMO_TIMER_WHEEL_BITS slots.  Level 0
+// has one slot per millisecond; each slot in the level above covers
+// a whole revolution of the level below.
+
+#define IRMO_TIMER_WHEEL_BITS 6
+#define IRMO_TIMER_WHEEL_SLOTS (1 << IRMO_TIMER_WHEEL_BITS)
+#define IRMO_TIMER_WHEEL_LEVELS 4
+
+//
+// A timer.  This is embedded in the structure that owns it, so
+// that adding and removing timers never allocates memory.
+//
+
+struct _IrmoTimer {
+
+        // Links in the list of timers in the same slot.
+
+        IrmoTimer *prev;
+        IrmoTimer *next;
+
+        // Time at which the timer expires, in milliseconds.
+
+        unsigned int expires;
+
+        // Non-zero if the timer is in a wheel, and the slot of the
+        // wheel that it is in.
+
+        int pending;
+        unsigned int level;
+        unsigned int slot;
+
+        // Function to invoke when the timer expires.
+
+        IrmoTimerCallback callback;
+        void *user_data;
+};
+
+//
+// A hierarchical timer wheel.  Adding and removing a timer takes
+// constant time, and advancing the wheel only touches the slots
+// that have passed, so the cost of running the wheel depends on the
+// number of timers that expire, not the number of timers waiting.
+//
+
+struct _IrmoTimerWheel {
+
+        // The next millisecond to be processed.
+
+        unsigned int now;
+
+        // Number of timers in each level.
+
+        unsigned int counts[IRMO_TIMER_WHEEL_LEVELS];
+
+        // Lists of timers in each slot.
+
+        IrmoTimer *slots[IRMO_TIMER_WHEEL_LEVELS][IRMO_TIMER_WHEEL_SLOTS];
+};
+
+/*!
+ * Initialise a timer wheel.
+ *
+ * @param wheel          The timer wheel.
+ * @param now            The current time, in milliseconds.
+ */
+
+void irmo_timer_wheel_init(IrmoTimerWheel *wheel, unsigned int now);
+
+/*!
+ * Initialise a timer.
+ *
+ * @param timer          The timer.
+ * @param callback       Function to invoke when the timer expires.
+ * @param user_data      Extra data to pass to the callback function.
+ */
+
+void irmo_timer_init(IrmoTimer *timer, IrmoTimerCallback callback,
+                     void *user_data);
+
+/*!
+ * Add a timer to a timer wheel.  If the timer is already in the
+ * wheel, it is rescheduled.
+ *
+ * @param wheel          The timer wheel.
+ * @param timer          The timer.
+ * @param expires        Time at which the timer expires, in
+ *                       milliseconds.  Timers that have already
+ *                       expired are invoked on the next call to
+ *                       @ref irmo_timer_wheel_advance.
+ */
+
+void irmo_timer_wheel_add(IrmoTimerWheel *wheel, IrmoTimer *timer,
+                          unsigned int expires);
+
+/*!
+ * Remove a timer from a timer wheel.  It is safe to call this for
+ * a timer that is not in the wheel.
+ *
+ * @param wheel          The timer wheel.
+ * @param timer          The timer.
+ */
+
+void irmo_timer_wheel_remove(IrmoTimerWheel *wheel, IrmoTimer *timer);
+
+/*!
+ * Advance a timer wheel to the current time, invoking the callback
+ * functions of all timers that have expired.  Callback functions may
+ * add and remove timers.
+ *
+ * @param wheel          The timer wheel.
+ * @param now            The current time, in milliseconds.
+ */
+
+void irmo_timer_wheel_advance(IrmoTimerWheel *wheel, unsigned int now);
+
+/*!
+ * Find when the next timer in a timer wheel will expire.
+ *
+ * @param wheel          The timer wheel.
+ * @param when           Pointer to a variable to store the expiry
+ *                       time of the first timer to expire.
+ * @return               Non-zero if a timer was found, or zero if
+ *                       the wheel is empty.
+ */
+
+int irmo_timer_wheel_next_expiry(IrmoTimerWheel *wheel, unsigned int *when);
+
+#endif /* #ifndef IRMO_NET_TIMER_WHEEL_H */
+
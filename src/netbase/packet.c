@@ -27,6 +27,12 @@
 
 #include <irmo/packet.h>
 
+typedef enum {
+        BIT_MODE_NONE,
+        BIT_MODE_WRITE,
+        BIT_MODE_READ,
+} IrmoPacketBitMode;
+
 struct _IrmoPacket {
         // Packet data
 	uint8_t *data;
@@ -43,6 +49,18 @@ struct _IrmoPacket {
 
         // Current position in packet
 	size_t pos;
+
+        // If true, integer values are written in the compact format.
+        int compact;
+
+        // Bit stream state: whether bits are being written or read,
+        // and the bits waiting to be written to the buffer, or read
+        // from it but not yet returned.  Bits are stored from the
+        // least significant end.
+
+        IrmoPacketBitMode bit_mode;
+        uint64_t bits;
+        unsigned int num_bits;
 };
 
 IrmoPacket *irmo_packet_new(void)
@@ -100,11 +118,57 @@ static void irmo_packet_update_len(IrmoPacket *packet)
 		packet->len = packet->pos;
 }
 
+// Write out the lowest bytes of the bit stream buffer.
+
+static void irmo_packet_emit_bits(IrmoPacket *packet, unsigned int nbytes)
+{
+        unsigned int i;
+
+	if (packet->pos + nbytes > packet->data_size) {
+		irmo_packet_resize(packet);
+        }
+
+        for (i=0; i<nbytes; ++i) {
+                packet->data[packet->pos++] = (uint8_t) packet->bits;
+                packet->bits >>= 8;
+        }
+
+	irmo_packet_update_len(packet);
+}
+
+// Finish bit-level access, moving the position to the start of the
+// next whole byte.
+
+static void irmo_packet_end_bits(IrmoPacket *packet)
+{
+        if (packet->bit_mode == BIT_MODE_NONE) {
+                return;
+        } else if (packet->bit_mode == BIT_MODE_WRITE) {
+
+                // Write out any remaining bits, padded with zeros.
+
+                irmo_packet_emit_bits(packet, (packet->num_bits + 7) / 8);
+
+        } else if (packet->bit_mode == BIT_MODE_READ) {
+
+                // Whole bytes in the buffer have not been read yet.
+                // Any bits left of a partly read byte are skipped.
+
+                packet->pos -= packet->num_bits / 8;
+        }
+
+        packet->bit_mode = BIT_MODE_NONE;
+        packet->bits = 0;
+        packet->num_bits = 0;
+}
+
 int irmo_packet_writei8(IrmoPacket *packet, unsigned int i)
 {
         irmo_return_val_if_fail(packet != NULL, 0);
         irmo_return_val_if_fail(packet->data_owned, 0);
 
+        irmo_packet_end_bits(packet);
+
 	if (packet->pos + 1 > packet->data_size)
 		irmo_packet_resize(packet);
 	
@@ -120,6 +184,8 @@ int irmo_packet_writei16(IrmoPacket *packet, unsigned int i)
         irmo_return_val_if_fail(packet != NULL, 0);
         irmo_return_val_if_fail(packet->data_owned, 0);
 
+        irmo_packet_end_bits(packet);
+
 	if (packet->pos + 2 > packet->data_size) {
 		irmo_packet_resize(packet);
         }
@@ -137,6 +203,8 @@ int irmo_packet_writei32(IrmoPacket *packet, unsigned int i)
         irmo_return_val_if_fail(packet != NULL, 0);
         irmo_return_val_if_fail(packet->data_owned, 0);
 
+        irmo_packet_end_bits(packet);
+
 	if (packet->pos + 4 > packet->data_size) {
 		irmo_packet_resize(packet);
         }
@@ -156,6 +224,8 @@ int irmo_packet_writestring(IrmoPacket *packet, char *s)
         irmo_return_val_if_fail(packet != NULL, 0);
         irmo_return_val_if_fail(packet->data_owned, 0);
 
+        irmo_packet_end_bits(packet);
+
 	if (packet->pos + strlen(s) + 1 > packet->data_size) {
 		irmo_packet_resize(packet);
         }
@@ -168,10 +238,98 @@ int irmo_packet_writestring(IrmoPacket *packet, char *s)
 	return 1;
 }
 
+int irmo_packet_writebytes(IrmoPacket *packet, uint8_t *data,
+                           unsigned int data_len)
+{
+        irmo_return_val_if_fail(packet != NULL, 0);
+        irmo_return_val_if_fail(packet->data_owned, 0);
+
+        irmo_packet_end_bits(packet);
+
+	while (packet->pos + data_len > packet->data_size) {
+		irmo_packet_resize(packet);
+        }
+
+	memcpy(packet->data + packet->pos, data, data_len);
+	packet->pos += data_len;
+
+	irmo_packet_update_len(packet);
+
+	return 1;
+}
+
+int irmo_packet_writevarint(IrmoPacket *packet, unsigned int i)
+{
+        irmo_return_val_if_fail(packet != NULL, 0);
+        irmo_return_val_if_fail(packet->data_owned, 0);
+
+        irmo_packet_end_bits(packet);
+
+	if (packet->pos + 5 > packet->data_size) {
+		irmo_packet_resize(packet);
+        }
+
+        // Seven bits at a time, low bits first.  The top bit of each
+        // byte is set if more bytes follow.
+
+        while (i >= 0x80) {
+                packet->data[packet->pos++] = (uint8_t) ((i & 0x7f) | 0x80);
+                i >>= 7;
+        }
+
+        packet->data[packet->pos++] = (uint8_t) i;
+
+	irmo_packet_update_len(packet);
+
+	return 1;
+}
+
+int irmo_packet_writei16v(IrmoPacket *packet, unsigned int i)
+{
+        irmo_return_val_if_fail(packet != NULL, 0);
+
+        if (packet->compact) {
+                return irmo_packet_writevarint(packet, i & 0xffff);
+        } else {
+                return irmo_packet_writei16(packet, i);
+        }
+}
+
+int irmo_packet_write_bits(IrmoPacket *packet, unsigned int value,
+                           unsigned int num_bits)
+{
+        irmo_return_val_if_fail(packet != NULL, 0);
+        irmo_return_val_if_fail(packet->data_owned, 0);
+        irmo_return_val_if_fail(num_bits <= 32, 0);
+
+        if (packet->bit_mode != BIT_MODE_WRITE) {
+                irmo_packet_end_bits(packet);
+                packet->bit_mode = BIT_MODE_WRITE;
+        }
+
+        if (num_bits < 32) {
+                value &= (1U << num_bits) - 1;
+        }
+
+        packet->bits |= ((uint64_t) value) << packet->num_bits;
+        packet->num_bits += num_bits;
+
+        // Once a whole word has been built up, write it out.
+
+        if (packet->num_bits >= 32) {
+                irmo_packet_emit_bits(packet, 4);
+                packet->num_bits -= 32;
+        }
+
+	return 1;
+}
+
 int irmo_packet_readi8(IrmoPacket *packet, unsigned int *i)
 {
         irmo_return_val_if_fail(packet != NULL, 0);
 
+        irmo_packet_end_bits(packet);
+
 	if (packet->pos + 1 > packet->len) {
 		return 0;
         }
@@ -191,6 +349,8 @@ int irmo_packet_readi16(IrmoPacket *packet, unsigned int *i)
 	
         irmo_return_val_if_fail(packet != NULL, 0);
 
+        irmo_packet_end_bits(packet);
+
 	if (packet->pos + 2 > packet->len) {
 		return 0;
         }
@@ -213,6 +373,8 @@ int irmo_packet_readi32(IrmoPacket *packet, unsigned int *i)
 
         irmo_return_val_if_fail(packet != NULL, 0);
 
+        irmo_packet_end_bits(packet);
+
 	if (packet->pos + 4 > packet->len) {
 		return 0;
         }
@@ -231,12 +393,128 @@ int irmo_packet_readi32(IrmoPacket *packet, unsigned int *i)
 	return 1;
 }
 
+int irmo_packet_read_bits(IrmoPacket *packet, unsigned int *value,
+                          unsigned int num_bits)
+{
+        irmo_return_val_if_fail(packet != NULL, 0);
+        irmo_return_val_if_fail(num_bits <= 32, 0);
+
+        if (packet->bit_mode != BIT_MODE_READ) {
+                irmo_packet_end_bits(packet);
+                packet->bit_mode = BIT_MODE_READ;
+        }
+
+        // Fill the buffer with as many bytes as will fit.
+
+        if (packet->num_bits < num_bits) {
+                while (packet->num_bits <= 56 && packet->pos < packet->len) {
+                        packet->bits |= ((uint64_t) packet->data[packet->pos])
+                                     << packet->num_bits;
+                        ++packet->pos;
+                        packet->num_bits += 8;
+                }
+
+                if (packet->num_bits < num_bits) {
+                        return 0;
+                }
+        }
+
+        if (value != NULL) {
+                *value = (unsigned int) (packet->bits
+                                      & ((((uint64_t) 1) << num_bits) - 1));
+        }
+
+        packet->bits >>= num_bits;
+        packet->num_bits -= num_bits;
+
+        return 1;
+}
+
+int irmo_packet_readvarint(IrmoPacket *packet, unsigned int *i)
+{
+        unsigned int result;
+        unsigned int shift;
+        size_t pos;
+        uint8_t b;
+
+        irmo_return_val_if_fail(packet != NULL, 0);
+
+        irmo_packet_end_bits(packet);
+
+        result = 0;
+        pos = packet->pos;
+
+        for (shift=0; ; shift += 7) {
+                if (pos + 1 > packet->len) {
+                        return 0;
+                }
+
+                b = packet->data[pos++];
+
+                // The fifth byte holds the top four bits of a 32-bit
+                // value, and must be the last.
+
+                if (shift == 28 && b > 0x0f) {
+                        return 0;
+                }
+
+                result |= ((unsigned int) (b & 0x7f)) << shift;
+
+                if ((b & 0x80) == 0) {
+                        break;
+                }
+        }
+
+        if (i != NULL) {
+                *i = result;
+        }
+
+        packet->pos = pos;
+
+        return 1;
+}
+
+int irmo_packet_readi16v(IrmoPacket *packet, unsigned int *i)
+{
+        unsigned int result;
+        size_t pos;
+
+        irmo_return_val_if_fail(packet != NULL, 0);
+
+        irmo_packet_end_bits(packet);
+
+        if (!packet->compact) {
+                return irmo_packet_readi16(packet, i);
+        }
+
+        pos = packet->pos;
+
+        if (!irmo_packet_readvarint(packet, &result)) {
+                return 0;
+        }
+
+        if (result > 0xffff) {
+                packet->pos = pos;
+                return 0;
+        }
+
+        if (i != NULL) {
+                *i = result;
+        }
+
+        return 1;
+}
+
 char *irmo_packet_readstring(IrmoPacket *packet)
 {
-	uint8_t *start = packet->data + packet->pos;
+	uint8_t *start;
 
         irmo_return_val_if_fail(packet != NULL, NULL);
 
+        irmo_packet_end_bits(packet);
+
+        start = packet->data + packet->pos;
+
 	for (; packet->pos < packet->len; ++packet->pos) {
 		if (packet->data[packet->pos] == '\0') {
 			// skip past the terminating 0
@@ -252,6 +530,86 @@ char *irmo_packet_readstring(IrmoPacket *packet)
 	return NULL;
 }
 
+// Integer values are zigzag encoded in the compact format, so that
+// small negative values are as short as small positive ones.  Values
+// narrower than 32 bits are sign extended first.
+
+static unsigned int zigzag_encode(unsigned int i, IrmoValueType type)
+{
+        if (type == IRMO_TYPE_INT16) {
+                i &= 0xffff;
+
+                if ((i & 0x8000) != 0) {
+                        i |= 0xffff0000;
+                }
+        }
+
+        return (i << 1) ^ (0U - (i >> 31));
+}
+
+static unsigned int zigzag_decode(unsigned int i, IrmoValueType type)
+{
+        i = (i >> 1) ^ (0U - (i & 1));
+
+        if (type == IRMO_TYPE_INT16) {
+                i &= 0xffff;
+        }
+
+        return i;
+}
+
+// Read an integer value in the compact format.
+
+static int read_compact_int(IrmoPacket *packet, unsigned int *i,
+                            IrmoValueType type)
+{
+        unsigned int zigzag;
+        size_t pos;
+
+        irmo_packet_end_bits(packet);
+
+        pos = packet->pos;
+
+        if (!irmo_packet_readvarint(packet, &zigzag)) {
+                return 0;
+        }
+
+        // A 16-bit value encodes to at most 17 bits.
+
+        if (type == IRMO_TYPE_INT16 && zigzag > 0x1ffff) {
+                packet->pos = pos;
+                return 0;
+        }
+
+        if (i != NULL) {
+                *i = zigzag_decode(zigzag, type);
+        }
+
+        return 1;
+}
+
+// Floating point values are sent as the bits of their IEEE 754
+// representation.
+
+static unsigned int float_to_bits(float f)
+{
+        uint32_t i;
+
+        memcpy(&i, &f, sizeof(i));
+
+        return i;
+}
+
+static float bits_to_float(unsigned int i)
+{
+        uint32_t bits = i;
+        float f;
+
+        memcpy(&f, &bits, sizeof(f));
+
+        return f;
+}
+
 int irmo_packet_verify_value(IrmoPacket *packet,
                              IrmoValueType type)
 {
@@ -261,11 +619,19 @@ int irmo_packet_verify_value(IrmoPacket *packet,
 	case IRMO_TYPE_INT8:
 		return irmo_packet_readi8(packet, NULL);
 	case IRMO_TYPE_INT16:
+                if (packet->compact) {
+                        return read_compact_int(packet, NULL, type);
+                }
 		return irmo_packet_readi16(packet, NULL);
 	case IRMO_TYPE_INT32:
+                if (packet->compact) {
+                        return read_compact_int(packet, NULL, type);
+                }
 		return irmo_packet_readi32(packet, NULL);
 	case IRMO_TYPE_STRING:
 		return irmo_packet_readstring(packet) != NULL;
+	case IRMO_TYPE_FLOAT32:
+		return irmo_packet_readi32(packet, NULL);
         default:
                 irmo_bug();
                 return 0;
@@ -276,6 +642,7 @@ int irmo_packet_read_value(IrmoPacket *packet, IrmoValue *value,
                            IrmoValueType type)
 {
         char *strvalue;
+        unsigned int bits;
 
         irmo_return_val_if_fail(packet != NULL, 0);
 
@@ -283,8 +650,14 @@ int irmo_packet_read_value(IrmoPacket *packet, IrmoValue *value,
 	case IRMO_TYPE_INT8:
 		return irmo_packet_readi8(packet, &value->i);
 	case IRMO_TYPE_INT16:
+                if (packet->compact) {
+                        return read_compact_int(packet, &value->i, type);
+                }
 		return irmo_packet_readi16(packet, &value->i);
 	case IRMO_TYPE_INT32:
+                if (packet->compact) {
+                        return read_compact_int(packet, &value->i, type);
+                }
 		return irmo_packet_readi32(packet, &value->i);
 	case IRMO_TYPE_STRING:
                 strvalue = irmo_packet_readstring(packet);
@@ -294,6 +667,12 @@ int irmo_packet_read_value(IrmoPacket *packet, IrmoValue *value,
                         value->s = strdup(strvalue);
                         return 1;
                 }
+	case IRMO_TYPE_FLOAT32:
+		if (!irmo_packet_readi32(packet, &bits)) {
+			return 0;
+		}
+		value->f = bits_to_float(bits);
+		return 1;
         default:
                 irmo_bug();
 	}
@@ -311,23 +690,220 @@ void irmo_packet_write_value(IrmoPacket *packet, IrmoValue *value,
 		irmo_packet_writei8(packet, value->i);
 		break;
 	case IRMO_TYPE_INT16:
-		irmo_packet_writei16(packet, value->i);
+                if (packet->compact) {
+                        irmo_packet_writevarint(packet,
+                                                zigzag_encode(value->i, type));
+                } else {
+		        irmo_packet_writei16(packet, value->i);
+                }
 		break;
 	case IRMO_TYPE_INT32:
-		irmo_packet_writei32(packet, value->i);
+                if (packet->compact) {
+                        irmo_packet_writevarint(packet,
+                                                zigzag_encode(value->i, type));
+                } else {
+		        irmo_packet_writei32(packet, value->i);
+                }
 		break;
 	case IRMO_TYPE_STRING:
 		irmo_packet_writestring(packet, value->s);
 		break;
+	case IRMO_TYPE_FLOAT32:
+		irmo_packet_writei32(packet, float_to_bits(value->f));
+		break;
+        default:
+                irmo_bug();
+	}
+}
+
+void irmo_packet_align_bits(IrmoPacket *packet)
+{
+        irmo_return_if_fail(packet != NULL);
+
+        irmo_packet_end_bits(packet);
+}
+
+// Quantized values are sent as a number of evenly spaced steps above
+// the minimum.  Get the number of steps across a range, so that steps
+// are no further apart than the precision.  A little leeway is
+// allowed for rounding errors, so that a range of 0 to 1 with a
+// precision of 0.1 has ten steps rather than eleven.
+
+static unsigned int quantized_steps(IrmoValueRange *range)
+{
+        unsigned int result;
+        double steps;
+
+        steps = ((double) range->max - range->min) / range->precision;
+        steps *= 1.0 - 1e-6;
+
+        if (!(steps > 0)) {
+                return 0;
+        } else if (steps >= 4294967295.0) {
+                return 0xffffffff;
+        }
+
+        result = (unsigned int) steps;
+
+        if (result < steps) {
+                ++result;
+        }
+
+        return result;
+}
+
+// Get the nearest step to the given value.
+
+static unsigned int quantized_step(IrmoValueRange *range, float value)
+{
+        unsigned int steps;
+        double step;
+
+        steps = quantized_steps(range);
+        step = ((double) value - range->min)
+             / ((double) range->max - range->min) * steps + 0.5;
+
+        if (!(step > 0)) {
+                return 0;
+        } else if (step >= steps) {
+                return steps;
+        } else {
+                return (unsigned int) step;
+        }
+}
+
+static float quantized_value(IrmoValueRange *range, unsigned int step)
+{
+        unsigned int steps;
+
+        steps = quantized_steps(range);
+
+        if (steps == 0) {
+                return range->min;
+        }
+
+        return (float) (range->min
+                      + ((double) range->max - range->min) * step / steps);
+}
+
+float irmo_packet_quantize(IrmoValueRange *range, float value)
+{
+        irmo_return_val_if_fail(range != NULL, value);
+
+        return quantized_value(range, quantized_step(range, value));
+}
+
+unsigned int irmo_packet_quantized_bits(IrmoValueRange *range)
+{
+        unsigned int steps;
+        unsigned int bits;
+
+        irmo_return_val_if_fail(range != NULL, 0);
+
+        steps = quantized_steps(range);
+
+        for (bits=0; bits < 32 && (steps >> bits) != 0; ++bits);
+
+        return bits;
+}
+
+void irmo_packet_write_quantized(IrmoPacket *packet, float value,
+                                 IrmoValueRange *range)
+{
+        irmo_return_if_fail(packet != NULL);
+        irmo_return_if_fail(range != NULL);
+
+        irmo_packet_write_bits(packet, quantized_step(range, value),
+                               irmo_packet_quantized_bits(range));
+}
+
+int irmo_packet_read_quantized(IrmoPacket *packet, float *value,
+                               IrmoValueRange *range)
+{
+        unsigned int step;
+
+        irmo_return_val_if_fail(packet != NULL, 0);
+        irmo_return_val_if_fail(range != NULL, 0);
+
+        if (!irmo_packet_read_bits(packet, &step,
+                                   irmo_packet_quantized_bits(range))) {
+                return 0;
+        }
+
+        // The number of steps may not fill the bits it is sent in.
+
+        if (step > quantized_steps(range)) {
+                return 0;
+        }
+
+        if (value != NULL) {
+                *value = quantized_value(range, step);
+        }
+
+        return 1;
+}
+
+unsigned int irmo_packet_varint_length(unsigned int i)
+{
+        unsigned int result;
+
+        for (result=1; i >= 0x80; ++result) {
+                i >>= 7;
+        }
+
+        return result;
+}
+
+unsigned int irmo_packet_value_length(IrmoValue *value, IrmoValueType type,
+                                      int compact)
+{
+        irmo_return_val_if_fail(value != NULL, 0);
+
+	switch (type) {
+	case IRMO_TYPE_INT8:
+		return 1;
+	case IRMO_TYPE_INT16:
+                if (compact) {
+                        return irmo_packet_varint_length(
+                                        zigzag_encode(value->i, type));
+                }
+		return 2;
+	case IRMO_TYPE_INT32:
+                if (compact) {
+                        return irmo_packet_varint_length(
+                                        zigzag_encode(value->i, type));
+                }
+		return 4;
+	case IRMO_TYPE_STRING:
+		return (unsigned int) strlen(value->s) + 1;
+	case IRMO_TYPE_FLOAT32:
+		return 4;
         default:
                 irmo_bug();
+                return 0;
 	}
 }
 
+void irmo_packet_set_compact(IrmoPacket *packet, int compact)
+{
+        irmo_return_if_fail(packet != NULL);
+
+        packet->compact = compact;
+}
+
+int irmo_packet_is_compact(IrmoPacket *packet)
+{
+        irmo_return_val_if_fail(packet != NULL, 0);
+
+        return packet->compact;
+}
+
 unsigned char *irmo_packet_get_buffer(IrmoPacket *packet)
 {
         irmo_return_val_if_fail(packet != NULL, NULL);
 
+        irmo_packet_end_bits(packet);
+
         return packet->data;
 }
 
@@ -335,6 +911,8 @@ unsigned int irmo_packet_get_length(IrmoPacket *packet)
 {
         irmo_return_val_if_fail(packet != NULL, 0);
 
+        irmo_packet_end_bits(packet);
+
         return (unsigned int) packet->len;
 }
 
@@ -342,6 +920,8 @@ unsigned int irmo_packet_get_position(IrmoPacket *packet)
 {
         irmo_return_val_if_fail(packet != NULL, 0);
 
+        irmo_packet_end_bits(packet);
+
         return (unsigned int) packet->pos;
 }
 
@@ -350,6 +930,8 @@ int irmo_packet_set_position(IrmoPacket *packet, unsigned int pos)
         irmo_return_val_if_fail(packet != NULL, 0);
         irmo_return_val_if_fail(pos <= packet->len, 0);
 
+        irmo_packet_end_bits(packet);
+
         packet->pos = pos;
 
         return 1;
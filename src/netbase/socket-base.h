@@ -42,7 +42,11 @@
 
 #endif
 
-#define RECV_BUFFER_SIZE 2048
+// Size of the buffer that packets are received into.  This is large
+// enough for any UDP datagram, so that packets are never truncated,
+// whatever packet size has been negotiated.
+
+#define RECV_BUFFER_SIZE 65536
 
 /*!
  * Implementation of a @ref IrmoNetSocket structure, for sockets-based
@@ -21,6 +21,8 @@
 #include "base/alloc.h"
 #include "base/assert.h"
 
+#include <irmo/packet.h>
+
 #include "interface/interface.h"
 
 #include "binding.h"
@@ -67,6 +69,24 @@ static void update_var_from_member(IrmoObject *obj,
 
                 break;
 
+        case IRMO_TYPE_FLOAT32:
+        case IRMO_TYPE_QUANTIZED:
+                new_value.f = irmo_struct_member_get_float(member,
+                                                           obj->binding);
+
+                // Quantized values are compared once rounded, so that
+                // small movements within the precision are ignored.
+
+                if (class_var->type == IRMO_TYPE_QUANTIZED) {
+                        new_value.f = irmo_packet_quantize(&class_var->range,
+                                                           new_value.f);
+                }
+
+                if (new_value.i == variable->i) {
+                        return;
+                }
+                break;
+
         default:
                 irmo_bug();
         }
@@ -183,6 +203,13 @@ void irmo_object_update_binding(IrmoObject *obj, IrmoClassVar *class_var)
                                               variable->s);
                 break;
 
+        case IRMO_TYPE_FLOAT32:
+        case IRMO_TYPE_QUANTIZED:
+                irmo_struct_member_set_float(class_var->member,
+                                             obj->binding,
+                                             variable->f);
+                break;
+
         default:
                 irmo_bug();
         }
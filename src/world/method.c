@@ -94,6 +94,8 @@ static int irmo_method_data_check(IrmoMethodData *data)
 		case IRMO_TYPE_STRING:
 			irmo_return_val_if_fail(value->s != NULL, 0);
 			break;
+		case IRMO_TYPE_FLOAT32:
+			break;
                 default:
                         irmo_return_val_if_fail(0, 0);
 		}
@@ -153,6 +155,9 @@ void irmo_world_method_call(IrmoWorld *world, char *method_name, ...)
 		case IRMO_TYPE_STRING:
 			args[i].s = va_arg(arglist, char *);
 			break;
+		case IRMO_TYPE_FLOAT32:
+			args[i].f = (float) va_arg(arglist, double);
+			break;
                 default:
                         irmo_bug();
                         break;
@@ -258,3 +263,30 @@ unsigned int irmo_method_arg_int(IrmoMethodData *data, char *argname)
 	}
 }
 
+float irmo_method_arg_float(IrmoMethodData *data, char *argname)
+{
+	IrmoMethodArg *arg;
+
+	irmo_return_val_if_fail(data != NULL, 0);
+	irmo_return_val_if_fail(argname != NULL, 0);
+
+	arg = irmo_method_get_argument(data->method, argname);
+
+	if (arg == NULL) {
+                irmo_warning_message("irmo_method_arg_float",
+                        "unknown method argument '%s' for '%s' method",
+                        data->method->name, argname);
+
+                return 0;
+	}
+
+	if (arg->type != IRMO_TYPE_FLOAT32) {
+                irmo_warning_message("irmo_method_arg_float",
+                        "'%s' argument for '%s' method is not a float type",
+                        argname, data->method->name);
+                return 0;
+	}
+
+	return data->args[arg->index].f;
+}
+
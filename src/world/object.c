@@ -26,6 +26,8 @@
 #include "base/assert.h"
 #include "base/error.h"
 
+#include <irmo/packet.h>
+
 #include "net/server-world.h"
 
 #include "binding.h"
@@ -84,10 +86,15 @@ IrmoObject *irmo_object_internal_new(IrmoWorld *world,
 
 	// int variables will be initialised to 0 by irmo_new0
 	// string values must be initialised to the empty string ("")
+	// quantized values are initialised to the nearest value to 0
 	
 	for (i=0; i<objclass->nvariables; ++i) {
 		if (objclass->variables[i]->type == IRMO_TYPE_STRING) {
 			object->variables[i].s = strdup("");
+                } else if (objclass->variables[i]->type
+                             == IRMO_TYPE_QUANTIZED) {
+                        object->variables[i].f = irmo_packet_quantize(
+                                        &objclass->variables[i]->range, 0);
                 }
         }
 	
@@ -149,6 +156,32 @@ IrmoObject *irmo_object_new(IrmoWorld *world, char *type_name)
 	return irmo_object_internal_new(world, klass, id);
 }
 
+// Free an object and its variables.
+
+static void free_object(IrmoObject *object)
+{
+	unsigned int i;
+
+	// destroy member variables
+
+	for (i=0; i<object->objclass->nvariables; ++i) {
+		if (object->objclass->variables[i]->type == IRMO_TYPE_STRING) {
+			free(object->variables[i].s);
+                }
+	}
+
+	free(object->variables);
+	irmo_object_callback_free(&object->callbacks, object->objclass);
+
+	// free variable time array
+
+        free(object->variable_time);
+
+	// done
+	
+	free(object);
+}
+
 // internal object destroy function
 
 void irmo_object_internal_destroy(IrmoObject *object,
@@ -183,25 +216,27 @@ void irmo_object_internal_destroy(IrmoObject *object,
 		irmo_hash_table_remove(object->world->objects,
 				       IRMO_POINTER_KEY(object->id));
 	}
-	
-	// destroy member variables
 
-	for (i=0; i<object->objclass->nvariables; ++i) {
-		if (object->objclass->variables[i]->type == IRMO_TYPE_STRING) {
-			free(object->variables[i].s);
-                }
-	}
+        // Servers may still need to refer to the object until they
+        // have brought their clients up to date.
 
-	free(object->variables);
-	irmo_object_callback_free(&object->callbacks, object->objclass);
+        if (object->journal_refs == 0) {
+                free_object(object);
+        }
+}
 
-	// free variable time array
+void irmo_object_internal_hold(IrmoObject *object)
+{
+        ++object->journal_refs;
+}
 
-        free(object->variable_time);
+void irmo_object_internal_release(IrmoObject *object)
+{
+        --object->journal_refs;
 
-	// done
-	
-	free(object);
+        if (object->journal_refs == 0) {
+                free_object(object);
+        }
 }
 
 void irmo_object_destroy(IrmoObject *object)
@@ -290,6 +325,13 @@ void irmo_object_internal_set(IrmoObject *object,
                 free(obj_value->s);
                 obj_value->s = strdup(value->s);
                 break;
+        case IRMO_TYPE_FLOAT32:
+                obj_value->f = value->f;
+                break;
+        case IRMO_TYPE_QUANTIZED:
+                obj_value->f = irmo_packet_quantize(&variable->range,
+                                                    value->f);
+                break;
         default:
                 irmo_bug();
         }
@@ -392,6 +434,38 @@ void irmo_object_set_string(IrmoObject *object, char *variable, char *value)
         irmo_object_set(object, var, &irmo_value);
 }
 
+void irmo_object_set_float(IrmoObject *object, char *variable, float value)
+{
+	IrmoClassVar *var;
+        IrmoValue irmo_value;
+
+	irmo_return_if_fail(object != NULL);
+	irmo_return_if_fail(variable != NULL);
+
+	var = irmo_class_get_variable(object->objclass, variable);
+
+	if (var == NULL) {
+                irmo_warning_message("irmo_object_set_float",
+                                     "unknown variable '%s' in class '%s'",
+                                     variable,
+                                     object->objclass->name);
+
+                return;
+	}
+
+	if (var->type != IRMO_TYPE_FLOAT32 && var->type != IRMO_TYPE_QUANTIZED) {
+                irmo_warning_message("irmo_object_set_float",
+                        "variable '%s' in class '%s' is not a float type",
+                        variable, object->objclass->name);
+                return;
+	}
+
+        // Set the new value
+
+        irmo_value.f = value;
+        irmo_object_set(object, var, &irmo_value);
+}
+
 void irmo_object_get(IrmoObject *object, IrmoClassVar *variable, 
                      IrmoValue *value)
 {
@@ -472,6 +546,36 @@ char *irmo_object_get_string(IrmoObject *object, char *variable)
 	return object->variables[var->index].s;
 }
 
+// get float value
+
+float irmo_object_get_float(IrmoObject *object, char *variable)
+{
+	IrmoClassVar *var;
+
+	irmo_return_val_if_fail(object != NULL, 0);
+	irmo_return_val_if_fail(variable != NULL, 0);
+
+	var = irmo_class_get_variable(object->objclass, variable);
+
+	if (var == NULL) {
+                irmo_warning_message("irmo_object_get_float",
+                                     "unknown variable '%s' in class '%s'",
+                                     variable,
+                                     object->objclass->name);
+
+                return 0;
+	}
+
+	if (var->type != IRMO_TYPE_FLOAT32 && var->type != IRMO_TYPE_QUANTIZED) {
+                irmo_warning_message("irmo_object_get_float",
+                        "variable '%s' in class '%s' is not a float type",
+                        variable, object->objclass->name);
+                return 0;
+	}
+
+	return object->variables[var->index].f;
+}
+
 IrmoWorld *irmo_object_get_world(IrmoObject *obj)
 {
 	irmo_return_val_if_fail(obj != NULL, NULL);
@@ -69,6 +69,13 @@ struct _IrmoObject {
         // Pointer to a C structure that this object is bound to.
 
         void *binding;
+
+        // Number of server change journals that still refer to the
+        // object after it has been destroyed.  Non-zero only for
+        // destroyed objects; the object is freed when the last
+        // reference is released.
+
+        unsigned int journal_refs;
 };
 
 /*!
@@ -98,6 +105,26 @@ IrmoObject *irmo_object_internal_new(IrmoWorld *world,
 void irmo_object_internal_destroy(IrmoObject *object, int notify,
 				  int remove);
 
+/*!
+ * Internal function to keep a destroyed object from being freed while
+ * a server's change journal still refers to it.  This must be called
+ * while the object is being destroyed, by the routines notified of
+ * the destruction.
+ *
+ * @param object          The object.
+ */
+
+void irmo_object_internal_hold(IrmoObject *object);
+
+/*!
+ * Release a reference taken by @ref irmo_object_internal_hold,
+ * freeing the object when there are no references left.
+ *
+ * @param object          The object.
+ */
+
+void irmo_object_internal_release(IrmoObject *object);
+
 
 /*!
  * Internal function to set the value of the specified variable.
@@ -0,0 +1,274 @@
+//
+// Copyright (C) 2008 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+//
+// Benchmark of the bytes saved by the compact wire format.  A world
+// is replicated to a connection: the initial state is sent, objects
+// move around on a regular clock, and finally they are destroyed.
+// The run is repeated with the fixed-width and compact formats, and
+// the number of bytes sent in each phase is compared.
+//
+// Usage: bench-compact [number of objects] [packet loss percent]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <irmo.h>
+#include "arch/sysheaders.h"
+#include "arch/arch-time.h"
+#include "loopback-test-module.h"
+
+#define SERVER_PORT 2
+#define MAX_OBJECTS 5000
+#define TICK_LENGTH 10
+#define RUN_LENGTH (2 * 1000)
+#define IDLE_TIME 1000
+#define NUM_PHASES 3
+
+static char *phase_names[NUM_PHASES] = {
+        "initial state",
+        "changes",
+        "destroys",
+};
+
+static IrmoInterface *gen_interface(void)
+{
+        IrmoInterface *iface;
+        IrmoClass *klass;
+
+        iface = irmo_interface_new();
+
+        klass = irmo_interface_new_class(iface, "player", NULL);
+
+        irmo_class_new_variable(klass, "team", IRMO_TYPE_INT8);
+        irmo_class_new_variable(klass, "x", IRMO_TYPE_INT16);
+        irmo_class_new_variable(klass, "y", IRMO_TYPE_INT16);
+        irmo_class_new_variable(klass, "dx", IRMO_TYPE_INT16);
+        irmo_class_new_variable(klass, "dy", IRMO_TYPE_INT16);
+        irmo_class_new_variable(klass, "score", IRMO_TYPE_INT32);
+        irmo_class_new_variable(klass, "name", IRMO_TYPE_STRING);
+
+        return iface;
+}
+
+// Run the server and connection for long enough for everything sent
+// to be delivered and acknowledged.
+
+static void run_until_idle(IrmoServer *server, IrmoConnection *conn)
+{
+        unsigned int start_time;
+
+        start_time = irmo_get_time();
+
+        while (irmo_get_time() - start_time < IDLE_TIME) {
+                irmo_server_run(server);
+                irmo_connection_run(conn);
+        }
+}
+
+// Values of 16-bit variables are masked to 16 bits.
+
+static unsigned int int16_value(int value)
+{
+        return (unsigned int) value & 0xffff;
+}
+
+static void run_benchmark(unsigned int num_objects, unsigned int loss,
+                          int compact, unsigned int *bytes)
+{
+        IrmoInterface *iface;
+        IrmoWorld *world;
+        IrmoServer *server;
+        IrmoConnection *conn;
+        IrmoIterator *iter;
+        IrmoClient *client;
+        IrmoObject **objects;
+        unsigned int start_time, next_tick;
+        unsigned int nowtime;
+        unsigned int bytes_sent;
+        unsigned int i, n;
+        char buf[32];
+
+        iface = gen_interface();
+        world = irmo_world_new(iface);
+
+        objects = malloc(sizeof(IrmoObject *) * num_objects);
+        assert(objects != NULL);
+
+        for (i=0; i<num_objects; ++i) {
+                objects[i] = irmo_object_new(world, "player");
+                sprintf(buf, "player %u", i);
+                irmo_object_set_int(objects[i], "team", i % 4);
+                irmo_object_set_int(objects[i], "x", (i * 37) % 1000);
+                irmo_object_set_int(objects[i], "y", (i * 91) % 1000);
+                irmo_object_set_string(objects[i], "name", buf);
+        }
+
+        server = irmo_server_new(&irmo_module_loopback, SERVER_PORT,
+                                 world, NULL);
+        assert(server != NULL);
+
+        loopback_set_packet_loss(loss);
+
+        bytes_sent = loopback_get_bytes_sent();
+
+        // Initial state.
+
+        conn = irmo_connect(&irmo_module_loopback, "localhost", SERVER_PORT,
+                            iface, NULL);
+        assert(conn != NULL);
+
+        irmo_client_set_compact(conn, compact);
+
+        while (irmo_connection_get_state(conn) != IRMO_CLIENT_SYNCHRONIZED) {
+                irmo_server_run(server);
+                irmo_connection_run(conn);
+        }
+
+        iter = irmo_server_iterate_clients(server);
+        client = irmo_iterator_next(iter);
+        irmo_iterator_free(iter);
+
+        run_until_idle(server, conn);
+
+        bytes[0] += loopback_get_bytes_sent() - bytes_sent;
+        bytes_sent = loopback_get_bytes_sent();
+
+        // Objects move on every tick, by small, sometimes negative,
+        // amounts.
+
+        start_time = irmo_get_time();
+        next_tick = start_time;
+        n = 0;
+
+        for (;;) {
+                nowtime = irmo_get_time();
+
+                if (nowtime - start_time > RUN_LENGTH) {
+                        break;
+                }
+
+                if ((int) (nowtime - next_tick) >= 0) {
+                        for (i=n % 8; i<num_objects; i += 8) {
+                                irmo_object_set_int(objects[i], "dx",
+                                        int16_value((int) ((n + i) % 16) - 8));
+                                irmo_object_set_int(objects[i], "dy",
+                                        int16_value((int) ((n * i) % 16) - 8));
+                                irmo_object_set_int(objects[i], "x",
+                                                    (i * 37 + n) % 1000);
+                                irmo_object_set_int(objects[i], "y",
+                                                    (i * 91 + n) % 1000);
+                                irmo_object_set_int(objects[i], "score",
+                                                    n * 10);
+                        }
+
+                        ++n;
+                        next_tick += TICK_LENGTH;
+                }
+
+                irmo_server_run(server);
+                irmo_connection_run(conn);
+        }
+
+        run_until_idle(server, conn);
+
+        bytes[1] += loopback_get_bytes_sent() - bytes_sent;
+        bytes_sent = loopback_get_bytes_sent();
+
+        // Destroy everything.
+
+        for (i=0; i<num_objects; ++i) {
+                irmo_object_destroy(objects[i]);
+        }
+
+        run_until_idle(server, conn);
+
+        bytes[2] += loopback_get_bytes_sent() - bytes_sent;
+
+        // Shut down.  Loss is disabled so that the disconnect completes.
+
+        loopback_set_packet_loss(0);
+
+        irmo_client_disconnect(client);
+
+        while (irmo_connection_get_state(conn) != IRMO_CLIENT_DISCONNECTED) {
+                irmo_server_run(server);
+                irmo_connection_run(conn);
+        }
+
+        irmo_server_shutdown(server);
+        irmo_server_unref(server);
+        irmo_connection_unref(conn);
+        irmo_world_unref(world);
+        irmo_interface_unref(iface);
+        free(objects);
+}
+
+int main(int argc, char *argv[])
+{
+        unsigned int fixed_bytes[NUM_PHASES];
+        unsigned int compact_bytes[NUM_PHASES];
+        unsigned int fixed_total, compact_total;
+        unsigned int num_objects = 500;
+        unsigned int loss = 0;
+        int i;
+
+        if (argc > 1) {
+                num_objects = (unsigned int) atoi(argv[1]);
+        }
+        if (argc > 2) {
+                loss = (unsigned int) atoi(argv[2]);
+        }
+
+        if (num_objects > MAX_OBJECTS) {
+                num_objects = MAX_OBJECTS;
+        }
+
+        printf("%u objects, %u%% packet loss\n", num_objects, loss);
+
+        memset(fixed_bytes, 0, sizeof(fixed_bytes));
+        memset(compact_bytes, 0, sizeof(compact_bytes));
+
+        run_benchmark(num_objects, loss, 0, fixed_bytes);
+        run_benchmark(num_objects, loss, 1, compact_bytes);
+
+        fixed_total = 0;
+        compact_total = 0;
+
+        for (i=0; i<NUM_PHASES; ++i) {
+                printf("%-14s fixed %8u bytes, compact %8u bytes, "
+                       "saved %5.1f%%\n",
+                       phase_names[i], fixed_bytes[i], compact_bytes[i],
+                       100.0 - 100.0 * compact_bytes[i] / fixed_bytes[i]);
+
+                fixed_total += fixed_bytes[i];
+                compact_total += compact_bytes[i];
+        }
+
+        printf("%-14s fixed %8u bytes, compact %8u bytes, "
+               "saved %5.1f%%\n",
+               "total", fixed_total, compact_total,
+               100.0 - 100.0 * compact_total / fixed_total);
+
+        return 0;
+}
+
@@ -0,0 +1,252 @@
+//
+// Copyright (C) 2008 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+//
+// Benchmark of change delivery latency over a lossy link.  A server
+// changes objects on a regular clock, writing the current time into
+// each change, and the connection measures how long each change took
+// to arrive.  The run is repeated with and without fast retransmit,
+// and with forward error correction.
+//
+// Usage: bench-loss [loss percent] [one-way latency in ms] [jitter in ms]
+//                   [mean loss burst length]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <irmo.h>
+#include "arch/sysheaders.h"
+#include "arch/arch-time.h"
+#include "net/protocol.h"
+#include "loopback-test-module.h"
+
+#define SERVER_PORT 2
+#define NUM_OBJECTS 500
+#define TICK_LENGTH 2
+#define RUN_LENGTH (5 * 1000)
+#define MAX_SAMPLES (RUN_LENGTH / TICK_LENGTH * 2)
+
+static unsigned int samples[MAX_SAMPLES];
+static unsigned int num_samples;
+
+static IrmoInterface *gen_interface(void)
+{
+        IrmoInterface *iface;
+        IrmoClass *klass;
+
+        iface = irmo_interface_new();
+
+        klass = irmo_interface_new_class(iface, "clock", NULL);
+
+        irmo_class_new_variable(klass, "time", IRMO_TYPE_INT32);
+
+        return iface;
+}
+
+// Invoked when a change arrives at the connection.
+
+static void record_change(IrmoObject *obj, IrmoClassVar *var,
+                          void *user_data)
+{
+        unsigned int sent;
+
+        sent = irmo_object_get_int(obj, "time");
+
+        if (num_samples < MAX_SAMPLES) {
+                samples[num_samples] = irmo_get_time() - sent;
+                ++num_samples;
+        }
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+        unsigned int x = *((const unsigned int *) a);
+        unsigned int y = *((const unsigned int *) b);
+
+        if (x < y) {
+                return -1;
+        } else if (x > y) {
+                return 1;
+        } else {
+                return 0;
+        }
+}
+
+static unsigned int percentile(unsigned int p)
+{
+        return samples[(num_samples - 1) * p / 100];
+}
+
+static void run_benchmark(unsigned int loss, unsigned int latency,
+                          unsigned int jitter, int fec)
+{
+        IrmoInterface *iface;
+        IrmoWorld *world;
+        IrmoServer *server;
+        IrmoConnection *conn;
+        IrmoObject *objects[NUM_OBJECTS];
+        IrmoIterator *iter;
+        IrmoClient *client;
+        unsigned int start_time, next_tick;
+        unsigned int nowtime;
+        unsigned int packets_sent;
+        int n;
+
+        iface = gen_interface();
+        world = irmo_world_new(iface);
+
+        for (n=0; n<NUM_OBJECTS; ++n) {
+                objects[n] = irmo_object_new(world, "clock");
+        }
+
+        server = irmo_server_new(&irmo_module_loopback, SERVER_PORT,
+                                 world, NULL);
+        assert(server != NULL);
+
+        irmo_server_set_fec(server, fec);
+
+        // Connect without loss.
+
+        loopback_set_packet_loss(0);
+        loopback_set_latency(latency, jitter);
+
+        conn = irmo_connect(&irmo_module_loopback, "localhost", SERVER_PORT,
+                            iface, NULL);
+        assert(conn != NULL);
+
+        while (irmo_connection_get_state(conn) != IRMO_CLIENT_SYNCHRONIZED) {
+                irmo_server_run(server);
+                irmo_connection_run(conn);
+        }
+
+        irmo_world_watch_class(irmo_connection_get_world(conn),
+                               "clock", "time", record_change, NULL);
+
+        // Change an object on every tick.
+
+        loopback_set_packet_loss(loss);
+        num_samples = 0;
+        packets_sent = loopback_get_packets_sent();
+
+        start_time = irmo_get_time();
+        next_tick = start_time;
+        n = 0;
+
+        for (;;) {
+                nowtime = irmo_get_time();
+
+                if (nowtime - start_time > RUN_LENGTH) {
+                        break;
+                }
+
+                if ((int) (nowtime - next_tick) >= 0) {
+                        irmo_object_set_int(objects[n], "time", nowtime);
+                        n = (n + 1) % NUM_OBJECTS;
+                        next_tick += TICK_LENGTH;
+                }
+
+                irmo_server_run(server);
+                irmo_connection_run(conn);
+        }
+
+        // Print results.
+
+        qsort(samples, num_samples, sizeof(*samples), compare_samples);
+
+        printf("fast retransmit %s, fec %s: ",
+               irmo_proto_use_fast_retransmit ? "on " : "off",
+               fec ? "on " : "off");
+
+        if (num_samples > 0) {
+                printf("%u changes, latency p50 %ums p90 %ums "
+                       "p99 %ums max %ums, ",
+                       num_samples, percentile(50), percentile(90),
+                       percentile(99), samples[num_samples - 1]);
+        }
+
+        printf("%u atoms resent (%u fast), %u parity packets, "
+               "%u packets sent\n",
+               irmo_server_get_stat(server, IRMO_SERVER_STAT_ATOMS_RESENT),
+               irmo_server_get_stat(server,
+                                    IRMO_SERVER_STAT_FAST_RETRANSMITS),
+               irmo_server_get_stat(server, IRMO_SERVER_STAT_FEC_PACKETS),
+               loopback_get_packets_sent() - packets_sent);
+
+        // Shut down.  Loss is disabled so that the disconnect completes.
+
+        loopback_set_packet_loss(0);
+
+        iter = irmo_server_iterate_clients(server);
+
+        while (irmo_iterator_has_more(iter)) {
+                client = irmo_iterator_next(iter);
+                irmo_client_disconnect(client);
+        }
+
+        irmo_iterator_free(iter);
+
+        while (irmo_connection_get_state(conn) != IRMO_CLIENT_DISCONNECTED) {
+                irmo_server_run(server);
+                irmo_connection_run(conn);
+        }
+
+        irmo_server_shutdown(server);
+        irmo_server_unref(server);
+        irmo_connection_unref(conn);
+        irmo_world_unref(world);
+        irmo_interface_unref(iface);
+}
+
+int main(int argc, char *argv[])
+{
+        unsigned int loss = 5;
+        unsigned int latency = 20;
+        unsigned int jitter = 10;
+        unsigned int burst = 0;
+
+        if (argc > 1) {
+                loss = (unsigned int) atoi(argv[1]);
+        }
+        if (argc > 2) {
+                latency = (unsigned int) atoi(argv[2]);
+        }
+        if (argc > 3) {
+                jitter = (unsigned int) atoi(argv[3]);
+        }
+        if (argc > 4) {
+                burst = (unsigned int) atoi(argv[4]);
+        }
+
+        printf("%u%% packet loss, %ums latency, %ums jitter, "
+               "mean loss burst %u\n", loss, latency, jitter, burst);
+
+        loopback_set_loss_burst(burst);
+
+        irmo_proto_use_fast_retransmit = 0;
+        run_benchmark(loss, latency, jitter, 0);
+
+        irmo_proto_use_fast_retransmit = 1;
+        run_benchmark(loss, latency, jitter, 0);
+        run_benchmark(loss, latency, jitter, 1);
+
+        return 0;
+}
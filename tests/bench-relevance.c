@@ -0,0 +1,319 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+//
+// Benchmark of relevance filtering in a large world.  Objects are
+// scattered across a map, and each client is only interested in the
+// objects within a box around its position.  All clients connect and
+// receive their part of the world; then objects change on every tick,
+// while some of the clients move around the map.  The server's CPU
+// time and the number of times the relevance filter was called are
+// reported for each phase.
+//
+// Usage: bench-relevance [number of objects] [number of clients]
+//                        [changes per tick]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include <irmo.h>
+#include "arch/sysheaders.h"
+#include "loopback-test-module.h"
+
+#define SERVER_PORT 2
+#define MAX_OBJECTS 60000
+#define MAP_SIZE 1000
+#define VIEW_SIZE 50
+#define NUM_TICKS 50
+#define MOVING_CLIENTS 10
+
+typedef struct {
+        int x, y;
+} ClientPosition;
+
+static IrmoClient **clients;
+static ClientPosition *positions;
+static unsigned int num_connected;
+static unsigned int filter_calls;
+
+static IrmoInterface *gen_interface(void)
+{
+        IrmoInterface *iface;
+        IrmoClass *klass;
+
+        iface = irmo_interface_new();
+
+        klass = irmo_interface_new_class(iface, "thing", NULL);
+
+        irmo_class_new_variable(klass, "x", IRMO_TYPE_INT16);
+        irmo_class_new_variable(klass, "y", IRMO_TYPE_INT16);
+        irmo_class_new_variable(klass, "health", IRMO_TYPE_INT8);
+
+        return iface;
+}
+
+// Objects are relevant if they are within the box around the client's
+// position.
+
+static int object_relevant(IrmoClient *client, IrmoObject *obj,
+                           void *user_data)
+{
+        ClientPosition *pos = user_data;
+        int x, y;
+
+        ++filter_calls;
+
+        x = (int) irmo_object_get_int(obj, "x");
+        y = (int) irmo_object_get_int(obj, "y");
+
+        return abs(x - pos->x) < VIEW_SIZE && abs(y - pos->y) < VIEW_SIZE;
+}
+
+// Set the filter when clients connect, so that it applies to the
+// initial world state.
+
+static void client_connected(IrmoClient *client, void *user_data)
+{
+        clients[num_connected] = client;
+        irmo_client_set_relevance_filter(client, object_relevant,
+                                         &positions[num_connected]);
+        ++num_connected;
+}
+
+static double cpu_ms(clock_t start)
+{
+        return (double) (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+// Run the server, adding the CPU time taken to the total.
+
+static void run_server(IrmoServer *server, double *total)
+{
+        clock_t start;
+
+        start = clock();
+        irmo_server_run(server);
+        *total += cpu_ms(start);
+}
+
+static void run_connections(IrmoConnection **conns, unsigned int num_conns)
+{
+        unsigned int i;
+
+        for (i=0; i<num_conns; ++i) {
+                irmo_connection_run(conns[i]);
+        }
+}
+
+static void print_phase(char *name, double ms, unsigned int runs,
+                        unsigned int calls)
+{
+        printf("%-16s server %9.1f ms (%7.2f ms per run), "
+               "%9u filter calls (%u per run)\n",
+               name, ms, ms / runs, calls, calls / runs);
+}
+
+int main(int argc, char *argv[])
+{
+        IrmoInterface *iface;
+        IrmoWorld *world;
+        IrmoServer *server;
+        IrmoConnection **conns;
+        IrmoObject **objects;
+        ClientPosition *pos;
+        clock_t start;
+        unsigned int num_objects = 50000;
+        unsigned int num_clients = 500;
+        unsigned int num_changes = 1000;
+        unsigned int synced, moving;
+        unsigned int i, n;
+        double server_ms;
+
+        if (argc > 1) {
+                num_objects = (unsigned int) atoi(argv[1]);
+        }
+        if (argc > 2) {
+                num_clients = (unsigned int) atoi(argv[2]);
+        }
+        if (argc > 3) {
+                num_changes = (unsigned int) atoi(argv[3]);
+        }
+
+        if (num_objects > MAX_OBJECTS) {
+                num_objects = MAX_OBJECTS;
+        }
+
+        printf("%u objects, %u clients, %u changes per tick\n",
+               num_objects, num_clients, num_changes);
+
+        srand(1);
+
+        iface = gen_interface();
+        world = irmo_world_new(iface);
+
+        objects = malloc(sizeof(IrmoObject *) * num_objects);
+        conns = malloc(sizeof(IrmoConnection *) * num_clients);
+        clients = malloc(sizeof(IrmoClient *) * num_clients);
+        positions = malloc(sizeof(ClientPosition) * num_clients);
+        assert(objects != NULL && conns != NULL && clients != NULL
+               && positions != NULL);
+
+        for (i=0; i<num_objects; ++i) {
+                objects[i] = irmo_object_new(world, "thing");
+                irmo_object_set_int(objects[i], "x",
+                                    (unsigned int) rand() % MAP_SIZE);
+                irmo_object_set_int(objects[i], "y",
+                                    (unsigned int) rand() % MAP_SIZE);
+        }
+
+        for (i=0; i<num_clients; ++i) {
+                positions[i].x = rand() % MAP_SIZE;
+                positions[i].y = rand() % MAP_SIZE;
+        }
+
+        server = irmo_server_new(&irmo_module_loopback, SERVER_PORT,
+                                 world, NULL);
+        assert(server != NULL);
+
+        irmo_server_watch_connect(server, client_connected, NULL);
+
+        // Initial state: connect all clients and wait until they have
+        // received their part of the world.
+
+        server_ms = 0;
+        filter_calls = 0;
+        n = 0;
+
+        for (i=0; i<num_clients; ++i) {
+                conns[i] = irmo_connect(&irmo_module_loopback, "localhost",
+                                        SERVER_PORT, iface, NULL);
+                assert(conns[i] != NULL);
+        }
+
+        do {
+                run_server(server, &server_ms);
+                run_connections(conns, num_clients);
+                ++n;
+
+                synced = 0;
+
+                for (i=0; i<num_clients; ++i) {
+                        if (irmo_connection_get_state(conns[i])
+                              == IRMO_CLIENT_SYNCHRONIZED) {
+                                ++synced;
+                        }
+                }
+        } while (synced < num_clients);
+
+        print_phase("initial state", server_ms, n, filter_calls);
+
+        // Objects change on every tick.  Only clients that can see an
+        // object receive the change, but every client must check it.
+
+        server_ms = 0;
+        filter_calls = 0;
+
+        for (n=0; n<NUM_TICKS; ++n) {
+                for (i=0; i<num_changes; ++i) {
+                        irmo_object_set_int(objects[rand() % num_objects],
+                                            "health",
+                                            (unsigned int) rand() % 100);
+                }
+
+                run_server(server, &server_ms);
+                run_connections(conns, num_clients);
+        }
+
+        print_phase("changes", server_ms, NUM_TICKS, filter_calls);
+
+        // Some clients move on every tick, and the filter must be
+        // evaluated again for every object.
+
+        server_ms = 0;
+        filter_calls = 0;
+
+        for (n=0; n<NUM_TICKS; ++n) {
+                start = clock();
+
+                for (i=0; i<MOVING_CLIENTS && i<num_clients; ++i) {
+                        moving = (n * MOVING_CLIENTS + i) % num_clients;
+                        pos = &positions[moving];
+                        pos->x = (pos->x + 10) % MAP_SIZE;
+                        irmo_client_update_relevance(clients[moving]);
+                }
+
+                server_ms += cpu_ms(start);
+
+                run_server(server, &server_ms);
+                run_connections(conns, num_clients);
+        }
+
+        print_phase("moving clients", server_ms, NUM_TICKS, filter_calls);
+
+        // Nothing changes.
+
+        server_ms = 0;
+        filter_calls = 0;
+
+        for (n=0; n<NUM_TICKS; ++n) {
+                run_server(server, &server_ms);
+        }
+
+        print_phase("idle", server_ms, NUM_TICKS, filter_calls);
+
+        // Shut down.
+
+        for (i=0; i<num_clients; ++i) {
+                irmo_client_disconnect(clients[i]);
+        }
+
+        do {
+                irmo_server_run(server);
+                run_connections(conns, num_clients);
+
+                synced = 0;
+
+                for (i=0; i<num_clients; ++i) {
+                        if (irmo_connection_get_state(conns[i])
+                              != IRMO_CLIENT_DISCONNECTED) {
+                                ++synced;
+                        }
+                }
+        } while (synced > 0);
+
+        irmo_server_shutdown(server);
+        irmo_server_unref(server);
+
+        for (i=0; i<num_clients; ++i) {
+                irmo_connection_unref(conns[i]);
+        }
+
+        irmo_world_unref(world);
+        irmo_interface_unref(iface);
+        free(objects);
+        free(conns);
+        free(clients);
+        free(positions);
+
+        return 0;
+}
@@ -28,7 +28,9 @@
 #include "arch/arch-time.h"
 #include "algo/queue.h"
 
-#define NUM_LOOPBACK_PORTS 16
+#include "loopback-test-module.h"
+
+#define NUM_LOOPBACK_PORTS 1024
 
 typedef struct _LoopbackSocket LoopbackSocket;
 typedef struct _LoopbackPacketData LoopbackPacketData;
@@ -44,6 +46,10 @@ struct _LoopbackPacketData
         // Source address of the packet.
 
         IrmoNetAddress *source;
+
+        // Time at which the packet is delivered.
+
+        unsigned int deliver_time;
 };
 
 struct _LoopbackSocket
@@ -71,6 +77,140 @@ static IrmoNetAddress addresses[NUM_LOOPBACK_PORTS];
 
 static LoopbackSocket *sockets[NUM_LOOPBACK_PORTS];
 
+// Percentage of packets to drop, and state of the random number
+// generator used to choose them.
+
+static unsigned int packet_loss;
+static unsigned int loss_seed;
+
+// Mean length of the bursts in which packets are lost, and whether a
+// burst is in progress.  If the length is zero or one, packets are
+// lost independently of each other.
+
+static unsigned int loss_burst;
+static int in_burst;
+
+// Time taken for packets to be delivered.
+
+static unsigned int latency;
+static unsigned int jitter;
+
+// Size of the largest packet that can be delivered, or zero for no
+// limit.
+
+static unsigned int max_packet_size;
+
+// Total number of packets and bytes sent.
+
+static unsigned int packets_sent;
+static unsigned int bytes_sent;
+
+void loopback_set_latency(unsigned int new_latency, unsigned int new_jitter)
+{
+        latency = new_latency;
+        jitter = new_jitter;
+}
+
+void loopback_set_max_packet_size(unsigned int size)
+{
+        max_packet_size = size;
+}
+
+unsigned int loopback_get_packets_sent(void)
+{
+        return packets_sent;
+}
+
+unsigned int loopback_get_bytes_sent(void)
+{
+        return bytes_sent;
+}
+
+// Insert a packet into a receive queue, which is kept in order of
+// delivery time.
+
+static void queue_packet(IrmoQueue *queue, LoopbackPacketData *packet_data)
+{
+        IrmoQueue *later;
+        LoopbackPacketData *tail;
+
+        // Remove packets to be delivered later than this one from
+        // the tail of the queue.
+
+        later = irmo_queue_new();
+
+        while (!irmo_queue_is_empty(queue)) {
+                tail = irmo_queue_peek_tail(queue);
+
+                if ((int) (tail->deliver_time - packet_data->deliver_time)
+                      <= 0) {
+                        break;
+                }
+
+                irmo_queue_push_head(later, irmo_queue_pop_tail(queue));
+        }
+
+        // Add the new packet, then put the others back.
+
+        irmo_queue_push_tail(queue, packet_data);
+
+        while (!irmo_queue_is_empty(later)) {
+                irmo_queue_push_tail(queue, irmo_queue_pop_head(later));
+        }
+
+        irmo_queue_free(later);
+}
+
+void loopback_set_packet_loss(unsigned int percent)
+{
+        packet_loss = percent;
+        loss_seed = 1;
+        in_burst = 0;
+}
+
+void loopback_set_loss_burst(unsigned int mean_length)
+{
+        loss_burst = mean_length;
+        in_burst = 0;
+}
+
+// Pseudo-random number generator used for loss and jitter.
+
+static unsigned int loopback_random(unsigned int range)
+{
+        loss_seed = loss_seed * 1103515245 + 12345;
+
+        return (loss_seed >> 16) % range;
+}
+
+// Returns true if the next packet should be dropped.
+
+static int drop_packet(void)
+{
+        if (packet_loss == 0) {
+                return 0;
+        } else if (packet_loss >= 100) {
+                return 1;
+        }
+
+        if (loss_burst <= 1) {
+                return loopback_random(100) < packet_loss;
+        }
+
+        // Two state model: each burst ends after a packet with
+        // probability 1 / loss_burst, and bursts start often enough
+        // that the overall percentage of packets lost is packet_loss.
+
+        if (in_burst) {
+                in_burst = loopback_random(loss_burst) != 0;
+        } else {
+                in_burst = loopback_random(loss_burst * (100 - packet_loss))
+                         < packet_loss;
+        }
+
+        return in_burst;
+}
+
 //---------------------------------------------------------------------------
 //
 // Lookback address class.
@@ -150,6 +290,10 @@ static IrmoPacket *dup_packet(IrmoPacket *packet)
                 irmo_packet_writei8(result, buf[i]);
         }
 
+        // Rewind so that the receiver reads from the start.
+
+        irmo_packet_set_position(result, 0);
+
         return result;
 }
 
@@ -158,6 +302,7 @@ static int loopback_send_packet(IrmoNetSocket *_sock,
                                 IrmoPacket *packet)
 {
         LoopbackSocket *sock = (LoopbackSocket *) _sock;
+        LoopbackSocket *dest;
         LoopbackPacketData *packet_data;
         unsigned int port;
 
@@ -165,7 +310,30 @@ static int loopback_send_packet(IrmoNetSocket *_sock,
                 return 0;
         }
 
-        // TODO: Packet loss simulation, latency, etc.
+        // Nothing bound to the destination port?  The packet is lost,
+        // just like a UDP packet sent to a closed port.
+
+        dest = sockets[port];
+
+        if (dest == NULL) {
+                return 1;
+        }
+
+        ++packets_sent;
+        bytes_sent += irmo_packet_get_length(packet);
+
+        // Simulate packet loss.
+
+        if (drop_packet()) {
+                return 1;
+        }
+
+        // Packets too large for the simulated path are lost.
+
+        if (max_packet_size != 0
+         && irmo_packet_get_length(packet) > max_packet_size) {
+                return 1;
+        }
 
         // Duplicate the packet and insert into the receive queue.
 
@@ -173,8 +341,13 @@ static int loopback_send_packet(IrmoNetSocket *_sock,
         assert(packet_data != NULL);
         packet_data->packet = dup_packet(packet);
         packet_data->source = &addresses[sock->port_num];
+        packet_data->deliver_time = irmo_get_time() + latency;
 
-        irmo_queue_push_tail(sock->recv_queue, packet_data);
+        if (jitter > 0) {
+                packet_data->deliver_time += loopback_random(jitter + 1);
+        }
+
+        queue_packet(dest->recv_queue, packet_data);
 
         return 1;
 }
@@ -192,6 +365,14 @@ static IrmoPacket *loopback_recv_packet(IrmoNetSocket *_sock,
                 return NULL;
         }
 
+        // Not arrived yet?
+
+        packet_data = irmo_queue_peek_head(sock->recv_queue);
+
+        if ((int) (irmo_get_time() - packet_data->deliver_time) < 0) {
+                return NULL;
+        }
+
         // Get the first packet from the head.
 
         packet_data = irmo_queue_pop_head(sock->recv_queue);
@@ -243,6 +424,8 @@ static void loopback_socket_close(IrmoNetSocket *_sock)
                 free(packet_data);
         }
 
+        irmo_queue_free(sock->recv_queue);
+
         // Unbind the socket.
 
         sockets[sock->port_num] = NULL;
@@ -281,6 +464,11 @@ static IrmoNetSocket *loopback_open_server_sock(IrmoNetModule *module,
         sock->port_num = port;
         sock->recv_queue = irmo_queue_new();
 
+        // Packets sent from this socket have the address for this port
+        // as their source address.
+
+        addresses[port].address_class = &loopback_address_class;
+
         // Bind.
 
         sockets[port] = sock;
@@ -0,0 +1,66 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+
+#ifndef IRMO_TEST_LOOPBACK_TEST_MODULE_H
+#define IRMO_TEST_LOOPBACK_TEST_MODULE_H
+
+#include <irmo/net-module.h>
+
+// Network module that delivers packets between sockets in the same
+// process, without using the operating system's network stack.
+
+extern IrmoNetModule irmo_module_loopback;
+
+// Set the percentage of packets that are randomly dropped instead of
+// being delivered.  The sequence of dropped packets is the same on
+// every run.
+
+void loopback_set_packet_loss(unsigned int percent);
+
+// Set the mean number of packets lost together in a burst.  The
+// percentage of packets lost stays the same, but losses are grouped
+// together, as they often are on real networks.  If zero or one,
+// each packet is lost independently.
+
+void loopback_set_loss_burst(unsigned int mean_length);
+
+// Set the time, in milliseconds, that packets take to be delivered.
+// Each packet is delayed by up to 'jitter' milliseconds more, so
+// packets may be delivered out of order.
+
+void loopback_set_latency(unsigned int latency, unsigned int jitter);
+
+// Set the size of the largest packet that can be delivered.  Larger
+// packets are dropped.  If zero, packets of any size are delivered.
+
+void loopback_set_max_packet_size(unsigned int size);
+
+// Get the number of packets that have been sent, including packets
+// that were dropped.
+
+unsigned int loopback_get_packets_sent(void);
+
+// Get the total size, in bytes, of the packets that have been sent,
+// including packets that were dropped.
+
+unsigned int loopback_get_bytes_sent(void);
+
+#endif /* #ifndef IRMO_TEST_LOOPBACK_TEST_MODULE_H */
+
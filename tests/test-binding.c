@@ -31,6 +31,8 @@ struct mystruct {
         uint16_t myint16;
         uint32_t myint32;
         char *mystring;
+        float myfloat;
+        double mydouble;
 };
 
 // Test the structure member macros in binding.h
@@ -56,6 +58,8 @@ static void test_map_bindings(void)
         irmo_map_struct(struct mystruct, myint16);
         irmo_map_struct(struct mystruct, myint32);
         irmo_map_struct(struct mystruct, mystring);
+        irmo_map_struct(struct mystruct, myfloat);
+        irmo_map_struct(struct mystruct, mydouble);
 
         // Duplicates should print a debug message
 
@@ -165,6 +169,33 @@ static void test_struct_member_get_set_string(void)
         assert(s.mystring == NULL);
 }
 
+static void test_struct_member_get_set_float(void)
+{
+        struct mystruct s;
+        IrmoStruct *structure;
+        IrmoStructMember *myfloat, *mydouble;
+
+        structure = irmo_binding_get_struct("struct mystruct");
+
+        // Test myfloat
+
+        myfloat = irmo_struct_get_member(structure, "myfloat");
+
+        s.myfloat = 1.5f;
+        assert(irmo_struct_member_get_float(myfloat, &s) == 1.5f);
+        irmo_struct_member_set_float(myfloat, &s, -0.25f);
+        assert(s.myfloat == -0.25f);
+
+        // Test mydouble
+
+        mydouble = irmo_struct_get_member(structure, "mydouble");
+
+        s.mydouble = 1234.5;
+        assert(irmo_struct_member_get_float(mydouble, &s) == 1234.5f);
+        irmo_struct_member_set_float(mydouble, &s, 0.75f);
+        assert(s.mydouble == 0.75);
+}
+
 int main(int argc, char *argv[])
 {
         test_member_macros();
@@ -173,6 +204,7 @@ int main(int argc, char *argv[])
         test_struct_member();
         test_struct_member_get_set_int();
         test_struct_member_get_set_string();
+        test_struct_member_get_set_float();
 
         return 0;
 }
@@ -18,10 +18,13 @@
 //
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <inttypes.h>
 
 #include <irmo.h>
+#include <irmo/interface-parser.h>
+#include <irmo/packet.h>
 #include "interface/interface.h"
 
 // Build up a basic interface
@@ -261,6 +264,23 @@ void test_method_arg_iterator(void)
         irmo_interface_unref(iface);
 }
 
+// Get the version number from the header of an interface blob.
+
+static unsigned int blob_version(void *buf, unsigned int buf_len)
+{
+        IrmoPacket *packet;
+        unsigned int version;
+
+        packet = irmo_packet_new_from(buf, buf_len);
+
+        assert(irmo_packet_readstring(packet) != NULL);
+        assert(irmo_packet_readi32(packet, &version));
+
+        irmo_packet_free(packet);
+
+        return version;
+}
+
 void test_dump_and_load(void)
 {
         IrmoInterface *iface;
@@ -272,12 +292,195 @@ void test_dump_and_load(void)
 
         irmo_interface_dump(iface, &buf, &buf_len);
 
+        // Nothing newer than the first blob version is used.
+
+        assert(blob_version(buf, buf_len) == 1);
+
         loaded_iface = irmo_interface_load(buf, buf_len);
 
         assert(loaded_iface != NULL);
         assert(irmo_interface_hash(iface) == irmo_interface_hash(loaded_iface));
 }
 
+// Unreliable variables
+
+void test_unreliable(void)
+{
+        IrmoInterface *iface;
+        IrmoInterface *loaded_iface;
+        IrmoClass *klass;
+        IrmoClass *subclass;
+        IrmoClassVar *classvar;
+        IrmoClassVar *subclassvar;
+        void *buf;
+        unsigned int buf_len;
+        uint32_t hash;
+
+        iface = build_interface();
+        klass = irmo_interface_get_class(iface, "myclass");
+        subclass = irmo_interface_get_class(iface, "mysubclass");
+        classvar = irmo_class_get_variable(klass, "classvar");
+        subclassvar = irmo_class_get_variable(subclass, "subclassvar");
+
+        assert(!irmo_class_var_is_unreliable(classvar));
+
+        hash = irmo_interface_hash(iface);
+
+        // Marking the subclass does not affect inherited variables,
+        // but does affect variables added later.
+
+        irmo_class_set_unreliable(subclass, 1);
+
+        assert(irmo_class_var_is_unreliable(subclassvar));
+        assert(!irmo_class_var_is_unreliable(classvar));
+        assert(irmo_class_var_is_unreliable(
+                irmo_class_new_variable(subclass, "latevar",
+                                        IRMO_TYPE_INT16)));
+
+        irmo_class_var_set_unreliable(classvar, 1);
+        assert(irmo_class_var_is_unreliable(classvar));
+
+        assert(irmo_interface_hash(iface) != hash);
+
+        // The flag survives a dump and load.
+
+        irmo_interface_dump(iface, &buf, &buf_len);
+
+        // Unreliable variables need version 2.
+
+        assert(blob_version(buf, buf_len) == 2);
+
+        loaded_iface = irmo_interface_load(buf, buf_len);
+
+        assert(loaded_iface != NULL);
+        assert(irmo_interface_hash(iface) == irmo_interface_hash(loaded_iface));
+
+        klass = irmo_interface_get_class(loaded_iface, "myclass");
+        assert(irmo_class_var_is_unreliable(
+                irmo_class_get_variable(klass, "classvar")));
+
+        irmo_interface_unref(loaded_iface);
+        irmo_interface_unref(iface);
+}
+
+// Floating point and quantized variables
+
+void test_float_types(void)
+{
+        IrmoInterface *iface;
+        IrmoInterface *loaded_iface;
+        IrmoInterface *other_iface;
+        IrmoClass *klass;
+        IrmoClassVar *var;
+        IrmoValueRange *range;
+        void *buf;
+        unsigned int buf_len;
+
+        iface = build_interface();
+        klass = irmo_interface_new_class(iface, "floatclass", NULL);
+
+        var = irmo_class_new_variable(klass, "floatvar", IRMO_TYPE_FLOAT32);
+        assert(var != NULL);
+        assert(irmo_class_var_get_type(var) == IRMO_TYPE_FLOAT32);
+        assert(irmo_class_var_get_range(var) == NULL);
+
+        var = irmo_class_new_quantized_variable(klass, "quantvar",
+                                                -10, 10, 0.5f);
+        assert(var != NULL);
+        assert(irmo_class_var_get_type(var) == IRMO_TYPE_QUANTIZED);
+
+        range = irmo_class_var_get_range(var);
+        assert(range != NULL);
+        assert(range->min == -10 && range->max == 10
+            && range->precision == 0.5f);
+
+        // Invalid ranges are rejected.
+
+        assert(irmo_class_new_quantized_variable(klass, "badvar",
+                                                 10, -10, 0.5f) == NULL);
+        assert(irmo_class_new_quantized_variable(klass, "badvar",
+                                                 -10, 10, 0) == NULL);
+        assert(irmo_class_new_quantized_variable(klass, "badvar",
+                                                 -1e9f, 1e9f, 0.1f)
+               == NULL);
+
+        // The range is part of the interface hash.
+
+        other_iface = build_interface();
+        klass = irmo_interface_new_class(other_iface, "floatclass", NULL);
+        irmo_class_new_variable(klass, "floatvar", IRMO_TYPE_FLOAT32);
+        irmo_class_new_quantized_variable(klass, "quantvar", -10, 10, 0.25f);
+
+        assert(irmo_interface_hash(iface) != irmo_interface_hash(other_iface));
+
+        irmo_interface_unref(other_iface);
+
+        // The range survives a dump and load.
+
+        irmo_interface_dump(iface, &buf, &buf_len);
+
+        // Floating point types need version 3.
+
+        assert(blob_version(buf, buf_len) == 3);
+
+        loaded_iface = irmo_interface_load(buf, buf_len);
+
+        assert(loaded_iface != NULL);
+        assert(irmo_interface_hash(iface) == irmo_interface_hash(loaded_iface));
+
+        klass = irmo_interface_get_class(loaded_iface, "floatclass");
+        range = irmo_class_var_get_range(
+                        irmo_class_get_variable(klass, "quantvar"));
+        assert(range != NULL && range->precision == 0.5f);
+
+        irmo_interface_unref(loaded_iface);
+        irmo_interface_unref(iface);
+}
+
+static IrmoInterface *parse_string(char *s)
+{
+        return irmo_interface_parse_from_buffer(s, strlen(s));
+}
+
+// Floating point and quantized types in interface files
+
+void test_parse_float_types(void)
+{
+        IrmoInterface *iface;
+        IrmoClass *klass;
+        IrmoMethod *method;
+        IrmoValueRange *range;
+
+        iface = parse_string("class thing {\n"
+                             "        float32 angle;\n"
+                             "        quantized(-1000, 1000, 0.125) x, y;\n"
+                             "}\n"
+                             "method fire(float32 power);\n");
+        assert(iface != NULL);
+
+        klass = irmo_interface_get_class(iface, "thing");
+        assert(irmo_class_var_get_type(irmo_class_get_variable(klass, "angle"))
+               == IRMO_TYPE_FLOAT32);
+
+        range = irmo_class_var_get_range(irmo_class_get_variable(klass, "y"));
+        assert(range != NULL);
+        assert(range->min == -1000 && range->max == 1000
+            && range->precision == 0.125f);
+
+        method = irmo_interface_get_method(iface, "fire");
+        assert(irmo_method_arg_get_type(irmo_method_get_argument(method,
+                                                                 "power"))
+               == IRMO_TYPE_FLOAT32);
+
+        irmo_interface_unref(iface);
+
+        // Bad ranges, and quantized method arguments.
+
+        assert(parse_string("class c { quantized(1, 0, 1) x; }") == NULL);
+        assert(parse_string("class c { quantized x; }") == NULL);
+        assert(parse_string("method m(quantized(0, 1, 0.5) a);") == NULL);
+}
+
 int main(int argc, char *argv[])
 {
         test_build_interface();
@@ -288,6 +491,9 @@ int main(int argc, char *argv[])
         test_method_iterator();
         test_method_arg_iterator();
         test_dump_and_load();
+        test_unreliable();
+        test_float_types();
+        test_parse_float_types();
 
         return 0;
 }
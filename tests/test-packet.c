@@ -72,6 +72,42 @@ static void test_write(void)
         irmo_packet_free(packet);
 }
 
+static void test_write_bytes(void)
+{
+        IrmoPacket *packet;
+        unsigned char *packet_data;
+        unsigned char big_block[1000];
+        unsigned int i;
+
+        packet = irmo_packet_new();
+
+        irmo_packet_writebytes(packet, expected_result, 7);
+        irmo_packet_writebytes(packet, expected_result + 7, 12);
+
+        assert(irmo_packet_get_length(packet) == 19);
+        assert(irmo_packet_get_position(packet) == 19);
+        packet_data = irmo_packet_get_buffer(packet);
+
+        assert(memcmp(packet_data, expected_result, 19) == 0);
+
+        // Write a block larger than the packet buffer, so that it
+        // must be resized.
+
+        for (i=0; i<sizeof(big_block); ++i) {
+                big_block[i] = (unsigned char) i;
+        }
+
+        irmo_packet_writebytes(packet, big_block, sizeof(big_block));
+
+        assert(irmo_packet_get_length(packet) == 19 + sizeof(big_block));
+        packet_data = irmo_packet_get_buffer(packet);
+
+        assert(memcmp(packet_data, expected_result, 19) == 0);
+        assert(memcmp(packet_data + 19, big_block, sizeof(big_block)) == 0);
+
+        irmo_packet_free(packet);
+}
+
 static void test_read(void)
 {
         IrmoPacket *packet;
@@ -211,15 +247,380 @@ static void test_write_value(void)
         irmo_packet_free(packet);
 }
 
+static unsigned char expected_varints[] = {
+        0x00,
+        0x7f,
+        0x80, 0x01,
+        0xe5, 0x8e, 0x26,
+        0xff, 0xff, 0xff, 0xff, 0x0f,
+};
+
+static unsigned int varint_values[] = {
+        0, 0x7f, 0x80, 624485, 0xffffffff,
+};
+
+static void test_varint(void)
+{
+        IrmoPacket *packet;
+        unsigned int value;
+        unsigned int start;
+        unsigned int i;
+        unsigned char too_long[] = { 0xff, 0xff, 0xff, 0xff, 0x1f };
+        unsigned char truncated[] = { 0x80, 0x80 };
+
+        packet = irmo_packet_new();
+
+        for (i=0; i<5; ++i) {
+                start = irmo_packet_get_position(packet);
+                assert(irmo_packet_writevarint(packet, varint_values[i]));
+                assert(irmo_packet_get_position(packet) - start
+                        == irmo_packet_varint_length(varint_values[i]));
+        }
+
+        assert(irmo_packet_get_length(packet) == sizeof(expected_varints));
+        assert(memcmp(irmo_packet_get_buffer(packet), expected_varints,
+                      sizeof(expected_varints)) == 0);
+
+        irmo_packet_free(packet);
+
+        // Read back.
+
+        packet = irmo_packet_new_from(expected_varints,
+                                      sizeof(expected_varints));
+
+        for (i=0; i<5; ++i) {
+                assert(irmo_packet_readvarint(packet, &value) != 0);
+                assert(value == varint_values[i]);
+        }
+
+        assert(irmo_packet_readvarint(packet, &value) == 0);
+
+        irmo_packet_free(packet);
+
+        // Values that do not fit in 32 bits, or that run off the end
+        // of the packet, are rejected without moving the position.
+
+        packet = irmo_packet_new_from(too_long, sizeof(too_long));
+        assert(irmo_packet_readvarint(packet, &value) == 0);
+        assert(irmo_packet_get_position(packet) == 0);
+        irmo_packet_free(packet);
+
+        packet = irmo_packet_new_from(truncated, sizeof(truncated));
+        assert(irmo_packet_readvarint(packet, &value) == 0);
+        assert(irmo_packet_get_position(packet) == 0);
+        irmo_packet_free(packet);
+
+        // 16-bit values larger than 0xffff are rejected.
+
+        packet = irmo_packet_new_from(expected_varints + 4, 3);
+        irmo_packet_set_compact(packet, 1);
+        assert(irmo_packet_readi16v(packet, &value) == 0);
+        irmo_packet_free(packet);
+}
+
+static void test_compact_values(void)
+{
+        IrmoPacket *packet;
+        IrmoValue value;
+        IrmoValue *expected;
+        IrmoValueType expected_type;
+        unsigned int len;
+        int i;
+
+        static struct {
+                IrmoValueType value_type;
+                IrmoValue value;
+                unsigned int len;
+        } compact_values[] = {
+                { IRMO_TYPE_INT8, { 0x12 }, 1 },
+                { IRMO_TYPE_INT16, { 3 }, 1 },
+                { IRMO_TYPE_INT16, { 0xffff }, 1 },
+                { IRMO_TYPE_INT16, { 0x8000 }, 3 },
+                { IRMO_TYPE_INT32, { 1000 }, 2 },
+                { IRMO_TYPE_INT32, { 0xfffffffe }, 1 },
+                { IRMO_TYPE_INT32, { 0x80000000 }, 5 },
+                { IRMO_TYPE_STRING, { 0 }, 6 },
+        };
+
+        compact_values[7].value.s = "hello";
+
+        packet = irmo_packet_new();
+        irmo_packet_set_compact(packet, 1);
+        assert(irmo_packet_is_compact(packet));
+
+        len = 0;
+
+        for (i=0; i<8; ++i) {
+                irmo_packet_write_value(packet, &compact_values[i].value,
+                                        compact_values[i].value_type);
+                assert(irmo_packet_value_length(&compact_values[i].value,
+                                                compact_values[i].value_type,
+                                                1)
+                        == compact_values[i].len);
+                len += compact_values[i].len;
+                assert(irmo_packet_get_length(packet) == len);
+        }
+
+        // Read back all values
+
+        irmo_packet_set_position(packet, 0);
+
+        for (i=0; i<8; ++i) {
+                expected = &compact_values[i].value;
+                expected_type = compact_values[i].value_type;
+
+                assert(irmo_packet_read_value(packet, &value, expected_type)
+                         != 0);
+
+                if (expected_type == IRMO_TYPE_STRING) {
+                        assert(strcmp(expected->s, value.s) == 0);
+                        free(value.s);
+                } else {
+                        assert(expected->i == value.i);
+                }
+        }
+
+        // Verify
+
+        irmo_packet_set_position(packet, 0);
+
+        for (i=0; i<8; ++i) {
+                assert(irmo_packet_verify_value(packet,
+                                                compact_values[i].value_type)
+                        != 0);
+        }
+
+        assert(irmo_packet_verify_value(packet, IRMO_TYPE_INT16) == 0);
+
+        irmo_packet_free(packet);
+}
+
+static void test_bits(void)
+{
+        IrmoPacket *packet;
+        unsigned char *packet_data;
+        unsigned int value;
+        unsigned int i;
+
+        packet = irmo_packet_new();
+
+        // Fields are packed low bits first.  A group header of a count
+        // and a type packs into the same byte as the equivalent
+        // hand-built value.
+
+        assert(irmo_packet_write_bits(packet, 5, 5) != 0);
+        assert(irmo_packet_write_bits(packet, 3, 3) != 0);
+
+        // A field that spans a byte boundary.
+
+        assert(irmo_packet_write_bits(packet, 0x1ff, 9) != 0);
+
+        // Byte-level writes start at the next whole byte.
+
+        assert(irmo_packet_writei8(packet, 0x12) != 0);
+
+        // Whole words, and more than a word in a row.
+
+        assert(irmo_packet_write_bits(packet, 0xdeadbeef, 32) != 0);
+        assert(irmo_packet_write_bits(packet, 1, 1) != 0);
+        assert(irmo_packet_write_bits(packet, 0x12345678, 32) != 0);
+
+        // Only the low bits of the value are written.
+
+        assert(irmo_packet_write_bits(packet, 0xff, 3) != 0);
+
+        assert(irmo_packet_get_length(packet) == 13);
+        packet_data = irmo_packet_get_buffer(packet);
+
+        assert(packet_data[0] == ((3 << 5) | 5));
+        assert(packet_data[1] == 0xff);
+        assert(packet_data[2] == 0x01);
+        assert(packet_data[3] == 0x12);
+        assert(packet_data[4] == 0xef);
+        assert(packet_data[7] == 0xde);
+        assert(packet_data[8] == ((0x78 << 1) | 1));
+        assert(packet_data[12] == 0x0e);
+
+        // Read back.
+
+        irmo_packet_set_position(packet, 0);
+
+        assert(irmo_packet_read_bits(packet, &value, 5) != 0);
+        assert(value == 5);
+        assert(irmo_packet_read_bits(packet, &value, 3) != 0);
+        assert(value == 3);
+        assert(irmo_packet_read_bits(packet, &value, 9) != 0);
+        assert(value == 0x1ff);
+        assert(irmo_packet_readi8(packet, &value) != 0);
+        assert(value == 0x12);
+        assert(irmo_packet_read_bits(packet, &value, 32) != 0);
+        assert(value == 0xdeadbeef);
+        assert(irmo_packet_read_bits(packet, &value, 1) != 0);
+        assert(value == 1);
+        assert(irmo_packet_read_bits(packet, &value, 32) != 0);
+        assert(value == 0x12345678);
+        assert(irmo_packet_read_bits(packet, &value, 3) != 0);
+        assert(value == 7);
+
+        // Only the padding bits are left.
+
+        assert(irmo_packet_read_bits(packet, &value, 4) != 0);
+        assert(value == 0);
+        assert(irmo_packet_read_bits(packet, &value, 1) == 0);
+
+        irmo_packet_free(packet);
+
+        // Reading bits, then bytes, does not skip whole bytes that
+        // have been buffered.
+
+        packet = irmo_packet_new();
+
+        for (i=0; i<16; ++i) {
+                irmo_packet_writei8(packet, i);
+        }
+
+        irmo_packet_set_position(packet, 0);
+
+        assert(irmo_packet_read_bits(packet, &value, 4) != 0);
+        assert(value == 0);
+        assert(irmo_packet_get_position(packet) == 1);
+        assert(irmo_packet_readi8(packet, &value) != 0);
+        assert(value == 1);
+        assert(irmo_packet_read_bits(packet, &value, 16) != 0);
+        assert(value == 0x0302);
+        irmo_packet_align_bits(packet);
+        assert(irmo_packet_readi16(packet, &value) != 0);
+        assert(value == 0x0405);
+
+        irmo_packet_free(packet);
+}
+
+static void test_float_values(void)
+{
+        IrmoPacket *packet;
+        IrmoValue value;
+        int compact;
+
+        // Floats take four bytes in both formats.
+
+        for (compact=0; compact<2; ++compact) {
+                packet = irmo_packet_new();
+                irmo_packet_set_compact(packet, compact);
+
+                value.f = -1.5f;
+                irmo_packet_write_value(packet, &value, IRMO_TYPE_FLOAT32);
+                assert(irmo_packet_get_length(packet) == 4);
+                assert(irmo_packet_value_length(&value, IRMO_TYPE_FLOAT32,
+                                                compact) == 4);
+
+                irmo_packet_set_position(packet, 0);
+                assert(irmo_packet_verify_value(packet, IRMO_TYPE_FLOAT32)
+                        != 0);
+
+                irmo_packet_set_position(packet, 0);
+                value.f = 0;
+                assert(irmo_packet_read_value(packet, &value,
+                                              IRMO_TYPE_FLOAT32) != 0);
+                assert(value.f == -1.5f);
+
+                assert(irmo_packet_verify_value(packet, IRMO_TYPE_FLOAT32)
+                        == 0);
+
+                irmo_packet_free(packet);
+        }
+}
+
+static void test_quantized(void)
+{
+        IrmoPacket *packet;
+        IrmoValueRange range = { -1000, 1000, 0.1f };
+        IrmoValueRange small_range = { 0, 1, 0.1f };
+        float value;
+        int i;
+
+        // Values are rounded to the precision and clamped to the range.
+
+        assert(irmo_packet_quantize(&small_range, 0.33f) == 0.3f);
+        assert(irmo_packet_quantize(&small_range, 0.36f) == 0.4f);
+        assert(irmo_packet_quantize(&small_range, -5) == 0);
+        assert(irmo_packet_quantize(&small_range, 5) == 1);
+        assert(irmo_packet_quantize(&range, 0) == 0);
+
+        // 20000 steps need 15 bits; 10 steps need 4.
+
+        assert(irmo_packet_quantized_bits(&range) == 15);
+        assert(irmo_packet_quantized_bits(&small_range) == 4);
+
+        // Three coordinates are packed into six bytes, half of the
+        // twelve needed for three 32-bit integers.
+
+        packet = irmo_packet_new();
+
+        irmo_packet_write_quantized(packet, 123.4f, &range);
+        irmo_packet_write_quantized(packet, -999.9f, &range);
+        irmo_packet_write_quantized(packet, 2000, &range);
+
+        assert(irmo_packet_get_length(packet) == 6);
+
+        irmo_packet_set_position(packet, 0);
+
+        assert(irmo_packet_read_quantized(packet, &value, &range) != 0);
+        assert(value == irmo_packet_quantize(&range, 123.4f));
+        assert(irmo_packet_read_quantized(packet, &value, &range) != 0);
+        assert(value == irmo_packet_quantize(&range, -999.9f));
+        assert(irmo_packet_read_quantized(packet, NULL, &range) != 0);
+
+        irmo_packet_free(packet);
+
+        // Values that round trip are unchanged.
+
+        packet = irmo_packet_new();
+
+        for (i=0; i<=10; ++i) {
+                irmo_packet_write_quantized(
+                        packet, irmo_packet_quantize(&small_range,
+                                                     (float) i / 10),
+                        &small_range);
+        }
+
+        irmo_packet_set_position(packet, 0);
+
+        for (i=0; i<=10; ++i) {
+                assert(irmo_packet_read_quantized(packet, &value,
+                                                  &small_range) != 0);
+                assert(value == irmo_packet_quantize(&small_range,
+                                                     (float) i / 10));
+        }
+
+        irmo_packet_free(packet);
+
+        // Steps beyond the end of the range are invalid.
+
+        packet = irmo_packet_new();
+        irmo_packet_write_bits(packet, 15, 4);
+        irmo_packet_align_bits(packet);
+        irmo_packet_set_position(packet, 0);
+
+        assert(irmo_packet_read_quantized(packet, NULL, &small_range) == 0);
+
+        irmo_packet_free(packet);
+}
+
 int main(int argc, char *argv[])
 {
         test_create_destroy();
         test_write();
+        test_write_bytes();
         test_read();
         test_write_value();
         test_read_value();
         test_set_position();
         test_verify();
+        test_varint();
+        test_compact_values();
+        test_bits();
+        test_float_values();
+        test_quantized();
 
         return 0;
 }
@@ -0,0 +1,207 @@
+//
+// Copyright (C) 2009 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "net/timer-wheel.h"
+
+#define NUM_TIMERS 1000
+
+static IrmoTimer timers[NUM_TIMERS];
+static unsigned int expired_time[NUM_TIMERS];
+static unsigned int current_time;
+static unsigned int current_step;
+
+// Timers must expire on the first advance on or after their
+// expiry time.
+
+static void timer_callback(IrmoTimer *timer, void *user_data)
+{
+        unsigned int *expired = user_data;
+
+        assert(*expired == 0);
+        assert((int) (current_time - timer->expires) >= 0);
+        assert((int) (current_time - timer->expires) < (int) current_step);
+
+        *expired = current_time;
+}
+
+// Add timers at a range of times, and check that each one expires
+// at the right time, no matter how far apart the calls to advance
+// the wheel are.
+
+static void test_expiry(unsigned int start, unsigned int step)
+{
+        IrmoTimerWheel wheel;
+        unsigned int expires;
+        unsigned int end;
+        int i;
+
+        irmo_timer_wheel_init(&wheel, start);
+
+        end = start;
+
+        for (i=0; i<NUM_TIMERS; ++i) {
+                expired_time[i] = 0;
+                irmo_timer_init(&timers[i], timer_callback,
+                                &expired_time[i]);
+
+                expires = start + 1 + (unsigned int) (rand() % 300000);
+                irmo_timer_wheel_add(&wheel, &timers[i], expires);
+
+                if ((int) (expires - end) > 0) {
+                        end = expires;
+                }
+        }
+
+        // Remove every tenth timer.
+
+        for (i=0; i<NUM_TIMERS; i += 10) {
+                irmo_timer_wheel_remove(&wheel, &timers[i]);
+        }
+
+        current_step = step;
+
+        for (current_time = start;
+             (int) (current_time - end) < (int) step;
+             current_time += step) {
+                irmo_timer_wheel_advance(&wheel, current_time);
+        }
+
+        for (i=0; i<NUM_TIMERS; ++i) {
+                if (i % 10 == 0) {
+                        assert(expired_time[i] == 0);
+                } else {
+                        assert(expired_time[i] != 0);
+                        assert(!timers[i].pending);
+                }
+        }
+}
+
+// Timers added in the past expire on the next advance.
+
+static void test_expired(void)
+{
+        IrmoTimerWheel wheel;
+        unsigned int expired = 0;
+        IrmoTimer timer;
+
+        irmo_timer_wheel_init(&wheel, 1000);
+        irmo_timer_init(&timer, timer_callback, &expired);
+
+        current_time = 1000;
+        current_step = 1000;
+        irmo_timer_wheel_add(&wheel, &timer, 500);
+        irmo_timer_wheel_advance(&wheel, current_time);
+
+        assert(expired == 1000);
+}
+
+// Rescheduling a timer replaces the previous expiry time.
+
+static void test_reschedule(void)
+{
+        IrmoTimerWheel wheel;
+        unsigned int expired = 0;
+        IrmoTimer timer;
+
+        irmo_timer_wheel_init(&wheel, 0);
+        irmo_timer_init(&timer, timer_callback, &expired);
+
+        irmo_timer_wheel_add(&wheel, &timer, 100);
+        irmo_timer_wheel_add(&wheel, &timer, 5000);
+
+        current_step = 1;
+        current_time = 200;
+        irmo_timer_wheel_advance(&wheel, current_time);
+        assert(expired == 0);
+
+        current_time = 5000;
+        irmo_timer_wheel_advance(&wheel, current_time);
+        assert(expired == 5000);
+}
+
+// The next expiry time is the time of the earliest pending timer.
+// Advance straight to each expiry time in turn until none are left.
+
+static void test_next_expiry(unsigned int start)
+{
+        IrmoTimerWheel wheel;
+        unsigned int expected;
+        unsigned int when;
+        int found;
+        int i;
+
+        irmo_timer_wheel_init(&wheel, start);
+
+        for (i=0; i<NUM_TIMERS; ++i) {
+                expired_time[i] = 0;
+                irmo_timer_init(&timers[i], timer_callback,
+                                &expired_time[i]);
+                irmo_timer_wheel_add(&wheel, &timers[i],
+                                     start + (unsigned int) (rand() % 300000));
+        }
+
+        current_time = start;
+        current_step = 1;
+
+        for (;;) {
+                found = 0;
+                expected = 0;
+
+                for (i=0; i<NUM_TIMERS; ++i) {
+                        if (timers[i].pending
+                         && (!found
+                          || (int) (timers[i].expires - expected) < 0)) {
+                                expected = timers[i].expires;
+                                found = 1;
+                        }
+                }
+
+                if (!found) {
+                        break;
+                }
+
+                assert(irmo_timer_wheel_next_expiry(&wheel, &when));
+                assert(when == expected);
+
+                current_time = when;
+                irmo_timer_wheel_advance(&wheel, current_time);
+        }
+
+        assert(!irmo_timer_wheel_next_expiry(&wheel, &when));
+}
+
+int main(int argc, char *argv[])
+{
+        test_expiry(0, 1);
+        test_expiry(12345, 7);
+        test_expiry(0, 1000);
+        test_expiry(0xffff0000, 50);
+        test_expired();
+        test_reschedule();
+        test_next_expiry(0);
+        test_next_expiry(0xffff0000);
+
+        return 0;
+}
+
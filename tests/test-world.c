@@ -277,6 +277,60 @@ void test_object_get_set(void)
         irmo_world_unref(world);
 }
 
+// Test float and quantized variables
+
+void test_object_get_set_float(void)
+{
+        IrmoInterface *iface;
+        IrmoClass *klass;
+        IrmoWorld *world;
+        IrmoObject *obj;
+
+        iface = irmo_interface_new();
+        klass = irmo_interface_new_class(iface, "floatclass", NULL);
+        irmo_class_new_variable(klass, "myfloat", IRMO_TYPE_FLOAT32);
+        irmo_class_new_quantized_variable(klass, "mypos", -100, 100, 0.5f);
+        irmo_class_new_quantized_variable(klass, "myangle", 10, 20, 1);
+
+        world = irmo_world_new(iface);
+        irmo_interface_unref(iface);
+
+        obj = irmo_object_new(world, "floatclass");
+
+        // Quantized variables start at the nearest value to zero.
+
+        assert(irmo_object_get_float(obj, "myfloat") == 0);
+        assert(irmo_object_get_float(obj, "mypos") == 0);
+        assert(irmo_object_get_float(obj, "myangle") == 10);
+
+        // Float values are stored exactly.
+
+        irmo_object_set_float(obj, "myfloat", 1.0f / 3);
+        assert(irmo_object_get_float(obj, "myfloat") == 1.0f / 3);
+
+        irmo_object_set_float(obj, "myfloat", -1e30f);
+        assert(irmo_object_get_float(obj, "myfloat") == -1e30f);
+
+        // Quantized values are rounded and clamped.
+
+        irmo_object_set_float(obj, "mypos", 12.3f);
+        assert(irmo_object_get_float(obj, "mypos") == 12.5f);
+
+        irmo_object_set_float(obj, "mypos", -42.1f);
+        assert(irmo_object_get_float(obj, "mypos") == -42);
+
+        irmo_object_set_float(obj, "mypos", 1000);
+        assert(irmo_object_get_float(obj, "mypos") == 100);
+
+        irmo_object_set_float(obj, "mypos", -1000);
+        assert(irmo_object_get_float(obj, "mypos") == -100);
+
+        irmo_object_set_float(obj, "myangle", 14.6f);
+        assert(irmo_object_get_float(obj, "myangle") == 15);
+
+        irmo_world_unref(world);
+}
+
 // Test object get/set (generic versions)
 
 void test_object_get_set_generic(void)
@@ -464,6 +518,7 @@ int main(int argc, char *argv[])
         test_object_destroy();
         test_object_data();
         test_object_get_set();
+        test_object_get_set_float();
         test_object_get_set_generic();
         test_object_set_bindings();
         test_object_get_bindings();